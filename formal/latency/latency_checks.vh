@@ -0,0 +1,217 @@
+// Cycle bounds for the core, included at the end of lemoncore.v when
+// FORMAL_LATENCY is defined. See latency.sby.
+//
+// The memory answers each request within `MEM_LATENCY cycles of it going
+// out, and the coprocessor accepts a request and then answers it within
+// `COP_LATENCY cycles each. Given that, the checks are:
+//  - Every instruction leaves for the next fetch (or traps, or sleeps) within
+//    a bound for its class, counted from its fetch response.
+//  - An interrupt that's enabled and pending is taken within a bound.
+//  - The control FSM only waits in a state while something is outstanding:
+//    a request on one of the ports, or the store buffer draining.
+//
+// The bounds build on the zero-wait cycle counts in rtl/core/timing.vh, which
+// the core tests check exactly, and follow the microarchitecture parameters.
+// A change that adds cycles to some class of instruction fails here unless
+// timing.vh is updated along with it.
+
+`ifndef MEM_LATENCY
+`define MEM_LATENCY 0
+`endif
+`ifndef COP_LATENCY
+`define COP_LATENCY 0
+`endif
+
+  // Cycles a memory access holds the MEM stage for
+  localparam FV_ACCESS = `MEM_LATENCY + 1;
+  // Cycles to empty a full store buffer, with a gap between entries
+  localparam FV_DRAIN = STORE_BUFFER * (`MEM_LATENCY + 2);
+  // A coprocessor instruction's time in the COP stage
+  localparam FV_COP = 2 * `COP_LATENCY + 1;
+
+  // Longest an enabled interrupt can be held off: through a coprocessor
+  // instruction's whole time in COP and then its writeback, through an
+  // exclusive write and its writeback, through an IO load's wait for the store
+  // buffer, its access and its writeback, or through the writeback of a CSR
+  // instruction or a WFI waking up.
+  localparam FV_IRQ_HOLD_COP = COPROCESSOR != 0 ? FV_COP + 1 : 0;
+  localparam FV_IRQ_HOLD_EXCL = ATOMICS != 0 ? FV_ACCESS + 1 : 0;
+  localparam FV_IRQ_HOLD_IO = IO_SIZE != 0 ? FV_DRAIN + FV_ACCESS + 1 : 0;
+  localparam FV_IRQ_HOLD_2 = FV_IRQ_HOLD_COP > FV_IRQ_HOLD_EXCL ? FV_IRQ_HOLD_COP : FV_IRQ_HOLD_EXCL;
+  localparam FV_IRQ_HOLD = FV_IRQ_HOLD_2 > FV_IRQ_HOLD_IO ? FV_IRQ_HOLD_2 : FV_IRQ_HOLD_IO;
+  localparam FV_IRQ_BOUND = FV_IRQ_HOLD > 1 ? FV_IRQ_HOLD : 1;
+
+  reg fv_past_valid = 1'b0;
+  always @(posedge clk_i)
+    fv_past_valid <= 1'b1;
+
+  always @(*)
+    if (!fv_past_valid)
+      assume(rst_i);
+
+  /*
+   * Environment
+   */
+
+  // Responses only go with a request
+  always @(*) begin
+    if (!instr_req_valid_o)
+      assume(!instr_res_valid_i && !instr_res_error_i);
+    if (!mem_read_req_valid_o)
+      assume(!mem_read_res_valid_i && !mem_read_res_error_i);
+    if (!mem_write_req_valid_o)
+      assume(!mem_write_res_valid_i && !mem_write_res_error_i && !mem_write_res_excl_fail_i);
+    if (!(cop_req_sent_q || cop_req_accept))
+      assume(!cop_res_valid_i);
+  end
+
+  // The bounds count cycles the core is enabled for
+  always @(*)
+    assume(clk_en_i);
+
+  // An AMO's own read takes the reservation, and with one hart nothing else
+  // can break it, so its write always goes ahead
+  always @(*)
+    if (amo)
+      assume(!mem_write_res_excl_fail_i);
+
+  // Cycles each request has been waiting for its response so far
+  reg [7:0] fv_instr_wait_q, fv_read_wait_q, fv_write_wait_q, fv_cop_ready_wait_q, fv_cop_res_wait_q;
+
+  always @(posedge clk_i) begin
+    if (rst_i || !instr_req_valid_o || instr_res_valid_i || instr_res_error_i)
+      fv_instr_wait_q <= 8'd0;
+    else
+      fv_instr_wait_q <= fv_instr_wait_q + 8'd1;
+
+    if (rst_i || !mem_read_req_valid_o || mem_read_res_valid_i || mem_read_res_error_i)
+      fv_read_wait_q <= 8'd0;
+    else
+      fv_read_wait_q <= fv_read_wait_q + 8'd1;
+
+    if (rst_i || !mem_write_req_valid_o || mem_write_res_valid_i || mem_write_res_error_i)
+      fv_write_wait_q <= 8'd0;
+    else
+      fv_write_wait_q <= fv_write_wait_q + 8'd1;
+
+    if (rst_i || !cop_req_valid_o || cop_req_ready_i)
+      fv_cop_ready_wait_q <= 8'd0;
+    else
+      fv_cop_ready_wait_q <= fv_cop_ready_wait_q + 8'd1;
+
+    if (rst_i || !(cop_req_sent_q || cop_req_accept) || cop_res_valid_i)
+      fv_cop_res_wait_q <= 8'd0;
+    else
+      fv_cop_res_wait_q <= fv_cop_res_wait_q + 8'd1;
+  end
+
+  always @(*) begin
+    if (fv_instr_wait_q == `MEM_LATENCY && instr_req_valid_o)
+      assume(instr_res_valid_i || instr_res_error_i);
+    if (fv_read_wait_q == `MEM_LATENCY && mem_read_req_valid_o)
+      assume(mem_read_res_valid_i || mem_read_res_error_i);
+    if (fv_write_wait_q == `MEM_LATENCY && mem_write_req_valid_o)
+      assume(mem_write_res_valid_i || mem_write_res_error_i);
+    if (fv_cop_ready_wait_q == `COP_LATENCY && cop_req_valid_o)
+      assume(cop_req_ready_i);
+    if (fv_cop_res_wait_q == `COP_LATENCY && (cop_req_sent_q || cop_req_accept))
+      assume(cop_res_valid_i);
+  end
+
+  /*
+   * Retirement
+   */
+
+  // Cycles after the fetch response an instruction may take to get back to
+  // fetch: its timing.vh count less the fetch, plus what it waits on.
+  reg [7:0] fv_retire_bound;
+  always @(*) begin
+    if (fence || wfi)
+      fv_retire_bound = TIMING_FENCE - 1 + FV_DRAIN;
+    else if (amo)
+      fv_retire_bound = 1 + FV_DRAIN + 1 + 2 * FV_ACCESS + 1;
+    else if (lr || sc)
+      fv_retire_bound = 1 + FV_DRAIN + 1 + FV_ACCESS + 1;
+    else if (wb_src == WB_SRC_MEM)
+      // A load waits for a buffered store to the same word
+      fv_retire_bound = TIMING_LOAD - 1 + FV_DRAIN + `MEM_LATENCY;
+    else if (mem_w)
+      // One more cycle if the buffer is full
+      fv_retire_bound = TIMING_STORE - 1 + `MEM_LATENCY + (STORE_BUFFER != 0 ? 1 : 0);
+    else if (cop)
+      fv_retire_bound = TIMING_ALU - 1 + FV_COP;
+    else
+      fv_retire_bound = TIMING_ALU - 1;
+  end
+
+  reg  [7:0] fv_busy_q;
+  wire [7:0] fv_busy;
+  wire       fv_executing;
+  assign fv_executing = ctrl_state != CTRL_STATE_FETCH && ctrl_state != CTRL_STATE_SLEEP;
+  assign fv_busy = fv_executing ? fv_busy_q + 8'd1 : 8'd0;
+
+  always @(posedge clk_i) begin
+    if (rst_i || exception)
+      fv_busy_q <= 8'd0;
+    else
+      fv_busy_q <= fv_busy;
+  end
+
+  always @(*)
+    if (!rst_i)
+      assert(fv_busy <= fv_retire_bound);
+
+  /*
+   * Interrupts
+   */
+
+  wire fv_irq_pending;
+  assign fv_irq_pending = mstatus_mie && ((mie_external && irq_external_i) ||
+                                          (mie_software && irq_software_i) ||
+                                          (mie_timer && irq_timer_i));
+
+  reg  [7:0] fv_irq_wait_q;
+  wire [7:0] fv_irq_wait;
+  assign fv_irq_wait = (fv_irq_pending && !exception) ? fv_irq_wait_q + 8'd1 : 8'd0;
+
+  always @(posedge clk_i) begin
+    if (rst_i)
+      fv_irq_wait_q <= 8'd0;
+    else
+      fv_irq_wait_q <= fv_irq_wait;
+  end
+
+  always @(*)
+    if (!rst_i)
+      assert(fv_irq_wait <= FV_IRQ_BOUND);
+
+  /*
+   * Stalls
+   */
+
+  wire fv_stalled;
+  assign fv_stalled = ctrl_state_next == ctrl_state && !exception &&
+                      (ctrl_state == CTRL_STATE_FETCH || ctrl_state == CTRL_STATE_DECODE ||
+                       ctrl_state == CTRL_STATE_MEM || ctrl_state == CTRL_STATE_COP);
+
+  always @(*)
+    if (!rst_i && fv_stalled)
+      assert(instr_req_valid_o || mem_read_req_valid_o || mem_write_req_valid_o ||
+             cop_req_valid_o || cop_req_sent_q || !sb_empty);
+
+  always @(*)
+    if (!rst_i)
+      assert(ctrl_state != CTRL_STATE_ERR);
+
+  /*
+   * Depth
+   */
+
+  // The setups for the largest bounds, which the BMC depth has to reach (see
+  // latency.sby): a load or an AMO behind a buffered store, with an interrupt
+  // enabled and pending
+  always @(*)
+    if (!rst_i) begin
+      cover(ctrl_state == CTRL_STATE_MEM && wb_src == WB_SRC_MEM && !sb_empty && fv_irq_pending);
+      cover(ctrl_state == CTRL_STATE_MEM && amo && !sb_empty);
+    end
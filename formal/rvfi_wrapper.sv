@@ -29,6 +29,7 @@ module rvfi_wrapper (
 
   lemoncore uut (
     .clk_i(clock),
+    .clk_en_i(1'b1),
     .rst_i(reset),
 
     .instr_req_addr_o(instr_req_addr),
@@ -50,6 +51,15 @@ module rvfi_wrapper (
     .mem_write_res_valid_i(mem_write_res_valid),
     .mem_write_res_error_i(mem_write_res_error),
 
+    // Built without atomics, so nothing is exclusive
+    .mem_write_res_excl_fail_i(1'b0),
+
+    // No coprocessor attached, custom opcodes are illegal
+    .cop_req_ready_i(1'b0),
+    .cop_res_valid_i(1'b0),
+    .cop_res_data_i(32'b0),
+    .cop_res_error_i(1'b0),
+
     .irq_timer_i(irq_timer),
     .irq_external_i(irq_external),
     .irq_software_i(irq_software),
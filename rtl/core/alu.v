@@ -1,5 +1,9 @@
-module alu (
-  input [2:0] op_i,
+module alu #(
+  // Set to 0 to strip the Zba/Zbb datapath out of the ALU
+  parameter BITMANIP = 1
+) (
+  input [3:0] op_i,
+  input [1:0] sub_op_i,
   input [31:0] a_i,
   input [31:0] b_i,
   input shift_type_i,
@@ -12,6 +16,87 @@ module alu (
   wire signed [31:0] sra_result;
   assign sra_result = $signed(a_i) >>> $signed(b_i[4:0]);
 
+  /*
+   * Bit-manipulation (Zba/Zbb) helpers
+   */
+
+  // Rotates are built from a pair of opposing shifts. Shifting by 32 yields 0,
+  // so a rotate amount of 0 falls out naturally.
+  wire [5:0] rot_inv;
+  assign rot_inv = 6'd32 - {1'b0, b_i[4:0]};
+
+  wire [31:0] rol_result, ror_result;
+  assign rol_result = (a_i << b_i[4:0]) | (a_i >> rot_inv);
+  assign ror_result = (a_i >> b_i[4:0]) | (a_i << rot_inv);
+
+  // sub_op_i[0] selects unsigned comparison, sub_op_i[1] selects max
+  wire lt;
+  assign lt = sub_op_i[0] ? (a_i < b_i) : ($signed(a_i) < $signed(b_i));
+
+  reg [5:0] clz, ctz, cpop;
+  integer i;
+  always @(*) begin
+    clz = 6'd32;
+    ctz = 6'd32;
+    cpop = 6'd0;
+    // Last assignment wins, so scan upwards for the MSB and downwards for the
+    // LSB
+    for (i = 0; i < 32; i = i + 1) begin
+      if (a_i[i])
+        clz = 6'd31 - i[5:0];
+      cpop = cpop + {5'b0, a_i[i]};
+    end
+    for (i = 31; i >= 0; i = i - 1) begin
+      if (a_i[i])
+        ctz = i[5:0];
+    end
+  end
+
+  reg [31:0] zb_result;
+  always @(*) begin
+    case (op_i)
+      // sh1add/sh2add/sh3add, sub-op is the shift amount
+      ALU_OP_SHADD: zb_result = (a_i << sub_op_i) + b_i;
+      // sub-op is funct3[1:0]: andn = 11, orn = 10, xnor = 00
+      ALU_OP_LOGN: begin
+        case (sub_op_i)
+          2'b11: zb_result = a_i & ~b_i;
+          2'b10: zb_result = a_i | ~b_i;
+          default: zb_result = ~(a_i ^ b_i);
+        endcase
+      end
+      ALU_OP_MINMAX: zb_result = (lt ^ sub_op_i[1]) ? a_i : b_i;
+      // sub-op 0 is rol, 1 is ror/rori
+      ALU_OP_ROT: zb_result = sub_op_i[0] ? ror_result : rol_result;
+      // sub-op is rs2[1:0]: clz = 00, ctz = 01, cpop = 10
+      ALU_OP_COUNT: begin
+        case (sub_op_i)
+          2'b00: zb_result = {26'b0, clz};
+          2'b01: zb_result = {26'b0, ctz};
+          default: zb_result = {26'b0, cpop};
+        endcase
+      end
+      // sext.b = 00, sext.h = 01, zext.h = 10
+      ALU_OP_EXT: begin
+        case (sub_op_i)
+          2'b00: zb_result = {{24{a_i[7]}}, a_i[7:0]};
+          2'b01: zb_result = {{16{a_i[15]}}, a_i[15:0]};
+          default: zb_result = {16'b0, a_i[15:0]};
+        endcase
+      end
+      // rev8 = 0, orc.b = 1
+      ALU_OP_BYTE: begin
+        if (sub_op_i[0]) begin
+          zb_result = {{8{|a_i[31:24]}}, {8{|a_i[23:16]}},
+                       {8{|a_i[15:8]}}, {8{|a_i[7:0]}}};
+        end else begin
+          zb_result = {a_i[7:0], a_i[15:8], a_i[23:16], a_i[31:24]};
+        end
+      end
+      default: zb_result = 32'b0;
+    endcase
+  end
+
   always @(*) begin
     case (op_i)
       ALU_OP_ADD: out_o = a_i + b_i;
@@ -22,7 +107,7 @@ module alu (
       ALU_OP_SHR: out_o = shift_type_i ? sra_result : a_i >> b_i[4:0];
       ALU_OP_OR: out_o = a_i | b_i;
       ALU_OP_AND: out_o = a_i & b_i;
-      default: out_o = 32'b0;
+      default: out_o = BITMANIP ? zb_result : 32'b0;
     endcase
   end
 
@@ -3,14 +3,23 @@ localparam A_SRC_RS1 /* verilator public */ = 1;
 localparam B_SRC_IMM /* verilator public */ = 0;
 localparam B_SRC_RS2 /* verilator public */ = 1;
 
-localparam ALU_OP_ADD  /* verilator public */ = 3'b000;
-localparam ALU_OP_SHL  /* verilator public */ = 3'b001;
-localparam ALU_OP_CMP  /* verilator public */ = 3'b010;
-localparam ALU_OP_CMPU /* verilator public */ = 3'b011;
-localparam ALU_OP_XOR  /* verilator public */ = 3'b100;
-localparam ALU_OP_SHR  /* verilator public */ = 3'b101;
-localparam ALU_OP_OR   /* verilator public */ = 3'b110;
-localparam ALU_OP_AND  /* verilator public */ = 3'b111;
+localparam ALU_OP_ADD  /* verilator public */ = 4'b0000;
+localparam ALU_OP_SHL  /* verilator public */ = 4'b0001;
+localparam ALU_OP_CMP  /* verilator public */ = 4'b0010;
+localparam ALU_OP_CMPU /* verilator public */ = 4'b0011;
+localparam ALU_OP_XOR  /* verilator public */ = 4'b0100;
+localparam ALU_OP_SHR  /* verilator public */ = 4'b0101;
+localparam ALU_OP_OR   /* verilator public */ = 4'b0110;
+localparam ALU_OP_AND  /* verilator public */ = 4'b0111;
+
+// Zba/Zbb bit-manipulation ops, variant selected by ALU sub-op
+localparam ALU_OP_SHADD  /* verilator public */ = 4'b1000;
+localparam ALU_OP_LOGN   /* verilator public */ = 4'b1001;
+localparam ALU_OP_MINMAX /* verilator public */ = 4'b1010;
+localparam ALU_OP_ROT    /* verilator public */ = 4'b1011;
+localparam ALU_OP_COUNT  /* verilator public */ = 4'b1100;
+localparam ALU_OP_EXT    /* verilator public */ = 4'b1101;
+localparam ALU_OP_BYTE   /* verilator public */ = 4'b1110;
 
 localparam NEXT_PC_ALU /* verilator public */ = 0;
 localparam NEXT_PC_INC /* verilator public */ = 1;
@@ -21,3 +30,4 @@ localparam WB_SRC_PC  /* verilator public */ = 0;
 localparam WB_SRC_MEM /* verilator public */ = 1;
 localparam WB_SRC_ALU /* verilator public */ = 2;
 localparam WB_SRC_CSR /* verilator public */ = 3;
+localparam WB_SRC_COP /* verilator public */ = 4;
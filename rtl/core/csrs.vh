@@ -20,6 +20,9 @@ localparam CSR_NUM_MCAUSE   = 12'h342;
 localparam CSR_NUM_MTVAL    = 12'h343;
 localparam CSR_NUM_MIP      = 12'h344;
 
+// Custom, machine read/write
+localparam CSR_NUM_MSHADOW = 12'h7C0; // shadow register bank, see lemoncore.v
+
 // Counters/timers
 // M mode
 localparam CSR_NUM_MCYCLE        = 12'hB00;
@@ -33,7 +36,7 @@ localparam CSR_NUM_MHPMCOUNTER3H  = 12'hB83;
 localparam CSR_NUM_MHPMCOUNTER31H = 12'hB9F;
 
 localparam CSR_NUM_MHPMEVENT3  = 12'h323;
-localparam CSR_NUM_MHPMEVENT31 = 12'h323;
+localparam CSR_NUM_MHPMEVENT31 = 12'h33F;
 
 // Shadows
 localparam CSR_NUM_CYCLE    = 12'hC00;
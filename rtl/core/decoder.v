@@ -1,10 +1,18 @@
-module decoder (
+module decoder #(
+  // Decode the Zba/Zbb bit-manipulation subset
+  parameter BITMANIP = 1,
+  // Decode custom-0/custom-1 as coprocessor instructions
+  parameter COPROCESSOR = 0,
+  // Decode the A extension (LR/SC and AMOs, word-sized only)
+  parameter ATOMICS = 0
+) (
   input [31:0]      instr_i,
   output [4:0]      rs1_o,
   output [4:0]      rs2_o,
   output [4:0]      rd_o,
   output reg [31:0] imm_o,
-  output reg [2:0]  alu_op_o,
+  output reg [3:0]  alu_op_o,
+  output reg [1:0]  alu_sub_op_o,
   output            a_src_o,
   output            b_src_o,
   output            negate_b_o,
@@ -12,13 +20,19 @@ module decoder (
   output            reg_w_o,
   output [2:0]      ext_sel_o,
   output reg [1:0]  next_pc_o,
-  output reg [1:0]  wb_src_o,
+  output reg [2:0]  wb_src_o,
   output            shift_type_o,
   output            illegal_instr_o,
   output            nop_o,
+  output            fence_o,
+  output            wfi_o,
   output reg        ecall_o,
   output reg        ebreak_o,
   output            mret_o,
+  output            cop_o,
+  output            lr_o,
+  output            sc_o,
+  output            amo_o,
   output [1:0]      csr_o,
   output            csr_imm_o,
   output [11:0]     csr_index_o,
@@ -47,6 +61,7 @@ module decoder (
   wire illegal_load;
   wire illegal_store;
   reg illegal_alu;
+  reg illegal_atomic;
 
   assign illegal_jalr = (is_jalr) && (funct3 != 3'b000);
   assign illegal_load = (is_load) && (
@@ -59,15 +74,17 @@ module decoder (
                          (ext_sel_o != 3'b010));
   always @(*) begin
     illegal_alu = 1'b0;
-    if (is_i_arith) begin
-      if (funct3 == ALU_OP_SHR) begin
+    if (is_zb) begin
+      illegal_alu = 1'b0;
+    end else if (is_i_arith) begin
+      if ({1'b0, funct3} == ALU_OP_SHR) begin
         illegal_alu = (funct7 != 7'b0100000) &&
                       (funct7 != 7'b0000000);
-      end else if (funct3 == ALU_OP_SHL) begin
+      end else if ({1'b0, funct3} == ALU_OP_SHL) begin
         illegal_alu = (funct7 != 7'b0000000);
       end
     end else if (is_r_arith) begin
-      if (funct3 == ALU_OP_ADD || instr_i[14:12] == ALU_OP_SHR) begin
+      if ({1'b0, funct3} == ALU_OP_ADD || {1'b0, instr_i[14:12]} == ALU_OP_SHR) begin
         illegal_alu = (funct7 != 7'b0100000) &&
                       (funct7 != 7'b0000000);
       end else begin
@@ -81,7 +98,8 @@ module decoder (
                            illegal_jalr ||
                            illegal_load ||
                            illegal_store ||
-                           illegal_alu) && !(is_wfi || is_mret);
+                           illegal_alu ||
+                           illegal_atomic) && !(is_wfi || is_mret);
 
   // Instruction type logic
   reg illegal_instr_type;
@@ -96,6 +114,8 @@ module decoder (
   reg is_r_arith;
   reg is_fence;
   reg is_sys;
+  reg is_cop;
+  reg is_atomic;
   always @(*) begin
     illegal_instr_type = 1'b0;
     is_lui = 1'b0;
@@ -109,6 +129,8 @@ module decoder (
     is_r_arith = 1'b0;
     is_fence = 1'b0;
     is_sys = 1'b0;
+    is_cop = 1'b0;
+    is_atomic = 1'b0;
     case (opcode)
       7'b0110111: is_lui = 1'b1;
       7'b0010111: is_auipc = 1'b1;
@@ -121,6 +143,21 @@ module decoder (
       7'b0110011: is_r_arith = 1'b1;
       7'b0001111: is_fence = 1'b1;
       7'b1110011: is_sys = 1'b1;
+      7'b0101111: begin // AMO
+        if (ATOMICS != 0) begin
+          is_atomic = 1'b1;
+        end else begin
+          illegal_instr_type = 1'b1;
+        end
+      end
+      7'b0001011, // custom-0
+      7'b0101011: begin // custom-1
+        if (COPROCESSOR != 0) begin
+          is_cop = 1'b1;
+        end else begin
+          illegal_instr_type = 1'b1;
+        end
+      end
       default: begin
         illegal_instr_type = 1'b1;
       end
@@ -144,12 +181,125 @@ module decoder (
     end
   end
 
+  // Bit-manipulation instructions share the OP/OP-IMM opcodes with the base
+  // ISA, and are picked out by funct7 (and rs2 for the unary ops)
+  reg       is_zb;
+  reg [3:0] zb_alu_op;
+  reg [1:0] zb_sub_op;
+  always @(*) begin
+    is_zb = 1'b0;
+    zb_alu_op = ALU_OP_ADD;
+    zb_sub_op = 2'b00;
+    if (BITMANIP && is_r_arith) begin
+      case (funct7)
+        7'b0010000: begin // sh1add, sh2add, sh3add
+          is_zb = funct3 == 3'b010 || funct3 == 3'b100 || funct3 == 3'b110;
+          zb_alu_op = ALU_OP_SHADD;
+          zb_sub_op = funct3[2:1];
+        end
+        7'b0100000: begin // andn, orn, xnor
+          is_zb = funct3 == 3'b111 || funct3 == 3'b110 || funct3 == 3'b100;
+          zb_alu_op = ALU_OP_LOGN;
+          zb_sub_op = funct3[1:0];
+        end
+        7'b0000101: begin // min, minu, max, maxu
+          is_zb = funct3[2];
+          zb_alu_op = ALU_OP_MINMAX;
+          zb_sub_op = funct3[1:0];
+        end
+        7'b0110000: begin // rol, ror
+          is_zb = funct3 == 3'b001 || funct3 == 3'b101;
+          zb_alu_op = ALU_OP_ROT;
+          zb_sub_op = {1'b0, funct3[2]};
+        end
+        7'b0000100: begin // zext.h
+          is_zb = funct3 == 3'b100 && instr_i[24:20] == 5'b0;
+          zb_alu_op = ALU_OP_EXT;
+          zb_sub_op = 2'b10;
+        end
+        default: begin
+          is_zb = 1'b0;
+        end
+      endcase
+    end else if (BITMANIP && is_i_arith) begin
+      if (funct3 == 3'b001 && funct7 == 7'b0110000) begin
+        case (instr_i[24:20])
+          5'b00000, // clz
+          5'b00001, // ctz
+          5'b00010: begin // cpop
+            is_zb = 1'b1;
+            zb_alu_op = ALU_OP_COUNT;
+            zb_sub_op = instr_i[21:20];
+          end
+          5'b00100, // sext.b
+          5'b00101: begin // sext.h
+            is_zb = 1'b1;
+            zb_alu_op = ALU_OP_EXT;
+            zb_sub_op = {1'b0, instr_i[20]};
+          end
+          default: begin
+            is_zb = 1'b0;
+          end
+        endcase
+      end else if (funct3 == 3'b101 && funct7 == 7'b0110000) begin // rori
+        is_zb = 1'b1;
+        zb_alu_op = ALU_OP_ROT;
+        zb_sub_op = 2'b01;
+      end else if (funct3 == 3'b101 && instr_i[31:20] == 12'h698) begin // rev8
+        is_zb = 1'b1;
+        zb_alu_op = ALU_OP_BYTE;
+        zb_sub_op = 2'b00;
+      end else if (funct3 == 3'b101 && instr_i[31:20] == 12'h287) begin // orc.b
+        is_zb = 1'b1;
+        zb_alu_op = ALU_OP_BYTE;
+        zb_sub_op = 2'b01;
+      end
+    end
+  end
+
+  // Atomics are picked out by funct5. The aq/rl bits are ignored, since the
+  // core waits for posted stores to drain before any atomic anyway.
+  wire [4:0] funct5;
+  assign funct5 = instr_i[31:27];
+
+  reg is_lr;
+  reg is_sc;
+  reg is_amo;
+  always @(*) begin
+    is_lr = 1'b0;
+    is_sc = 1'b0;
+    is_amo = 1'b0;
+    illegal_atomic = 1'b0;
+    if (is_atomic) begin
+      case (funct5)
+        5'b00010: is_lr = 1'b1;
+        5'b00011: is_sc = 1'b1;
+        5'b00000, // amoadd
+        5'b00001, // amoswap
+        5'b00100, // amoxor
+        5'b01000, // amoor
+        5'b01100, // amoand
+        5'b10000, // amomin
+        5'b10100, // amomax
+        5'b11000, // amominu
+        5'b11100: is_amo = 1'b1; // amomaxu
+        default: illegal_atomic = 1'b1;
+      endcase
+      // Only .W, and lr.w has no rs2
+      if (funct3 != 3'b010 || (is_lr && instr_i[24:20] != 5'b0))
+        illegal_atomic = 1'b1;
+    end
+  end
+
   // ALU OP
   always @(*) begin
-    if (is_r_arith || is_i_arith) begin
+    alu_sub_op_o = zb_sub_op;
+    if (is_zb) begin
+      alu_op_o = zb_alu_op;
+    end else if (is_r_arith || is_i_arith) begin
       // we only use these bits as alu op for R-type instructions and one
       // specific variant of I-type
-      alu_op_o = funct3;
+      alu_op_o = {1'b0, funct3};
     end else if (is_lui || is_auipc) begin
       alu_op_o = ALU_OP_ADD;
     end else if (is_jal) begin
@@ -169,7 +319,8 @@ module decoder (
           alu_op_o = ALU_OP_XOR;
         end
       endcase
-    end else if (is_store || is_load) begin
+    end else if (is_store || is_load || is_atomic) begin
+      // Atomics have no offset, and imm_o is 0 for them
       alu_op_o = ALU_OP_ADD;
     end else begin
       // only thing left are system instructions, which is a don't care for
@@ -184,7 +335,7 @@ module decoder (
   assign b_src_o = (is_branch || is_r_arith) ? B_SRC_RS2 : B_SRC_IMM;
 
   // MemW and RegW
-  assign mem_w_o = is_store;
+  assign mem_w_o = is_store || is_sc || is_amo;
   assign reg_w_o = !(is_store || is_branch);
 
   // Extension
@@ -218,10 +369,13 @@ module decoder (
 
   // WB src
   always @(*) begin
-    if (is_load) begin
+    if (is_load || is_atomic) begin
+      // sc writes back its success flag, which comes from the memory system
       wb_src_o = WB_SRC_MEM;
     end else if (is_jal || is_jalr) begin
       wb_src_o = WB_SRC_PC;
+    end else if (is_cop) begin
+      wb_src_o = WB_SRC_COP;
     end else if (csr_o != 2'b0) begin
       wb_src_o = WB_SRC_CSR;
     end else begin
@@ -231,7 +385,7 @@ module decoder (
 
   // B negate (only for sub instruction)
   assign negate_b_o = (is_r_arith &&
-                       funct3 == ALU_OP_ADD &&
+                       {1'b0, funct3} == ALU_OP_ADD &&
                        instr_i[30] == 1'b1) ? 1'b1 : 1'b0;
 
   // Shift type (arithmetic or logical)
@@ -270,6 +424,12 @@ module decoder (
   assign is_mret = instr_i == 32'b0011000_00010_00000_000_00000_1110011;
 
   assign nop_o = is_fence | is_wfi; // fence and wfi are nops
+  assign fence_o = is_fence;
+  assign wfi_o = is_wfi;
   assign mret_o = is_mret;
+  assign cop_o = is_cop;
+  assign lr_o = is_lr;
+  assign sc_o = is_sc;
+  assign amo_o = is_amo;
 
 endmodule
@@ -1,5 +1,32 @@
-module lemoncore (
+module lemoncore #(
+  // Implement the Zba/Zbb bit-manipulation subset
+  parameter BITMANIP = 1,
+  // Route custom-0/custom-1 instructions to the coprocessor port. When 0 the
+  // port is tied off and those opcodes raise illegal instruction exceptions.
+  parameter COPROCESSOR = 0,
+  // Number of posted stores (1-4) buffered in front of the data write port, 0
+  // to make every store wait for its write response. See the memory stage.
+  parameter STORE_BUFFER = 0,
+  // Addresses of memory-mapped devices. Loads from [IO_BASE, IO_BASE +
+  // IO_SIZE) wait for the store buffer to drain, see the memory stage.
+  parameter [31:0] IO_BASE = 0,
+  parameter [31:0] IO_SIZE = 0,
+  // Implement the A extension. Atomics rely on the memory system for their
+  // reservations, see the exclusive access signals below.
+  parameter ATOMICS = 0,
+  // Value of mhartid
+  parameter [31:0] HART_ID = 0,
+  // Add a shadow bank of registers that trap handlers can switch to, see the
+  // mshadow CSR below
+  parameter SHADOW_REGS = 0,
+  // Keep mcycle counting while asleep in WFI. Off by default, since the SoC
+  // disables the core's clock while it sleeps and couldn't count those cycles.
+  parameter MCYCLE_IN_SLEEP = 0
+) (
   input         clk_i,
+  // Clock enable. Nothing in the core changes state while it's low, which lets
+  // the SoC idle the core in WFI without gating its clock (see sleep_o).
+  input         clk_en_i,
   input         rst_i,
 
 `ifdef RISCV_FORMAL
@@ -45,13 +72,63 @@ module lemoncore (
   input         mem_write_res_valid_i,
   input         mem_write_res_error_i,
 
+  /*
+   * Exclusive accesses, for the A extension
+   *
+   * The read of an lr.w or an AMO is flagged with mem_read_req_excl_o, which
+   * asks the memory system to place a reservation on the word for this hart.
+   * The write of an sc.w or an AMO is flagged with mem_write_req_excl_o, and
+   * must only take effect if the reservation is still held, i.e. no one has
+   * written the word since. mem_write_res_excl_fail_i goes with the write
+   * response, high if the write was dropped. An AMO whose write fails goes
+   * back and reads the word again, so AMOs are only atomic where the memory
+   * system keeps reservations.
+   */
+  output        mem_read_req_excl_o,
+  output        mem_write_req_excl_o,
+  input         mem_write_res_excl_fail_i,
+
+  /*
+   * Coprocessor port
+   *
+   * custom-0/custom-1 R-type instructions are handed to the coprocessor along
+   * with their source register values. cop_req_valid_o is held until the
+   * coprocessor accepts the request with cop_req_ready_i, and the core then
+   * waits for a single-cycle cop_res_valid_i pulse, which may arrive in the
+   * same cycle as the acceptance or any number of cycles later. Exactly one
+   * response is expected per accepted request. cop_res_data_i is written to rd;
+   * asserting cop_res_error_i instead raises an illegal instruction exception.
+   * Interrupts are held off from the request going out until writeback, so a
+   * request is never withdrawn before it's accepted or replayed after.
+   */
+  output        cop_req_valid_o,
+  input         cop_req_ready_i,
+  output        cop_req_custom_o, // 0 for custom-0, 1 for custom-1
+  output [2:0]  cop_req_funct3_o,
+  output [6:0]  cop_req_funct7_o,
+  output [31:0] cop_req_rs1_o,
+  output [31:0] cop_req_rs2_o,
+  input         cop_res_valid_i,
+  input [31:0]  cop_res_data_i,
+  input         cop_res_error_i,
+
   input         irq_timer_i,
   input         irq_external_i,
-  input         irq_software_i
+  input         irq_software_i,
+
+  // High while the core is stalled in WFI with no enabled interrupt pending.
+  // Nothing in the core changes state in this time (mcycle stops too, unless
+  // MCYCLE_IN_SLEEP is set), so clk_en_i can be dropped until an interrupt
+  // arrives.
+  output        sleep_o
   );
 
   `include "control_signals.vh"
   `include "csrs.vh"
+  // Only the formal checks and the harness read these
+  /* verilator lint_off UNUSED */
+  `include "timing.vh"
+  /* verilator lint_on UNUSED */
 
   // Could make these changeable params, but we'd need to add some logic to make
   // sure they are honored by power-on-reset
@@ -73,15 +150,19 @@ module lemoncore (
   localparam CTRL_STATE_EX = 2;
   localparam CTRL_STATE_MEM = 3;
   localparam CTRL_STATE_WB = 4;
+  localparam CTRL_STATE_COP = 5;
+  localparam CTRL_STATE_SLEEP = 6;
   localparam CTRL_STATE_ERR = 3'b111;
 
-  reg [2:0]   ctrl_state;
+  reg [2:0]   ctrl_state /*verilator public*/;
   reg [2:0]   ctrl_state_next;
   wire [2:0]  fetch_ctrl_state_next;
   wire [2:0]  decode_ctrl_state_next;
   wire [2:0]  ex_ctrl_state_next;
   reg [2:0]   mem_ctrl_state_next;
   wire [2:0]  wb_ctrl_state_next;
+  wire [2:0]  cop_ctrl_state_next;
+  wire [2:0]  sleep_ctrl_state_next;
 
   always @(*) begin
     case (ctrl_state)
@@ -90,39 +171,45 @@ module lemoncore (
       CTRL_STATE_EX: ctrl_state_next = ex_ctrl_state_next;
       CTRL_STATE_MEM: ctrl_state_next = mem_ctrl_state_next;
       CTRL_STATE_WB: ctrl_state_next = wb_ctrl_state_next;
+      CTRL_STATE_COP: ctrl_state_next = cop_ctrl_state_next;
+      CTRL_STATE_SLEEP: ctrl_state_next = sleep_ctrl_state_next;
       default: ctrl_state_next = CTRL_STATE_ERR;
     endcase
   end
 
   always @(posedge clk_i) begin
-    if (rst_i) begin
-      ctrl_state <= CTRL_STATE_FETCH;
-    end else if (exception) begin
-      ctrl_state <= CTRL_STATE_FETCH;
-    end else begin
-      ctrl_state <= ctrl_state_next;
+    if (clk_en_i) begin
+      if (rst_i) begin
+        ctrl_state <= CTRL_STATE_FETCH;
+      end else if (exception) begin
+        ctrl_state <= CTRL_STATE_FETCH;
+      end else begin
+        ctrl_state <= ctrl_state_next;
+      end
     end
   end
 
   always @(posedge clk_i) begin
-    if (rst_i) begin
-      pc_q <= BOOT_ADDRESS;
-    end else if (exception) begin
-        if (mtvec_q[0] == 1'b1 && irq) begin
-          // vectored mode
-          pc_q <= {mtvec_q[31:2] + (mcause_q[29:0] << 2), 2'b00};
-        end else begin
-          // normal mode
-          pc_q <= {mtvec_q[31:2], 2'b00};
+    if (clk_en_i) begin
+      if (rst_i) begin
+        pc_q <= BOOT_ADDRESS;
+      end else if (exception) begin
+          if (mtvec_q[0] == 1'b1 && irq && !sb_fault_take) begin
+            // vectored mode
+            pc_q <= {mtvec_q[31:2] + mcause_d[29:0], 2'b00};
+          end else begin
+            // normal mode
+            pc_q <= {mtvec_q[31:2], 2'b00};
+          end
+      end else if (ctrl_state_next == CTRL_STATE_FETCH) begin
+        // Latch next PC right before transitioning to fetch
+        if (mret) begin
+          pc_q <= mepc_q;
+        end else if (ctrl_state != CTRL_STATE_FETCH) begin
+          // If we're blocked in fetch waiting for memory reply, don't continue to
+          // step PC
+          pc_q <= pc_d;
         end
-    end else if (ctrl_state_next == CTRL_STATE_FETCH) begin
-      // Latch next PC right before transitioning to fetch
-      if (mret) begin
-        pc_q <= mepc_q;
-      end else if (ctrl_state != CTRL_STATE_FETCH) begin
-        // If we're blocked in fetch waiting for memory reply, don't continue to
-        // step PC
-        pc_q <= pc_d;
       end
     end
   end
@@ -140,7 +227,8 @@ module lemoncore (
   assign instr_req_addr_o = pc_q;
   // If we get an interrupt during fetch state, need valid to go low while we
   // remain in fetch state in order to indicate we'd like to fetch a new instr
-  assign instr_req_valid_o = ~irq & (ctrl_state == CTRL_STATE_FETCH);
+  // The same goes for a pending store buffer fault.
+  assign instr_req_valid_o = ~irq & ~sb_fault & (ctrl_state == CTRL_STATE_FETCH);
 
   assign misaligned_instr = (pc_d[1:0] != 2'b00) &&
                             (ctrl_state_next == CTRL_STATE_FETCH);
@@ -151,10 +239,12 @@ module lemoncore (
                                  ? CTRL_STATE_DECODE : CTRL_STATE_FETCH;
 
   always @(posedge clk_i) begin
-    if (ctrl_state == CTRL_STATE_FETCH &&
-                 fetch_ctrl_state_next == CTRL_STATE_DECODE) begin
-      // latch current instruction on transition
-      instr_q <= instr_res_data_i;
+    if (clk_en_i) begin
+      if (ctrl_state == CTRL_STATE_FETCH &&
+                   fetch_ctrl_state_next == CTRL_STATE_DECODE) begin
+        // latch current instruction on transition
+        instr_q <= instr_res_data_i;
+      end
     end
   end
 
@@ -175,33 +265,45 @@ module lemoncore (
   reg [31:0] wdata;
 
   // Decoder control signals
-  wire [2:0] alu_op;
+  wire [3:0] alu_op;
+  wire [1:0] alu_sub_op;
   wire a_src, b_src;
   wire negate_b;
   wire mem_w, reg_w;
   wire [2:0] ext_sel;
   reg [1:0] next_pc_q;
   wire [1:0] next_pc_d;
-  wire [1:0] wb_src;
+  wire [2:0] wb_src;
   wire shift_type;
   wire illegal_instr;
   wire illegal_instr_decode;
   wire nop;
+  wire fence;
+  wire wfi;
   wire ecall;
   wire ebreak;
   wire mret;
+  wire cop;
+  wire lr;
+  wire sc;
+  wire amo;
   wire [1:0] csr;
   wire csr_use_imm;
   wire [11:0] csr_num;
   wire [4:0] csr_zimm;
 
-  decoder decoder(
+  decoder #(
+    .BITMANIP(BITMANIP),
+    .COPROCESSOR(COPROCESSOR),
+    .ATOMICS(ATOMICS)
+  ) decoder(
     .instr_i(instr_q),
     .rs1_o(rs1),
     .rs2_o(rs2),
     .rd_o(rd),
     .imm_o(imm_d),
     .alu_op_o(alu_op),
+    .alu_sub_op_o(alu_sub_op),
     .a_src_o(a_src),
     .b_src_o(b_src),
     .negate_b_o(negate_b),
@@ -213,9 +315,15 @@ module lemoncore (
     .shift_type_o(shift_type),
     .illegal_instr_o(illegal_instr_decode),
     .nop_o(nop),
+    .fence_o(fence),
+    .wfi_o(wfi),
     .ecall_o(ecall),
     .ebreak_o(ebreak),
     .mret_o(mret),
+    .cop_o(cop),
+    .lr_o(lr),
+    .sc_o(sc),
+    .amo_o(amo),
     .csr_o(csr),
     .csr_imm_o(csr_use_imm),
     .csr_index_o(csr_num),
@@ -224,8 +332,28 @@ module lemoncore (
 
   assign illegal_instr = illegal_instr_decode | (illegal_csr_num & is_csr);
 
-  regfile regfile(
+  /*
+   * Shadow register bank
+   *
+   * With SHADOW_REGS set, the register file has a second bank, and the custom
+   * mshadow CSR (0x7C0) selects between them:
+   *  - bit 0, enable: switch to bank 1 on every trap
+   *  - bit 1, bank: the bank in use
+   *  - bit 2, previous bank: the bank in use before the last trap, which mret
+   *    goes back to
+   * Trap handlers then get registers of their own without saving anything,
+   * and bank 1 keeps its values between traps, so firmware can set it up
+   * ahead of time by writing bank. A CSR instruction that changes bank writes
+   * its rd in the new bank. Without SHADOW_REGS, mshadow reads as 0 and writes
+   * are ignored, so firmware can tell whether the bank is there.
+   */
+  reg shadow_en_q, bank_q, prev_bank_q;
+
+  regfile #(
+    .BANKS(SHADOW_REGS != 0 ? 2 : 1)
+  ) regfile(
     .clk_i(clk_i),
+    .bank_i(bank_q),
     .rs1_i(rs1),
     .rs2_i(rs2),
     .rd1_o(rd1_q),
@@ -235,15 +363,22 @@ module lemoncore (
     .wd_i(wdata)
   );
 
-  assign decode_ctrl_state_next = nop ? CTRL_STATE_FETCH :  CTRL_STATE_EX;
+  // Fences wait for posted stores to drain, and so does WFI so the memory
+  // system is quiet while we sleep. Atomics do too, so they're ordered after
+  // every earlier store and their own writes can bypass the buffer.
+  assign decode_ctrl_state_next = ((fence || wfi || lr || sc || amo) && !sb_empty) ? CTRL_STATE_DECODE :
+                                  wfi ? CTRL_STATE_SLEEP :
+                                  nop ? CTRL_STATE_FETCH :  CTRL_STATE_EX;
 
   always @(posedge clk_i) begin
-    if (rst_i) begin
-      imm_q <= 32'b0;
-      next_pc_q <= NEXT_PC_ALU; // important for correct boot
-    end else if (ctrl_state == CTRL_STATE_DECODE) begin
-      imm_q <= imm_d;
-      next_pc_q <= next_pc_d;
+    if (clk_en_i) begin
+      if (rst_i) begin
+        imm_q <= 32'b0;
+        next_pc_q <= NEXT_PC_ALU; // important for correct boot
+      end else if (ctrl_state == CTRL_STATE_DECODE) begin
+        imm_q <= imm_d;
+        next_pc_q <= next_pc_d;
+      end
     end
   end
 
@@ -259,8 +394,11 @@ module lemoncore (
   assign alu_a = a_src == A_SRC_PC ? pc_q : rd1_q;
   assign alu_b = b_src == B_SRC_IMM ? imm_q : (negate_b ? -rd2_q : rd2_q);
 
-  alu alu(
+  alu #(
+    .BITMANIP(BITMANIP)
+  ) alu(
     .op_i(alu_op),
+    .sub_op_i(alu_sub_op),
     .a_i(alu_a),
     .b_i(alu_b),
     .shift_type_i(shift_type),
@@ -275,16 +413,19 @@ module lemoncore (
   );
 
   assign ex_ctrl_state_next = mret ? CTRL_STATE_FETCH :
+                              cop ? CTRL_STATE_COP :
                               (mem_w || wb_src == WB_SRC_MEM) ?
                               CTRL_STATE_MEM : CTRL_STATE_WB;
 
   always @(posedge clk_i) begin
-    if (rst_i) begin
-      alu_result_q <= BOOT_ADDRESS; // important for correct boot
-      store_data_q <= 32'b0;
-    end else if (ctrl_state == CTRL_STATE_EX) begin
-      alu_result_q <= alu_result_d;
-      store_data_q <= store_data_d;
+    if (clk_en_i) begin
+      if (rst_i) begin
+        alu_result_q <= BOOT_ADDRESS; // important for correct boot
+        store_data_q <= 32'b0;
+      end else if (ctrl_state == CTRL_STATE_EX) begin
+        alu_result_q <= alu_result_d;
+        store_data_q <= store_data_d;
+      end
     end
   end
 
@@ -293,46 +434,253 @@ module lemoncore (
    */
   reg  [31:0] mem_rdata_q;
   wire [31:0] mem_rdata_d;
+  wire [3:0]  store_mask;
 
   assign mem_read_req_addr_o = alu_result_q;
-  assign mem_write_req_addr_o = alu_result_q;
-  assign mem_write_req_data_o = store_data_q;
-  assign mem_write_req_mask_o = (ext_sel == 3'b010) ? 4'b1111 : // sw
-                                (ext_sel == 3'b001) ? 4'b0011 : // sh
-                                (ext_sel == 3'b000) ? 4'b0001 : // sb
-                                4'b0; // shouldn't happen/don't care
-
+  assign store_mask = (ext_sel == 3'b010) ? 4'b1111 : // sw
+                      (ext_sel == 3'b001) ? 4'b0011 : // sh
+                      (ext_sel == 3'b000) ? 4'b0001 : // sb
+                      4'b0; // shouldn't happen/don't care
+
+  // An AMO reads in the MEM stage, then writes once amo_write_q is set. sc.w
+  // only writes, and writes back whether it succeeded.
+  reg  amo_write_q;
   wire read_req_outstanding;
   wire write_req_outstanding;
-  assign read_req_outstanding = (wb_src == WB_SRC_MEM) && ctrl_state == CTRL_STATE_MEM;
-  assign write_req_outstanding = mem_w && ctrl_state == CTRL_STATE_MEM;
+  wire excl_write;
+  assign read_req_outstanding = (wb_src == WB_SRC_MEM) && !sc && !amo_write_q &&
+                                ctrl_state == CTRL_STATE_MEM;
+  assign write_req_outstanding = mem_w && !(amo && !amo_write_q) &&
+                                 ctrl_state == CTRL_STATE_MEM;
+  assign excl_write = write_req_outstanding && (sc || amo);
+
+  assign mem_read_req_excl_o = lr || amo;
+  assign mem_write_req_excl_o = excl_write;
 
+  // AMOs take store/AMO exceptions even in their read phase
   wire misaligned_load, misaligned_store;
   assign misaligned_load = ((ext_sel[1:0] == 2'b10) ? (mem_read_req_addr_o[1:0] != 2'b00) :  // lw
                             (ext_sel[1:0] == 2'b01) ? (mem_read_req_addr_o[0] != 1'b0) :     // lh[u]
-                            1'b0) & read_req_outstanding;
-  assign misaligned_store = ((ext_sel[1:0] == 2'b10) ? (mem_write_req_addr_o[1:0] != 2'b00) :  // sw
-                             (ext_sel[1:0] == 2'b01) ? (mem_write_req_addr_o[0] != 1'b0) :     // sh[u]
-                             1'b0) & write_req_outstanding;
+                            1'b0) & read_req_outstanding & !amo;
+  assign misaligned_store = ((ext_sel[1:0] == 2'b10) ? (alu_result_q[1:0] != 2'b00) :  // sw
+                             (ext_sel[1:0] == 2'b01) ? (alu_result_q[0] != 1'b0) :     // sh[u]
+                             1'b0) & (write_req_outstanding | (read_req_outstanding & amo));
 
   wire access_fault_load, access_fault_store;
   assign access_fault_load = mem_read_res_error_i & read_req_outstanding;
-  assign access_fault_store = mem_write_res_error_i & write_req_outstanding;
 
-  assign mem_read_req_valid_o = ~(misaligned_load | irq) & read_req_outstanding;
-  assign mem_write_req_valid_o = ~(misaligned_store | irq) & write_req_outstanding;
+  // Value an AMO writes, from the word it read and rs2
+  reg [31:0] amo_result;
+  always @(*) begin
+    case (instr_q[31:27])
+      5'b00000: amo_result = mem_rdata_q + rd2_q;
+      5'b00100: amo_result = mem_rdata_q ^ rd2_q;
+      5'b01000: amo_result = mem_rdata_q | rd2_q;
+      5'b01100: amo_result = mem_rdata_q & rd2_q;
+      5'b10000: amo_result = $signed(mem_rdata_q) < $signed(rd2_q) ? mem_rdata_q : rd2_q;
+      5'b10100: amo_result = $signed(mem_rdata_q) < $signed(rd2_q) ? rd2_q : mem_rdata_q;
+      5'b11000: amo_result = mem_rdata_q < rd2_q ? mem_rdata_q : rd2_q;
+      5'b11100: amo_result = mem_rdata_q < rd2_q ? rd2_q : mem_rdata_q;
+      default: amo_result = rd2_q; // amoswap
+    endcase
+  end
+
+  wire [31:0] store_wdata;
+  assign store_wdata = amo ? amo_result : store_data_q;
+
+  // Store buffer interface, filled in below
+  wire        store_issue;  // store leaves the MEM stage this cycle
+  wire        store_done;   // store may retire
+  wire        sb_load_hit;  // load overlaps a buffered store
+  wire        sb_empty;
+  wire        sb_fault;     // imprecise store fault pending
+  wire [31:0] sb_fault_addr;
+  wire        sb_fault_take;
+
+  wire io_access = (alu_result_q - IO_BASE) < IO_SIZE;
+
+  assign store_issue = ~(misaligned_store | irq) & write_req_outstanding;
+
+  assign mem_read_req_valid_o = ~(misaligned_load | misaligned_store | irq | sb_load_hit) &
+                                read_req_outstanding;
 
-  // Transition on appropriate memory response
+  // Transition on appropriate memory response. An AMO stays for its write,
+  // and starts over if the write lost its reservation.
   always @(*) begin
     if (read_req_outstanding && mem_read_res_valid_i) begin
-      mem_ctrl_state_next = CTRL_STATE_WB;
-    end else if (write_req_outstanding && mem_write_res_valid_i) begin
-      mem_ctrl_state_next = CTRL_STATE_FETCH;
+      mem_ctrl_state_next = amo ? CTRL_STATE_MEM : CTRL_STATE_WB;
+    end else if (write_req_outstanding && store_done) begin
+      mem_ctrl_state_next = sc ? CTRL_STATE_WB :
+                            !amo ? CTRL_STATE_FETCH :
+                            mem_write_res_excl_fail_i ? CTRL_STATE_MEM : CTRL_STATE_WB;
     end else begin
       mem_ctrl_state_next = CTRL_STATE_MEM;
     end
   end
 
+  always @(posedge clk_i) begin
+    if (clk_en_i) begin
+      if (rst_i || ctrl_state != CTRL_STATE_MEM) begin
+        amo_write_q <= 1'b0;
+      end else if (amo && read_req_outstanding && mem_read_res_valid_i) begin
+        amo_write_q <= 1'b1;
+      end else if (amo_write_q && store_done && mem_write_res_excl_fail_i) begin
+        amo_write_q <= 1'b0;
+      end
+    end
+  end
+
+  /*
+   * Store buffer
+   *
+   * With STORE_BUFFER > 0, a store retires as soon as it has been queued, and
+   * the buffer drains to the write port in the background, oldest first. The
+   * core only waits on it when:
+   *  - the buffer is full,
+   *  - a load touches a word with a buffered store, in which case the load
+   *    stalls until that store has drained,
+   *  - a load reads the IO region while any store is buffered, in which case
+   *    it stalls until the whole buffer has drained, so a device always sees
+   *    earlier stores to its other registers before the read, and
+   *  - a fence (or fence.i) is executed, which waits for the buffer to empty.
+   *
+   * Since the store has already retired by the time its write response comes
+   * back, write errors are imprecise: the first failing store is latched and
+   * raised as a store access fault (mcause 7, mtval = store address) before the
+   * next instruction fetch, with mepc pointing at that next instruction. Like
+   * any other exception, this overwrites mepc if it lands inside a trap
+   * handler. Software that needs to attribute a fault to a particular store
+   * can follow it with a fence.
+   *
+   * Without a store buffer, stores hold the MEM stage until the write response
+   * arrives and faults are precise.
+   *
+   * The exclusive writes of sc.w and AMOs need their response, so they bypass
+   * the buffer, which is always empty by then, and their faults are precise.
+   */
+  generate
+    if (STORE_BUFFER == 0) begin : gen_no_store_buffer
+      assign mem_write_req_addr_o = alu_result_q;
+      assign mem_write_req_data_o = store_wdata;
+      assign mem_write_req_mask_o = store_mask;
+      assign mem_write_req_valid_o = store_issue;
+
+      assign access_fault_store = mem_write_res_error_i & write_req_outstanding;
+      assign store_done = mem_write_res_valid_i;
+      assign sb_load_hit = 1'b0;
+      assign sb_empty = 1'b1;
+      assign sb_fault = 1'b0;
+      assign sb_fault_addr = 32'b0;
+    end else begin : gen_store_buffer
+      // Entry 0 is the oldest and is the one being drained
+      reg [31:0] addr_q [0:STORE_BUFFER-1];
+      reg [31:0] data_q [0:STORE_BUFFER-1];
+      reg [3:0]  mask_q [0:STORE_BUFFER-1];
+      reg [STORE_BUFFER-1:0] valid_q;
+      reg        gap_q;
+      reg        fault_q;
+      reg [31:0] fault_addr_q;
+
+      wire push, pop;
+      wire [STORE_BUFFER-1:0] valid_shifted;
+      reg  [STORE_BUFFER-1:0] push_slot;
+      reg  hit;
+
+      wire drain;
+
+      assign mem_write_req_addr_o = excl_write ? alu_result_q : addr_q[0];
+      assign mem_write_req_data_o = excl_write ? store_wdata : data_q[0];
+      assign mem_write_req_mask_o = excl_write ? store_mask : mask_q[0];
+      assign mem_write_req_valid_o = excl_write ? store_issue : drain;
+
+      // Memories keep responding while valid is held, so leave a cycle between
+      // entries to keep a stale response from retiring the next one
+      assign drain = valid_q[0] && !gap_q;
+      assign pop = drain && (mem_write_res_valid_i || mem_write_res_error_i);
+      assign push = store_issue && !excl_write && !valid_q[STORE_BUFFER-1];
+
+      assign valid_shifted = pop ? (valid_q >> 1) : valid_q;
+
+      // Lowest free slot once the popped entry has shifted out
+      integer i;
+      always @(*) begin
+        push_slot = {STORE_BUFFER{1'b0}};
+        for (i = STORE_BUFFER - 1; i >= 0; i = i - 1) begin
+          if (!valid_shifted[i]) begin
+            push_slot = {STORE_BUFFER{1'b0}};
+            push_slot[i] = 1'b1;
+          end
+        end
+      end
+
+      // Stores are buffered at word granularity
+      integer j;
+      always @(*) begin
+        hit = 1'b0;
+        for (j = 0; j < STORE_BUFFER; j = j + 1) begin
+          if (valid_q[j] && addr_q[j][31:2] == alu_result_q[31:2])
+            hit = 1'b1;
+        end
+      end
+
+      integer k;
+      always @(posedge clk_i) begin
+        if (clk_en_i) begin
+          if (pop) begin
+            for (k = 0; k < STORE_BUFFER - 1; k = k + 1) begin
+              addr_q[k] <= addr_q[k+1];
+              data_q[k] <= data_q[k+1];
+              mask_q[k] <= mask_q[k+1];
+            end
+          end
+          // Overrides the shift for the slot being filled
+          for (k = 0; k < STORE_BUFFER; k = k + 1) begin
+            if (push && push_slot[k]) begin
+              addr_q[k] <= alu_result_q;
+              data_q[k] <= store_data_q;
+              mask_q[k] <= store_mask;
+            end
+          end
+        end
+      end
+
+      always @(posedge clk_i) begin
+        if (clk_en_i) begin
+          if (rst_i) begin
+            valid_q <= {STORE_BUFFER{1'b0}};
+            gap_q <= 1'b0;
+          end else begin
+            valid_q <= valid_shifted | (push ? push_slot : {STORE_BUFFER{1'b0}});
+            gap_q <= pop;
+          end
+        end
+      end
+
+      always @(posedge clk_i) begin
+        if (clk_en_i) begin
+          if (rst_i) begin
+            fault_q <= 1'b0;
+          end else if (pop && mem_write_res_error_i && (!fault_q || sb_fault_take)) begin
+            fault_q <= 1'b1;
+            fault_addr_q <= addr_q[0];
+          end else if (sb_fault_take) begin
+            fault_q <= 1'b0;
+          end
+        end
+      end
+
+      assign access_fault_store = mem_write_res_error_i & excl_write;
+      assign store_done = excl_write ? mem_write_res_valid_i : push;
+      assign sb_load_hit = hit || (io_access && valid_q[0]);
+      assign sb_empty = !valid_q[0];
+      assign sb_fault = fault_q;
+      assign sb_fault_addr = fault_addr_q;
+    end
+  endgenerate
+
+  // Raised at the start of the next fetch, see above
+  assign sb_fault_take = sb_fault && ctrl_state == CTRL_STATE_FETCH;
+
   ext memext(
     .in_i(mem_read_res_data_i),
     .sel_i(ext_sel),
@@ -340,13 +688,76 @@ module lemoncore (
   );
 
   always @(posedge clk_i) begin
-    if (rst_i) begin
-      mem_rdata_q <= 32'b0;
-    end else if (ctrl_state == CTRL_STATE_MEM && mem_read_res_valid_i) begin
-      mem_rdata_q <= mem_rdata_d;
+    if (clk_en_i) begin
+      if (rst_i) begin
+        mem_rdata_q <= 32'b0;
+      end else if (ctrl_state == CTRL_STATE_MEM && mem_read_res_valid_i) begin
+        mem_rdata_q <= mem_rdata_d;
+      end else if (ctrl_state == CTRL_STATE_MEM && sc && store_done) begin
+        // sc.w writes 0 to rd on success and 1 on failure
+        mem_rdata_q <= {31'b0, mem_write_res_excl_fail_i};
+      end
+    end
+  end
+
+  /*
+   * Coprocessor stage
+   */
+  reg        cop_req_sent_q;
+  reg [31:0] cop_result_q;
+  wire       cop_req_accept;
+  wire       cop_res_take;
+  wire       cop_fault;
+
+  assign cop_req_valid_o = (COPROCESSOR != 0) && (ctrl_state == CTRL_STATE_COP) &&
+                           !cop_req_sent_q;
+  assign cop_req_custom_o = instr_q[5];
+  assign cop_req_funct3_o = instr_q[14:12];
+  assign cop_req_funct7_o = instr_q[31:25];
+  assign cop_req_rs1_o = rd1_q;
+  assign cop_req_rs2_o = rd2_q;
+
+  assign cop_req_accept = cop_req_valid_o && cop_req_ready_i;
+  assign cop_res_take = (COPROCESSOR != 0) && (ctrl_state == CTRL_STATE_COP) &&
+                        (cop_req_sent_q || cop_req_accept) && cop_res_valid_i;
+  assign cop_fault = cop_res_take && cop_res_error_i;
+
+  assign cop_ctrl_state_next = cop_res_take ? CTRL_STATE_WB : CTRL_STATE_COP;
+
+  always @(posedge clk_i) begin
+    if (clk_en_i) begin
+      if (rst_i || ctrl_state != CTRL_STATE_COP || cop_res_take) begin
+        cop_req_sent_q <= 1'b0;
+      end else if (cop_req_accept) begin
+        cop_req_sent_q <= 1'b1;
+      end
+    end
+  end
+
+  always @(posedge clk_i) begin
+    if (clk_en_i) begin
+      if (cop_res_take) begin
+        cop_result_q <= cop_res_data_i;
+      end
     end
   end
 
+  /*
+   * Sleep stage
+   *
+   * WFI waits here until an interrupt that's enabled in mie is pending, whether
+   * or not mstatus.MIE is set. It then retires, and if interrupts are enabled
+   * globally the trap is taken at the next fetch, so mepc points past the WFI.
+   */
+  wire wake;
+  assign wake = (mie_external & irq_external_i) |
+                (mie_software & irq_software_i) |
+                (mie_timer    & irq_timer_i);
+
+  assign sleep_ctrl_state_next = wake ? CTRL_STATE_FETCH : CTRL_STATE_SLEEP;
+
+  assign sleep_o = ctrl_state == CTRL_STATE_SLEEP && !wake;
+
   /*
    * Writeback stage
    */
@@ -354,14 +765,15 @@ module lemoncore (
   // Regfile is instantiated with the decode stage logic
   // Just need to fill in 'we' and 'wdata' signals here
 
-  // don't commit if we get an IRQ here
-  assign we = (ctrl_state == CTRL_STATE_WB && reg_w && !irq);
+  // don't commit if we get an IRQ here, or if a jump traps on its target
+  assign we = (ctrl_state == CTRL_STATE_WB && reg_w && !exception);
   always @(*) begin
     case (wb_src)
       WB_SRC_PC:  wdata = pc_q + 32'd4;
       WB_SRC_MEM: wdata = mem_rdata_q;
       WB_SRC_ALU: wdata = alu_result_q;
       WB_SRC_CSR: wdata = csr_read_q;
+      WB_SRC_COP: wdata = cop_result_q;
       default: wdata = 32'b0;
     endcase
   end
@@ -372,22 +784,28 @@ module lemoncore (
    * Close the loop back to fetch stage
    */
   always @(*) begin
-    case (next_pc_q)
-      NEXT_PC_ALU: pc_d = {alu_result_q[31:1], 1'b0};
-      NEXT_PC_INC: pc_d = pc_q + 32'd4;
-      NEXT_PC_BR0: pc_d = (alu_result_q == 32'b0) ? pc_q + imm_q : pc_q + 32'd4;
-      NEXT_PC_BR1: pc_d = (alu_result_q == 32'b0) ? pc_q + 32'd4 : pc_q + imm_q;
-    endcase
+    if (ctrl_state == CTRL_STATE_DECODE) begin
+      // Fences go straight back to fetch from here, before next_pc_q and
+      // alu_result_q are their own
+      pc_d = pc_q + 32'd4;
+    end else begin
+      case (next_pc_q)
+        NEXT_PC_ALU: pc_d = {alu_result_q[31:1], 1'b0};
+        NEXT_PC_INC: pc_d = pc_q + 32'd4;
+        NEXT_PC_BR0: pc_d = (alu_result_q == 32'b0) ? pc_q + imm_q : pc_q + 32'd4;
+        NEXT_PC_BR1: pc_d = (alu_result_q == 32'b0) ? pc_q + 32'd4 : pc_q + imm_q;
+      endcase
+    end
   end
 
   /*
    * CSRs & exception handling
    */
   reg mstatus_mie /*verilator public*/, mstatus_mpie /*verilator public*/;
-  reg [31:0] mepc_q, mepc_d /*verilator public*/;
+  reg [31:0] mepc_q /*verilator public*/, mepc_d /*verilator public*/;
   reg [31:0] mcause_q /*verilator public*/, mcause_d;
   reg [31:0] mtval_q /*verilator public*/, mtval_d;
-  reg [31:0] mtvec_q, mtvec_d /*verilator public*/;
+  reg [31:0] mtvec_q /*verilator public*/, mtvec_d /*verilator public*/;
   wire       mip_external /*verilator public*/, mip_software /*verilator public*/, mip_timer /*verilator public*/;
   reg        mie_external /*verilator public*/, mie_software /*verilator public*/, mie_timer /*verilator public*/;
   reg [31:0] mscratch_q /*verilator public*/;
@@ -396,12 +814,31 @@ module lemoncore (
   assign mip_software = irq_software_i;
   assign mip_timer = irq_timer_i;
 
-  wire irq = mstatus_mie & ((mie_external & irq_external_i) |
+  // Once a coprocessor request has gone out, hold off interrupts until its
+  // result has been written back, since it can't be withdrawn before the
+  // coprocessor accepts it. Likewise once an exclusive write has been sent or
+  // a CSR instruction has written its CSR, since none of them can be
+  // replayed. Loads from the IO region can't be either, as reading some device
+  // registers pops a FIFO or claims an interrupt. A WFI that wakes up retires
+  // first.
+  wire irq_hold;
+  assign irq_hold = ctrl_state == CTRL_STATE_COP || (ctrl_state == CTRL_STATE_WB && wb_src == WB_SRC_COP) ||
+                    excl_write || (ctrl_state == CTRL_STATE_WB && (sc || amo || is_csr)) ||
+                    ((ctrl_state == CTRL_STATE_MEM || ctrl_state == CTRL_STATE_WB) &&
+                     wb_src == WB_SRC_MEM && io_access) ||
+                    ctrl_state == CTRL_STATE_SLEEP;
+
+  wire irq = mstatus_mie & ~irq_hold &
+                           ((mie_external & irq_external_i) |
                             (mie_software & irq_software_i) |
                             (mie_timer    & irq_timer_i));
   wire is_csr;
   assign is_csr = csr != 2'b0;
 
+  // RV32I, plus A and X (non-standard extensions, for the coprocessor) when
+  // configured. Writes are ignored.
+  localparam [31:0] MISA = {2'b01, 6'b0, COPROCESSOR != 0, 14'b0, 1'b1, 7'b0, ATOMICS != 0};
+
   reg [31:0] csr_read_q, csr_read_d;
   reg        illegal_csr_num_read;
   always @(*) begin
@@ -425,11 +862,11 @@ module lemoncore (
         CSR_NUM_MVENDORID: csr_read_d = 32'd0;
         CSR_NUM_MARCHID:   csr_read_d = 32'd0;
         CSR_NUM_MIMPID:    csr_read_d = 32'd0;
-        CSR_NUM_MHARTID:   csr_read_d = 32'd0;
+        CSR_NUM_MHARTID:   csr_read_d = HART_ID;
 
         // Machine trap setup
         CSR_NUM_MSTATUS: csr_read_d = {25'b0, mstatus_mpie, 3'b0, mstatus_mie, 2'b0};
-        CSR_NUM_MISA:    csr_read_d = 32'h4070; // RV32I only, TODO: show pieces
+        CSR_NUM_MISA:    csr_read_d = MISA;
         CSR_NUM_MIE:     csr_read_d = {21'b0, mie_external, 3'b0, mie_timer, 3'b0, mie_software, 2'b0};
         CSR_NUM_MTVEC:   csr_read_d = mtvec_q;
 
@@ -440,6 +877,9 @@ module lemoncore (
         CSR_NUM_MTVAL:    csr_read_d = mtval_q;
         CSR_NUM_MIP:      csr_read_d = {21'b0, mip_external, 3'b0, mip_timer, 3'b0, mip_software, 2'b0};
 
+        // Custom
+        CSR_NUM_MSHADOW: csr_read_d = {29'b0, prev_bank_q, bank_q, shadow_en_q};
+
         // Counters/timers
         CSR_NUM_CYCLE,
         CSR_NUM_MCYCLE:    csr_read_d = cycles_q[31:0];
@@ -464,99 +904,121 @@ module lemoncore (
     case (csr)
       CSR_RW: csr_update = csr_operand;
       CSR_RS: csr_update = csr_read_d | csr_operand;
-      CSR_RC: csr_update = csr_read_d ^ csr_operand;
+      CSR_RC: csr_update = csr_read_d & ~csr_operand;
       default: csr_update = csr_read_d; // don't care
     endcase
   end
 
   always @(posedge clk_i) begin
-    csr_read_q <= csr_read_d;
+    if (clk_en_i) begin
+      csr_read_q <= csr_read_d;
+    end
   end
 
   wire exception, trap;
   always @(posedge clk_i) begin
-    if (rst_i) begin
-      mtvec_q <= EXCEPTION_ADDRESS;
-      mie_external <= 1'b0;
-      mie_software <= 1'b0;
-      mie_timer <= 1'b0;
-      mstatus_mie <= 1'b0;
-    end
-    if (exception) begin
-      // Changes that occur automatically on exception
-      mstatus_mpie <= mstatus_mie;
-      mstatus_mie <= 1'b0;
-      mcause_q <= mcause_d;
-      mepc_q <= pc_q;
-      mtval_q <= mtval_d;
-    end else if (ctrl_state == CTRL_STATE_EX) begin
-      if (is_csr && !no_csr_write) begin
-        case (csr_num)
-          // Fill in writable CSRs
-          CSR_NUM_MSTATUS: begin
-            mstatus_mie <= csr_update[3];
-            mstatus_mpie <= csr_update[7];
-          end
-          CSR_NUM_MIE: begin
-            mie_external <= csr_update[EXTERNAL_IRQ];
-            mie_software <= csr_update[SOFTWARE_IRQ];
-            mie_timer    <= csr_update[TIMER_IRQ];
-          end
-          CSR_NUM_MTVEC: mtvec_q <= csr_update;
-          CSR_NUM_MSCRATCH: mscratch_q <= csr_update;
-          CSR_NUM_MEPC: mepc_q <= csr_update;
-          CSR_NUM_MCAUSE: mcause_q <= csr_update;
-          CSR_NUM_MTVAL: mtval_q <= csr_update;
-          default: begin
-            // Empty block to prevent incomplete case lint warning
-          end
-        endcase
-      end else if (mret) begin
-        mstatus_mie <= mstatus_mpie;
+    if (clk_en_i) begin
+      if (rst_i) begin
+        mtvec_q <= EXCEPTION_ADDRESS;
+        mie_external <= 1'b0;
+        mie_software <= 1'b0;
+        mie_timer <= 1'b0;
+        mstatus_mie <= 1'b0;
+        shadow_en_q <= 1'b0;
+        bank_q <= 1'b0;
+        prev_bank_q <= 1'b0;
+      end
+      if (exception) begin
+        // Changes that occur automatically on exception
+        mstatus_mpie <= mstatus_mie;
+        mstatus_mie <= 1'b0;
+        prev_bank_q <= bank_q;
+        if (shadow_en_q)
+          bank_q <= 1'b1;
+        mcause_q <= mcause_d;
+        mepc_q <= pc_q;
+        mtval_q <= mtval_d;
+      end else if (ctrl_state == CTRL_STATE_EX) begin
+        if (is_csr && !no_csr_write) begin
+          case (csr_num)
+            // Fill in writable CSRs
+            CSR_NUM_MSTATUS: begin
+              mstatus_mie <= csr_update[3];
+              mstatus_mpie <= csr_update[7];
+            end
+            CSR_NUM_MIE: begin
+              mie_external <= csr_update[EXTERNAL_IRQ];
+              mie_software <= csr_update[SOFTWARE_IRQ];
+              mie_timer    <= csr_update[TIMER_IRQ];
+            end
+            CSR_NUM_MTVEC: mtvec_q <= csr_update;
+            CSR_NUM_MSCRATCH: mscratch_q <= csr_update;
+            CSR_NUM_MEPC: mepc_q <= {csr_update[31:2], 2'b00}; // IALIGN is 32
+            CSR_NUM_MCAUSE: mcause_q <= csr_update;
+            CSR_NUM_MTVAL: mtval_q <= csr_update;
+            CSR_NUM_MSHADOW: begin
+              shadow_en_q <= csr_update[0] && SHADOW_REGS != 0;
+              bank_q <= csr_update[1] && SHADOW_REGS != 0;
+              prev_bank_q <= csr_update[2] && SHADOW_REGS != 0;
+            end
+            default: begin
+              // Empty block to prevent incomplete case lint warning
+            end
+          endcase
+        end else if (mret) begin
+          mstatus_mie <= mstatus_mpie;
+          mstatus_mpie <= 1'b1;
+          bank_q <= prev_bank_q;
+        end
       end
     end
   end
 
-  // Performance counters
+  // Performance counters. mcycle doesn't count time spent asleep in WFI unless
+  // MCYCLE_IN_SLEEP is set, since clk_en_i may be low then.
   reg [63:0] cycles_q, instret_q;
   always @(posedge clk_i) begin
-    if (rst_i) begin
-      cycles_q <= 64'b0;
-    end else if (ctrl_state == CTRL_STATE_EX && is_csr && !no_csr_write &&
-                (csr_num == CSR_NUM_MCYCLE || csr_num == CSR_NUM_MCYCLEH)) begin
-      if (csr_num == CSR_NUM_MCYCLE) begin
-        cycles_q[31:0] <= csr_update;
-      end else begin
-        cycles_q[63:32] <= csr_update;
+    if (clk_en_i) begin
+      if (rst_i) begin
+        cycles_q <= 64'b0;
+      end else if (ctrl_state == CTRL_STATE_EX && !exception && is_csr && !no_csr_write &&
+                  (csr_num == CSR_NUM_MCYCLE || csr_num == CSR_NUM_MCYCLEH)) begin
+        if (csr_num == CSR_NUM_MCYCLE) begin
+          cycles_q[31:0] <= csr_update;
+        end else begin
+          cycles_q[63:32] <= csr_update;
+        end
+      end else if (!sleep_o || MCYCLE_IN_SLEEP != 0) begin
+        cycles_q <= cycles_q + 64'b1;
       end
-    end else begin
-      cycles_q <= cycles_q + 64'b1;
     end
   end
 
   // if we're transitioning from a non-fetch state to the fetch state, and we're
   // not handling an exception, we've just retired an instruction
-  wire instret;
+  wire instret /*verilator public*/;
   assign instret = (ctrl_state != CTRL_STATE_FETCH) &&
                     (ctrl_state_next == CTRL_STATE_FETCH) &&
                     !exception;
 
   always @(posedge clk_i) begin
-    if (rst_i) begin
-      instret_q <= 64'b0;
-    end else if (is_csr && !no_csr_write &&
-                (csr_num == CSR_NUM_MINSTRET || csr_num == CSR_NUM_MINSTRETH)) begin
-      if (ctrl_state == CTRL_STATE_EX) begin
-        // only perform update when we reach ex state, but should still bypass
-        // the next condition
-        if (csr_num == CSR_NUM_MINSTRET) begin
-          instret_q[31:0] <= csr_update;
-        end else begin
-          instret_q[63:32] <= csr_update;
+    if (clk_en_i) begin
+      if (rst_i) begin
+        instret_q <= 64'b0;
+      end else if (is_csr && !no_csr_write &&
+                  (csr_num == CSR_NUM_MINSTRET || csr_num == CSR_NUM_MINSTRETH)) begin
+        if (ctrl_state == CTRL_STATE_EX && !exception) begin
+          // only perform update when we reach ex state, but should still bypass
+          // the next condition
+          if (csr_num == CSR_NUM_MINSTRET) begin
+            instret_q[31:0] <= csr_update;
+          end else begin
+            instret_q[63:32] <= csr_update;
+          end
         end
+      end else if (instret) begin
+        instret_q <= instret_q + 64'b1;
       end
-    end else if (instret) begin
-      instret_q <= instret_q + 64'b1;
     end
   end
 
@@ -564,10 +1026,9 @@ module lemoncore (
   always @(*) begin
     if ((csr_num >= CSR_NUM_MHPMCOUNTER3  && csr_num <= CSR_NUM_MHPMCOUNTER31) ||
         (csr_num >= CSR_NUM_MHPMCOUNTER3H && csr_num <= CSR_NUM_MHPMCOUNTER31H) ||
-        (csr_num >= CSR_NUM_HPMCOUNTER3   && csr_num <= CSR_NUM_HPMCOUNTER31) ||
-        (csr_num >= CSR_NUM_HPMCOUNTER3H  && csr_num <= CSR_NUM_HPMCOUNTER31H) ||
         (csr_num >= CSR_NUM_MHPMEVENT3    && csr_num <= CSR_NUM_MHPMEVENT31)) begin
-      // Extra performance counters are R/W
+      // Extra performance counters are R/W, apart from their read-only user
+      // shadows
       illegal_csr_num_write = 1'b0;
     end else begin
       case (csr_num)
@@ -584,16 +1045,19 @@ module lemoncore (
         CSR_NUM_MCYCLE,
         CSR_NUM_MINSTRET,
         CSR_NUM_MCYCLEH,
-        CSR_NUM_MINSTRETH: illegal_csr_num_write = 1'b0;
+        CSR_NUM_MINSTRETH,
+        CSR_NUM_MSHADOW: illegal_csr_num_write = 1'b0;
         // All remaining are RO
         default: illegal_csr_num_write = 1'b1;
       endcase
     end
   end
 
-  // don't write CSR if we have a CSRRW with rd = x0, or CSRRWI with zimm = 5'b0
+  // don't write CSR for a CSRRS/CSRRC with rs1 = x0, or CSRRSI/CSRRCI with
+  // zimm = 5'b0, so csrr can read read-only CSRs like mhartid. CSRRW/CSRRWI
+  // always write, even from x0.
   wire no_csr_write;
-  assign no_csr_write = (csr == CSR_RW) && (csr_use_imm ? (csr_zimm == 5'b0) :
+  assign no_csr_write = (csr != CSR_RW) && (csr_use_imm ? (csr_zimm == 5'b0) :
                                                           (rs1 == 5'b0));
   wire illegal_csr_write;
   assign illegal_csr_write = illegal_csr_num_write && !no_csr_write;
@@ -615,18 +1079,23 @@ module lemoncore (
 
   always @(*) begin
     mcause_d = mcause_q;
-    if (irq_external_i) begin
+    if (sb_fault_take) begin
+      // Taken ahead of interrupts so they aren't lost to a nested trap
+      mcause_d = 32'd7;
+    end else if (irq && mie_external && irq_external_i) begin
+      // Only the enabled lines count: one that's pending but masked mustn't
+      // take over the cause of another trap
       mcause_d[31] = 1'b1;
       mcause_d[30:0] = EXTERNAL_IRQ;
-    end else if (irq_software_i) begin
+    end else if (irq && mie_software && irq_software_i) begin
       mcause_d[31] = 1'b1;
       mcause_d[30:0] = SOFTWARE_IRQ;
-    end else if (irq_timer_i) begin
+    end else if (irq && mie_timer && irq_timer_i) begin
       mcause_d[31] = 1'b1;
       mcause_d[30:0] = TIMER_IRQ;
     end else if (access_fault_instr) begin
       mcause_d = 32'd1;
-    end else if (illegal_instr) begin
+    end else if (illegal_instr || cop_fault) begin
       mcause_d = 32'd2;
     end else if (misaligned_instr) begin
       mcause_d = 32'd0;
@@ -641,21 +1110,19 @@ module lemoncore (
     end else if (access_fault_store) begin
       mcause_d = 32'd7;
     end else if (access_fault_load) begin
-      mcause_d = 32'd5;
+      mcause_d = amo ? 32'd7 : 32'd5;
     end
   end
 
   always @(*) begin
     mtval_d = mtval_q;
-    if (irq_external_i) begin
-      mtval_d = 32'd0;
-    end else if (irq_software_i) begin
-      mtval_d = 32'd0;
-    end else if (irq_timer_i) begin
+    if (sb_fault_take) begin
+      mtval_d = sb_fault_addr;
+    end else if (irq) begin
       mtval_d = 32'd0;
     end else if (access_fault_instr) begin
       mtval_d = pc_q;
-    end else if (illegal_instr) begin
+    end else if (illegal_instr || cop_fault) begin
       mtval_d = instr_q;
     end else if (misaligned_instr) begin
       mtval_d = pc_d;
@@ -664,11 +1131,11 @@ module lemoncore (
     end else if (ebreak) begin
       mtval_d = 32'd0;
     end else if (misaligned_store) begin
-      mtval_d = mem_write_req_addr_o;
+      mtval_d = alu_result_q;
     end else if (misaligned_load) begin
       mtval_d = mem_read_req_addr_o;
     end else if (access_fault_store) begin
-      mtval_d = mem_write_req_addr_o;
+      mtval_d = alu_result_q;
     end else if (access_fault_load) begin
       mtval_d = mem_read_req_addr_o;
     end
@@ -680,7 +1147,9 @@ module lemoncore (
                 (misaligned_load & ctrl_state == CTRL_STATE_MEM) |
                 (misaligned_store & ctrl_state == CTRL_STATE_MEM) |
                 (access_fault_load & ctrl_state == CTRL_STATE_MEM) |
-                (access_fault_store & ctrl_state == CTRL_STATE_MEM);
+                (access_fault_store & ctrl_state == CTRL_STATE_MEM) |
+                cop_fault |
+                sb_fault_take;
 
   assign exception = trap |
                      (ecall & ctrl_state == CTRL_STATE_DECODE) |
@@ -704,13 +1173,15 @@ module lemoncore (
 	assign rvfi_halt = 1'b0;
   // rvfi_intr must be set for the first instruction that is part of a trap handler
   always @(posedge clk_i) begin
-    if (rst_i) begin
-      rvfi_intr <= 1'b0;
-    end else if (exception) begin
-      rvfi_intr <= 1'b1;
-    end else if (instret) begin
-      // reset after instruction retired
-      rvfi_intr <= 1'b0;
+    if (clk_en_i) begin
+      if (rst_i) begin
+        rvfi_intr <= 1'b0;
+      end else if (exception) begin
+        rvfi_intr <= 1'b1;
+      end else if (instret) begin
+        // reset after instruction retired
+        rvfi_intr <= 1'b0;
+      end
     end
   end
 
@@ -727,27 +1198,45 @@ module lemoncore (
 	assign rvfi_pc_rdata = pc_q;
 	assign rvfi_pc_wdata = pc_d;
 
-  assign rvfi_mem_addr = mem_read_req_valid_o ? mem_read_req_addr_o : mem_write_req_addr_o;
+  assign rvfi_mem_addr = mem_read_req_valid_o ? mem_read_req_addr_o : alu_result_q;
   always @(posedge clk_i) begin
-    if (rst_i) begin
-      rvfi_mem_rmask <= 4'b0;
-    end else if (instret) begin
-      // reset after instruction retired
-      rvfi_mem_rmask <= 4'b0;
-    end else begin
-      if (mem_read_req_valid_o) begin
-        rvfi_mem_rmask <= ((ext_sel == 3'b010) ? 4'b1111 :
-                          (ext_sel == 3'b001 | ext_sel == 3'b101) ? 4'b0011 :
-                          (ext_sel == 3'b000 | ext_sel == 3'b100) ? 4'b0001 :
-                          4'b0);
+    if (clk_en_i) begin
+      if (rst_i) begin
+        rvfi_mem_rmask <= 4'b0;
+      end else if (instret) begin
+        // reset after instruction retired
+        rvfi_mem_rmask <= 4'b0;
+      end else begin
+        if (mem_read_req_valid_o) begin
+          rvfi_mem_rmask <= ((ext_sel == 3'b010) ? 4'b1111 :
+                            (ext_sel == 3'b001 | ext_sel == 3'b101) ? 4'b0011 :
+                            (ext_sel == 3'b000 | ext_sel == 3'b100) ? 4'b0001 :
+                            4'b0);
+        end
+        if (mem_read_res_valid_i) begin
+          rvfi_mem_rdata <= mem_read_res_data_i;
+        end
       end
-      if (mem_read_res_valid_i) begin
-        rvfi_mem_rdata <= mem_read_res_data_i;
+    end
+  end
+  // Stores are reported when they leave the MEM stage, buffered or not.
+  // Exclusive writes retire later, in WB, and only if they went ahead.
+  reg [3:0] rvfi_excl_wmask_q;
+  always @(posedge clk_i) begin
+    if (clk_en_i) begin
+      if (rst_i || instret) begin
+        rvfi_excl_wmask_q <= 4'b0;
+      end else if (excl_write && store_done && !mem_write_res_excl_fail_i) begin
+        rvfi_excl_wmask_q <= store_mask;
       end
     end
   end
-  assign rvfi_mem_wmask = mem_write_req_valid_o ? mem_write_req_mask_o : 4'b0;
-  assign rvfi_mem_wdata = mem_write_req_data_o;
+  assign rvfi_mem_wmask = (store_issue && !excl_write) ? store_mask : rvfi_excl_wmask_q;
+  assign rvfi_mem_wdata = store_wdata;
+`endif
+
+`ifdef FORMAL_LATENCY
+  `include "latency_checks.vh"
 `endif
 
 endmodule
@@ -1,5 +1,12 @@
-module regfile (
+module regfile #(
+  // 2 for a shadow bank, selected by bank_i
+  parameter BANKS = 1
+) (
   input clk_i,
+  // Only used with a shadow bank
+  /* verilator lint_off UNUSED */
+  input bank_i,
+  /* verilator lint_on UNUSED */
   input [4:0] rs1_i,
   input [4:0]  rs2_i,
   output reg [31:0] rd1_o,
@@ -9,22 +16,38 @@ module regfile (
   input [31:0] wd_i
 );
 
-  reg [31:0] regs[0:31] /*verilator public*/;
+  localparam ADDR_BITS = BANKS > 1 ? 6 : 5;
+
+  // Bank 0 comes first, so regs[1:31] are always the ordinary registers
+  reg [31:0] regs[0:32*BANKS-1] /*verilator public*/;
+
+  wire [ADDR_BITS-1:0] ws, rs1, rs2;
+  generate
+    if (BANKS > 1) begin : gen_banked
+      assign ws = {bank_i, ws_i};
+      assign rs1 = {bank_i, rs1_i};
+      assign rs2 = {bank_i, rs2_i};
+    end else begin : gen_single
+      assign ws = ws_i;
+      assign rs1 = rs1_i;
+      assign rs2 = rs2_i;
+    end
+  endgenerate
 
   always @(posedge clk_i) begin
     if (we_i && ws_i != 5'b0) begin
-        regs[ws_i] <= wd_i;
+        regs[ws] <= wd_i;
     end
   end
 
   always @(posedge clk_i) begin
-    rd1_o <= regs[rs1_i];
-    rd2_o <= regs[rs2_i];
+    rd1_o <= regs[rs1];
+    rd2_o <= regs[rs2];
   end
 
   integer i;
   initial begin
-    for (i = 0; i < 32; i = i + 1) begin
+    for (i = 0; i < 32 * BANKS; i = i + 1) begin
       regs[i] = 32'b0;
     end
   end
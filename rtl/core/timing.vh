@@ -0,0 +1,24 @@
+/*
+ * Instruction timing
+ */
+// Cycles each class of instruction takes from the start of its fetch to the
+// start of the next one's, with every memory answering in the cycle it's
+// asked and the store buffer empty. The core tests check these exactly
+// (sim/lemoncore_timing_tb.cpp reads them from the model) and the formal
+// latency checks add the waits on top for their bounds, so a change to the
+// pipeline only needs updating here.
+
+// FETCH, DECODE, EX and WB: ALU ops, lui/auipc, jumps, branches and CSRs
+localparam TIMING_ALU /*verilator public*/ = 4;
+// Plus a MEM cycle for the access
+localparam TIMING_LOAD /*verilator public*/ = 5;
+// Straight back to fetch from MEM, once the write is buffered or answered
+localparam TIMING_STORE /*verilator public*/ = 4;
+// Back to fetch from DECODE
+localparam TIMING_FENCE /*verilator public*/ = 2;
+// ecall, ebreak or an illegal instruction, to the handler's first fetch
+localparam TIMING_TRAP /*verilator public*/ = 2;
+// From the fetch an interrupt arrives in to the handler's first fetch
+localparam TIMING_IRQ /*verilator public*/ = 1;
+// To the fetch at mepc
+localparam TIMING_MRET /*verilator public*/ = 3;
@@ -0,0 +1,59 @@
+// Bus slave template for register-based peripherals (see bus_xbar.v for the
+// protocol).
+//
+// Takes a request every cycle and answers it on the next. The peripheral sees
+// each access as a single-cycle read or write strobe, with the address given
+// as an offset from BASE, and returns read data and errors in the same cycle.
+// Write data and mask are on their byte lanes, as on the bus.
+module bus_regs #(
+  parameter BASE = 32'h0,
+  parameter ADDR_BITS = 4
+) (
+  input                  clk_i,
+  input                  rst_i,
+
+  input                  req_valid_i,
+  output                 req_ready_o,
+  input [31:0]           req_addr_i,
+  input                  req_we_i,
+  input [31:0]           req_wdata_i,
+  input [3:0]            req_mask_i,
+  output reg             rsp_valid_o,
+  output reg [31:0]      rsp_rdata_o,
+  output reg             rsp_error_o,
+
+  output                 reg_read_o,
+  output                 reg_write_o,
+  output [ADDR_BITS-1:0] reg_addr_o,
+  output [31:0]          reg_wdata_o,
+  output [3:0]           reg_mask_o,
+  input [31:0]           reg_rdata_i,
+  input                  reg_error_i
+);
+
+  // The crossbar only sends requests within the peripheral's range
+  /* verilator lint_off UNUSED */
+  wire [31:0] offset;
+  /* verilator lint_on UNUSED */
+  assign offset = req_addr_i - BASE;
+
+  assign req_ready_o = 1'b1;
+
+  assign reg_read_o = req_valid_i && !req_we_i;
+  assign reg_write_o = req_valid_i && req_we_i;
+  assign reg_addr_o = offset[ADDR_BITS-1:0];
+  assign reg_wdata_o = req_wdata_i;
+  assign reg_mask_o = req_mask_i;
+
+  always @(posedge clk_i) begin
+    if (rst_i) begin
+      rsp_valid_o <= 1'b0;
+      rsp_error_o <= 1'b0;
+    end else begin
+      rsp_valid_o <= req_valid_i;
+      rsp_error_o <= req_valid_i && reg_error_i;
+    end
+    rsp_rdata_o <= reg_read_o ? reg_rdata_i : 32'b0;
+  end
+
+endmodule
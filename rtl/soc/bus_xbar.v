@@ -0,0 +1,218 @@
+// Crossbar connecting NUM_MASTERS bus masters to NUM_SLAVES slaves.
+//
+// Bus protocol: a request (address, write enable, write data and byte mask)
+// transfers when req_valid and req_ready are both high. Write data and mask
+// are aligned to their byte lanes. Every request gets exactly one response,
+// rsp_valid high for a cycle along with read data and an error flag, at least
+// a cycle after the request and in the order requests were made. Responses
+// can't be stalled. Masters may have several requests outstanding.
+//
+// Requests also carry USER_BITS of sideband, which the crossbar passes on to
+// the slave untouched. The SoC uses it to tag exclusive accesses with their
+// hart, see resv_monitor.v.
+//
+// Slave i covers SLAVE_SIZE[i] bytes from SLAVE_BASE[i], packed 32 bits per
+// slave with slave 0 in the low bits. Requests to unmapped addresses get an
+// error response from the crossbar itself.
+//
+// Each master's request is registered along with its decoded slave before
+// being passed on, so the address comparators aren't in the path to the
+// slaves. To keep responses in order, a master only sends to a different
+// slave once everything it has outstanding has come back, and each slave
+// serves one master at a time. When a slave is free, the masters waiting for
+// it take turns: the lowest-numbered one above its last owner wins, wrapping
+// around to master 0. A master can keep issuing to a slave it owns until
+// someone else is waiting for it.
+module bus_xbar #(
+  parameter NUM_MASTERS = 1,
+  parameter NUM_SLAVES = 1,
+  parameter [32*NUM_SLAVES-1:0] SLAVE_BASE = 0,
+  parameter [32*NUM_SLAVES-1:0] SLAVE_SIZE = 0,
+  parameter MAX_OUTSTANDING = 4, // per master
+  parameter USER_BITS = 1
+) (
+  input                           clk_i,
+  input                           rst_i,
+
+  input [NUM_MASTERS-1:0]         m_req_valid_i,
+  output reg [NUM_MASTERS-1:0]    m_req_ready_o,
+  input [32*NUM_MASTERS-1:0]      m_req_addr_i,
+  input [NUM_MASTERS-1:0]         m_req_we_i,
+  input [32*NUM_MASTERS-1:0]      m_req_wdata_i,
+  input [4*NUM_MASTERS-1:0]       m_req_mask_i,
+  input [USER_BITS*NUM_MASTERS-1:0] m_req_user_i,
+  output reg [NUM_MASTERS-1:0]    m_rsp_valid_o,
+  output reg [32*NUM_MASTERS-1:0] m_rsp_rdata_o,
+  output reg [NUM_MASTERS-1:0]    m_rsp_error_o,
+
+  output reg [NUM_SLAVES-1:0]     s_req_valid_o,
+  input [NUM_SLAVES-1:0]          s_req_ready_i,
+  output reg [32*NUM_SLAVES-1:0]  s_req_addr_o,
+  output reg [NUM_SLAVES-1:0]     s_req_we_o,
+  output reg [32*NUM_SLAVES-1:0]  s_req_wdata_o,
+  output reg [4*NUM_SLAVES-1:0]   s_req_mask_o,
+  output reg [USER_BITS*NUM_SLAVES-1:0] s_req_user_o,
+  input [NUM_SLAVES-1:0]          s_rsp_valid_i,
+  input [32*NUM_SLAVES-1:0]       s_rsp_rdata_i,
+  input [NUM_SLAVES-1:0]          s_rsp_error_i
+);
+
+  // Slave index NUM_SLAVES stands for "unmapped"
+  localparam SEL_BITS = $clog2(NUM_SLAVES + 1);
+  localparam ID_BITS = NUM_MASTERS > 1 ? $clog2(NUM_MASTERS) : 1;
+  localparam CNT_BITS = $clog2(MAX_OUTSTANDING + 1);
+
+  localparam [SEL_BITS-1:0] UNMAPPED = NUM_SLAVES[SEL_BITS-1:0];
+  localparam [CNT_BITS-1:0] CNT_MAX = MAX_OUTSTANDING[CNT_BITS-1:0];
+
+  function [SEL_BITS-1:0] decode;
+    input [31:0] addr;
+    integer k;
+    begin
+      decode = UNMAPPED;
+      for (k = 0; k < NUM_SLAVES; k = k + 1) begin
+        // Wraps around for addresses below the base
+        if (addr - SLAVE_BASE[32*k +: 32] < SLAVE_SIZE[32*k +: 32])
+          decode = k[SEL_BITS-1:0];
+      end
+    end
+  endfunction
+
+  // Registered requests, one per master
+  reg [NUM_MASTERS-1:0] st_valid_q;
+  reg [31:0]            st_addr_q [0:NUM_MASTERS-1];
+  reg [NUM_MASTERS-1:0] st_we_q;
+  reg [31:0]            st_wdata_q [0:NUM_MASTERS-1];
+  reg [3:0]             st_mask_q [0:NUM_MASTERS-1];
+  reg [USER_BITS-1:0]   st_user_q [0:NUM_MASTERS-1];
+  reg [SEL_BITS-1:0]    st_sel_q [0:NUM_MASTERS-1];
+
+  // Requests each master has outstanding, all to m_slave_q
+  reg [CNT_BITS-1:0]    m_count_q [0:NUM_MASTERS-1];
+  reg [SEL_BITS-1:0]    m_slave_q [0:NUM_MASTERS-1];
+  // Error response for an unmapped request, sent the cycle after it's taken
+  reg [NUM_MASTERS-1:0] m_unmapped_q;
+
+  // Requests each slave has outstanding, all from s_owner_q
+  reg [CNT_BITS-1:0]    s_count_q [0:NUM_SLAVES-1];
+  reg [ID_BITS-1:0]     s_owner_q [0:NUM_SLAVES-1];
+
+  reg [NUM_MASTERS-1:0] m_can_issue;
+  reg [NUM_MASTERS-1:0] m_fire;
+  reg [NUM_MASTERS-1:0] waiting;
+  reg [NUM_MASTERS-1:0] others;
+  reg [NUM_SLAVES-1:0]  s_fire;
+  reg [ID_BITS-1:0]     s_grant [0:NUM_SLAVES-1];
+
+  integer m, s, i, j;
+
+  always @(*) begin
+    for (m = 0; m < NUM_MASTERS; m = m + 1) begin
+      m_can_issue[m] = st_valid_q[m] &&
+                       (m_count_q[m] == 0 ||
+                        (m_slave_q[m] == st_sel_q[m] && m_count_q[m] != CNT_MAX));
+      // The crossbar answers unmapped requests itself, so they never wait
+      m_fire[m] = m_can_issue[m] && st_sel_q[m] == UNMAPPED;
+    end
+
+    for (s = 0; s < NUM_SLAVES; s = s + 1) begin
+      for (m = 0; m < NUM_MASTERS; m = m + 1)
+        waiting[m] = m_can_issue[m] && st_sel_q[m] == s[SEL_BITS-1:0];
+
+      others = waiting;
+      s_req_valid_o[s] = 1'b0;
+      s_grant[s] = {ID_BITS{1'b0}};
+      if (s_count_q[s] != 0) begin
+        // Only the owner may add to what's outstanding, and only if no one
+        // else wants a turn
+        others[s_owner_q[s]] = 1'b0;
+        if (waiting[s_owner_q[s]] && others == 0) begin
+          s_req_valid_o[s] = 1'b1;
+          s_grant[s] = s_owner_q[s];
+        end
+      end else begin
+        for (m = NUM_MASTERS - 1; m >= 0; m = m - 1) begin
+          if (waiting[m]) begin
+            s_req_valid_o[s] = 1'b1;
+            s_grant[s] = m[ID_BITS-1:0];
+          end
+        end
+        // Round-robin: prefer masters after the last owner
+        for (m = NUM_MASTERS - 1; m >= 0; m = m - 1) begin
+          if (waiting[m] && m[ID_BITS-1:0] > s_owner_q[s])
+            s_grant[s] = m[ID_BITS-1:0];
+        end
+      end
+
+      s_req_addr_o[32*s +: 32] = st_addr_q[s_grant[s]];
+      s_req_we_o[s] = st_we_q[s_grant[s]];
+      s_req_wdata_o[32*s +: 32] = st_wdata_q[s_grant[s]];
+      s_req_mask_o[4*s +: 4] = st_mask_q[s_grant[s]];
+      s_req_user_o[USER_BITS*s +: USER_BITS] = st_user_q[s_grant[s]];
+
+      s_fire[s] = s_req_valid_o[s] && s_req_ready_i[s];
+      if (s_fire[s])
+        m_fire[s_grant[s]] = 1'b1;
+    end
+
+    for (m = 0; m < NUM_MASTERS; m = m + 1) begin
+      m_req_ready_o[m] = !st_valid_q[m] || m_fire[m];
+
+      m_rsp_valid_o[m] = m_unmapped_q[m];
+      m_rsp_rdata_o[32*m +: 32] = 32'b0;
+      m_rsp_error_o[m] = m_unmapped_q[m];
+      for (s = 0; s < NUM_SLAVES; s = s + 1) begin
+        if (s_rsp_valid_i[s] && s_count_q[s] != 0 && s_owner_q[s] == m[ID_BITS-1:0]) begin
+          m_rsp_valid_o[m] = 1'b1;
+          m_rsp_rdata_o[32*m +: 32] = s_rsp_rdata_i[32*s +: 32];
+          m_rsp_error_o[m] = s_rsp_error_i[s];
+        end
+      end
+    end
+  end
+
+  always @(posedge clk_i) begin
+    if (rst_i) begin
+      st_valid_q <= {NUM_MASTERS{1'b0}};
+      m_unmapped_q <= {NUM_MASTERS{1'b0}};
+      for (i = 0; i < NUM_MASTERS; i = i + 1)
+        m_count_q[i] <= {CNT_BITS{1'b0}};
+      for (j = 0; j < NUM_SLAVES; j = j + 1) begin
+        s_count_q[j] <= {CNT_BITS{1'b0}};
+        s_owner_q[j] <= {ID_BITS{1'b0}};
+      end
+    end else begin
+      for (i = 0; i < NUM_MASTERS; i = i + 1) begin
+        if (m_req_ready_o[i]) begin
+          st_valid_q[i] <= m_req_valid_i[i];
+          st_addr_q[i] <= m_req_addr_i[32*i +: 32];
+          st_we_q[i] <= m_req_we_i[i];
+          st_wdata_q[i] <= m_req_wdata_i[32*i +: 32];
+          st_mask_q[i] <= m_req_mask_i[4*i +: 4];
+          st_user_q[i] <= m_req_user_i[USER_BITS*i +: USER_BITS];
+          st_sel_q[i] <= decode(m_req_addr_i[32*i +: 32]);
+        end
+
+        if (m_fire[i])
+          m_slave_q[i] <= st_sel_q[i];
+        m_unmapped_q[i] <= m_fire[i] && st_sel_q[i] == UNMAPPED;
+
+        if (m_fire[i] && !m_rsp_valid_o[i])
+          m_count_q[i] <= m_count_q[i] + 1'b1;
+        else if (!m_fire[i] && m_rsp_valid_o[i])
+          m_count_q[i] <= m_count_q[i] - 1'b1;
+      end
+
+      for (j = 0; j < NUM_SLAVES; j = j + 1) begin
+        if (s_fire[j])
+          s_owner_q[j] <= s_grant[j];
+
+        if (s_fire[j] && !(s_rsp_valid_i[j] && s_count_q[j] != 0))
+          s_count_q[j] <= s_count_q[j] + 1'b1;
+        else if (!s_fire[j] && s_rsp_valid_i[j] && s_count_q[j] != 0)
+          s_count_q[j] <= s_count_q[j] - 1'b1;
+      end
+    end
+  end
+
+endmodule
@@ -0,0 +1,60 @@
+// Connects one of Lemoncore's memory ports to a bus master port (see
+// bus_xbar.v for the protocol).
+//
+// The core holds a request until its response comes back, including through
+// the cycle the response arrives, so the bridge only sends a request once.
+// Data and masks are shifted between the core's low-aligned form and the bus'
+// byte lanes. If the core gives up on a request (it drops valid when an
+// interrupt comes in), the response is swallowed.
+module core_bridge (
+  input         clk_i,
+  input         rst_i,
+
+  input         req_valid_i,
+  input [31:0]  req_addr_i,
+  input         req_we_i,
+  input [31:0]  req_data_i,
+  input [3:0]   req_mask_i,
+  output        res_valid_o,
+  output [31:0] res_data_o,
+  output        res_error_o,
+
+  output        bus_req_valid_o,
+  input         bus_req_ready_i,
+  output [31:0] bus_req_addr_o,
+  output        bus_req_we_o,
+  output [31:0] bus_req_wdata_o,
+  output [3:0]  bus_req_mask_o,
+  input         bus_rsp_valid_i,
+  input [31:0]  bus_rsp_rdata_i,
+  input         bus_rsp_error_i
+);
+
+  reg pending_q;
+  reg abandoned_q;
+
+  assign bus_req_valid_o = req_valid_i && !pending_q;
+  assign bus_req_addr_o = req_addr_i;
+  assign bus_req_we_o = req_we_i;
+  assign bus_req_wdata_o = req_data_i << (8 * req_addr_i[1:0]);
+  assign bus_req_mask_o = req_mask_i << req_addr_i[1:0];
+
+  assign res_valid_o = bus_rsp_valid_i && req_valid_i && !abandoned_q;
+  assign res_data_o = bus_rsp_rdata_i >> (8 * req_addr_i[1:0]);
+  assign res_error_o = bus_rsp_error_i;
+
+  always @(posedge clk_i) begin
+    if (rst_i) begin
+      pending_q <= 1'b0;
+      abandoned_q <= 1'b0;
+    end else if (bus_rsp_valid_i) begin
+      pending_q <= 1'b0;
+      abandoned_q <= 1'b0;
+    end else if (bus_req_valid_o && bus_req_ready_i) begin
+      pending_q <= 1'b1;
+    end else if (pending_q && !req_valid_i) begin
+      abandoned_q <= 1'b1;
+    end
+  end
+
+endmodule
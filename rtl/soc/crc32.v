@@ -0,0 +1,93 @@
+// Reference coprocessor: CRC-32 (IEEE 802.3, reflected) accelerator.
+//
+// Instructions (custom-0, funct7 = 0):
+//   funct3 = 000: rd = crc32_update(rs1, rs2[7:0])
+//   funct3 = 001: rd = crc32_update(rs1, rs2[15:0])
+//   funct3 = 010: rd = crc32_update(rs1, rs2[31:0])
+//
+// rs1 holds the running CRC. The initial value and final inversion are left
+// to software, so a buffer's checksum is ~crc32_update(~0, data...). Anything
+// else gets an error response, which the core turns into an illegal
+// instruction exception.
+//
+// BITS_PER_CYCLE data bits are folded in each cycle, so the latency of an
+// update depends on its width. It must divide 8.
+module crc32 #(
+  parameter BITS_PER_CYCLE = 8
+) (
+  input             clk_i,
+  input             rst_i,
+
+  input             req_valid_i,
+  output            req_ready_o,
+  input             req_custom_i,
+  input [2:0]       req_funct3_i,
+  input [6:0]       req_funct7_i,
+  input [31:0]      req_rs1_i,
+  input [31:0]      req_rs2_i,
+
+  output reg        res_valid_o,
+  output [31:0]     res_data_o,
+  output reg        res_error_o
+  );
+
+  localparam [31:0] POLY = 32'hEDB88320;
+
+  reg        busy_q;
+  reg [31:0] crc_q;
+  reg [31:0] data_q;
+  reg [5:0]  bits_left_q;
+
+  wire legal;
+  assign legal = !req_custom_i && req_funct7_i == 7'b0 &&
+                 (req_funct3_i == 3'b000 || req_funct3_i == 3'b001 ||
+                  req_funct3_i == 3'b010);
+
+  assign req_ready_o = !busy_q;
+  assign res_data_o = crc_q;
+
+  reg [31:0] crc_next;
+  reg [31:0] data_next;
+  integer i;
+  always @(*) begin
+    crc_next = crc_q;
+    data_next = data_q;
+    for (i = 0; i < BITS_PER_CYCLE; i = i + 1) begin
+      crc_next = (crc_next >> 1) ^ (POLY & {32{crc_next[0] ^ data_next[0]}});
+      data_next = data_next >> 1;
+    end
+  end
+
+  always @(posedge clk_i) begin
+    if (rst_i) begin
+      busy_q <= 1'b0;
+      res_valid_o <= 1'b0;
+      res_error_o <= 1'b0;
+    end else if (busy_q) begin
+      crc_q <= crc_next;
+      data_q <= data_next;
+      bits_left_q <= bits_left_q - BITS_PER_CYCLE[5:0];
+      if (bits_left_q == BITS_PER_CYCLE[5:0]) begin
+        busy_q <= 1'b0;
+        res_valid_o <= 1'b1;
+        res_error_o <= 1'b0;
+      end
+    end else if (req_valid_i) begin
+      if (legal) begin
+        busy_q <= 1'b1;
+        crc_q <= req_rs1_i;
+        data_q <= req_rs2_i;
+        bits_left_q <= (req_funct3_i == 3'b000) ? 6'd8 :
+                       (req_funct3_i == 3'b001) ? 6'd16 : 6'd32;
+        res_valid_o <= 1'b0;
+      end else begin
+        res_valid_o <= 1'b1;
+        res_error_o <= 1'b1;
+      end
+    end else begin
+      res_valid_o <= 1'b0;
+      res_error_o <= 1'b0;
+    end
+  end
+
+endmodule
@@ -0,0 +1,240 @@
+// Memory-to-memory DMA engine. Firmware fills in a transfer through the
+// registers below and starts it; the engine then moves it as a bus master of
+// its own, in bursts of up to BURST words: all of a burst's reads, then all of
+// its writes.
+//
+// Registers (offsets from DMA_BASE):
+//   0x00 src: source address, word-aligned
+//   0x04 dst: destination address, word-aligned
+//   0x08 len: bytes to move, rounded down to whole words
+//   0x0C ctrl: writing bit 0 starts a transfer. Bit 1 selects fill mode,
+//        which writes the fill register instead of reading src. Bits 2 and 3
+//        keep src and dst fixed rather than incrementing, for peripheral
+//        registers. Bit 4 enables the completion interrupt. Reads return
+//        busy in bit 0 and the other bits as written.
+//   0x10 status: bit 0 busy, bit 1 done, bit 2 error. Write 1s to clear done
+//        and error.
+//   0x14 fill: word written in fill mode
+//
+// src, dst and len advance as the transfer goes, and can't be written while
+// it's busy, and neither can the mode bits of ctrl. A bus error stops the
+// transfer at the end of its burst, with error and done both set; the writes
+// of a burst whose reads failed are skipped.
+//
+// The interrupt is level-triggered: it stays up while done is set and
+// enabled. There is no flow control with peripherals, so a transfer to or
+// from one only works if it can take a word every few cycles.
+module dma #(
+  // A power of two, no more than the crossbar's MAX_OUTSTANDING
+  parameter BURST = 4
+) (
+  input             clk_i,
+  input             rst_i,
+
+  input             req_valid_i,
+  output            req_ready_o,
+  input [31:0]      req_addr_i,
+  input             req_we_i,
+  input [31:0]      req_wdata_i,
+  input [3:0]       req_mask_i,
+  output            rsp_valid_o,
+  output [31:0]     rsp_rdata_o,
+  output            rsp_error_o,
+
+  output            bus_req_valid_o,
+  input             bus_req_ready_i,
+  output [31:0]     bus_req_addr_o,
+  output            bus_req_we_o,
+  output [31:0]     bus_req_wdata_o,
+  output [3:0]      bus_req_mask_o,
+  input             bus_rsp_valid_i,
+  input [31:0]      bus_rsp_rdata_i,
+  input             bus_rsp_error_i,
+
+  output            busy_o,
+  output            irq_o
+);
+
+`include "memmap.vh"
+
+  localparam CNT_BITS = $clog2(BURST + 1);
+
+  wire        reg_write;
+  wire [4:0]  reg_addr;
+  wire [31:0] reg_wdata;
+  reg [31:0]  reg_rdata;
+  reg         reg_error;
+  // Reads have no side effects, and registers are only written as whole words
+  /* verilator lint_off UNUSED */
+  wire        reg_read;
+  wire [3:0]  reg_mask;
+  /* verilator lint_on UNUSED */
+
+  bus_regs #(
+    .BASE(DMA_BASE),
+    .ADDR_BITS(5)
+  ) regs (
+    .clk_i(clk_i),
+    .rst_i(rst_i),
+
+    .req_valid_i(req_valid_i),
+    .req_ready_o(req_ready_o),
+    .req_addr_i(req_addr_i),
+    .req_we_i(req_we_i),
+    .req_wdata_i(req_wdata_i),
+    .req_mask_i(req_mask_i),
+    .rsp_valid_o(rsp_valid_o),
+    .rsp_rdata_o(rsp_rdata_o),
+    .rsp_error_o(rsp_error_o),
+
+    .reg_read_o(reg_read),
+    .reg_write_o(reg_write),
+    .reg_addr_o(reg_addr),
+    .reg_wdata_o(reg_wdata),
+    .reg_mask_o(reg_mask),
+    .reg_rdata_i(reg_rdata),
+    .reg_error_i(reg_error)
+  );
+
+  localparam STATE_IDLE = 2'd0;
+  localparam STATE_READ = 2'd1;
+  localparam STATE_WRITE = 2'd2;
+
+  reg [1:0]  state_q;
+  reg [31:0] src_q;
+  reg [31:0] dst_q;
+  reg [29:0] len_q;  // words not yet in a burst
+  reg [31:0] fill_q;
+  reg        fill_mode_q;
+  reg        src_fixed_q;
+  reg        dst_fixed_q;
+  reg        ie_q;
+  reg        done_q;
+  reg        error_q;
+
+  reg [31:0]         burst_data_q [0:BURST-1];
+  reg [CNT_BITS-1:0] burst_len_q;  // words in the current burst
+  reg [CNT_BITS-1:0] issued_q;     // requests sent in this phase
+  reg [CNT_BITS-1:0] answered_q;   // responses back in this phase
+
+  wire busy;
+  assign busy = state_q != STATE_IDLE;
+  assign busy_o = busy;
+
+  // Next burst's length, and whether this phase's last response is arriving
+  wire [CNT_BITS-1:0] next_burst;
+  wire                phase_done;
+  assign next_burst = len_q < BURST ? len_q[CNT_BITS-1:0] : BURST[CNT_BITS-1:0];
+  assign phase_done = bus_rsp_valid_i && answered_q + 1'b1 == burst_len_q;
+
+  assign bus_req_valid_o = busy && issued_q != burst_len_q;
+  assign bus_req_addr_o = state_q == STATE_READ ? src_q : dst_q;
+  assign bus_req_we_o = state_q == STATE_WRITE;
+  assign bus_req_wdata_o = fill_mode_q ? fill_q : burst_data_q[issued_q[CNT_BITS-2:0]];
+  assign bus_req_mask_o = 4'b1111;
+
+  wire start;
+  assign start = reg_write && reg_addr == 5'h0C && reg_wdata[0] && !busy;
+
+  always @(posedge clk_i) begin
+    if (rst_i) begin
+      state_q <= STATE_IDLE;
+      ie_q <= 1'b0;
+      done_q <= 1'b0;
+      error_q <= 1'b0;
+      fill_mode_q <= 1'b0;
+      src_fixed_q <= 1'b0;
+      dst_fixed_q <= 1'b0;
+    end else begin
+      if (reg_write) begin
+        case (reg_addr)
+          5'h00: if (!busy) src_q <= reg_wdata;
+          5'h04: if (!busy) dst_q <= reg_wdata;
+          5'h08: if (!busy) len_q <= reg_wdata[31:2];
+          5'h0C: begin
+            ie_q <= reg_wdata[4];
+            if (!busy) begin
+              fill_mode_q <= reg_wdata[1];
+              src_fixed_q <= reg_wdata[2];
+              dst_fixed_q <= reg_wdata[3];
+            end
+          end
+          5'h10: begin
+            if (reg_wdata[1])
+              done_q <= 1'b0;
+            if (reg_wdata[2])
+              error_q <= 1'b0;
+          end
+          5'h14: fill_q <= reg_wdata;
+          default: ;
+        endcase
+      end
+
+      if (start) begin
+        done_q <= 1'b0;
+        error_q <= 1'b0;
+        // An empty transfer is done straight away
+        if (len_q == 30'd0) begin
+          done_q <= 1'b1;
+        end else begin
+          state_q <= reg_wdata[1] ? STATE_WRITE : STATE_READ;
+          burst_len_q <= next_burst;
+          len_q <= len_q - {{(30-CNT_BITS){1'b0}}, next_burst};
+          issued_q <= {CNT_BITS{1'b0}};
+          answered_q <= {CNT_BITS{1'b0}};
+        end
+      end
+
+      if (bus_req_valid_o && bus_req_ready_i) begin
+        issued_q <= issued_q + 1'b1;
+        if (state_q == STATE_READ && !src_fixed_q)
+          src_q <= src_q + 32'd4;
+        if (state_q == STATE_WRITE && !dst_fixed_q)
+          dst_q <= dst_q + 32'd4;
+      end
+
+      if (bus_rsp_valid_i) begin
+        answered_q <= answered_q + 1'b1;
+        if (state_q == STATE_READ)
+          burst_data_q[answered_q[CNT_BITS-2:0]] <= bus_rsp_rdata_i;
+        if (bus_rsp_error_i)
+          error_q <= 1'b1;
+      end
+
+      // Only move on once every response is back, so a later burst never
+      // overtakes an earlier one
+      if (phase_done) begin
+        issued_q <= {CNT_BITS{1'b0}};
+        answered_q <= {CNT_BITS{1'b0}};
+        if (error_q || bus_rsp_error_i || (state_q == STATE_WRITE && len_q == 30'd0)) begin
+          state_q <= STATE_IDLE;
+          done_q <= 1'b1;
+        end else if (state_q == STATE_READ) begin
+          state_q <= STATE_WRITE;
+        end else begin
+          state_q <= fill_mode_q ? STATE_WRITE : STATE_READ;
+          burst_len_q <= next_burst;
+          len_q <= len_q - {{(30-CNT_BITS){1'b0}}, next_burst};
+        end
+      end
+    end
+  end
+
+  always @(*) begin
+    reg_rdata = 32'b0;
+    reg_error = 1'b0;
+
+    case (reg_addr)
+      5'h00: reg_rdata = src_q;
+      5'h04: reg_rdata = dst_q;
+      5'h08: reg_rdata = {len_q, 2'b0};
+      5'h0C: reg_rdata = {27'b0, ie_q, dst_fixed_q, src_fixed_q, fill_mode_q, busy};
+      5'h10: reg_rdata = {29'b0, error_q, done_q, busy};
+      5'h14: reg_rdata = fill_q;
+      default: reg_error = 1'b1;
+    endcase
+  end
+
+  assign irq_o = ie_q && done_q;
+
+endmodule
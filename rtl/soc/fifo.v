@@ -0,0 +1,58 @@
+// Synchronous FIFO with valid/ready on both sides. DEPTH must be a power of
+// two. Data pushed in one cycle can be popped the next.
+module fifo #(
+  parameter WIDTH = 8,
+  parameter DEPTH = 16
+) (
+  input                        clk_i,
+  input                        rst_i,
+
+  input                        push_valid_i,
+  output                       push_ready_o,
+  input [WIDTH-1:0]            push_data_i,
+
+  output                       pop_valid_o,
+  input                        pop_ready_i,
+  output [WIDTH-1:0]           pop_data_o,
+
+  // Number of entries, 0 to DEPTH
+  output [$clog2(DEPTH+1)-1:0] level_o
+);
+
+  localparam PTR_BITS = $clog2(DEPTH);
+
+  reg [WIDTH-1:0]  mem [0:DEPTH-1];
+  // One extra bit to tell full from empty
+  reg [PTR_BITS:0]  rd_ptr_q;
+  reg [PTR_BITS:0]  wr_ptr_q;
+
+  wire [PTR_BITS:0] count;
+  assign count = wr_ptr_q - rd_ptr_q;
+
+  assign push_ready_o = count != DEPTH[PTR_BITS:0];
+  assign pop_valid_o = count != 0;
+  assign pop_data_o = mem[rd_ptr_q[PTR_BITS-1:0]];
+  assign level_o = count;
+
+  wire push, pop;
+  assign push = push_valid_i && push_ready_o;
+  assign pop = pop_valid_o && pop_ready_i;
+
+  always @(posedge clk_i) begin
+    if (push)
+      mem[wr_ptr_q[PTR_BITS-1:0]] <= push_data_i;
+  end
+
+  always @(posedge clk_i) begin
+    if (rst_i) begin
+      rd_ptr_q <= {(PTR_BITS+1){1'b0}};
+      wr_ptr_q <= {(PTR_BITS+1){1'b0}};
+    end else begin
+      if (push)
+        wr_ptr_q <= wr_ptr_q + 1'b1;
+      if (pop)
+        rd_ptr_q <= rd_ptr_q + 1'b1;
+    end
+  end
+
+endmodule
@@ -2,25 +2,15 @@ module gpio (
   input             clk_i,
   input             rst_i,
 
-  input             write_req_valid_i,
-  input [31:0]      write_req_addr_i,
-
-  // Lint complains since we only use the least significant bit of the written
-  // data, but we're keeping the port at its full width so the interfaces are
-  // consistent (and we may use the rest in the future).
-  /* verilator lint_off UNUSED */
-  input [31:0]      write_req_data_i,
-  input [3:0]       write_req_mask_i,
-  /* verilator lint_on UNUSED */
-
-  output reg        write_res_valid_o,
-  output reg        write_res_error_o,
-
-  input             read_req_valid_i,
-  input [31:0]      read_req_addr_i,
-  output reg [31:0] read_res_data_o,
-  output reg        read_res_valid_o,
-  output reg        read_res_error_o,
+  input             req_valid_i,
+  output            req_ready_o,
+  input [31:0]      req_addr_i,
+  input             req_we_i,
+  input [31:0]      req_wdata_i,
+  input [3:0]       req_mask_i,
+  output            rsp_valid_o,
+  output [31:0]     rsp_rdata_o,
+  output            rsp_error_o,
 
   input [2:0]       buttons_i,
   output reg [4:0]  user_leds_o,
@@ -30,57 +20,78 @@ module gpio (
 
 `include "memmap.vh"
 
+  wire        reg_read;
+  wire        reg_write;
+  wire [3:0]  reg_addr;
+  // Lint complains since we only use the least significant byte of the
+  // written data, but we're keeping the port at its full width so the
+  // interfaces are consistent (and we may use the rest in the future).
+  /* verilator lint_off UNUSED */
+  wire [31:0] reg_wdata;
+  wire [3:0]  reg_mask;
+  /* verilator lint_on UNUSED */
+  reg [31:0]  reg_rdata;
+  reg         reg_error;
+
+  bus_regs #(
+    .BASE(GPIO_BASE),
+    .ADDR_BITS(4)
+  ) regs (
+    .clk_i(clk_i),
+    .rst_i(rst_i),
+
+    .req_valid_i(req_valid_i),
+    .req_ready_o(req_ready_o),
+    .req_addr_i(req_addr_i),
+    .req_we_i(req_we_i),
+    .req_wdata_i(req_wdata_i),
+    .req_mask_i(req_mask_i),
+    .rsp_valid_o(rsp_valid_o),
+    .rsp_rdata_o(rsp_rdata_o),
+    .rsp_error_o(rsp_error_o),
+
+    .reg_read_o(reg_read),
+    .reg_write_o(reg_write),
+    .reg_addr_o(reg_addr),
+    .reg_wdata_o(reg_wdata),
+    .reg_mask_o(reg_mask),
+    .reg_rdata_i(reg_rdata),
+    .reg_error_i(reg_error)
+  );
+
   // Writes
   always @(posedge clk_i) begin
     if (rst_i) begin
       user_leds_o <= 5'b0;
       done_led_o <= 1'b0;
       exception_led_o <= 1'b0;
-      write_res_valid_o <= 1'b0;
-    end else if (write_req_valid_i) begin
-      if (write_req_addr_i == GPIO_BASE) begin
-        if (write_req_mask_i[0])
-          user_leds_o <= write_req_data_i[4:0];
-        write_res_valid_o <= 1'b1;
-        write_res_error_o <= 1'b0;
-      end else if (write_req_addr_i == GPIO_BASE + 32'h4) begin
-        if (write_req_mask_i[0]) begin
-          done_led_o <= write_req_data_i[0];
-          exception_led_o <= write_req_data_i[1];
+    end else if (reg_write) begin
+      if (reg_addr == 4'h0) begin
+        if (reg_mask[0])
+          user_leds_o <= reg_wdata[4:0];
+      end else if (reg_addr == 4'h4) begin
+        if (reg_mask[0]) begin
+          done_led_o <= reg_wdata[0];
+          exception_led_o <= reg_wdata[1];
         end
-        write_res_valid_o <= 1'b1;
-        write_res_error_o <= 1'b0;
-      end else begin
-        write_res_valid_o <= 1'b0;
-        write_res_error_o <= 1'b1;
       end
-    end else begin
-      write_res_valid_o <= 1'b0;
-      write_res_error_o <= 1'b0;
     end
   end
 
-  // Reads
+  // Reads, plus errors for accesses to anything but the registers
   always @(*) begin
-    read_res_data_o = 32'b0;
-    read_res_valid_o = 1'b0;
-    read_res_error_o = 1'b0;
+    reg_rdata = 32'b0;
+    reg_error = 1'b0;
 
-    if (read_req_valid_i) begin
-      if (read_req_addr_i == GPIO_BASE) begin
-        read_res_data_o = {27'b0, user_leds_o};
-        read_res_valid_o = 1'b1;
-      end else if (read_req_addr_i == GPIO_BASE + 32'h4) begin
-        read_res_data_o = {30'b0, exception_led_o, done_led_o};
-        read_res_valid_o = 1'b1;
-      end else if (read_req_addr_i == GPIO_BASE + 32'h8) begin
-        read_res_data_o = {29'b0, buttons_i};
-        read_res_valid_o = 1'b1;
-      end else begin
-        read_res_error_o = 1'b1;
-      end
+    if (reg_addr == 4'h0) begin
+      reg_rdata = {27'b0, user_leds_o};
+    end else if (reg_addr == 4'h4) begin
+      reg_rdata = {30'b0, exception_led_o, done_led_o};
+    end else if (reg_addr == 4'h8 && reg_read) begin
+      reg_rdata = {29'b0, buttons_i};
+    end else begin
+      reg_error = 1'b1;
     end
   end
 
-
 endmodule
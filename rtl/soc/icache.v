@@ -0,0 +1,211 @@
+// Read-only cache in front of the QSPI flash, used for instruction fetches
+// (and any loads) from the flash region at BASE. A bus slave (see bus_xbar.v)
+// that handles one request at a time. Writes get an error response.
+//
+// WAYS is 1 (direct-mapped) or 2 (LRU replacement), each way holding SETS
+// lines of LINE_WORDS words. Both must be powers of two, and LINE_WORDS at
+// least 2. Data lives in block RAM and tags in flip-flops, both read on the
+// clock edge, so a lookup takes a cycle and a hit is answered the cycle after
+// the request, the same as ram. On a miss the
+// whole line is fetched from flash and written into the victim way a word per
+// cycle, and the request is answered along with the last write.
+module icache #(
+  parameter BASE = 32'h0,
+  parameter WAYS = 1,
+  parameter SETS = 64,
+  parameter LINE_WORDS = 4
+) (
+  input                         clk_i,
+  input                         rst_i,
+
+  input                         req_valid_i,
+  output                        req_ready_o,
+  input [31:0]                  req_addr_i,
+  input                         req_we_i,
+  // Nothing can be written
+  /* verilator lint_off UNUSED */
+  input [31:0]                  req_wdata_i,
+  input [3:0]                   req_mask_i,
+  /* verilator lint_on UNUSED */
+  output                        rsp_valid_o,
+  output reg [31:0]             rsp_rdata_o,
+  output                        rsp_error_o,
+
+  output reg                    fill_req_valid_o,
+  output [23:0]                 fill_req_addr_o,
+  input                         fill_res_valid_i,
+  input [32*LINE_WORDS-1:0]     fill_res_data_i
+);
+
+  localparam WORD_BITS = $clog2(LINE_WORDS);
+  localparam INDEX_BITS = $clog2(SETS);
+  localparam TAG_BITS = 24 - 2 - WORD_BITS - INDEX_BITS;
+
+  localparam ST_LOOKUP = 0;
+  localparam ST_FILL = 1;
+  localparam ST_WRITE = 2;
+
+  // Hit/miss counters for sizing the cache, read from the simulation harness
+  reg [31:0] hits_q /*verilator public*/;
+  reg [31:0] misses_q /*verilator public*/;
+
+  // Only the word offset into the 16 MiB flash is used
+  /* verilator lint_off UNUSED */
+  wire [31:0] offset;
+  /* verilator lint_on UNUSED */
+  assign offset = req_addr_i - BASE;
+
+  wire [WORD_BITS-1:0]  word;
+  wire [INDEX_BITS-1:0] index;
+  wire [TAG_BITS-1:0]   tag;
+  assign word = offset[2 +: WORD_BITS];
+  assign index = offset[2 + WORD_BITS +: INDEX_BITS];
+  assign tag = offset[23 -: TAG_BITS];
+
+  reg [1:0] state_q;
+  reg       lookup_q; // request taken last cycle, result of the lookup is in
+  reg       write_q;  // ...and it was a write
+  reg [WORD_BITS-1:0]  word_q;
+  reg [INDEX_BITS-1:0] index_q;
+  reg [TAG_BITS-1:0]   tag_q;
+
+  // Fill bookkeeping
+  reg [WORD_BITS-1:0]  fill_word_q;
+  reg                  victim_q;
+  wire                 fill_write;
+  assign fill_write = state_q == ST_WRITE;
+  assign fill_req_addr_o = {tag_q, index_q, {(WORD_BITS + 2){1'b0}}};
+
+  wire [31:0] fill_word_data;
+  assign fill_word_data = fill_res_data_i[32*fill_word_q +: 32];
+
+  // Per-way lookup results
+  wire [WAYS-1:0]    way_hit;
+  wire [32*WAYS-1:0] way_data;
+
+  assign req_ready_o = state_q == ST_LOOKUP && !lookup_q;
+
+  wire lookup;
+  assign lookup = req_valid_i && req_ready_o;
+
+  genvar w;
+  generate
+    for (w = 0; w < WAYS; w = w + 1) begin : gen_way
+      reg [31:0]         data_mem [0:SETS*LINE_WORDS-1];
+      // Kept out of block RAM, which the UP5K has none left of
+      (* ram_style = "logic" *)
+      reg [TAG_BITS-1:0] tag_mem [0:SETS-1];
+      reg [SETS-1:0]     valid_q;
+      reg [31:0]         data_rd;
+      reg [TAG_BITS-1:0] tag_rd;
+
+      wire fill_this_way;
+      assign fill_this_way = fill_write && (victim_q ? w == 1 : w == 0);
+
+      always @(posedge clk_i) begin
+        data_rd <= data_mem[{index, word}];
+        tag_rd <= tag_mem[index];
+
+        if (fill_this_way) begin
+          data_mem[{index_q, fill_word_q}] <= fill_word_data;
+          if (fill_word_q == 0)
+            tag_mem[index_q] <= tag_q;
+        end
+      end
+
+      always @(posedge clk_i) begin
+        if (rst_i) begin
+          valid_q <= {SETS{1'b0}};
+        end else if (fill_this_way && fill_word_q == LINE_WORDS - 1) begin
+          valid_q[index_q] <= 1'b1;
+        end
+      end
+
+      assign way_hit[w] = valid_q[index_q] && tag_rd == tag_q;
+      assign way_data[32*w +: 32] = data_rd;
+    end
+  endgenerate
+
+  wire hit, miss, fill_done;
+  assign hit = state_q == ST_LOOKUP && lookup_q && !write_q && |way_hit;
+  assign miss = state_q == ST_LOOKUP && lookup_q && !write_q && !(|way_hit);
+  assign fill_done = fill_write && fill_word_q == LINE_WORDS - 1;
+
+  assign rsp_valid_o = hit || fill_done || (lookup_q && write_q);
+  assign rsp_error_o = lookup_q && write_q;
+
+  integer i;
+  always @(*) begin
+    rsp_rdata_o = way_data[31:0];
+    for (i = 0; i < WAYS; i = i + 1) begin
+      if (way_hit[i])
+        rsp_rdata_o = way_data[32*i +: 32];
+    end
+    if (fill_done)
+      rsp_rdata_o = fill_res_data_i[32*word_q +: 32];
+  end
+
+  // Replacement: prefer an invalid way, otherwise the least recently used one
+  /* verilator lint_off UNUSED */
+  reg [SETS-1:0] lru_q; // way to replace next, only used with 2 ways
+  /* verilator lint_on UNUSED */
+  wire victim;
+  generate
+    if (WAYS == 2) begin : gen_lru
+      assign victim = !gen_way[0].valid_q[index_q] ? 1'b0 :
+                      !gen_way[1].valid_q[index_q] ? 1'b1 :
+                      lru_q[index_q];
+    end else begin : gen_no_lru
+      assign victim = 1'b0;
+    end
+  endgenerate
+
+  always @(posedge clk_i) begin
+    if (rst_i) begin
+      state_q <= ST_LOOKUP;
+      lookup_q <= 1'b0;
+      fill_req_valid_o <= 1'b0;
+      lru_q <= {SETS{1'b0}};
+      hits_q <= 32'b0;
+      misses_q <= 32'b0;
+    end else begin
+      case (state_q)
+        ST_LOOKUP: begin
+          lookup_q <= lookup;
+          if (lookup) begin
+            write_q <= req_we_i;
+            word_q <= word;
+            index_q <= index;
+            tag_q <= tag;
+          end
+
+          if (hit) begin
+            hits_q <= hits_q + 32'b1;
+            lru_q[index_q] <= !way_hit[WAYS-1];
+          end else if (miss) begin
+            misses_q <= misses_q + 32'b1;
+            victim_q <= victim;
+            fill_req_valid_o <= 1'b1;
+            state_q <= ST_FILL;
+          end
+        end
+        ST_FILL: begin
+          if (fill_res_valid_i) begin
+            fill_req_valid_o <= 1'b0;
+            fill_word_q <= {WORD_BITS{1'b0}};
+            state_q <= ST_WRITE;
+          end
+        end
+        ST_WRITE: begin
+          fill_word_q <= fill_word_q + 1'b1;
+          if (fill_word_q == LINE_WORDS - 1) begin
+            lru_q[index_q] <= !victim_q;
+            state_q <= ST_LOOKUP;
+          end
+        end
+        default: state_q <= ST_LOOKUP;
+      endcase
+    end
+  end
+
+endmodule
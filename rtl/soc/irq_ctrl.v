@@ -0,0 +1,161 @@
+// Interrupt controller for the external interrupt, a cut-down PLIC. Each
+// edge-triggered source latches a pending bit on the edges selected for it,
+// and the interrupt is raised while any enabled source is pending.
+//
+// Registers (offsets from IRQ_BASE), one bit per source:
+//   0x00 enable
+//   0x04 rising-edge select
+//   0x08 falling-edge select
+//   0x0C pending, write 1s to clear
+//   0x10 claim: reading returns the lowest enabled pending source plus one, or
+//        0 if there is none, and clears its pending bit
+//
+// Edges are latched whether or not the source is enabled, so enabling a source
+// with a stale pending bit fires straight away; clear it first if that's not
+// wanted.
+//
+// Sources set in LEVEL_SOURCES are level-triggered instead: their pending bit
+// just follows the input, and it's up to the device to drop its request once
+// it has been serviced. Edge selects, clears and claims don't affect them.
+module irq_ctrl #(
+  parameter NUM_SOURCES = 3,
+  parameter [NUM_SOURCES-1:0] LEVEL_SOURCES = 0
+) (
+  input                   clk_i,
+  input                   rst_i,
+
+  input                   req_valid_i,
+  output                  req_ready_o,
+  input [31:0]            req_addr_i,
+  input                   req_we_i,
+  input [31:0]            req_wdata_i,
+  input [3:0]             req_mask_i,
+  output                  rsp_valid_o,
+  output [31:0]           rsp_rdata_o,
+  output                  rsp_error_o,
+
+  // Must already be synchronized to clk_i
+  input [NUM_SOURCES-1:0] sources_i,
+  output                  irq_o
+);
+
+`include "memmap.vh"
+
+  wire        reg_read;
+  wire        reg_write;
+  wire [4:0]  reg_addr;
+  // Only the low bits of each register are used
+  /* verilator lint_off UNUSED */
+  wire [31:0] reg_wdata;
+  wire [3:0]  reg_mask;
+  /* verilator lint_on UNUSED */
+  reg [31:0]  reg_rdata;
+  reg         reg_error;
+
+  bus_regs #(
+    .BASE(IRQ_BASE),
+    .ADDR_BITS(5)
+  ) regs (
+    .clk_i(clk_i),
+    .rst_i(rst_i),
+
+    .req_valid_i(req_valid_i),
+    .req_ready_o(req_ready_o),
+    .req_addr_i(req_addr_i),
+    .req_we_i(req_we_i),
+    .req_wdata_i(req_wdata_i),
+    .req_mask_i(req_mask_i),
+    .rsp_valid_o(rsp_valid_o),
+    .rsp_rdata_o(rsp_rdata_o),
+    .rsp_error_o(rsp_error_o),
+
+    .reg_read_o(reg_read),
+    .reg_write_o(reg_write),
+    .reg_addr_o(reg_addr),
+    .reg_wdata_o(reg_wdata),
+    .reg_mask_o(reg_mask),
+    .reg_rdata_i(reg_rdata),
+    .reg_error_i(reg_error)
+  );
+
+  reg [NUM_SOURCES-1:0] enable_q;
+  reg [NUM_SOURCES-1:0] rise_q;
+  reg [NUM_SOURCES-1:0] fall_q;
+  reg [NUM_SOURCES-1:0] pending_q;
+  reg [NUM_SOURCES-1:0] sources_q;
+
+  wire [NUM_SOURCES-1:0] edges;
+  assign edges = ((rise_q & sources_i & ~sources_q) |
+                  (fall_q & ~sources_i & sources_q)) & ~LEVEL_SOURCES;
+
+  // Lowest enabled pending source, for claims
+  wire [NUM_SOURCES-1:0] active;
+  reg [NUM_SOURCES-1:0]  claim_bit;
+  reg [31:0]             claim_id;
+  assign active = pending_q & enable_q;
+
+  integer i;
+  always @(*) begin
+    claim_bit = {NUM_SOURCES{1'b0}};
+    claim_id = 32'b0;
+    for (i = NUM_SOURCES - 1; i >= 0; i = i - 1) begin
+      if (active[i]) begin
+        claim_bit = {NUM_SOURCES{1'b0}};
+        claim_bit[i] = 1'b1;
+        claim_id = i + 1;
+      end
+    end
+  end
+
+  wire claim;
+  assign claim = reg_read && reg_addr == 5'h10;
+
+  always @(posedge clk_i) begin
+    if (rst_i) begin
+      enable_q <= {NUM_SOURCES{1'b0}};
+      rise_q <= {NUM_SOURCES{1'b0}};
+      fall_q <= {NUM_SOURCES{1'b0}};
+      pending_q <= {NUM_SOURCES{1'b0}};
+      sources_q <= sources_i;
+    end else begin
+      sources_q <= sources_i;
+
+      if (reg_write && reg_mask[0]) begin
+        case (reg_addr)
+          5'h00: enable_q <= reg_wdata[NUM_SOURCES-1:0];
+          5'h04: rise_q <= reg_wdata[NUM_SOURCES-1:0];
+          5'h08: fall_q <= reg_wdata[NUM_SOURCES-1:0];
+          default: ;
+        endcase
+      end
+
+      // New edges win over clears in the same cycle
+      if (reg_write && reg_mask[0] && reg_addr == 5'h0C)
+        pending_q <= (pending_q & ~reg_wdata[NUM_SOURCES-1:0] & ~LEVEL_SOURCES) |
+                     edges | (sources_i & LEVEL_SOURCES);
+      else if (claim)
+        pending_q <= (pending_q & ~claim_bit & ~LEVEL_SOURCES) |
+                     edges | (sources_i & LEVEL_SOURCES);
+      else
+        pending_q <= (pending_q & ~LEVEL_SOURCES) |
+                     edges | (sources_i & LEVEL_SOURCES);
+    end
+  end
+
+  always @(*) begin
+    reg_rdata = 32'b0;
+    reg_error = 1'b0;
+
+    case (reg_addr)
+      5'h00: reg_rdata[NUM_SOURCES-1:0] = enable_q;
+      5'h04: reg_rdata[NUM_SOURCES-1:0] = rise_q;
+      5'h08: reg_rdata[NUM_SOURCES-1:0] = fall_q;
+      5'h0C: reg_rdata[NUM_SOURCES-1:0] = pending_q;
+      5'h10: reg_rdata = claim_id;
+      default: reg_error = 1'b1;
+    endcase
+  end
+
+  assign irq_o = |active;
+
+endmodule
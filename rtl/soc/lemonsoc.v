@@ -1,4 +1,19 @@
-module lemonsoc (
+module lemonsoc #(
+  // Core configuration, see lemoncore.v
+  parameter BITMANIP = 1,
+  // Attach the CRC-32 accelerator to the core's coprocessor port
+  parameter COPROCESSOR = 1,
+  parameter STORE_BUFFER = 2,
+  parameter SHADOW_REGS = 1,
+  // Instruction cache in front of the flash: 1 (direct-mapped) or 2 ways
+  parameter ICACHE_WAYS = 1,
+  parameter ICACHE_SETS = 64,
+  // Cores sharing the bus, 1 to 4. Harts other than 0 wait in reset until
+  // they're started with a software interrupt, see gen_hart below. Each one
+  // takes 4 more block RAMs, which the UP5K doesn't have (see the README), so
+  // only simulation builds have a second by default.
+  parameter NUM_HARTS = 1
+) (
   input  CLK,
 
   output LED1,
@@ -12,7 +27,32 @@ module lemonsoc (
   input  BTN1,
   input  BTN2,
   input  BTN3,
-  input  BTN_N
+  input  BTN_N,
+
+  output FLASH_SCK,
+  output FLASH_SSB,
+`ifdef SIM
+  // Verilator can't model the bidirectional pins, so the flash model in the
+  // harness sees each direction separately
+  output [3:0] FLASH_IO_O,
+  output [3:0] FLASH_IO_OE,
+  input  [3:0] FLASH_IO_I,
+
+  // The harness exchanges UART bytes directly, skipping the serial timing
+  output       UART_TX_VALID,
+  output [7:0] UART_TX_DATA,
+  input        UART_RX_VALID,
+  output       UART_RX_READY,
+  input  [7:0] UART_RX_DATA
+`else
+  inout  FLASH_IO0,
+  inout  FLASH_IO1,
+  inout  FLASH_IO2,
+  inout  FLASH_IO3,
+
+  output TX,
+  input  RX
+`endif
 );
 
 `include "memmap.vh"
@@ -46,188 +86,365 @@ module lemonsoc (
 
   wire        instr_req_valid;
   wire [31:0] instr_req_addr;
-  reg         instr_res_valid;
-  reg [31:0]  instr_res_data;
-  reg         instr_res_error;
+  wire        instr_res_valid;
+  wire [31:0] instr_res_data;
+  wire        instr_res_error;
 
   wire        mem_read_req_valid;
   wire [31:0] mem_read_req_addr;
-  reg [31:0]  mem_read_res_data;
-  reg         mem_read_res_valid;
-  reg         mem_read_res_error;
+  wire        mem_read_req_excl;
+  wire [31:0] mem_read_res_data;
+  wire        mem_read_res_valid;
+  wire        mem_read_res_error;
 
   wire        mem_write_req_valid;
   wire [31:0] mem_write_req_addr;
   wire [31:0] mem_write_req_data;
   wire [3:0]  mem_write_req_mask;
-  reg         mem_write_res_valid;
-  reg         mem_write_res_error;
-
-  reg         imem_read_req_valid;
-  reg [31:0]  imem_read_req_addr;
-  reg [31:0]  imem_read_res_data;
-  reg         imem_read_res_valid;
-
-  reg         dmem_read_req_valid;
-  reg [31:0]  dmem_read_req_addr;
-  reg [31:0]  dmem_read_res_data;
-  reg         dmem_read_res_valid;
-
-  reg         ram_read_req_valid;
-  reg [31:0]  ram_read_req_addr;
-  wire [31:0] ram_read_res_data;
-  wire        ram_read_res_valid;
-
-  reg         ram_write_req_valid;
-  reg [31:0]  ram_write_req_addr;
-  reg [31:0]  ram_write_req_data;
-  reg [3:0]   ram_write_req_mask;
-  wire        ram_write_res_valid;
-
-  reg         gpio_read_req_valid;
-  reg [31:0]  gpio_read_req_addr;
-  wire [31:0] gpio_read_res_data;
-  wire        gpio_read_res_valid;
-  wire        gpio_read_res_error;
-
-  reg         gpio_write_req_valid;
-  reg [31:0]  gpio_write_req_addr;
-  reg [31:0]  gpio_write_req_data;
-  reg [3:0]   gpio_write_req_mask;
-  wire        gpio_write_res_valid;
-  wire        gpio_write_res_error;
-
-  reg         timer_write_req_valid;
-
-  always @(*) begin
-    gpio_write_req_valid =1'b0;
-    gpio_write_req_addr = 32'b0;
-    gpio_write_req_data = 32'b0;
-    gpio_write_req_mask = 4'b0;
-
-    ram_write_req_valid =1'b0;
-    ram_write_req_addr = 32'b0;
-    ram_write_req_data = 32'b0;
-    ram_write_req_mask = 4'b0;
-
-    timer_write_req_valid = 1'b0;
-
-    if (mem_write_req_addr >= GPIO_BASE && mem_write_req_addr < GPIO_BASE + GPIO_SIZE) begin
-      // GPIO
-      gpio_write_req_addr = mem_write_req_addr;
-      gpio_write_req_data = mem_write_req_data;
-      gpio_write_req_valid = mem_write_req_valid;
-      gpio_write_req_mask = mem_write_req_mask;
-      mem_write_res_valid = gpio_write_res_valid;
-      mem_write_res_error = gpio_write_res_error;
-    end else if (mem_write_req_addr >= RAM_BASE && mem_write_req_addr < RAM_BASE + RAM_SIZE) begin
-      // RAM
-      ram_write_req_addr = mem_write_req_addr;
-      ram_write_req_data = mem_write_req_data;
-      ram_write_req_valid = mem_write_req_valid;
-      ram_write_req_mask = mem_write_req_mask;
-      mem_write_res_valid = ram_write_res_valid;
-      mem_write_res_error = 1'b0;
-    end else if (mem_write_req_addr >= TIMER_BASE && mem_write_req_addr < TIMER_BASE + TIMER_SIZE) begin
-      timer_write_req_valid = mem_write_req_valid;
-      mem_write_res_valid = 1'b1;
-      mem_write_res_error = 1'b0;
-    end else begin
-      mem_write_res_valid = 1'b0;
-      mem_write_res_error = 1'b1;
-    end
-  end
-
-  always @(*) begin
-    imem_read_req_valid = 1'b0;
-    imem_read_req_addr = 32'b0;
-
-    // Lint complains because ROM_BASE is 0, and so the first comparison is meaningless.
-    // want to keep as-is just in case we did happen to change the ROM base, however, so
-    // we turn off the relevant lint error.
-
-    /* verilator lint_off UNSIGNED */
-    if (instr_req_addr >= ROM_BASE && instr_req_addr < ROM_BASE + ROM_SIZE) begin
-    /*verilator lint_on UNSIGNED */
-      imem_read_req_addr = instr_req_addr;
-      imem_read_req_valid = instr_req_valid;
-      instr_res_data = imem_read_res_data;
-      instr_res_valid = imem_read_res_valid;
-      instr_res_error = 1'b0;
-    end else begin
-      instr_res_data = 32'b0;
-      instr_res_valid = 1'b0;
-      instr_res_error = 1'b1;
-    end
-  end
-
-  always @(*) begin
-    gpio_read_req_valid =1'b0;
-    gpio_read_req_addr = 32'b0;
-
-    dmem_read_req_valid =1'b0;
-    dmem_read_req_addr = 32'b0;
-
-    if (mem_read_req_addr >= GPIO_BASE && mem_read_req_addr < GPIO_BASE + GPIO_SIZE) begin
-      // GPIO
-      gpio_read_req_addr = mem_read_req_addr;
-      gpio_read_req_valid = mem_read_req_valid;
-      mem_read_res_data = gpio_read_res_data;
-      mem_read_res_valid = gpio_read_res_valid;
-      mem_read_res_error = gpio_read_res_error;
-    end else if (mem_read_req_addr >= RAM_BASE && mem_read_req_addr < RAM_BASE + RAM_SIZE) begin
-      // RAM
-      dmem_read_req_addr = mem_read_req_addr;
-      dmem_read_req_valid = mem_read_req_valid;
-      mem_read_res_data = dmem_read_res_data;
-      mem_read_res_valid = dmem_read_res_valid;
-      mem_read_res_error = 1'b0;
-    end else begin
-      mem_read_res_data = 32'b0;
-      mem_read_res_valid = 1'b0;
-      mem_read_res_error = 1'b1;
-    end
-  end
-
-  // Arbitrate access to RAM between instruction and data ports.
-  // Instruction requests always get priority
-  always @(*) begin
-    ram_read_req_valid = 1'b0;
-    ram_read_req_addr = 32'b0;
-
-    imem_read_res_data = 32'b0;
-    imem_read_res_valid = 1'b0;
-
-    dmem_read_res_data = 32'b0;
-    dmem_read_res_valid = 1'b0;
-
-    if (instr_req_valid) begin
-      ram_read_req_valid = imem_read_req_valid;
-      ram_read_req_addr = imem_read_req_addr;
-      imem_read_res_data = ram_read_res_data;
-      imem_read_res_valid = ram_read_res_valid;
-    end else if (mem_read_req_valid) begin
-      ram_read_req_valid = dmem_read_req_valid;
-      ram_read_req_addr = dmem_read_req_addr;
-      dmem_read_res_data = ram_read_res_data;
-      dmem_read_res_valid = ram_read_res_valid;
-    end
-  end
+  wire        mem_write_req_excl;
+  wire        mem_write_res_valid;
+  wire        mem_write_res_error;
+
+  // Bus masters. They take turns when they compete for a slave. Hart 0's
+  // ports and the DMA engine come first, then three more for each other hart.
+  localparam M_INSTR = 0;
+  localparam M_READ = 1;
+  localparam M_WRITE = 2;
+  localparam M_DMA = 3;
+  localparam NUM_MASTERS = 1 + 3 * NUM_HARTS;
+
+  // Requests carry {hart, exclusive} for the reservation monitor
+  localparam HART_BITS = NUM_HARTS > 1 ? $clog2(NUM_HARTS) : 1;
+  localparam USER_BITS = HART_BITS + 1;
+
+  // Bus slaves and the address map, see memmap.vh
+  localparam S_ROM = 0;
+  localparam S_RAM = 1;
+  localparam S_GPIO = 2;
+  localparam S_TIMER = 3;
+  localparam S_SPRAM = 4;
+  localparam S_FLASH = 5;
+  localparam S_IRQ = 6;
+  localparam S_UART = 7;
+  localparam S_DMA = 8;
+  localparam NUM_SLAVES = 9;
+
+  localparam [32*NUM_SLAVES-1:0] SLAVE_BASE = {
+    DMA_BASE, UART_BASE, IRQ_BASE, FLASH_BASE, SPRAM_BASE, TIMER_BASE, GPIO_BASE,
+    RAM_BASE, ROM_BASE
+  };
+  localparam [32*NUM_SLAVES-1:0] SLAVE_SIZE = {
+    DMA_SIZE, UART_SIZE, IRQ_SIZE, FLASH_SIZE, SPRAM_SIZE, TIMER_SIZE, GPIO_SIZE,
+    RAM_SIZE, ROM_SIZE
+  };
+
+  wire [NUM_MASTERS-1:0]    m_req_valid;
+  wire [NUM_MASTERS-1:0]    m_req_ready;
+  wire [32*NUM_MASTERS-1:0] m_req_addr;
+  wire [NUM_MASTERS-1:0]    m_req_we;
+  wire [32*NUM_MASTERS-1:0] m_req_wdata;
+  wire [4*NUM_MASTERS-1:0]  m_req_mask;
+  wire [USER_BITS*NUM_MASTERS-1:0] m_req_user;
+  wire [NUM_MASTERS-1:0]    m_rsp_valid;
+  wire [32*NUM_MASTERS-1:0] m_rsp_rdata;
+  wire [NUM_MASTERS-1:0]    m_rsp_error;
+
+  wire [NUM_SLAVES-1:0]     s_req_valid;
+  wire [NUM_SLAVES-1:0]     s_req_ready;
+  wire [32*NUM_SLAVES-1:0]  s_req_addr;
+  wire [NUM_SLAVES-1:0]     s_req_we;
+  wire [32*NUM_SLAVES-1:0]  s_req_wdata;
+  wire [4*NUM_SLAVES-1:0]   s_req_mask;
+  // Only the memories behind the reservation monitor look at this
+  /* verilator lint_off UNUSED */
+  wire [USER_BITS*NUM_SLAVES-1:0] s_req_user;
+  /* verilator lint_on UNUSED */
+  wire [NUM_SLAVES-1:0]     s_rsp_valid;
+  wire [32*NUM_SLAVES-1:0]  s_rsp_rdata;
+  wire [NUM_SLAVES-1:0]     s_rsp_error;
+
+  bus_xbar #(
+    .NUM_MASTERS(NUM_MASTERS),
+    .NUM_SLAVES(NUM_SLAVES),
+    .SLAVE_BASE(SLAVE_BASE),
+    .SLAVE_SIZE(SLAVE_SIZE),
+    .USER_BITS(USER_BITS)
+  ) xbar (
+    .clk_i(CLK),
+    .rst_i(rst),
+
+    .m_req_valid_i(m_req_valid),
+    .m_req_ready_o(m_req_ready),
+    .m_req_addr_i(m_req_addr),
+    .m_req_we_i(m_req_we),
+    .m_req_wdata_i(m_req_wdata),
+    .m_req_mask_i(m_req_mask),
+    .m_req_user_i(m_req_user),
+    .m_rsp_valid_o(m_rsp_valid),
+    .m_rsp_rdata_o(m_rsp_rdata),
+    .m_rsp_error_o(m_rsp_error),
+
+    .s_req_valid_o(s_req_valid),
+    .s_req_ready_i(s_req_ready),
+    .s_req_addr_o(s_req_addr),
+    .s_req_we_o(s_req_we),
+    .s_req_wdata_o(s_req_wdata),
+    .s_req_mask_o(s_req_mask),
+    .s_req_user_o(s_req_user),
+    .s_rsp_valid_i(s_rsp_valid),
+    .s_rsp_rdata_i(s_rsp_rdata),
+    .s_rsp_error_i(s_rsp_error)
+  );
+
+  // Each of the core's ports is a bus master
+  core_bridge instr_bridge (
+    .clk_i(CLK),
+    .rst_i(rst),
+
+    .req_valid_i(instr_req_valid),
+    .req_addr_i(instr_req_addr),
+    .req_we_i(1'b0),
+    .req_data_i(32'b0),
+    .req_mask_i(4'b1111),
+    .res_valid_o(instr_res_valid),
+    .res_data_o(instr_res_data),
+    .res_error_o(instr_res_error),
+
+    .bus_req_valid_o(m_req_valid[M_INSTR]),
+    .bus_req_ready_i(m_req_ready[M_INSTR]),
+    .bus_req_addr_o(m_req_addr[32*M_INSTR +: 32]),
+    .bus_req_we_o(m_req_we[M_INSTR]),
+    .bus_req_wdata_o(m_req_wdata[32*M_INSTR +: 32]),
+    .bus_req_mask_o(m_req_mask[4*M_INSTR +: 4]),
+    .bus_rsp_valid_i(m_rsp_valid[M_INSTR]),
+    .bus_rsp_rdata_i(m_rsp_rdata[32*M_INSTR +: 32]),
+    .bus_rsp_error_i(m_rsp_error[M_INSTR])
+  );
+
+  core_bridge read_bridge (
+    .clk_i(CLK),
+    .rst_i(rst),
+
+    .req_valid_i(mem_read_req_valid),
+    .req_addr_i(mem_read_req_addr),
+    .req_we_i(1'b0),
+    .req_data_i(32'b0),
+    .req_mask_i(4'b1111),
+    .res_valid_o(mem_read_res_valid),
+    .res_data_o(mem_read_res_data),
+    .res_error_o(mem_read_res_error),
+
+    .bus_req_valid_o(m_req_valid[M_READ]),
+    .bus_req_ready_i(m_req_ready[M_READ]),
+    .bus_req_addr_o(m_req_addr[32*M_READ +: 32]),
+    .bus_req_we_o(m_req_we[M_READ]),
+    .bus_req_wdata_o(m_req_wdata[32*M_READ +: 32]),
+    .bus_req_mask_o(m_req_mask[4*M_READ +: 4]),
+    .bus_rsp_valid_i(m_rsp_valid[M_READ]),
+    .bus_rsp_rdata_i(m_rsp_rdata[32*M_READ +: 32]),
+    .bus_rsp_error_i(m_rsp_error[M_READ])
+  );
+
+  // Write responses only carry the exclusive write's result, in bit 0
+  /* verilator lint_off UNUSED */
+  wire [31:0] mem_write_res_data;
+  /* verilator lint_on UNUSED */
+
+  core_bridge write_bridge (
+    .clk_i(CLK),
+    .rst_i(rst),
+
+    .req_valid_i(mem_write_req_valid),
+    .req_addr_i(mem_write_req_addr),
+    .req_we_i(1'b1),
+    .req_data_i(mem_write_req_data),
+    .req_mask_i(mem_write_req_mask),
+    .res_valid_o(mem_write_res_valid),
+    .res_data_o(mem_write_res_data),
+    .res_error_o(mem_write_res_error),
+
+    .bus_req_valid_o(m_req_valid[M_WRITE]),
+    .bus_req_ready_i(m_req_ready[M_WRITE]),
+    .bus_req_addr_o(m_req_addr[32*M_WRITE +: 32]),
+    .bus_req_we_o(m_req_we[M_WRITE]),
+    .bus_req_wdata_o(m_req_wdata[32*M_WRITE +: 32]),
+    .bus_req_mask_o(m_req_mask[4*M_WRITE +: 4]),
+    .bus_rsp_valid_i(m_rsp_valid[M_WRITE]),
+    .bus_rsp_rdata_i(m_rsp_rdata[32*M_WRITE +: 32]),
+    .bus_rsp_error_i(m_rsp_error[M_WRITE])
+  );
+
+  assign m_req_user[USER_BITS*M_INSTR +: USER_BITS] = {USER_BITS{1'b0}};
+  assign m_req_user[USER_BITS*M_READ +: USER_BITS] = {{HART_BITS{1'b0}}, mem_read_req_excl};
+  assign m_req_user[USER_BITS*M_WRITE +: USER_BITS] = {{HART_BITS{1'b0}}, mem_write_req_excl};
+  assign m_req_user[USER_BITS*M_DMA +: USER_BITS] = {USER_BITS{1'b0}};
+
+  // RAM (port 0) and SPRAM (port 1) keep reservations for LR/SC, so atomics
+  // only work there
+  wire [1:0]  resv_req_valid;
+  wire [1:0]  resv_req_ready;
+  wire [63:0] resv_req_addr;
+  wire [1:0]  resv_req_we;
+  wire [63:0] resv_req_wdata;
+  wire [7:0]  resv_req_mask;
+  wire [1:0]  resv_rsp_valid;
+  wire [63:0] resv_rsp_rdata;
+  wire [1:0]  resv_rsp_error;
+
+  resv_monitor #(
+    .NUM_PORTS(2),
+    .NUM_HARTS(NUM_HARTS),
+    .HART_BITS(HART_BITS)
+  ) resv_monitor (
+    .clk_i(CLK),
+    .rst_i(rst),
+
+    .req_valid_i({s_req_valid[S_SPRAM], s_req_valid[S_RAM]}),
+    .req_ready_o({s_req_ready[S_SPRAM], s_req_ready[S_RAM]}),
+    .req_addr_i({s_req_addr[32*S_SPRAM +: 32], s_req_addr[32*S_RAM +: 32]}),
+    .req_we_i({s_req_we[S_SPRAM], s_req_we[S_RAM]}),
+    .req_wdata_i({s_req_wdata[32*S_SPRAM +: 32], s_req_wdata[32*S_RAM +: 32]}),
+    .req_mask_i({s_req_mask[4*S_SPRAM +: 4], s_req_mask[4*S_RAM +: 4]}),
+    .req_user_i({s_req_user[USER_BITS*S_SPRAM +: USER_BITS],
+                 s_req_user[USER_BITS*S_RAM +: USER_BITS]}),
+    .rsp_valid_o({s_rsp_valid[S_SPRAM], s_rsp_valid[S_RAM]}),
+    .rsp_rdata_o({s_rsp_rdata[32*S_SPRAM +: 32], s_rsp_rdata[32*S_RAM +: 32]}),
+    .rsp_error_o({s_rsp_error[S_SPRAM], s_rsp_error[S_RAM]}),
+
+    .mem_req_valid_o(resv_req_valid),
+    .mem_req_ready_i(resv_req_ready),
+    .mem_req_addr_o(resv_req_addr),
+    .mem_req_we_o(resv_req_we),
+    .mem_req_wdata_o(resv_req_wdata),
+    .mem_req_mask_o(resv_req_mask),
+    .mem_rsp_valid_i(resv_rsp_valid),
+    .mem_rsp_rdata_i(resv_rsp_rdata),
+    .mem_rsp_error_i(resv_rsp_error)
+  );
+
+  // Instructions and constants. Writes are errors
+  ram #(
+    .BASE(ROM_BASE),
+    .SIZE(ROM_SIZE / 4),
+    .WRITABLE(0),
+    .INIT_FILE("rom_random.mem")
+  ) rom (
+    .clk_i(CLK),
+    .rst_i(rst),
+
+    .req_valid_i(s_req_valid[S_ROM]),
+    .req_ready_o(s_req_ready[S_ROM]),
+    .req_addr_i(s_req_addr[32*S_ROM +: 32]),
+    .req_we_i(s_req_we[S_ROM]),
+    .req_wdata_i(s_req_wdata[32*S_ROM +: 32]),
+    .req_mask_i(s_req_mask[4*S_ROM +: 4]),
+    .rsp_valid_o(s_rsp_valid[S_ROM]),
+    .rsp_rdata_o(s_rsp_rdata[32*S_ROM +: 32]),
+    .rsp_error_o(s_rsp_error[S_ROM])
+  );
+
+  ram #(
+    .BASE(RAM_BASE),
+    .SIZE(RAM_SIZE / 4),
+    .INIT_FILE("ram_random.mem")
+  ) ram (
+    .clk_i(CLK),
+    .rst_i(rst),
+
+    .req_valid_i(resv_req_valid[0]),
+    .req_ready_o(resv_req_ready[0]),
+    .req_addr_i(resv_req_addr[31:0]),
+    .req_we_i(resv_req_we[0]),
+    .req_wdata_i(resv_req_wdata[31:0]),
+    .req_mask_i(resv_req_mask[3:0]),
+    .rsp_valid_o(resv_rsp_valid[0]),
+    .rsp_rdata_o(resv_rsp_rdata[31:0]),
+    .rsp_error_o(resv_rsp_error[0])
+  );
+
+  spram spram (
+    .clk_i(CLK),
+    .rst_i(rst),
+
+    .req_valid_i(resv_req_valid[1]),
+    .req_ready_o(resv_req_ready[1]),
+    .req_addr_i(resv_req_addr[63:32]),
+    .req_we_i(resv_req_we[1]),
+    .req_wdata_i(resv_req_wdata[63:32]),
+    .req_mask_i(resv_req_mask[7:4]),
+    .rsp_valid_o(resv_rsp_valid[1]),
+    .rsp_rdata_o(resv_rsp_rdata[63:32]),
+    .rsp_error_o(resv_rsp_error[1])
+  );
+
+  localparam LINE_WORDS = 4;
+
+  wire                    fill_req_valid;
+  wire [23:0]             fill_req_addr;
+  wire                    fill_res_valid;
+  wire [32*LINE_WORDS-1:0] fill_res_data;
 
-  ram ram (
+  icache #(
+    .BASE(FLASH_BASE),
+    .WAYS(ICACHE_WAYS),
+    .SETS(ICACHE_SETS),
+    .LINE_WORDS(LINE_WORDS)
+  ) icache (
     .clk_i(CLK),
+    .rst_i(rst),
+
+    .req_valid_i(s_req_valid[S_FLASH]),
+    .req_ready_o(s_req_ready[S_FLASH]),
+    .req_addr_i(s_req_addr[32*S_FLASH +: 32]),
+    .req_we_i(s_req_we[S_FLASH]),
+    .req_wdata_i(s_req_wdata[32*S_FLASH +: 32]),
+    .req_mask_i(s_req_mask[4*S_FLASH +: 4]),
+    .rsp_valid_o(s_rsp_valid[S_FLASH]),
+    .rsp_rdata_o(s_rsp_rdata[32*S_FLASH +: 32]),
+    .rsp_error_o(s_rsp_error[S_FLASH]),
+
+    .fill_req_valid_o(fill_req_valid),
+    .fill_req_addr_o(fill_req_addr),
+    .fill_res_valid_i(fill_res_valid),
+    .fill_res_data_i(fill_res_data)
+  );
+
+  wire [3:0] flash_io_o;
+  wire [3:0] flash_io_oe;
+  wire [3:0] flash_io_i;
+
+  qspi_flash #(
+    .LINE_WORDS(LINE_WORDS)
+  ) qspi_flash (
+    .clk_i(CLK),
+    .rst_i(rst),
+
+    .req_valid_i(fill_req_valid),
+    .req_addr_i(fill_req_addr),
+    .res_valid_o(fill_res_valid),
+    .res_data_o(fill_res_data),
 
-    .read_req_valid_i(ram_read_req_valid),
-    .read_req_addr_i(ram_read_req_addr),
-    .read_res_valid_o(ram_read_res_valid),
-    .read_res_data_o(ram_read_res_data),
+    .flash_sck_o(FLASH_SCK),
+    .flash_ssb_o(FLASH_SSB),
+    .flash_io_o(flash_io_o),
+    .flash_io_oe_o(flash_io_oe),
+    .flash_io_i(flash_io_i)
+  );
 
-    .write_req_valid_i(ram_write_req_valid),
-    .write_req_addr_i(ram_write_req_addr),
-    .write_req_data_i(ram_write_req_data),
-    .write_req_mask_i(ram_write_req_mask),
-    .write_res_valid_o(ram_write_res_valid)
+`ifdef SIM
+  assign FLASH_IO_O = flash_io_o;
+  assign FLASH_IO_OE = flash_io_oe;
+  assign flash_io_i = FLASH_IO_I;
+`else
+  SB_IO #(
+    .PIN_TYPE(6'b1010_01) // unregistered output with enable, unregistered input
+  ) flash_io [3:0] (
+    .PACKAGE_PIN({FLASH_IO3, FLASH_IO2, FLASH_IO1, FLASH_IO0}),
+    .OUTPUT_ENABLE(flash_io_oe),
+    .D_OUT_0(flash_io_o),
+    .D_IN_0(flash_io_i)
   );
+`endif
 
   wire [4:0] user_leds;
   wire       done_led;
@@ -236,18 +453,15 @@ module lemonsoc (
     .clk_i(CLK),
     .rst_i(rst),
 
-    .write_req_valid_i(gpio_write_req_valid),
-    .write_req_addr_i(gpio_write_req_addr),
-    .write_req_data_i(gpio_write_req_data),
-    .write_req_mask_i(gpio_write_req_mask),
-    .write_res_valid_o(gpio_write_res_valid),
-    .write_res_error_o(gpio_write_res_error),
-
-    .read_req_valid_i(gpio_read_req_valid),
-    .read_req_addr_i(gpio_read_req_addr),
-    .read_res_data_o(gpio_read_res_data),
-    .read_res_valid_o(gpio_read_res_valid),
-    .read_res_error_o(gpio_read_res_error),
+    .req_valid_i(s_req_valid[S_GPIO]),
+    .req_ready_o(s_req_ready[S_GPIO]),
+    .req_addr_i(s_req_addr[32*S_GPIO +: 32]),
+    .req_we_i(s_req_we[S_GPIO]),
+    .req_wdata_i(s_req_wdata[32*S_GPIO +: 32]),
+    .req_mask_i(s_req_mask[4*S_GPIO +: 4]),
+    .rsp_valid_o(s_rsp_valid[S_GPIO]),
+    .rsp_rdata_o(s_rsp_rdata[32*S_GPIO +: 32]),
+    .rsp_error_o(s_rsp_error[S_GPIO]),
 
     .buttons_i(btn),
     .user_leds_o(user_leds),
@@ -255,14 +469,153 @@ module lemonsoc (
     .exception_led_o(exception_led)
   );
 
-  wire irq_timer;
-  timer timer (
+  wire                 irq_timer;
+  wire [NUM_HARTS-1:0] irq_software;
+  timer #(
+    .NUM_HARTS(NUM_HARTS)
+  ) timer (
     .clk_i(CLK),
     .rst_i(rst),
 
-    .write_req_i(timer_write_req_valid),
+    .req_valid_i(s_req_valid[S_TIMER]),
+    .req_ready_o(s_req_ready[S_TIMER]),
+    .req_addr_i(s_req_addr[32*S_TIMER +: 32]),
+    .req_we_i(s_req_we[S_TIMER]),
+    .req_wdata_i(s_req_wdata[32*S_TIMER +: 32]),
+    .req_mask_i(s_req_mask[4*S_TIMER +: 4]),
+    .rsp_valid_o(s_rsp_valid[S_TIMER]),
+    .rsp_rdata_o(s_rsp_rdata[32*S_TIMER +: 32]),
+    .rsp_error_o(s_rsp_error[S_TIMER]),
+
+    .timer_irq_o(irq_timer),
+    .software_irq_o(irq_software)
+  );
+
+  wire        uart_tx_valid;
+  wire        uart_tx_ready;
+  wire [7:0]  uart_tx_data;
+  wire        uart_rx_valid;
+  wire [7:0]  uart_rx_data;
+  wire        irq_uart;
+  // The simulated UART has no baud rate, and the PHY has no backpressure on
+  // receive: bytes that find the FIFO full are dropped
+  /* verilator lint_off UNUSED */
+  wire        uart_rx_ready;
+  wire [15:0] uart_div;
+  /* verilator lint_on UNUSED */
+
+  uart uart (
+    .clk_i(CLK),
+    .rst_i(rst),
 
-    .timer_irq_o(irq_timer)
+    .req_valid_i(s_req_valid[S_UART]),
+    .req_ready_o(s_req_ready[S_UART]),
+    .req_addr_i(s_req_addr[32*S_UART +: 32]),
+    .req_we_i(s_req_we[S_UART]),
+    .req_wdata_i(s_req_wdata[32*S_UART +: 32]),
+    .req_mask_i(s_req_mask[4*S_UART +: 4]),
+    .rsp_valid_o(s_rsp_valid[S_UART]),
+    .rsp_rdata_o(s_rsp_rdata[32*S_UART +: 32]),
+    .rsp_error_o(s_rsp_error[S_UART]),
+
+    .tx_valid_o(uart_tx_valid),
+    .tx_ready_i(uart_tx_ready),
+    .tx_data_o(uart_tx_data),
+
+    .rx_valid_i(uart_rx_valid),
+    .rx_ready_o(uart_rx_ready),
+    .rx_data_i(uart_rx_data),
+
+    .div_o(uart_div),
+    .irq_o(irq_uart)
+  );
+
+`ifdef SIM
+  // The harness takes every byte as soon as it's offered
+  assign UART_TX_VALID = uart_tx_valid;
+  assign UART_TX_DATA = uart_tx_data;
+  assign uart_tx_ready = 1'b1;
+  assign uart_rx_valid = UART_RX_VALID;
+  assign UART_RX_READY = uart_rx_ready;
+  assign uart_rx_data = UART_RX_DATA;
+`else
+  wire uart_rx_pin;
+  sync sync_rx(
+    .clk(CLK),
+    .in(RX),
+    .out(uart_rx_pin)
+  );
+
+  uart_phy uart_phy (
+    .clk_i(CLK),
+    .rst_i(rst),
+
+    .div_i(uart_div),
+
+    .tx_valid_i(uart_tx_valid),
+    .tx_ready_o(uart_tx_ready),
+    .tx_data_i(uart_tx_data),
+
+    .rx_valid_o(uart_rx_valid),
+    .rx_data_o(uart_rx_data),
+
+    .tx_o(TX),
+    .rx_i(uart_rx_pin)
+  );
+`endif
+
+  // Second bus master, for moving data without the core
+  wire irq_dma;
+  wire dma_busy;
+  dma dma (
+    .clk_i(CLK),
+    .rst_i(rst),
+
+    .req_valid_i(s_req_valid[S_DMA]),
+    .req_ready_o(s_req_ready[S_DMA]),
+    .req_addr_i(s_req_addr[32*S_DMA +: 32]),
+    .req_we_i(s_req_we[S_DMA]),
+    .req_wdata_i(s_req_wdata[32*S_DMA +: 32]),
+    .req_mask_i(s_req_mask[4*S_DMA +: 4]),
+    .rsp_valid_o(s_rsp_valid[S_DMA]),
+    .rsp_rdata_o(s_rsp_rdata[32*S_DMA +: 32]),
+    .rsp_error_o(s_rsp_error[S_DMA]),
+
+    .bus_req_valid_o(m_req_valid[M_DMA]),
+    .bus_req_ready_i(m_req_ready[M_DMA]),
+    .bus_req_addr_o(m_req_addr[32*M_DMA +: 32]),
+    .bus_req_we_o(m_req_we[M_DMA]),
+    .bus_req_wdata_o(m_req_wdata[32*M_DMA +: 32]),
+    .bus_req_mask_o(m_req_mask[4*M_DMA +: 4]),
+    .bus_rsp_valid_i(m_rsp_valid[M_DMA]),
+    .bus_rsp_rdata_i(m_rsp_rdata[32*M_DMA +: 32]),
+    .bus_rsp_error_i(m_rsp_error[M_DMA]),
+
+    .busy_o(dma_busy),
+    .irq_o(irq_dma)
+  );
+
+  // Button edges, the UART and the DMA engine drive the external interrupt
+  wire irq_external;
+  irq_ctrl #(
+    .NUM_SOURCES(5),
+    .LEVEL_SOURCES(5'b11000)
+  ) irq_ctrl (
+    .clk_i(CLK),
+    .rst_i(rst),
+
+    .req_valid_i(s_req_valid[S_IRQ]),
+    .req_ready_o(s_req_ready[S_IRQ]),
+    .req_addr_i(s_req_addr[32*S_IRQ +: 32]),
+    .req_we_i(s_req_we[S_IRQ]),
+    .req_wdata_i(s_req_wdata[32*S_IRQ +: 32]),
+    .req_mask_i(s_req_mask[4*S_IRQ +: 4]),
+    .rsp_valid_o(s_rsp_valid[S_IRQ]),
+    .rsp_rdata_o(s_rsp_rdata[32*S_IRQ +: 32]),
+    .rsp_error_o(s_rsp_error[S_IRQ]),
+
+    .sources_i({irq_dma, irq_uart, btn}),
+    .irq_o(irq_external)
   );
 
   assign LED1 = user_leds[0];
@@ -273,8 +626,64 @@ module lemonsoc (
   assign LEDG_N = ~done_led;
   assign LEDR_N = ~exception_led;
 
-  lemoncore lemon (
+  // Request signals go nowhere when no coprocessor is attached
+  /* verilator lint_off UNUSED */
+  wire        cop_req_valid;
+  wire        cop_req_custom;
+  wire [2:0]  cop_req_funct3;
+  wire [6:0]  cop_req_funct7;
+  wire [31:0] cop_req_rs1;
+  wire [31:0] cop_req_rs2;
+  /* verilator lint_on UNUSED */
+  wire        cop_req_ready;
+  wire        cop_res_valid;
+  wire [31:0] cop_res_data;
+  wire        cop_res_error;
+
+  generate
+    if (COPROCESSOR != 0) begin : gen_cop
+      crc32 crc32 (
+        .clk_i(CLK),
+        .rst_i(rst),
+
+        .req_valid_i(cop_req_valid),
+        .req_ready_o(cop_req_ready),
+        .req_custom_i(cop_req_custom),
+        .req_funct3_i(cop_req_funct3),
+        .req_funct7_i(cop_req_funct7),
+        .req_rs1_i(cop_req_rs1),
+        .req_rs2_i(cop_req_rs2),
+
+        .res_valid_o(cop_res_valid),
+        .res_data_o(cop_res_data),
+        .res_error_o(cop_res_error)
+      );
+    end else begin : gen_no_cop
+      assign cop_req_ready = 1'b0;
+      assign cop_res_valid = 1'b0;
+      assign cop_res_data = 32'b0;
+      assign cop_res_error = 1'b0;
+    end
+  endgenerate
+
+  // The core is disabled while it sleeps in WFI, through its clock enable so
+  // it stays on CLK. Everything else keeps running, and any enabled interrupt
+  // enables it again.
+  wire core_sleep /*verilator public*/;
+  wire core_clk_en = rst || !core_sleep;
+
+  lemoncore #(
+    .BITMANIP(BITMANIP),
+    .COPROCESSOR(COPROCESSOR),
+    .STORE_BUFFER(STORE_BUFFER),
+    .IO_BASE(IO_BASE),
+    .IO_SIZE(IO_SIZE),
+    .SHADOW_REGS(SHADOW_REGS),
+    .ATOMICS(1),
+    .HART_ID(0)
+  ) lemon (
     .clk_i(CLK),
+    .clk_en_i(core_clk_en),
     .rst_i(rst),
     .instr_req_addr_o(instr_req_addr),
     .instr_req_valid_o(instr_req_valid),
@@ -295,9 +704,229 @@ module lemonsoc (
     .mem_write_res_valid_i(mem_write_res_valid),
     .mem_write_res_error_i(mem_write_res_error),
 
-    .irq_external_i(1'b0),
+    .mem_read_req_excl_o(mem_read_req_excl),
+    .mem_write_req_excl_o(mem_write_req_excl),
+    .mem_write_res_excl_fail_i(mem_write_res_data[0]),
+
+    .cop_req_valid_o(cop_req_valid),
+    .cop_req_ready_i(cop_req_ready),
+    .cop_req_custom_o(cop_req_custom),
+    .cop_req_funct3_o(cop_req_funct3),
+    .cop_req_funct7_o(cop_req_funct7),
+    .cop_req_rs1_o(cop_req_rs1),
+    .cop_req_rs2_o(cop_req_rs2),
+    .cop_res_valid_i(cop_res_valid),
+    .cop_res_data_i(cop_res_data),
+    .cop_res_error_i(cop_res_error),
+
+    .irq_external_i(irq_external),
     .irq_timer_i(irq_timer),
-    .irq_software_i(1'b0)
+    .irq_software_i(irq_software[0]),
+
+    .sleep_o(core_sleep)
   );
 
+  // The other harts, if any. They have no coprocessor and only take their
+  // software interrupt. Each is held in reset until the first time its msip
+  // is set, and then boots from the reset vector like hart 0 did, so hart 0
+  // can get things ready before starting them (see entry.S).
+  wire [NUM_HARTS-1:0] hart_sleep;
+  assign hart_sleep[0] = core_sleep;
+
+  genvar h;
+  generate
+    for (h = 1; h < NUM_HARTS; h = h + 1) begin : gen_hart
+      localparam H_INSTR = 1 + 3 * h;
+      localparam H_READ = H_INSTR + 1;
+      localparam H_WRITE = H_INSTR + 2;
+      localparam [HART_BITS-1:0] HART = h;
+
+      reg  started_q;
+      wire hart_rst;
+      always @(posedge CLK) begin
+        if (rst) begin
+          started_q <= 1'b0;
+        end else if (irq_software[h]) begin
+          started_q <= 1'b1;
+        end
+      end
+      assign hart_rst = rst || !started_q;
+
+      wire        instr_req_valid;
+      wire [31:0] instr_req_addr;
+      wire        instr_res_valid;
+      wire [31:0] instr_res_data;
+      wire        instr_res_error;
+
+      wire        mem_read_req_valid;
+      wire [31:0] mem_read_req_addr;
+      wire        mem_read_req_excl;
+      wire [31:0] mem_read_res_data;
+      wire        mem_read_res_valid;
+      wire        mem_read_res_error;
+
+      wire        mem_write_req_valid;
+      wire [31:0] mem_write_req_addr;
+      wire [31:0] mem_write_req_data;
+      wire [3:0]  mem_write_req_mask;
+      wire        mem_write_req_excl;
+      wire        mem_write_res_valid;
+      wire        mem_write_res_error;
+      /* verilator lint_off UNUSED */
+      wire [31:0] mem_write_res_data;
+      /* verilator lint_on UNUSED */
+
+      core_bridge instr_bridge (
+        .clk_i(CLK),
+        .rst_i(hart_rst),
+
+        .req_valid_i(instr_req_valid),
+        .req_addr_i(instr_req_addr),
+        .req_we_i(1'b0),
+        .req_data_i(32'b0),
+        .req_mask_i(4'b1111),
+        .res_valid_o(instr_res_valid),
+        .res_data_o(instr_res_data),
+        .res_error_o(instr_res_error),
+
+        .bus_req_valid_o(m_req_valid[H_INSTR]),
+        .bus_req_ready_i(m_req_ready[H_INSTR]),
+        .bus_req_addr_o(m_req_addr[32*H_INSTR +: 32]),
+        .bus_req_we_o(m_req_we[H_INSTR]),
+        .bus_req_wdata_o(m_req_wdata[32*H_INSTR +: 32]),
+        .bus_req_mask_o(m_req_mask[4*H_INSTR +: 4]),
+        .bus_rsp_valid_i(m_rsp_valid[H_INSTR]),
+        .bus_rsp_rdata_i(m_rsp_rdata[32*H_INSTR +: 32]),
+        .bus_rsp_error_i(m_rsp_error[H_INSTR])
+      );
+
+      core_bridge read_bridge (
+        .clk_i(CLK),
+        .rst_i(hart_rst),
+
+        .req_valid_i(mem_read_req_valid),
+        .req_addr_i(mem_read_req_addr),
+        .req_we_i(1'b0),
+        .req_data_i(32'b0),
+        .req_mask_i(4'b1111),
+        .res_valid_o(mem_read_res_valid),
+        .res_data_o(mem_read_res_data),
+        .res_error_o(mem_read_res_error),
+
+        .bus_req_valid_o(m_req_valid[H_READ]),
+        .bus_req_ready_i(m_req_ready[H_READ]),
+        .bus_req_addr_o(m_req_addr[32*H_READ +: 32]),
+        .bus_req_we_o(m_req_we[H_READ]),
+        .bus_req_wdata_o(m_req_wdata[32*H_READ +: 32]),
+        .bus_req_mask_o(m_req_mask[4*H_READ +: 4]),
+        .bus_rsp_valid_i(m_rsp_valid[H_READ]),
+        .bus_rsp_rdata_i(m_rsp_rdata[32*H_READ +: 32]),
+        .bus_rsp_error_i(m_rsp_error[H_READ])
+      );
+
+      core_bridge write_bridge (
+        .clk_i(CLK),
+        .rst_i(hart_rst),
+
+        .req_valid_i(mem_write_req_valid),
+        .req_addr_i(mem_write_req_addr),
+        .req_we_i(1'b1),
+        .req_data_i(mem_write_req_data),
+        .req_mask_i(mem_write_req_mask),
+        .res_valid_o(mem_write_res_valid),
+        .res_data_o(mem_write_res_data),
+        .res_error_o(mem_write_res_error),
+
+        .bus_req_valid_o(m_req_valid[H_WRITE]),
+        .bus_req_ready_i(m_req_ready[H_WRITE]),
+        .bus_req_addr_o(m_req_addr[32*H_WRITE +: 32]),
+        .bus_req_we_o(m_req_we[H_WRITE]),
+        .bus_req_wdata_o(m_req_wdata[32*H_WRITE +: 32]),
+        .bus_req_mask_o(m_req_mask[4*H_WRITE +: 4]),
+        .bus_rsp_valid_i(m_rsp_valid[H_WRITE]),
+        .bus_rsp_rdata_i(m_rsp_rdata[32*H_WRITE +: 32]),
+        .bus_rsp_error_i(m_rsp_error[H_WRITE])
+      );
+
+      assign m_req_user[USER_BITS*H_INSTR +: USER_BITS] = {HART, 1'b0};
+      assign m_req_user[USER_BITS*H_READ +: USER_BITS] = {HART, mem_read_req_excl};
+      assign m_req_user[USER_BITS*H_WRITE +: USER_BITS] = {HART, mem_write_req_excl};
+
+      /* verilator lint_off UNUSED */
+      wire        cop_req_valid;
+      wire        cop_req_custom;
+      wire [2:0]  cop_req_funct3;
+      wire [6:0]  cop_req_funct7;
+      wire [31:0] cop_req_rs1;
+      wire [31:0] cop_req_rs2;
+      /* verilator lint_on UNUSED */
+
+      wire sleep;
+      // Also off until the hart is started, but on for its last cycle in reset
+      wire clk_en = rst || irq_software[h] || (started_q && !sleep);
+
+      lemoncore #(
+        .BITMANIP(BITMANIP),
+        .COPROCESSOR(0),
+        .STORE_BUFFER(STORE_BUFFER),
+        .IO_BASE(IO_BASE),
+        .IO_SIZE(IO_SIZE),
+        .SHADOW_REGS(SHADOW_REGS),
+        .ATOMICS(1),
+        .HART_ID(h)
+      ) lemon (
+        .clk_i(CLK),
+        .clk_en_i(clk_en),
+        .rst_i(hart_rst),
+        .instr_req_addr_o(instr_req_addr),
+        .instr_req_valid_o(instr_req_valid),
+        .instr_res_data_i(instr_res_data),
+        .instr_res_valid_i(instr_res_valid),
+        .instr_res_error_i(instr_res_error),
+
+        .mem_read_req_addr_o(mem_read_req_addr),
+        .mem_read_req_valid_o(mem_read_req_valid),
+        .mem_read_res_data_i(mem_read_res_data),
+        .mem_read_res_valid_i(mem_read_res_valid),
+        .mem_read_res_error_i(mem_read_res_error),
+
+        .mem_write_req_addr_o(mem_write_req_addr),
+        .mem_write_req_data_o(mem_write_req_data),
+        .mem_write_req_valid_o(mem_write_req_valid),
+        .mem_write_req_mask_o(mem_write_req_mask),
+        .mem_write_res_valid_i(mem_write_res_valid),
+        .mem_write_res_error_i(mem_write_res_error),
+
+        .mem_read_req_excl_o(mem_read_req_excl),
+        .mem_write_req_excl_o(mem_write_req_excl),
+        .mem_write_res_excl_fail_i(mem_write_res_data[0]),
+
+        .cop_req_valid_o(cop_req_valid),
+        .cop_req_ready_i(1'b0),
+        .cop_req_custom_o(cop_req_custom),
+        .cop_req_funct3_o(cop_req_funct3),
+        .cop_req_funct7_o(cop_req_funct7),
+        .cop_req_rs1_o(cop_req_rs1),
+        .cop_req_rs2_o(cop_req_rs2),
+        .cop_res_valid_i(1'b0),
+        .cop_res_data_i(32'b0),
+        .cop_res_error_i(1'b0),
+
+        .irq_external_i(1'b0),
+        .irq_timer_i(1'b0),
+        .irq_software_i(irq_software[h]),
+
+        .sleep_o(sleep)
+      );
+
+      // A hart that hasn't been started counts as asleep
+      assign hart_sleep[h] = sleep || !started_q;
+    end
+  endgenerate
+
+  // For Lemonsoc::run() to tell when the whole SoC is idle: every hart asleep,
+  // and nothing left running that will raise an interrupt when it finishes
+  wire soc_idle /*verilator public*/;
+  assign soc_idle = &hart_sleep && !dma_busy && !uart_tx_valid;
+
 endmodule
@@ -7,5 +7,25 @@ localparam [31:0] RAM_SIZE  = 32'h2000;
 localparam [31:0] GPIO_BASE = RAM_BASE + RAM_SIZE; // 0x3000
 localparam [31:0] GPIO_SIZE = 32'hC;
 
-localparam [31:0] TIMER_BASE = GPIO_BASE + GPIO_SIZE; // 0x300C
-localparam [31:0] TIMER_SIZE = 32'h4;
+localparam [31:0] TIMER_BASE = GPIO_BASE + 32'h10; // 0x3010
+localparam [31:0] TIMER_SIZE = 32'h20; // msip for up to 4 harts
+
+localparam [31:0] IRQ_BASE = GPIO_BASE + 32'h30; // 0x3030
+localparam [31:0] IRQ_SIZE = 32'h14;
+
+localparam [31:0] UART_BASE = GPIO_BASE + 32'h50; // 0x3050
+localparam [31:0] UART_SIZE = 32'h18;
+
+localparam [31:0] DMA_BASE = GPIO_BASE + 32'h70; // 0x3070
+localparam [31:0] DMA_SIZE = 32'h18;
+
+// Device registers, which the core's loads don't let pass buffered stores
+localparam [31:0] IO_BASE = GPIO_BASE;
+localparam [31:0] IO_SIZE = DMA_BASE + DMA_SIZE - GPIO_BASE;
+
+localparam [31:0] SPRAM_BASE = 32'h10000;
+localparam [31:0] SPRAM_SIZE = 32'h20000; // 128 KiB
+
+// Memory-mapped QSPI flash, read-only and cached (see icache.v)
+localparam [31:0] FLASH_BASE = 32'h01000000;
+localparam [31:0] FLASH_SIZE = 32'h01000000; // 16 MiB
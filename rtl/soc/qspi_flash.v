@@ -0,0 +1,124 @@
+// Read-only QSPI flash controller. Fetches one cache line at a time with the
+// Quad Output Fast Read (0x6B) command: command, address and dummy cycles go
+// out on IO0, then the flash returns data 4 bits per clock. The flash needs its
+// QE bit set, which is the factory default for the Icebreaker's W25Q128JV.
+//
+// SCK runs at half the system clock. Flash is woken from power-down (0xAB)
+// once after reset, before the first request is accepted.
+//
+// Requests are line-aligned byte offsets into flash, and res_data_o holds the
+// line as little-endian words until the next request.
+module qspi_flash #(
+  parameter LINE_WORDS = 4
+) (
+  input                         clk_i,
+  input                         rst_i,
+
+  input                         req_valid_i,
+  input [23:0]                  req_addr_i,
+  output reg                    res_valid_o,
+  output [32*LINE_WORDS-1:0]    res_data_o,
+
+  output reg                    flash_sck_o,
+  output reg                    flash_ssb_o,
+  output [3:0]                  flash_io_o,
+  output [3:0]                  flash_io_oe_o,
+  input [3:0]                   flash_io_i
+);
+
+  localparam [7:0] CMD_WAKE = 8'hAB;
+  localparam [7:0] CMD_QUAD_READ = 8'h6B;
+
+  localparam DUMMY_CYCLES = 8;
+  localparam DATA_CYCLES = 8 * LINE_WORDS; // two nibbles per byte
+  localparam WAKE_CYCLES = 64; // tRES1 is 3us
+
+  localparam ST_WAKE = 0;
+  localparam ST_WAKE_WAIT = 1;
+  localparam ST_IDLE = 2;
+  localparam ST_CMD = 3;
+  localparam ST_DUMMY = 4;
+  localparam ST_DATA = 5;
+
+  reg [2:0]  state_q;
+  reg [31:0] shift_q; // command and address, MSB first on IO0
+  reg [6:0]  count_q;
+  reg [32*LINE_WORDS-1:0] data_q;
+
+  // IO2/IO3 double as WP#/HOLD# during single-bit phases, so keep them high
+  assign flash_io_o = {2'b11, 1'b0, shift_q[31]};
+  assign flash_io_oe_o = (state_q == ST_WAKE || state_q == ST_CMD) ? 4'b1101 : 4'b0000;
+
+  always @(posedge clk_i) begin
+    res_valid_o <= 1'b0;
+
+    if (rst_i) begin
+      state_q <= ST_WAKE;
+      shift_q <= {CMD_WAKE, 24'b0};
+      count_q <= 7'd8;
+      flash_sck_o <= 1'b0;
+      flash_ssb_o <= 1'b0;
+    end else begin
+      case (state_q)
+        ST_WAKE, ST_CMD, ST_DUMMY, ST_DATA: begin
+          flash_sck_o <= ~flash_sck_o;
+          // Flash samples on the rising edge and shifts out on the falling
+          // edge, so sample and advance at the end of the high phase
+          if (flash_sck_o) begin
+            shift_q <= {shift_q[30:0], 1'b0};
+            data_q <= {data_q[32*LINE_WORDS-5:0], flash_io_i};
+            count_q <= count_q - 7'd1;
+
+            if (count_q == 7'd1) begin
+              case (state_q)
+                ST_WAKE: begin
+                  flash_ssb_o <= 1'b1;
+                  count_q <= WAKE_CYCLES[6:0];
+                  state_q <= ST_WAKE_WAIT;
+                end
+                ST_CMD: begin
+                  count_q <= DUMMY_CYCLES[6:0];
+                  state_q <= ST_DUMMY;
+                end
+                ST_DUMMY: begin
+                  count_q <= DATA_CYCLES[6:0];
+                  state_q <= ST_DATA;
+                end
+                default: begin
+                  flash_ssb_o <= 1'b1;
+                  res_valid_o <= 1'b1;
+                  state_q <= ST_IDLE;
+                end
+              endcase
+            end
+          end
+        end
+        ST_WAKE_WAIT: begin
+          count_q <= count_q - 7'd1;
+          if (count_q == 7'd1)
+            state_q <= ST_IDLE;
+        end
+        ST_IDLE: begin
+          // Requests are held through the response cycle, so don't mistake
+          // that for a new one
+          if (req_valid_i && !res_valid_o) begin
+            flash_ssb_o <= 1'b0;
+            shift_q <= {CMD_QUAD_READ, req_addr_i};
+            count_q <= 7'd32;
+            state_q <= ST_CMD;
+          end
+        end
+        default: state_q <= ST_IDLE;
+      endcase
+    end
+  end
+
+  // The first byte read lands at the top of data_q
+  genvar b;
+  generate
+    for (b = 0; b < 4 * LINE_WORDS; b = b + 1) begin : gen_bytes
+      assign res_data_o[8*b +: 8] = data_q[32*LINE_WORDS - 8*b - 1 -: 8];
+    end
+  endgenerate
+
+endmodule
@@ -1,53 +1,60 @@
-module ram (
-  input         clk_i,
-  input         read_req_valid_i,
-  input [31:0]  read_req_addr_i,
-  output reg    read_res_valid_o,
-  output [31:0] read_res_data_o,
+// Block RAM covering SIZE words starting at byte address BASE, as a bus slave
+// (see bus_xbar.v). Requests are answered the next cycle. With WRITABLE set to
+// 0 it acts as a ROM, and writes get an error response.
+module ram #(
+  parameter BASE = 32'h0,
+  parameter SIZE = 1024, // words
+  parameter WRITABLE = 1,
+  // Placeholder contents for FPGA builds, see below
+  parameter INIT_FILE = "random.mem"
+) (
+  input             clk_i,
+  input             rst_i,
 
-  input         write_req_valid_i,
-  input [31:0]  write_req_addr_i,
-  input [31:0]  write_req_data_i,
-  input [3:0]   write_req_mask_i,
-  output reg    write_res_valid_o
+  input             req_valid_i,
+  output            req_ready_o,
+  input [31:0]      req_addr_i,
+  input             req_we_i,
+  input [31:0]      req_wdata_i,
+  input [3:0]       req_mask_i,
+  output reg        rsp_valid_o,
+  output reg [31:0] rsp_rdata_o,
+  output reg        rsp_error_o
 );
 
 `include "memmap.vh"
 
-  parameter SIZE = (ROM_SIZE + RAM_SIZE) / 4; // words
+  reg [31:0] mem[SIZE] /*verilator public*/;
 
-  reg [31:0] mem[SIZE];
+  wire do_write;
+  assign do_write = req_valid_i && req_we_i && WRITABLE != 0;
 
-  wire [31:0] wdata;
-  assign wdata = write_req_data_i << (8 * (write_req_addr_i & 32'b11));
-
-  wire [3:0] wmask;
-  assign wmask = write_req_mask_i << (write_req_addr_i & 32'b11);
-
-  reg [31:0] rdata_word;
-  assign read_res_data_o =  rdata_word >> (8 * (read_req_addr_i & 32'b11));
+  assign req_ready_o = 1'b1;
 
   always @(posedge clk_i) begin
-    if (read_req_valid_i) begin
-      rdata_word <= mem[read_req_addr_i >> 2];
-      read_res_valid_o <= 1'b1;
+    if (rst_i) begin
+      rsp_valid_o <= 1'b0;
+      rsp_error_o <= 1'b0;
     end else begin
-      read_res_valid_o <= 1'b0;
+      rsp_valid_o <= req_valid_i;
+      rsp_error_o <= req_valid_i && req_we_i && WRITABLE == 0;
     end
+  end
 
-    if (write_req_valid_i) begin
-      if (wmask[3])
-        mem[write_req_addr_i >> 2][31:24] <= wdata[31:24];
-      if (wmask[2])
-        mem[write_req_addr_i >> 2][23:16] <= wdata[23:16];
-      if (wmask[1])
-        mem[write_req_addr_i >> 2][15:8] <= wdata[15:8];
-      if (wmask[0])
-        mem[write_req_addr_i >> 2][7:0] <= wdata[7:0];
+  always @(posedge clk_i) begin
+    if (req_valid_i && !req_we_i) begin
+      rsp_rdata_o <= mem[(req_addr_i - BASE) >> 2];
+    end
 
-      write_res_valid_o <= 1'b1;
-    end else begin
-      write_res_valid_o <= 1'b0;
+    if (do_write) begin
+      if (req_mask_i[3])
+        mem[(req_addr_i - BASE) >> 2][31:24] <= req_wdata_i[31:24];
+      if (req_mask_i[2])
+        mem[(req_addr_i - BASE) >> 2][23:16] <= req_wdata_i[23:16];
+      if (req_mask_i[1])
+        mem[(req_addr_i - BASE) >> 2][15:8] <= req_wdata_i[15:8];
+      if (req_mask_i[0])
+        mem[(req_addr_i - BASE) >> 2][7:0] <= req_wdata_i[7:0];
     end
   end
 
@@ -56,22 +63,31 @@ module ram (
   export "DPI-C" task verilator_load_mem;
   export "DPI-C" task verilator_set_mem_entry;
 
+  // Firmware images cover ROM and RAM, so load the whole thing and copy out
+  // this memory's slice
+  reg [31:0] image[(ROM_SIZE + RAM_SIZE) / 4];
+
   task verilator_load_mem;
     input string file;
-    $readmemh(file, mem);
+    integer i;
+    begin
+      $readmemh(file, image);
+      for (i = 0; i < SIZE; i = i + 1)
+        mem[i] = image[(BASE - ROM_BASE) / 4 + i];
+    end
   endtask
 
   task verilator_set_mem_entry;
     input int addr;
     input int data;
-    mem[addr >> 2] = data;
+    mem[(addr - BASE) >> 2] = data;
   endtask
 `else
   // For FPGA we generate a bistream that loads the ROM with a randomly
   // generated pattern. We can then use `icebram` to quickly generate new
-  // bitstreams that load our firmware.
+  // bitstreams that load our firmware. Each instance needs its own pattern.
   initial begin
-    $readmemh("random.mem", mem);
+    $readmemh(INIT_FILE, mem);
   end
 `endif
 
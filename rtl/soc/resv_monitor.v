@@ -0,0 +1,139 @@
+// Reservations for LR/SC, kept for the memories between the crossbar and
+// NUM_PORTS slaves. Each request's user bits (see bus_xbar.v) are
+// {hart, exclusive}:
+//  - an exclusive read places a reservation on its word for the hart,
+//    replacing any the hart had,
+//  - an exclusive write only goes ahead if the hart still holds a reservation
+//    on its word. Its response data is 0 if it did and 1 if it was dropped.
+//    Either way the hart's reservation ends.
+//  - any write to a reserved word, from any master, ends every reservation on
+//    it.
+//
+// The ports share the reservations, so a hart's most recent lr.w is the one
+// that counts wherever it went. Requests are checked in the order the slaves
+// see them, which is the order they take effect in. A dropped write is still
+// passed on, with an empty mask, so the slave answers it in turn; writes
+// carry no response data otherwise, so it's filled in here. Read responses
+// pass through. Slaves must answer in order, and MAX_OUTSTANDING (a power of
+// two) bounds how many requests each port can have waiting.
+module resv_monitor #(
+  parameter NUM_PORTS = 1,
+  parameter NUM_HARTS = 1,
+  parameter HART_BITS = 1,
+  parameter MAX_OUTSTANDING = 4
+) (
+  input                                clk_i,
+  input                                rst_i,
+
+  // From the crossbar
+  input [NUM_PORTS-1:0]                req_valid_i,
+  output [NUM_PORTS-1:0]               req_ready_o,
+  input [32*NUM_PORTS-1:0]             req_addr_i,
+  input [NUM_PORTS-1:0]                req_we_i,
+  input [32*NUM_PORTS-1:0]             req_wdata_i,
+  input [4*NUM_PORTS-1:0]              req_mask_i,
+  input [(HART_BITS+1)*NUM_PORTS-1:0]  req_user_i,
+  output [NUM_PORTS-1:0]               rsp_valid_o,
+  output [32*NUM_PORTS-1:0]            rsp_rdata_o,
+  output [NUM_PORTS-1:0]               rsp_error_o,
+
+  // To the memories
+  output [NUM_PORTS-1:0]               mem_req_valid_o,
+  input [NUM_PORTS-1:0]                mem_req_ready_i,
+  output [32*NUM_PORTS-1:0]            mem_req_addr_o,
+  output [NUM_PORTS-1:0]               mem_req_we_o,
+  output [32*NUM_PORTS-1:0]            mem_req_wdata_o,
+  output [4*NUM_PORTS-1:0]             mem_req_mask_o,
+  input [NUM_PORTS-1:0]                mem_rsp_valid_i,
+  input [32*NUM_PORTS-1:0]             mem_rsp_rdata_i,
+  input [NUM_PORTS-1:0]                mem_rsp_error_i
+);
+
+  localparam USER_BITS = HART_BITS + 1;
+
+  reg [NUM_HARTS-1:0] resv_valid_q;
+  reg [29:0]          resv_word_q [0:NUM_HARTS-1];
+
+  // Request fields, per port
+  wire [NUM_PORTS-1:0] fire;
+  wire [NUM_PORTS-1:0] excl;
+  wire [HART_BITS-1:0] hart [0:NUM_PORTS-1];
+  wire [29:0]          word [0:NUM_PORTS-1];
+
+  genvar p;
+  generate
+    for (p = 0; p < NUM_PORTS; p = p + 1) begin : gen_port
+      wire       held;
+      wire       drop;
+      wire       queue_ready;
+      wire [1:0] queued;  // {write, dropped} for the oldest outstanding request
+      // Requests are only queued once they've been passed on
+      /* verilator lint_off UNUSED */
+      wire       queue_valid;
+      wire [$clog2(MAX_OUTSTANDING+1)-1:0] queue_level;
+      /* verilator lint_on UNUSED */
+
+      assign excl[p] = req_user_i[USER_BITS*p];
+      assign hart[p] = req_user_i[USER_BITS*p + 1 +: HART_BITS];
+      assign word[p] = req_addr_i[32*p + 2 +: 30];
+
+      assign held = resv_valid_q[hart[p]] && resv_word_q[hart[p]] == word[p];
+      assign drop = req_we_i[p] && excl[p] && !held;
+
+      assign mem_req_valid_o[p] = req_valid_i[p] && queue_ready;
+      assign req_ready_o[p] = mem_req_ready_i[p] && queue_ready;
+      assign mem_req_addr_o[32*p +: 32] = req_addr_i[32*p +: 32];
+      assign mem_req_we_o[p] = req_we_i[p];
+      assign mem_req_wdata_o[32*p +: 32] = req_wdata_i[32*p +: 32];
+      assign mem_req_mask_o[4*p +: 4] = drop ? 4'b0 : req_mask_i[4*p +: 4];
+      assign fire[p] = mem_req_valid_o[p] && mem_req_ready_i[p];
+
+      fifo #(
+        .WIDTH(2),
+        .DEPTH(MAX_OUTSTANDING)
+      ) queue (
+        .clk_i(clk_i),
+        .rst_i(rst_i),
+
+        .push_valid_i(fire[p]),
+        .push_ready_o(queue_ready),
+        .push_data_i({req_we_i[p], drop}),
+
+        .pop_valid_o(queue_valid),
+        .pop_ready_i(mem_rsp_valid_i[p]),
+        .pop_data_o(queued),
+
+        .level_o(queue_level)
+      );
+
+      assign rsp_valid_o[p] = mem_rsp_valid_i[p];
+      assign rsp_rdata_o[32*p +: 32] = queued[1] ? {31'b0, queued[0]} :
+                                                   mem_rsp_rdata_i[32*p +: 32];
+      assign rsp_error_o[p] = mem_rsp_error_i[p];
+    end
+  endgenerate
+
+  // Ports cover different addresses, so a write and an exclusive read of the
+  // same word never arrive together
+  integer h, i;
+  always @(posedge clk_i) begin
+    if (rst_i) begin
+      resv_valid_q <= {NUM_HARTS{1'b0}};
+    end else begin
+      for (h = 0; h < NUM_HARTS; h = h + 1) begin
+        for (i = 0; i < NUM_PORTS; i = i + 1) begin
+          if (fire[i] && req_we_i[i] &&
+              (resv_word_q[h] == word[i] || (excl[i] && hart[i] == h[HART_BITS-1:0])))
+            resv_valid_q[h] <= 1'b0;
+        end
+        for (i = 0; i < NUM_PORTS; i = i + 1) begin
+          if (fire[i] && !req_we_i[i] && excl[i] && hart[i] == h[HART_BITS-1:0]) begin
+            resv_valid_q[h] <= 1'b1;
+            resv_word_q[h] <= word[i];
+          end
+        end
+      end
+    end
+  end
+
+endmodule
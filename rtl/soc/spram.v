@@ -0,0 +1,167 @@
+// Data memory built from the UP5K's four 256 Kbit single-port RAMs
+// (SB_SPRAM256KA), covering SPRAM_SIZE bytes at SPRAM_BASE. A bus slave (see
+// bus_xbar.v) that answers requests the next cycle, like ram.
+//
+// Each SPRAM is 16K x 16 bits, so they're paired up into two 16K x 32 bit
+// banks.
+module spram (
+  input         clk_i,
+  input         rst_i,
+
+  input         req_valid_i,
+  output        req_ready_o,
+  input [31:0]  req_addr_i,
+  input         req_we_i,
+  input [31:0]  req_wdata_i,
+  input [3:0]   req_mask_i,
+  output reg    rsp_valid_o,
+  output [31:0] rsp_rdata_o,
+  output        rsp_error_o
+);
+
+`include "memmap.vh"
+
+  wire do_read, do_write;
+  assign do_read = req_valid_i && !req_we_i;
+  assign do_write = req_valid_i && req_we_i;
+
+  // Only the bits covering SPRAM_SIZE are used
+  /* verilator lint_off UNUSED */
+  wire [31:0] offset;
+  /* verilator lint_on UNUSED */
+  assign offset = req_addr_i - SPRAM_BASE;
+
+  // Bit 16 of the offset selects the bank, the rest is the word within it
+  wire        bank;
+  wire [13:0] word;
+  assign bank = offset[16];
+  assign word = offset[15:2];
+
+  reg  [31:0] rdata_word;
+  assign rsp_rdata_o = rdata_word;
+
+  assign req_ready_o = 1'b1;
+  assign rsp_error_o = 1'b0;
+
+  always @(posedge clk_i) begin
+    if (rst_i) begin
+      rsp_valid_o <= 1'b0;
+    end else begin
+      rsp_valid_o <= req_valid_i;
+    end
+  end
+
+`ifdef SIM
+  // Behavioral model with the same read latency as the SPRAM primitives
+  reg [31:0] mem[SPRAM_SIZE / 4] /*verilator public*/;
+
+  always @(posedge clk_i) begin
+    if (do_read) begin
+      rdata_word <= mem[{bank, word}];
+    end
+
+    if (do_write) begin
+      if (req_mask_i[3])
+        mem[{bank, word}][31:24] <= req_wdata_i[31:24];
+      if (req_mask_i[2])
+        mem[{bank, word}][23:16] <= req_wdata_i[23:16];
+      if (req_mask_i[1])
+        mem[{bank, word}][15:8] <= req_wdata_i[15:8];
+      if (req_mask_i[0])
+        mem[{bank, word}][7:0] <= req_wdata_i[7:0];
+    end
+  end
+
+  // Tasks for loading and inspecting SPRAM from simulation. Addresses are
+  // offsets from SPRAM_BASE.
+  export "DPI-C" task verilator_load_spram;
+  export "DPI-C" task verilator_set_spram_entry;
+  export "DPI-C" function verilator_get_spram_entry;
+
+  task verilator_load_spram;
+    input string file;
+    $readmemh(file, mem);
+  endtask
+
+  task verilator_set_spram_entry;
+    input int addr;
+    input int data;
+    mem[addr >> 2] = data;
+  endtask
+
+  function int verilator_get_spram_entry;
+    input int addr;
+    verilator_get_spram_entry = mem[addr >> 2];
+  endfunction
+`else
+  // SPRAM write enables are per nibble
+  wire [3:0] maskwren_lo, maskwren_hi;
+  assign maskwren_lo = {req_mask_i[1], req_mask_i[1], req_mask_i[0], req_mask_i[0]};
+  assign maskwren_hi = {req_mask_i[3], req_mask_i[3], req_mask_i[2], req_mask_i[2]};
+
+  reg bank_q;
+  always @(posedge clk_i) begin
+    if (do_read) begin
+      bank_q <= bank;
+    end
+  end
+
+  wire [31:0] bank0_data, bank1_data;
+  always @(*) begin
+    rdata_word = bank_q ? bank1_data : bank0_data;
+  end
+
+  SB_SPRAM256KA bank0_lo (
+    .ADDRESS(word),
+    .DATAIN(req_wdata_i[15:0]),
+    .MASKWREN(maskwren_lo),
+    .WREN(do_write),
+    .CHIPSELECT((do_read || do_write) && !bank),
+    .CLOCK(clk_i),
+    .STANDBY(1'b0),
+    .SLEEP(1'b0),
+    .POWEROFF(1'b1),
+    .DATAOUT(bank0_data[15:0])
+  );
+
+  SB_SPRAM256KA bank0_hi (
+    .ADDRESS(word),
+    .DATAIN(req_wdata_i[31:16]),
+    .MASKWREN(maskwren_hi),
+    .WREN(do_write),
+    .CHIPSELECT((do_read || do_write) && !bank),
+    .CLOCK(clk_i),
+    .STANDBY(1'b0),
+    .SLEEP(1'b0),
+    .POWEROFF(1'b1),
+    .DATAOUT(bank0_data[31:16])
+  );
+
+  SB_SPRAM256KA bank1_lo (
+    .ADDRESS(word),
+    .DATAIN(req_wdata_i[15:0]),
+    .MASKWREN(maskwren_lo),
+    .WREN(do_write),
+    .CHIPSELECT((do_read || do_write) && bank),
+    .CLOCK(clk_i),
+    .STANDBY(1'b0),
+    .SLEEP(1'b0),
+    .POWEROFF(1'b1),
+    .DATAOUT(bank1_data[15:0])
+  );
+
+  SB_SPRAM256KA bank1_hi (
+    .ADDRESS(word),
+    .DATAIN(req_wdata_i[31:16]),
+    .MASKWREN(maskwren_hi),
+    .WREN(do_write),
+    .CHIPSELECT((do_read || do_write) && bank),
+    .CLOCK(clk_i),
+    .STANDBY(1'b0),
+    .SLEEP(1'b0),
+    .POWEROFF(1'b1),
+    .DATAOUT(bank1_data[31:16])
+  );
+`endif
+
+endmodule
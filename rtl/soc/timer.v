@@ -1,28 +1,152 @@
-module timer (
-  input  clk_i,
-  input  rst_i,
+// CLINT-style machine timer. mtime counts milliseconds from reset, and the
+// timer interrupt is raised whenever mtime >= mtimecmp. mtimecmp starts out
+// at its maximum, so nothing fires until software asks for it. Each hart has
+// an msip register driving its software interrupt, for harts to signal each
+// other; the timer interrupt is only for hart 0.
+//
+// Registers (offsets from TIMER_BASE):
+//   0x00 mtime[31:0]
+//   0x04 mtime[63:32]
+//   0x08 mtimecmp[31:0]
+//   0x0C mtimecmp[63:32]
+//   0x10 + 4 * hart: msip (bit 0), for up to 4 harts
+module timer #(
+  parameter NUM_HARTS = 1
+) (
+  input         clk_i,
+  input         rst_i,
 
-  input write_req_i,
+  input         req_valid_i,
+  output        req_ready_o,
+  input [31:0]  req_addr_i,
+  input         req_we_i,
+  input [31:0]  req_wdata_i,
+  input [3:0]   req_mask_i,
+  output        rsp_valid_o,
+  output [31:0] rsp_rdata_o,
+  output        rsp_error_o,
 
-  output timer_irq_o
+  output                 timer_irq_o,
+  output [NUM_HARTS-1:0] software_irq_o
 );
 
+`include "memmap.vh"
+
 `ifndef SIM
   localparam [13:0] TICKS_PER_MS = 14'd12_000; // 12 mhz clock
 `else
   localparam [13:0] TICKS_PER_MS = 14'd100;
 `endif
 
-  reg [13:0] counter;
+  // Reads have no side effects
+  /* verilator lint_off UNUSED */
+  wire        reg_read;
+  /* verilator lint_on UNUSED */
+  wire        reg_write;
+  wire [4:0]  reg_addr;
+  wire [31:0] reg_wdata;
+  wire [3:0]  reg_mask;
+  reg [31:0]  reg_rdata;
+  reg         reg_error;
+
+  bus_regs #(
+    .BASE(TIMER_BASE),
+    .ADDR_BITS(5)
+  ) regs (
+    .clk_i(clk_i),
+    .rst_i(rst_i),
+
+    .req_valid_i(req_valid_i),
+    .req_ready_o(req_ready_o),
+    .req_addr_i(req_addr_i),
+    .req_we_i(req_we_i),
+    .req_wdata_i(req_wdata_i),
+    .req_mask_i(req_mask_i),
+    .rsp_valid_o(rsp_valid_o),
+    .rsp_rdata_o(rsp_rdata_o),
+    .rsp_error_o(rsp_error_o),
+
+    .reg_read_o(reg_read),
+    .reg_write_o(reg_write),
+    .reg_addr_o(reg_addr),
+    .reg_wdata_o(reg_wdata),
+    .reg_mask_o(reg_mask),
+    .reg_rdata_i(reg_rdata),
+    .reg_error_i(reg_error)
+  );
+
+  // Applies a write to a register, keeping bytes outside the mask
+  function [31:0] masked;
+    input [31:0] old;
+    input [31:0] data;
+    input [3:0]  mask;
+    integer b;
+    begin
+      for (b = 0; b < 4; b = b + 1)
+        masked[8*b +: 8] = mask[b] ? data[8*b +: 8] : old[8*b +: 8];
+    end
+  endfunction
+
+  // Public so the simulator can fast-forward while the core sleeps
+  reg [13:0] prescaler /*verilator public*/;
+  reg [63:0] mtime /*verilator public*/;
+  reg [63:0] mtimecmp /*verilator public*/;
+  reg [NUM_HARTS-1:0] msip;
+
+  // Hart whose msip is addressed, if any
+  wire       msip_sel;
+  wire [1:0] msip_hart;
+  assign msip_hart = reg_addr[3:2];
+  assign msip_sel = reg_addr[4] && {1'b0, msip_hart} < NUM_HARTS[2:0];
 
   always @(posedge clk_i) begin
-    if (rst_i || write_req_i) begin
-      counter <= 14'b0;
-    end else if (counter != TICKS_PER_MS) begin
-      counter <= counter + 14'b1;
+    if (rst_i) begin
+      prescaler <= 14'b0;
+      mtime <= 64'b0;
+      mtimecmp <= {64{1'b1}};
+      msip <= {NUM_HARTS{1'b0}};
+    end else begin
+      if (prescaler == TICKS_PER_MS - 14'd1) begin
+        prescaler <= 14'b0;
+        mtime <= mtime + 64'b1;
+      end else begin
+        prescaler <= prescaler + 14'b1;
+      end
+
+      // Writes take priority over the count
+      if (reg_write) begin
+        case (reg_addr)
+          5'h00: mtime[31:0] <= masked(mtime[31:0], reg_wdata, reg_mask);
+          5'h04: mtime[63:32] <= masked(mtime[63:32], reg_wdata, reg_mask);
+          5'h08: mtimecmp[31:0] <= masked(mtimecmp[31:0], reg_wdata, reg_mask);
+          5'h0C: mtimecmp[63:32] <= masked(mtimecmp[63:32], reg_wdata, reg_mask);
+          default: ;
+        endcase
+        if (msip_sel && reg_mask[0])
+          msip[msip_hart] <= reg_wdata[0];
+      end
     end
   end
 
-  assign timer_irq_o = counter == TICKS_PER_MS;
+  always @(*) begin
+    reg_rdata = 32'b0;
+    reg_error = 1'b0;
+
+    case (reg_addr)
+      5'h00: reg_rdata = mtime[31:0];
+      5'h04: reg_rdata = mtime[63:32];
+      5'h08: reg_rdata = mtimecmp[31:0];
+      5'h0C: reg_rdata = mtimecmp[63:32];
+      default: begin
+        if (msip_sel)
+          reg_rdata = {31'b0, msip[msip_hart]};
+        else
+          reg_error = 1'b1;
+      end
+    endcase
+  end
+
+  assign timer_irq_o = mtime >= mtimecmp;
+  assign software_irq_o = msip;
 
 endmodule
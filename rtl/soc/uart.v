@@ -0,0 +1,195 @@
+// UART registers and FIFOs. The serial side is a byte stream in each
+// direction, which uart_phy.v turns into TX/RX pins on the FPGA and the
+// harness talks to directly in simulation.
+//
+// Registers (offsets from UART_BASE):
+//   0x00 txdata: writes push a byte to the TX FIFO, dropped if it's full.
+//        Reads return the full flag in bit 31.
+//   0x04 rxdata: reads pop a byte from the RX FIFO into bits 7:0, or return
+//        bit 31 set if it's empty.
+//   0x08 status: TX FIFO level in bits 7:0, RX FIFO level in bits 15:8, and
+//        bit 16 set once the TX FIFO is empty and the last byte's stop bit
+//        has gone out
+//   0x0C ctrl: bit 0 enables the TX interrupt, bit 1 the RX interrupt. The TX
+//        threshold is in bits 11:8 and the RX threshold in bits 19:16.
+//   0x10 ip: bit 0 is set while the TX level is below its threshold, bit 1
+//        while the RX level is above its threshold
+//   0x14 div: clock cycles per bit, minus one
+//
+// The interrupt is level-triggered: it stays up as long as an enabled ip bit
+// is set.
+//
+// Reading rxdata pops the FIFO. The core never abandons a load from a device
+// for an interrupt, so each load pops exactly one byte.
+module uart #(
+  // A power of two from 16 to 64
+  parameter FIFO_DEPTH = 16,
+  parameter [15:0] DEFAULT_DIV = 16'd103 // 115200 baud at 12 MHz
+) (
+  input             clk_i,
+  input             rst_i,
+
+  input             req_valid_i,
+  output            req_ready_o,
+  input [31:0]      req_addr_i,
+  input             req_we_i,
+  input [31:0]      req_wdata_i,
+  input [3:0]       req_mask_i,
+  output            rsp_valid_o,
+  output [31:0]     rsp_rdata_o,
+  output            rsp_error_o,
+
+  output            tx_valid_o,
+  input             tx_ready_i,
+  output [7:0]      tx_data_o,
+
+  input             rx_valid_i,
+  output            rx_ready_o,
+  input [7:0]       rx_data_i,
+
+  output reg [15:0] div_o,
+  output            irq_o
+);
+
+`include "memmap.vh"
+
+  localparam LEVEL_BITS = $clog2(FIFO_DEPTH + 1);
+
+  wire        reg_read;
+  wire        reg_write;
+  wire [4:0]  reg_addr;
+  // Not every bit of every register is writable
+  /* verilator lint_off UNUSED */
+  wire [31:0] reg_wdata;
+  /* verilator lint_on UNUSED */
+  wire [3:0]  reg_mask;
+  reg [31:0]  reg_rdata;
+  reg         reg_error;
+
+  bus_regs #(
+    .BASE(UART_BASE),
+    .ADDR_BITS(5)
+  ) regs (
+    .clk_i(clk_i),
+    .rst_i(rst_i),
+
+    .req_valid_i(req_valid_i),
+    .req_ready_o(req_ready_o),
+    .req_addr_i(req_addr_i),
+    .req_we_i(req_we_i),
+    .req_wdata_i(req_wdata_i),
+    .req_mask_i(req_mask_i),
+    .rsp_valid_o(rsp_valid_o),
+    .rsp_rdata_o(rsp_rdata_o),
+    .rsp_error_o(rsp_error_o),
+
+    .reg_read_o(reg_read),
+    .reg_write_o(reg_write),
+    .reg_addr_o(reg_addr),
+    .reg_wdata_o(reg_wdata),
+    .reg_mask_o(reg_mask),
+    .reg_rdata_i(reg_rdata),
+    .reg_error_i(reg_error)
+  );
+
+  wire                  tx_push_ready;
+  wire [LEVEL_BITS-1:0] tx_level;
+  wire                  rx_pop_valid;
+  wire [7:0]            rx_pop_data;
+  wire [LEVEL_BITS-1:0] rx_level;
+
+  fifo #(
+    .WIDTH(8),
+    .DEPTH(FIFO_DEPTH)
+  ) tx_fifo (
+    .clk_i(clk_i),
+    .rst_i(rst_i),
+
+    .push_valid_i(reg_write && reg_addr == 5'h00 && reg_mask[0]),
+    .push_ready_o(tx_push_ready),
+    .push_data_i(reg_wdata[7:0]),
+
+    .pop_valid_o(tx_valid_o),
+    .pop_ready_i(tx_ready_i),
+    .pop_data_o(tx_data_o),
+
+    .level_o(tx_level)
+  );
+
+  fifo #(
+    .WIDTH(8),
+    .DEPTH(FIFO_DEPTH)
+  ) rx_fifo (
+    .clk_i(clk_i),
+    .rst_i(rst_i),
+
+    .push_valid_i(rx_valid_i),
+    .push_ready_o(rx_ready_o),
+    .push_data_i(rx_data_i),
+
+    .pop_valid_o(rx_pop_valid),
+    .pop_ready_i(reg_read && reg_addr == 5'h04),
+    .pop_data_o(rx_pop_data),
+
+    .level_o(rx_level)
+  );
+
+  reg       tx_ie, rx_ie;
+  reg [3:0] tx_thresh, rx_thresh;
+
+  always @(posedge clk_i) begin
+    if (rst_i) begin
+      tx_ie <= 1'b0;
+      rx_ie <= 1'b0;
+      tx_thresh <= 4'b0;
+      rx_thresh <= 4'b0;
+      div_o <= DEFAULT_DIV;
+    end else if (reg_write) begin
+      case (reg_addr)
+        5'h0C: begin
+          if (reg_mask[0]) begin
+            tx_ie <= reg_wdata[0];
+            rx_ie <= reg_wdata[1];
+          end
+          if (reg_mask[1])
+            tx_thresh <= reg_wdata[11:8];
+          if (reg_mask[2])
+            rx_thresh <= reg_wdata[19:16];
+        end
+        5'h14: begin
+          if (reg_mask[0])
+            div_o[7:0] <= reg_wdata[7:0];
+          if (reg_mask[1])
+            div_o[15:8] <= reg_wdata[15:8];
+        end
+        default: ;
+      endcase
+    end
+  end
+
+  wire tx_ip, rx_ip;
+  assign tx_ip = tx_level < {{(LEVEL_BITS-4){1'b0}}, tx_thresh};
+  assign rx_ip = rx_level > {{(LEVEL_BITS-4){1'b0}}, rx_thresh};
+
+  assign irq_o = (tx_ie && tx_ip) || (rx_ie && rx_ip);
+
+  always @(*) begin
+    reg_rdata = 32'b0;
+    reg_error = 1'b0;
+
+    case (reg_addr)
+      5'h00: reg_rdata[31] = !tx_push_ready;
+      5'h04: reg_rdata = rx_pop_valid ? {24'b0, rx_pop_data} : 32'h80000000;
+      5'h08: begin
+        reg_rdata[7:0] = {{(8-LEVEL_BITS){1'b0}}, tx_level};
+        reg_rdata[15:8] = {{(8-LEVEL_BITS){1'b0}}, rx_level};
+        reg_rdata[16] = !tx_valid_o && tx_ready_i;
+      end
+      5'h0C: reg_rdata = {12'b0, rx_thresh, 4'b0, tx_thresh, 6'b0, rx_ie, tx_ie};
+      5'h10: reg_rdata = {30'b0, rx_ip, tx_ip};
+      5'h14: reg_rdata = {16'b0, div_o};
+      default: reg_error = 1'b1;
+    endcase
+  end
+
+endmodule
@@ -0,0 +1,87 @@
+// Serial side of the UART: 8 data bits, no parity, one stop bit. Each bit
+// lasts div_i + 1 cycles. rx_i must already be synchronized to clk_i.
+//
+// Received bytes are dropped if the RX FIFO is full when they arrive.
+module uart_phy (
+  input         clk_i,
+  input         rst_i,
+
+  input [15:0]  div_i,
+
+  input         tx_valid_i,
+  output        tx_ready_o,
+  input [7:0]   tx_data_i,
+
+  output reg    rx_valid_o,
+  output [7:0]  rx_data_o,
+
+  output        tx_o,
+  input         rx_i
+);
+
+  /*
+   * Transmitter
+   */
+  reg [9:0]  tx_shift_q; // stop bit, data LSB first, start bit
+  reg [3:0]  tx_bits_q;  // bits left to send, 0 when idle
+  reg [15:0] tx_count_q;
+
+  assign tx_ready_o = tx_bits_q == 4'd0;
+  assign tx_o = tx_bits_q == 4'd0 || tx_shift_q[0];
+
+  always @(posedge clk_i) begin
+    if (rst_i) begin
+      tx_bits_q <= 4'd0;
+    end else if (tx_valid_i && tx_ready_o) begin
+      tx_shift_q <= {1'b1, tx_data_i, 1'b0};
+      tx_bits_q <= 4'd10;
+      tx_count_q <= div_i;
+    end else if (tx_bits_q != 4'd0) begin
+      if (tx_count_q == 16'd0) begin
+        tx_shift_q <= {1'b1, tx_shift_q[9:1]};
+        tx_bits_q <= tx_bits_q - 4'd1;
+        tx_count_q <= div_i;
+      end else begin
+        tx_count_q <= tx_count_q - 16'd1;
+      end
+    end
+  end
+
+  /*
+   * Receiver. Waits for a falling edge, then samples the middle of each bit.
+   */
+  reg [7:0]  rx_shift_q;
+  reg [3:0]  rx_bits_q;  // bits left to sample, 0 when idle
+  reg [15:0] rx_count_q;
+
+  assign rx_data_o = rx_shift_q;
+
+  always @(posedge clk_i) begin
+    rx_valid_o <= 1'b0;
+
+    if (rst_i) begin
+      rx_bits_q <= 4'd0;
+    end else if (rx_bits_q == 4'd0) begin
+      if (!rx_i) begin
+        rx_bits_q <= 4'd10;
+        rx_count_q <= {1'b0, div_i[15:1]};
+      end
+    end else if (rx_count_q == 16'd0) begin
+      rx_count_q <= div_i;
+      rx_bits_q <= rx_bits_q - 4'd1;
+      if (rx_bits_q == 4'd10) begin
+        // Glitch rather than a start bit
+        if (rx_i)
+          rx_bits_q <= 4'd0;
+      end else if (rx_bits_q == 4'd1) begin
+        // Keep the byte only if the stop bit is good
+        rx_valid_o <= rx_i;
+      end else begin
+        rx_shift_q <= {rx_i, rx_shift_q[7:1]};
+      end
+    end else begin
+      rx_count_q <= rx_count_q - 16'd1;
+    end
+  end
+
+endmodule
@@ -12,6 +12,14 @@
 #define ALU_OP_OR   0b110;
 #define ALU_OP_AND  0b111;
 
+#define ALU_OP_SHADD  0b1000;
+#define ALU_OP_LOGN   0b1001;
+#define ALU_OP_MINMAX 0b1010;
+#define ALU_OP_ROT    0b1011;
+#define ALU_OP_COUNT  0b1100;
+#define ALU_OP_EXT    0b1101;
+#define ALU_OP_BYTE   0b1110;
+
 class AluTest : public ::testing::Test {
 protected:
   void SetUp() override {
@@ -62,3 +70,129 @@ TEST_F(AluTest, ArithmeticVsLogicalShift) {
   tb->eval();
   EXPECT_EQ(tb->out_o, 1);
 }
+
+TEST_F(AluTest, ShiftAdd) {
+  tb->a_i = 3;
+  tb->b_i = 100;
+  tb->op_i = ALU_OP_SHADD;
+  tb->sub_op_i = 1; // sh1add
+  tb->eval();
+  EXPECT_EQ(tb->out_o, 106);
+
+  tb->sub_op_i = 2; // sh2add
+  tb->eval();
+  EXPECT_EQ(tb->out_o, 112);
+
+  tb->sub_op_i = 3; // sh3add
+  tb->eval();
+  EXPECT_EQ(tb->out_o, 124);
+}
+
+TEST_F(AluTest, InvertedLogic) {
+  tb->a_i = 0xF0F0F0F0;
+  tb->b_i = 0xFF00FF00;
+  tb->op_i = ALU_OP_LOGN;
+  tb->sub_op_i = 0b11; // andn
+  tb->eval();
+  EXPECT_EQ(tb->out_o, 0x00F000F0);
+
+  tb->sub_op_i = 0b10; // orn
+  tb->eval();
+  EXPECT_EQ(tb->out_o, 0xF0FFF0FF);
+
+  tb->sub_op_i = 0b00; // xnor
+  tb->eval();
+  EXPECT_EQ(tb->out_o, 0xF00FF00F);
+}
+
+TEST_F(AluTest, MinMax) {
+  tb->a_i = -1;
+  tb->b_i = 1;
+  tb->op_i = ALU_OP_MINMAX;
+  tb->sub_op_i = 0b00; // min
+  tb->eval();
+  EXPECT_EQ(tb->out_o, 0xFFFFFFFF);
+
+  tb->sub_op_i = 0b01; // minu
+  tb->eval();
+  EXPECT_EQ(tb->out_o, 1);
+
+  tb->sub_op_i = 0b10; // max
+  tb->eval();
+  EXPECT_EQ(tb->out_o, 1);
+
+  tb->sub_op_i = 0b11; // maxu
+  tb->eval();
+  EXPECT_EQ(tb->out_o, 0xFFFFFFFF);
+}
+
+TEST_F(AluTest, Rotate) {
+  tb->a_i = 0x80000001;
+  tb->b_i = 4;
+  tb->op_i = ALU_OP_ROT;
+  tb->sub_op_i = 0; // rol
+  tb->eval();
+  EXPECT_EQ(tb->out_o, 0x00000018);
+
+  tb->sub_op_i = 1; // ror
+  tb->eval();
+  EXPECT_EQ(tb->out_o, 0x18000000);
+
+  // Rotate amount only uses the low 5 bits, and 0 is the identity
+  tb->b_i = 32;
+  tb->eval();
+  EXPECT_EQ(tb->out_o, 0x80000001);
+}
+
+TEST_F(AluTest, CountBits) {
+  tb->a_i = 0x00F00100;
+  tb->op_i = ALU_OP_COUNT;
+  tb->sub_op_i = 0b00; // clz
+  tb->eval();
+  EXPECT_EQ(tb->out_o, 8);
+
+  tb->sub_op_i = 0b01; // ctz
+  tb->eval();
+  EXPECT_EQ(tb->out_o, 8);
+
+  tb->sub_op_i = 0b10; // cpop
+  tb->eval();
+  EXPECT_EQ(tb->out_o, 5);
+
+  // Zero input counts all 32 bits for clz/ctz
+  tb->a_i = 0;
+  tb->sub_op_i = 0b00;
+  tb->eval();
+  EXPECT_EQ(tb->out_o, 32);
+  tb->sub_op_i = 0b01;
+  tb->eval();
+  EXPECT_EQ(tb->out_o, 32);
+}
+
+TEST_F(AluTest, Extend) {
+  tb->a_i = 0x12348080;
+  tb->op_i = ALU_OP_EXT;
+  tb->sub_op_i = 0b00; // sext.b
+  tb->eval();
+  EXPECT_EQ(tb->out_o, 0xFFFFFF80);
+
+  tb->sub_op_i = 0b01; // sext.h
+  tb->eval();
+  EXPECT_EQ(tb->out_o, 0xFFFF8080);
+
+  tb->sub_op_i = 0b10; // zext.h
+  tb->eval();
+  EXPECT_EQ(tb->out_o, 0x00008080);
+}
+
+TEST_F(AluTest, ByteOps) {
+  tb->a_i = 0x12003400;
+  tb->op_i = ALU_OP_BYTE;
+  tb->sub_op_i = 0; // rev8
+  tb->eval();
+  EXPECT_EQ(tb->out_o, 0x00340012);
+
+  tb->sub_op_i = 1; // orc.b
+  tb->eval();
+  EXPECT_EQ(tb->out_o, 0xFF00FF00);
+}
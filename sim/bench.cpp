@@ -0,0 +1,134 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+#include "lemoncore.h"
+#include "verilated.h"
+
+// Runs the benchmarks in sw/bench on the core harness and prints what they
+// measured. Usage: bench.verilator <firmware.bin>...
+//
+// Each benchmark reports through a mailbox at the top of RAM (see
+// sw/bench/bench.h). The harness also drives the software interrupt for
+// the ones that ask for it. Exits with failure if any benchmark fails its
+// self-check, traps or doesn't finish.
+
+// RAM-relative offsets of the mailbox fields
+#define MAILBOX (0x2FE0 - ROM_SIZE)
+#define MAILBOX_STATUS (MAILBOX + 0)
+#define MAILBOX_ITERATIONS (MAILBOX + 4)
+#define MAILBOX_CYCLES (MAILBOX + 8)
+#define MAILBOX_INSTRET (MAILBOX + 12)
+#define MAILBOX_CHECKSUM (MAILBOX + 16)
+#define MAILBOX_IRQ_DELAY (MAILBOX + 20)
+#define MAILBOX_IRQ_ACK (MAILBOX + 24)
+
+#define STATUS_PASS 1
+#define STATUS_FAIL 2
+#define STATUS_TRAP 3
+
+#define MAX_CYCLES 10000000
+
+// VAX 11/780 Dhrystones per second, for DMIPS
+#define VAX_DHRYSTONES 1757
+
+static std::string bench_name(const std::string& path) {
+  size_t start = path.find_last_of('/');
+  start = start == std::string::npos ? 0 : start + 1;
+  size_t end = path.find('.', start);
+  return path.substr(start, end - start);
+}
+
+// Returns the mailbox status, or 0 if the benchmark never finished
+static uint32_t run_bench(Lemoncore& cpu, int* cycles) {
+  bool irq_raised = false;
+  uint32_t countdown = 0;
+  bool counting = false;
+
+  for (*cycles = 0; *cycles < MAX_CYCLES; (*cycles)++) {
+    if (!cpu.step())
+      return 0;
+
+    uint32_t status = cpu.read_ram(MAILBOX_STATUS);
+    if (status != 0)
+      return status;
+
+    // Lower the interrupt once it's acknowledged, then raise the next one
+    // irq_delay cycles later
+    uint32_t delay = cpu.read_ram(MAILBOX_IRQ_DELAY);
+    if (irq_raised) {
+      if (cpu.read_ram(MAILBOX_IRQ_ACK)) {
+        cpu.write_ram(MAILBOX_IRQ_ACK, 0);
+        cpu.set_irq_software(0);
+        irq_raised = false;
+      }
+    } else if (delay != 0) {
+      if (!counting) {
+        countdown = delay;
+        counting = true;
+      }
+      if (--countdown == 0) {
+        cpu.set_irq_software(1);
+        irq_raised = true;
+        counting = false;
+      }
+    }
+  }
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  Verilated::commandArgs(argc, argv);
+
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s <firmware.bin>...\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+
+  bool ok = true;
+  printf("%-10s %10s %10s %10s %6s %12s %10s\n", "benchmark", "iterations",
+         "cycles", "instret", "CPI", "cycles/iter", "score");
+  for (int i = 1; i < argc; i++) {
+    std::string path = argv[i];
+    std::string name = bench_name(path);
+
+    Lemoncore cpu(false, false);
+    if (!cpu.load_firmware(path)) {
+      fprintf(stderr, "Error reading file %s\n", path.c_str());
+      exit(EXIT_FAILURE);
+    }
+
+    int run_cycles;
+    uint32_t status = run_bench(cpu, &run_cycles);
+    if (status != STATUS_PASS) {
+      ok = false;
+      if (status == STATUS_FAIL)
+        printf("%-10s failed its self-check (checksum 0x%08x)\n", name.c_str(),
+               cpu.read_ram(MAILBOX_CHECKSUM));
+      else if (status == STATUS_TRAP)
+        printf("%-10s took an exception (mcause %u, mepc 0x%08x)\n", name.c_str(),
+               cpu.get_mcause(), cpu.get_mepc());
+      else
+        printf("%-10s didn't finish in %d cycles\n", name.c_str(), run_cycles);
+      continue;
+    }
+
+    uint32_t iterations = cpu.read_ram(MAILBOX_ITERATIONS);
+    uint32_t cycles = cpu.read_ram(MAILBOX_CYCLES);
+    uint32_t instret = cpu.read_ram(MAILBOX_INSTRET);
+    double cpi = instret ? (double) cycles / instret : 0;
+    double per_iter = iterations ? (double) cycles / iterations : 0;
+    // Iterations per second at 1 MHz, in the manner of CoreMark/MHz
+    double score = cycles ? 1e6 * iterations / cycles : 0;
+    const char* unit = "/MHz";
+    if (name == "dhrystone") {
+      score /= VAX_DHRYSTONES;
+      unit = " DMIPS/MHz";
+    }
+    printf("%-10s %10u %10u %10u %6.2f %12.1f %10.3f%s\n", name.c_str(),
+           iterations, cycles, instret, cpi, per_iter, score, unit);
+  }
+
+  exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+}
@@ -0,0 +1,55 @@
+#include "checkpoint.h"
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+CheckpointLog::CheckpointLog() : file(nullptr), interval(0) {
+}
+
+CheckpointLog::~CheckpointLog() {
+  close();
+}
+
+bool CheckpointLog::open(std::string path, uint64_t interval) {
+  if (interval == 0)
+    return false;
+  file = fopen(path.c_str(), "w");
+  if (!file)
+    return false;
+  this->interval = interval;
+  fprintf(file, "%s %" PRIu64 "\n", CHECKPOINT_MAGIC, interval);
+  return true;
+}
+
+void CheckpointLog::close() {
+  if (!file)
+    return;
+  fclose(file);
+  file = nullptr;
+}
+
+void CheckpointLog::record(const Checkpoint& c) {
+  fprintf(file, "%" PRIu64 " %" PRIu64 " %08x %016" PRIx64 "\n", c.instret, c.cycle, c.pc,
+          c.hash);
+}
+
+bool read_checkpoints(std::string path, uint64_t* interval, std::vector<Checkpoint>* checkpoints) {
+  FILE* file = fopen(path.c_str(), "r");
+  if (!file)
+    return false;
+
+  char magic[32];
+  bool ok = fscanf(file, "%31s %" SCNu64, magic, interval) == 2 &&
+            !strcmp(magic, CHECKPOINT_MAGIC);
+  checkpoints->clear();
+  Checkpoint c;
+  while (ok && fscanf(file, "%" SCNu64 " %" SCNu64 " %x %" SCNx64, &c.instret, &c.cycle, &c.pc,
+                      &c.hash) == 4) {
+    checkpoints->push_back(c);
+  }
+
+  fclose(file);
+  return ok;
+}
@@ -0,0 +1,66 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+// Checkpoint log: every `interval` retired instructions the core harness
+// folds its architectural state (registers, pc, CSRs and the RAM pages
+// written since the last checkpoint) into a rolling hash and logs it. Each
+// hash covers everything before it, so two runs first differ in the interval
+// ending at the first checkpoint whose hashes don't match. Only the core
+// harness takes them: in the SoC, other bus masters and the timer make the
+// state at an instruction count depend on timing.
+//
+// File format, text:
+//
+//   lemoncore-checkpoints <interval>
+//   <instret> <cycle> <pc> <hash>     one line per checkpoint
+//
+// pc and hash are hex, the pc being that of the next instruction.
+
+#define CHECKPOINT_MAGIC "lemoncore-checkpoints"
+
+struct Checkpoint {
+  uint64_t instret;
+  uint64_t cycle;
+  uint32_t pc;
+  uint64_t hash;
+};
+
+// Order-dependent hash of 32-bit words. Every step is invertible, so runs
+// that differ in a single word always end up with different hashes.
+class StateHash {
+ public:
+  explicit StateHash(uint64_t seed) : h(seed) {}
+  void add(uint32_t word) {
+    h = (h ^ word) * 0x100000001B3ull;
+    h ^= h >> 29;
+  }
+  uint64_t value() const { return h; }
+
+ private:
+  uint64_t h;
+};
+
+class CheckpointLog {
+ public:
+  CheckpointLog();
+  ~CheckpointLog();
+  bool open(std::string path, uint64_t interval);
+  void close();
+  void record(const Checkpoint& c);
+  uint64_t get_interval() const { return interval; }
+
+ private:
+  FILE* file;
+  uint64_t interval;
+};
+
+// Fails if the file can't be read or isn't a checkpoint log
+bool read_checkpoints(std::string path, uint64_t* interval, std::vector<Checkpoint>* checkpoints);
+
+#endif
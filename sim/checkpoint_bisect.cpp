@@ -0,0 +1,179 @@
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "checkpoint.h"
+#include "retire_trace.h"
+#include "util.h"
+
+// Compares two checkpoint logs (see checkpoint.h) and finds the interval in
+// which the runs first part. Usage:
+//
+//   checkpoint_bisect [--rerun-a CMD] [--rerun-b CMD] [--elf FILE] <a> <b>
+//
+// Given the commands that produced each log, it runs them again with just
+// that interval traced, CMD +window=FROM:TO +trace=<log>.window.trace
+// +vcd=<log>.window.vcd, and prints the first instruction the two
+// retirement traces disagree on.
+
+static void usage(const char* name) {
+  fprintf(stderr, "Usage: %s [--rerun-a CMD] [--rerun-b CMD] [--elf FILE] <a> <b>\n", name);
+  exit(EXIT_FAILURE);
+}
+
+static bool rerun(const std::string& cmd, const std::string& log, uint64_t from, uint64_t to) {
+  char window[64];
+  snprintf(window, sizeof(window), " +window=%" PRIu64 ":%" PRIu64, from, to);
+  std::string full = cmd + window + " +trace=" + log + ".window.trace +vcd=" + log + ".window.vcd";
+  printf("Running %s\n", full.c_str());
+  fflush(stdout);
+  return system(full.c_str()) == 0;
+}
+
+static bool same(const RetireRecord& a, const RetireRecord& b) {
+  return a.flags == b.flags && a.pc == b.pc && a.instr == b.instr && a.rd == b.rd &&
+         a.rd_value == b.rd_value && a.mem_addr == b.mem_addr && a.load_data == b.load_data &&
+         a.store_data == b.store_data && a.store_mask == b.store_mask && a.cause == b.cause;
+}
+
+static void print_record(const char* side, const RetireRecord& r, const SymbolTable* symbols) {
+  char text[128];
+  if (r.flags & RETIRE_NO_INSTR)
+    snprintf(text, sizeof(text), "-");
+  else
+    disassemble(text, sizeof(text), r.instr, r.pc, symbols);
+  printf("  %s 0x%08x %-32s", side, r.pc, text);
+  if (r.flags & RETIRE_TRAP)
+    printf(" trap mcause=0x%08x", r.cause);
+  if (r.flags & RETIRE_RD)
+    printf(" x%d=0x%08x", r.rd, r.rd_value);
+  if (r.flags & RETIRE_LOAD)
+    printf(" [0x%08x]->0x%08x", r.mem_addr, r.load_data);
+  if (r.flags & RETIRE_STORE)
+    printf(" [0x%08x]<-0x%08x/%x", r.mem_addr, r.store_data, r.store_mask);
+  printf("\n");
+}
+
+// Walks both window traces together and shows where they first differ, with
+// the last few records they agree on
+static void compare_traces(const std::string& a, const std::string& b, uint64_t from,
+                           const SymbolTable* symbols) {
+  RetireTraceReader ta, tb;
+  if (!ta.open(a + ".window.trace") || !tb.open(b + ".window.trace")) {
+    fprintf(stderr, "Couldn't read the window traces\n");
+    return;
+  }
+
+  const int context = 4;
+  std::vector<RetireRecord> history;
+  RetireRecord ra, rb;
+  uint64_t instr = from;
+  while (true) {
+    bool more_a = ta.next(&ra);
+    bool more_b = tb.next(&rb);
+    if (!more_a && !more_b) {
+      printf("The window traces match; the difference is in state they don't record\n");
+      return;
+    }
+    if (more_a != more_b || !same(ra, rb)) {
+      printf("First difference at instruction %" PRIu64 ":\n", instr);
+      for (const RetireRecord& r : history)
+        print_record(" ", r, symbols);
+      if (more_a)
+        print_record("a", ra, symbols);
+      else
+        printf("  a (trace ends)\n");
+      if (more_b)
+        print_record("b", rb, symbols);
+      else
+        printf("  b (trace ends)\n");
+      return;
+    }
+    if (!(ra.flags & RETIRE_TRAP))
+      instr++;
+    history.push_back(ra);
+    if (history.size() > context)
+      history.erase(history.begin());
+  }
+}
+
+int main(int argc, char** argv) {
+  const char* rerun_a = nullptr;
+  const char* rerun_b = nullptr;
+  const char* elf = nullptr;
+  std::vector<const char*> paths;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--rerun-a") && i + 1 < argc) {
+      rerun_a = argv[++i];
+    } else if (!strcmp(argv[i], "--rerun-b") && i + 1 < argc) {
+      rerun_b = argv[++i];
+    } else if (!strcmp(argv[i], "--elf") && i + 1 < argc) {
+      elf = argv[++i];
+    } else if (argv[i][0] != '-') {
+      paths.push_back(argv[i]);
+    } else {
+      usage(argv[0]);
+    }
+  }
+  if (paths.size() != 2)
+    usage(argv[0]);
+
+  uint64_t interval_a, interval_b;
+  std::vector<Checkpoint> a, b;
+  for (int i = 0; i < 2; i++) {
+    if (!read_checkpoints(paths[i], i ? &interval_b : &interval_a, i ? &b : &a)) {
+      fprintf(stderr, "%s is not a checkpoint log\n", paths[i]);
+      return EXIT_FAILURE;
+    }
+  }
+  if (interval_a != interval_b) {
+    fprintf(stderr, "The logs have different intervals (%" PRIu64 " and %" PRIu64 ")\n",
+            interval_a, interval_b);
+    return EXIT_FAILURE;
+  }
+
+  size_t n = std::min(a.size(), b.size());
+  size_t first = 0;
+  while (first < n && a[first].instret == b[first].instret && a[first].hash == b[first].hash)
+    first++;
+
+  if (first == n && a.size() == b.size()) {
+    printf("No divergence in %zu checkpoints\n", n);
+    return EXIT_SUCCESS;
+  }
+
+  // Past the end of the shorter log, the interval is where it stopped
+  uint64_t from = first ? a[first - 1].instret : 0;
+  uint64_t to = from + interval_a;
+  if (first < n) {
+    printf("Runs diverge between instructions %" PRIu64 " and %" PRIu64 "\n", from, to);
+    printf("  a: cycle %" PRIu64 ", pc 0x%08x, hash %016" PRIx64 "\n", a[first].cycle,
+           a[first].pc, a[first].hash);
+    printf("  b: cycle %" PRIu64 ", pc 0x%08x, hash %016" PRIx64 "\n", b[first].cycle,
+           b[first].pc, b[first].hash);
+  } else {
+    printf("Runs agree for %zu checkpoints, then %s stops\n", n,
+           a.size() < b.size() ? "a" : "b");
+  }
+
+  SymbolTable symbols;
+  if (elf && !symbols.load_elf(elf)) {
+    fprintf(stderr, "Couldn't read symbols from %s\n", elf);
+    return EXIT_FAILURE;
+  }
+
+  bool traced_a = rerun_a && rerun(rerun_a, paths[0], from, to);
+  bool traced_b = rerun_b && rerun(rerun_b, paths[1], from, to);
+  if ((rerun_a && !traced_a) || (rerun_b && !traced_b))
+    fprintf(stderr, "A rerun failed; its trace may be cut short\n");
+  if (rerun_a && rerun_b)
+    compare_traces(paths[0], paths[1], from, elf ? &symbols : nullptr);
+
+  return EXIT_FAILURE;
+}
@@ -0,0 +1,383 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include "Vlemoncore.h"
+#include "Vlemoncore_lemoncore.h"
+#include "verilated.h"
+#include "verilated_save.h"
+#if VM_COVERAGE
+#include "verilated_cov.h"
+#endif
+
+// Coverage-guided fuzzing entry point for libFuzzer (or AFL++, which builds
+// the same LLVMFuzzerTestOneInput). Unlike sim/fuzz.cpp there's no reference
+// model and no core harness: the input is a program plus a cycle-by-cycle
+// schedule of memory latencies, error responses and interrupt lines, driven
+// straight into Vlemoncore, and the run fails on a broken protocol invariant
+// rather than on a wrong result.
+//
+// The model is built with --coverage-line and --coverage-toggle, which turn
+// every RTL branch and signal toggle into a guarded counter increment in the
+// generated C++. Compiled with -fsanitize=fuzzer, each of those is an edge
+// the fuzzer sees, so its feedback is RTL coverage. Set COREFUZZ_COVERAGE to
+// a path to also write the Verilator coverage of the run there on exit, e.g.
+// to annotate the RTL for a corpus with corefuzz.verilator corpus -runs=0.
+//
+// Input layout:
+//
+//   byte 0         number of instruction words, 1 + n % MAX_WORDS
+//   4 bytes each   instruction words, little-endian, loaded from address 0
+//   1 byte/cycle   stimulus for each cycle after reset, zero once it runs out
+//
+// Stimulus bits:
+//
+//   [1:0]  latency of any request that starts this cycle
+//   [3:2]  port whose request starting this cycle gets an error response:
+//          0 none, 1 fetch, 2 read, 3 write
+//   [4]    irq_timer_i
+//   [5]    irq_software_i
+//   [6]    irq_external_i
+//   [7]    error response for a coprocessor request accepted this cycle
+//
+// Between inputs the model is restored from a snapshot taken just after
+// reset, rather than rebuilt. Needs --savable.
+
+#define MAX_WORDS 64
+#define MAX_CYCLES 4096
+// A fetch should complete at least this often unless the core is asleep
+#define WATCHDOG_CYCLES 256
+
+// Fetch from ROM only, read from both, write to RAM only
+#define ROM_SIZE 0x1000
+#define RAM_BASE 0x1000
+#define RAM_SIZE 0x1000
+
+#define CTRL_STATE_ERR 7
+
+enum Port { PORT_NONE, PORT_INSTR, PORT_READ, PORT_WRITE };
+
+// VerilatedSave and VerilatedRestore go through a file. These keep the
+// snapshot in memory.
+class SnapshotSave : public VerilatedSerialize {
+ public:
+  explicit SnapshotSave(std::vector<uint8_t>* buf) : buf(buf) {
+    m_isOpen = true;
+    header();
+  }
+  ~SnapshotSave() { flush(); }
+  void flush() override {
+    buf->insert(buf->end(), m_bufp, m_cp);
+    m_cp = m_bufp;
+  }
+
+ private:
+  std::vector<uint8_t>* buf;
+};
+
+class SnapshotRestore : public VerilatedDeserialize {
+ public:
+  explicit SnapshotRestore(const std::vector<uint8_t>* buf) : buf(buf) {
+    m_isOpen = true;
+  }
+  // Start reading the snapshot from the beginning again
+  void rewind() {
+    pos = 0;
+    m_cp = m_bufp;
+    m_endp = m_bufp;
+    header();
+  }
+  void fill() override {
+    // Keep what hasn't been read yet and top up from the snapshot
+    size_t left = m_endp - m_cp;
+    memmove(m_bufp, m_cp, left);
+    size_t n = std::min(bufferSize() - left, buf->size() - pos);
+    memcpy(m_bufp + left, buf->data() + pos, n);
+    pos += n;
+    m_cp = m_bufp;
+    m_endp = m_bufp + left + n;
+  }
+
+ private:
+  const std::vector<uint8_t>* buf;
+  size_t pos;
+};
+
+// One request/response port of the memory model. A request is answered
+// latency cycles after valid first goes up, in the cycle the countdown
+// reaches zero, and the port expects it to be held unchanged until then.
+struct PortState {
+  bool busy;
+  int countdown;
+  bool error;
+  uint32_t addr;
+  uint32_t data;
+  uint8_t mask;
+  bool excl;
+};
+
+static Vlemoncore* tb;
+static std::vector<uint8_t> snapshot;
+static SnapshotRestore* restore;
+
+static uint32_t rom[ROM_SIZE / 4];
+static uint32_t ram[RAM_SIZE / 4];
+static bool reservation_valid;
+static uint32_t reservation_addr;
+// A posted store got an error response, and the fault hasn't been taken yet
+static bool store_fault;
+
+static uint64_t cycle;
+
+static void fail(const char* what) {
+  fprintf(stderr, "corefuzz: %s at cycle %lu (state %d, fetching 0x%08x)\n", what,
+          (unsigned long)cycle, tb->lemoncore->ctrl_state, tb->instr_req_addr_o);
+  abort();
+}
+
+// An interrupt is enabled and pending, so the core takes it at the next
+// clock edge unless something holds it off. Sampled before that edge, while
+// mstatus.MIE still has its pre-trap value.
+static bool irq_taken() {
+  const Vlemoncore_lemoncore* core = tb->lemoncore;
+  return core->mstatus_mie && ((core->mie_timer && core->mip_timer) ||
+                               (core->mie_software && core->mip_software) ||
+                               (core->mie_external && core->mip_external));
+}
+
+// Tracks one port for this cycle. Returns true if the request is answered
+// now. A new request takes the latency and error from the stimulus, and one
+// that's outstanding may only be given up if may_drop.
+static bool port_step(PortState* p, bool valid, uint32_t addr, uint32_t data, uint8_t mask,
+                      bool excl, int latency, bool error, bool may_drop, const char* name) {
+  if (!valid) {
+    if (p->busy && !may_drop) {
+      static char msg[64];
+      snprintf(msg, sizeof(msg), "%s request dropped before its response", name);
+      fail(msg);
+    }
+    p->busy = false;
+    return false;
+  }
+
+  if (!p->busy) {
+    p->busy = true;
+    p->countdown = latency;
+    p->error = error;
+    p->addr = addr;
+    p->data = data;
+    p->mask = mask;
+    p->excl = excl;
+  } else if (p->addr != addr || p->data != data || p->mask != mask || p->excl != excl) {
+    static char msg[64];
+    snprintf(msg, sizeof(msg), "%s request changed before its response", name);
+    fail(msg);
+  }
+
+  if (p->countdown > 0) {
+    p->countdown--;
+    return false;
+  }
+  p->busy = false;
+  return true;
+}
+
+static void step_memory(PortState* instr, PortState* read, PortState* write, uint8_t stimulus) {
+  int latency = stimulus & 0x3;
+  Port error_port = (Port)((stimulus >> 2) & 0x3);
+
+  tb->instr_res_valid_i = 0;
+  tb->instr_res_error_i = 0;
+  tb->mem_read_res_valid_i = 0;
+  tb->mem_read_res_error_i = 0;
+  tb->mem_write_res_valid_i = 0;
+  tb->mem_write_res_error_i = 0;
+  tb->mem_write_res_excl_fail_i = 0;
+
+  // The core only gives up on a read or fetch to take an interrupt, or a
+  // fetch to take a store fault. Writes come out of the store buffer, or are
+  // exclusive and hold interrupts off, so they're always seen through.
+  if (port_step(instr, tb->instr_req_valid_o, tb->instr_req_addr_o, 0, 0, false,
+                latency, error_port == PORT_INSTR, irq_taken() || store_fault, "fetch")) {
+    uint32_t addr = instr->addr;
+    store_fault = false;
+    if (instr->error || addr % 4 != 0 || addr >= ROM_SIZE) {
+      tb->instr_res_error_i = 1;
+    } else {
+      tb->instr_res_valid_i = 1;
+      tb->instr_res_data_i = rom[addr / 4];
+    }
+  }
+
+  if (port_step(read, tb->mem_read_req_valid_o, tb->mem_read_req_addr_o, 0, 0,
+                tb->mem_read_req_excl_o, latency, error_port == PORT_READ, irq_taken(), "read")) {
+    uint32_t addr = read->addr;
+    if (read->error || addr >= RAM_BASE + RAM_SIZE) {
+      tb->mem_read_res_error_i = 1;
+    } else {
+      // Loads are taken low-aligned
+      uint32_t word = addr < ROM_SIZE ? rom[addr / 4] : ram[(addr - RAM_BASE) / 4];
+      tb->mem_read_res_valid_i = 1;
+      tb->mem_read_res_data_i = word >> (8 * (addr % 4));
+      if (read->excl) {
+        reservation_valid = true;
+        reservation_addr = addr;
+      }
+    }
+  }
+
+  if (port_step(write, tb->mem_write_req_valid_o, tb->mem_write_req_addr_o,
+                tb->mem_write_req_data_o, tb->mem_write_req_mask_o, tb->mem_write_req_excl_o,
+                latency, error_port == PORT_WRITE, false, "write")) {
+    uint32_t addr = write->addr;
+    // A store that runs off its word should have trapped as misaligned
+    uint32_t lanes = (uint32_t)write->mask << (addr % 4);
+    if (write->mask == 0 || lanes > 0xF)
+      fail("write with a bad mask");
+
+    if (write->error || addr < RAM_BASE || addr >= RAM_BASE + RAM_SIZE) {
+      // Nothing outside RAM is ever written, the core gets an access fault
+      tb->mem_write_res_error_i = 1;
+      if (!write->excl)
+        store_fault = true;
+    } else {
+      bool same_word = reservation_addr / 4 == addr / 4;
+      bool excl_fail = write->excl && !(reservation_valid && same_word);
+      if (write->excl || same_word)
+        reservation_valid = false;
+
+      tb->mem_write_res_valid_i = 1;
+      tb->mem_write_res_excl_fail_i = excl_fail;
+      if (!excl_fail) {
+        // Every write that lands must be inside RAM, all of its bytes
+        if ((addr & ~3u) < RAM_BASE || (addr & ~3u) + 4 > RAM_BASE + RAM_SIZE)
+          fail("write outside RAM");
+        uint32_t mask = 0;
+        for (int i = 0; i < 4; i++) {
+          if (lanes & (1 << i))
+            mask |= 0xFFu << (8 * i);
+        }
+        uint32_t* word = &ram[(addr - RAM_BASE) / 4];
+        *word = (*word & ~mask) | ((write->data << (8 * (addr % 4))) & mask);
+      }
+    }
+  }
+}
+
+// The coprocessor accepts requests straight away and answers after the
+// latency, with an arbitrary function of the operands
+static void step_coprocessor(PortState* cop, uint8_t stimulus) {
+  tb->cop_req_ready_i = 0;
+  tb->cop_res_valid_i = 0;
+  tb->cop_res_error_i = 0;
+
+  if (!cop->busy) {
+    if (tb->cop_req_valid_o) {
+      tb->cop_req_ready_i = 1;
+      cop->busy = true;
+      cop->countdown = stimulus & 0x3;
+      cop->error = stimulus & 0x80;
+      cop->data = (tb->cop_req_rs1_o ^ tb->cop_req_rs2_o) + tb->cop_req_funct3_o +
+                  (tb->cop_req_funct7_o << 3) + (tb->cop_req_custom_o << 10);
+    }
+  } else if (tb->cop_req_valid_o) {
+    fail("coprocessor request before the last one's response");
+  }
+
+  if (cop->busy && cop->countdown-- == 0) {
+    tb->cop_res_valid_i = 1;
+    tb->cop_res_data_i = cop->data;
+    tb->cop_res_error_i = cop->error;
+    cop->busy = false;
+  }
+}
+
+static void write_coverage() {
+#if VM_COVERAGE
+  VerilatedCov::write(getenv("COREFUZZ_COVERAGE"));
+#endif
+}
+
+extern "C" int LLVMFuzzerInitialize(int* argc, char*** argv) {
+  Verilated::commandArgs(*argc, *argv);
+  tb = new Vlemoncore;
+
+  // Same reset as the core harness, then snapshot with every other input low
+  tb->clk_en_i = 1;
+  tb->rst_i = 1;
+  tb->clk_i = 0;
+  tb->eval();
+  tb->clk_i = 1;
+  tb->eval();
+  tb->rst_i = 0;
+  tb->eval();
+  {
+    SnapshotSave os(&snapshot);
+    os << *tb;
+  }
+  restore = new SnapshotRestore(&snapshot);
+
+  if (getenv("COREFUZZ_COVERAGE"))
+    atexit(write_coverage);
+  return 0;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  if (size < 1)
+    return 0;
+
+  restore->rewind();
+  *restore >> *tb;
+
+  memset(rom, 0, sizeof(rom));
+  memset(ram, 0, sizeof(ram));
+  reservation_valid = false;
+  reservation_addr = 0;
+  store_fault = false;
+
+  size_t words = 1 + data[0] % MAX_WORDS;
+  size_t pos = 1;
+  for (size_t i = 0; i < words && pos < size; i++) {
+    size_t n = std::min((size_t)4, size - pos);
+    memcpy(&rom[i], data + pos, n);
+    pos += n;
+  }
+
+  PortState instr = {}, read = {}, write = {}, cop = {};
+  int since_fetch = 0;
+  for (cycle = 0; cycle < MAX_CYCLES; cycle++) {
+    uint8_t stimulus = pos < size ? data[pos++] : 0;
+    tb->irq_timer_i = (stimulus >> 4) & 1;
+    tb->irq_software_i = (stimulus >> 5) & 1;
+    tb->irq_external_i = (stimulus >> 6) & 1;
+    tb->eval();
+
+    if (tb->lemoncore->ctrl_state == CTRL_STATE_ERR)
+      fail("control state machine in ERR");
+    if (tb->sleep_o && (tb->instr_req_valid_o || tb->mem_read_req_valid_o ||
+                        tb->mem_write_req_valid_o || tb->cop_req_valid_o))
+      fail("request while asleep");
+
+    step_memory(&instr, &read, &write, stimulus);
+    step_coprocessor(&cop, stimulus);
+
+    if (tb->instr_res_valid_i || tb->instr_res_error_i || tb->sleep_o)
+      since_fetch = 0;
+    else if (++since_fetch > WATCHDOG_CYCLES)
+      fail("no instruction fetched");
+
+    // Asleep with nothing left to wake it up
+    if (tb->sleep_o && pos >= size)
+      break;
+
+    tb->clk_i = 0;
+    tb->eval();
+    tb->clk_i = 1;
+    tb->eval();
+  }
+
+  return 0;
+}
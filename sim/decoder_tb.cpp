@@ -7,7 +7,7 @@
 
 #include "decoder_tb.h"
 
-const static int NUM_INSTRUCTIONS = 37;
+const static int NUM_INSTRUCTIONS = 58;
 
 struct control_signals_t {
   std::string instr;
@@ -50,18 +50,41 @@ struct control_signals_t CONTROL_SIGNAL_TABLE[NUM_INSTRUCTIONS] = {
  {"ORI",   rv_ori,   ALU_OP_OR,   A_SRC_RS1, B_SRC_IMM, 0,    0,    1,    NEXT_PC_INC, WB_SRC_ALU, -1},
  {"ANDI",  rv_andi,  ALU_OP_AND,  A_SRC_RS1, B_SRC_IMM, 0,    0,    1,    NEXT_PC_INC, WB_SRC_ALU, -1},
  {"SLLI",  rv_slli,  ALU_OP_SHL,  A_SRC_RS1, B_SRC_IMM, 0,    0,    1,    NEXT_PC_INC, WB_SRC_ALU, -1},
- {"SRLI",  rv_srli,  ALU_OP_SHR,  A_SRC_RS1, B_SRC_IMM, 0,    0,    1,    NEXT_PC_INC, WB_SRC_ALU, 1},
- {"SRAI",  rv_srai,  ALU_OP_SHR,  A_SRC_RS1, B_SRC_IMM, 0,    0,    1,    NEXT_PC_INC, WB_SRC_ALU, 0},
+ {"SRLI",  rv_srli,  ALU_OP_SHR,  A_SRC_RS1, B_SRC_IMM, 0,    0,    1,    NEXT_PC_INC, WB_SRC_ALU, 0},
+ {"SRAI",  rv_srai,  ALU_OP_SHR,  A_SRC_RS1, B_SRC_IMM, 0,    0,    1,    NEXT_PC_INC, WB_SRC_ALU, 1},
  {"ADD",   rv_add,   ALU_OP_ADD,  A_SRC_RS1, B_SRC_RS2, 0,    0,    1,    NEXT_PC_INC, WB_SRC_ALU, -1},
  {"SUB",   rv_sub,   ALU_OP_ADD,  A_SRC_RS1, B_SRC_RS2, 1,    0,    1,    NEXT_PC_INC, WB_SRC_ALU, -1},
  {"SLL",   rv_sll,   ALU_OP_SHL,  A_SRC_RS1, B_SRC_RS2, 0,    0,    1,    NEXT_PC_INC, WB_SRC_ALU, -1},
  {"SLT",   rv_slt,   ALU_OP_CMP,  A_SRC_RS1, B_SRC_RS2, 0,    0,    1,    NEXT_PC_INC, WB_SRC_ALU, -1},
  {"SLTU",  rv_sltu,  ALU_OP_CMPU, A_SRC_RS1, B_SRC_RS2, 0,    0,    1,    NEXT_PC_INC, WB_SRC_ALU, -1},
  {"XOR",   rv_xor,   ALU_OP_XOR,  A_SRC_RS1, B_SRC_RS2, 0,    0,    1,    NEXT_PC_INC, WB_SRC_ALU, -1},
- {"SRL",   rv_srl,   ALU_OP_SHR,  A_SRC_RS1, B_SRC_RS2, 0,    0,    1,    NEXT_PC_INC, WB_SRC_ALU, 1},
- {"SRA",   rv_sra,   ALU_OP_SHR,  A_SRC_RS1, B_SRC_RS2, 0,    0,    1,    NEXT_PC_INC, WB_SRC_ALU, 0},
+ {"SRL",   rv_srl,   ALU_OP_SHR,  A_SRC_RS1, B_SRC_RS2, 0,    0,    1,    NEXT_PC_INC, WB_SRC_ALU, 0},
+ {"SRA",   rv_sra,   ALU_OP_SHR,  A_SRC_RS1, B_SRC_RS2, 0,    0,    1,    NEXT_PC_INC, WB_SRC_ALU, 1},
  {"OR",    rv_or,    ALU_OP_OR,   A_SRC_RS1, B_SRC_RS2, 0,    0,    1,    NEXT_PC_INC, WB_SRC_ALU, -1},
  {"AND",   rv_and,   ALU_OP_AND,  A_SRC_RS1, B_SRC_RS2, 0,    0,    1,    NEXT_PC_INC, WB_SRC_ALU, -1},
+  // Zba/Zbb
+  // Instr             ALUop          Asrc       Bsrc       Bneg MemW RegW NextPc       WBsrc       ShiftType
+ {"SH1ADD", rv_sh1add, ALU_OP_SHADD,  A_SRC_RS1, B_SRC_RS2, 0,   0,   1,   NEXT_PC_INC, WB_SRC_ALU, -1},
+ {"SH2ADD", rv_sh2add, ALU_OP_SHADD,  A_SRC_RS1, B_SRC_RS2, 0,   0,   1,   NEXT_PC_INC, WB_SRC_ALU, -1},
+ {"SH3ADD", rv_sh3add, ALU_OP_SHADD,  A_SRC_RS1, B_SRC_RS2, 0,   0,   1,   NEXT_PC_INC, WB_SRC_ALU, -1},
+ {"ANDN",   rv_andn,   ALU_OP_LOGN,   A_SRC_RS1, B_SRC_RS2, 0,   0,   1,   NEXT_PC_INC, WB_SRC_ALU, -1},
+ {"ORN",    rv_orn,    ALU_OP_LOGN,   A_SRC_RS1, B_SRC_RS2, 0,   0,   1,   NEXT_PC_INC, WB_SRC_ALU, -1},
+ {"XNOR",   rv_xnor,   ALU_OP_LOGN,   A_SRC_RS1, B_SRC_RS2, 0,   0,   1,   NEXT_PC_INC, WB_SRC_ALU, -1},
+ {"MIN",    rv_min,    ALU_OP_MINMAX, A_SRC_RS1, B_SRC_RS2, 0,   0,   1,   NEXT_PC_INC, WB_SRC_ALU, -1},
+ {"MINU",   rv_minu,   ALU_OP_MINMAX, A_SRC_RS1, B_SRC_RS2, 0,   0,   1,   NEXT_PC_INC, WB_SRC_ALU, -1},
+ {"MAX",    rv_max,    ALU_OP_MINMAX, A_SRC_RS1, B_SRC_RS2, 0,   0,   1,   NEXT_PC_INC, WB_SRC_ALU, -1},
+ {"MAXU",   rv_maxu,   ALU_OP_MINMAX, A_SRC_RS1, B_SRC_RS2, 0,   0,   1,   NEXT_PC_INC, WB_SRC_ALU, -1},
+ {"ROL",    rv_rol,    ALU_OP_ROT,    A_SRC_RS1, B_SRC_RS2, 0,   0,   1,   NEXT_PC_INC, WB_SRC_ALU, -1},
+ {"ROR",    rv_ror,    ALU_OP_ROT,    A_SRC_RS1, B_SRC_RS2, 0,   0,   1,   NEXT_PC_INC, WB_SRC_ALU, -1},
+ {"RORI",   rv_rori,   ALU_OP_ROT,    A_SRC_RS1, B_SRC_IMM, 0,   0,   1,   NEXT_PC_INC, WB_SRC_ALU, -1},
+ {"CLZ",    rv_clz,    ALU_OP_COUNT,  A_SRC_RS1, B_SRC_IMM, 0,   0,   1,   NEXT_PC_INC, WB_SRC_ALU, -1},
+ {"CTZ",    rv_ctz,    ALU_OP_COUNT,  A_SRC_RS1, B_SRC_IMM, 0,   0,   1,   NEXT_PC_INC, WB_SRC_ALU, -1},
+ {"CPOP",   rv_cpop,   ALU_OP_COUNT,  A_SRC_RS1, B_SRC_IMM, 0,   0,   1,   NEXT_PC_INC, WB_SRC_ALU, -1},
+ {"SEXT.B", rv_sext_b, ALU_OP_EXT,    A_SRC_RS1, B_SRC_IMM, 0,   0,   1,   NEXT_PC_INC, WB_SRC_ALU, -1},
+ {"SEXT.H", rv_sext_h, ALU_OP_EXT,    A_SRC_RS1, B_SRC_IMM, 0,   0,   1,   NEXT_PC_INC, WB_SRC_ALU, -1},
+ {"ZEXT.H", rv_zext_h, ALU_OP_EXT,    A_SRC_RS1, B_SRC_RS2, 0,   0,   1,   NEXT_PC_INC, WB_SRC_ALU, -1},
+ {"REV8",   rv_rev8,   ALU_OP_BYTE,   A_SRC_RS1, B_SRC_IMM, 0,   0,   1,   NEXT_PC_INC, WB_SRC_ALU, -1},
+ {"ORC.B",  rv_orc_b,  ALU_OP_BYTE,   A_SRC_RS1, B_SRC_IMM, 0,   0,   1,   NEXT_PC_INC, WB_SRC_ALU, -1},
 };
 
 class DecoderTest : public ::testing::Test {
@@ -102,6 +125,8 @@ TEST_F(DecoderTest, ControlSignals) {
       EXPECT_EQ(tb->next_pc_o, ctrlsigs.next_pc) << "NextPC incorrect for instruction " << name;
     if (ctrlsigs.wb_src != -1)
       EXPECT_EQ(tb->wb_src_o, ctrlsigs.wb_src) << "WBsrc incorrect for instruction " << name;
+    if (ctrlsigs.shift_type != -1)
+      EXPECT_EQ(tb->shift_type_o, ctrlsigs.shift_type) << "ShiftType incorrect for instruction " << name;
   }
 }
 
@@ -110,7 +135,16 @@ TEST_F(DecoderTest, IllegalInstruction) {
   tb->eval();
   EXPECT_EQ(tb->illegal_instr_o, 1);
 
-  tb->instr_i = rv_and() | (1 << 30); // AND w/ a twist
+  tb->instr_i = rv_and() | (1 << 29); // AND w/ a twist
+  tb->eval();
+  EXPECT_EQ(tb->illegal_instr_o, 1);
+
+  // Bit 30 on AND is andn, but the same twist on ADD has no Zbb meaning
+  tb->instr_i = rv_add() | (1 << 29);
+  tb->eval();
+  EXPECT_EQ(tb->illegal_instr_o, 1);
+
+  tb->instr_i = rv_clz() | (0b11 << 20); // unused unary Zbb slot
   tb->eval();
   EXPECT_EQ(tb->illegal_instr_o, 1);
 }
@@ -128,12 +162,30 @@ TEST_F(DecoderTest, ExtractRs1) {
   EXPECT_EQ(tb->rs1_o, 0);
 }
 
+TEST_F(DecoderTest, ShiftImmediate) {
+  // The shift amount is the low 5 bits of the immediate, and srai's bit 30 is
+  // part of the instruction rather than of the amount
+  EXPECT_EQ(rv_srai(1, 2, 31), 0x41F15093u); // srai x1, x2, 31
+  tb->instr_i = rv_srai(1, 2, 31);
+  tb->eval();
+  EXPECT_EQ(tb->illegal_instr_o, 0);
+  EXPECT_EQ(tb->shift_type_o, 1);
+  EXPECT_EQ(tb->imm_o & 0x1f, 31);
+
+  tb->instr_i = rv_srli(1, 2, 31);
+  tb->eval();
+  EXPECT_EQ(tb->illegal_instr_o, 0);
+  EXPECT_EQ(tb->shift_type_o, 0);
+}
+
 TEST_F(DecoderTest, System) {
   // System instructions don't really take advantage of the same control signals,
   // so cleanest to test them individually.
   tb->instr_i = rv_fence();
   tb->eval();
   EXPECT_EQ(tb->nop_o, 1);
+  EXPECT_EQ(tb->fence_o, 1);
+  EXPECT_EQ(tb->wfi_o, 0);
   EXPECT_EQ(tb->ebreak_o, 0);
   EXPECT_EQ(tb->ecall_o, 0);
   EXPECT_EQ(tb->mret_o, 0);
@@ -141,6 +193,7 @@ TEST_F(DecoderTest, System) {
   tb->instr_i = rv_fence_i();
   tb->eval();
   EXPECT_EQ(tb->nop_o, 1);
+  EXPECT_EQ(tb->fence_o, 1);
   EXPECT_EQ(tb->ebreak_o, 0);
   EXPECT_EQ(tb->ecall_o, 0);
   EXPECT_EQ(tb->mret_o, 0);
@@ -148,6 +201,8 @@ TEST_F(DecoderTest, System) {
   tb->instr_i = rv_wfi();
   tb->eval();
   EXPECT_EQ(tb->nop_o, 1);
+  EXPECT_EQ(tb->wfi_o, 1);
+  EXPECT_EQ(tb->fence_o, 0);
   EXPECT_EQ(tb->ebreak_o, 0);
   EXPECT_EQ(tb->ecall_o, 0);
   EXPECT_EQ(tb->mret_o, 0);
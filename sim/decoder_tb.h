@@ -19,6 +19,14 @@
 #define ALU_OP_OR   DECODER_SIG(ALU_OP_OR)
 #define ALU_OP_AND  DECODER_SIG(ALU_OP_AND)
 
+#define ALU_OP_SHADD  DECODER_SIG(ALU_OP_SHADD)
+#define ALU_OP_LOGN   DECODER_SIG(ALU_OP_LOGN)
+#define ALU_OP_MINMAX DECODER_SIG(ALU_OP_MINMAX)
+#define ALU_OP_ROT    DECODER_SIG(ALU_OP_ROT)
+#define ALU_OP_COUNT  DECODER_SIG(ALU_OP_COUNT)
+#define ALU_OP_EXT    DECODER_SIG(ALU_OP_EXT)
+#define ALU_OP_BYTE   DECODER_SIG(ALU_OP_BYTE)
+
 #define NEXT_PC_ALU DECODER_SIG(NEXT_PC_ALU)
 #define NEXT_PC_INC DECODER_SIG(NEXT_PC_INC)
 #define NEXT_PC_BR0 DECODER_SIG(NEXT_PC_BR0)
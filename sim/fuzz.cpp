@@ -0,0 +1,692 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "iss.h"
+#include "lemoncore.h"
+#include "riscv.h"
+#include "util.h"
+#include "verilated.h"
+
+// Differential fuzzer: generates random programs, runs each on the core
+// harness and on the reference model in sim/iss.cpp in lockstep, and stops at
+// the first point where their architectural state differs. Usage:
+//
+//   fuzz.verilator [--seed N | --seeds A:B] [--jobs N] [--length N] [--trace]
+//
+// Program N is generated from seed N alone, so a failure reproduces with
+// --seed N. Seeds run in parallel, --jobs at a time (one per CPU by default).
+// Failing programs are then minimized, by dropping interrupts and replacing
+// instructions with nops for as long as the failure persists, and the
+// smallest one is printed along with where the two diverged. --trace dumps
+// its waveform to sim/fuzz-<seed>.vcd.
+//
+// A program is a straight run of random instructions: ALU and bit
+// manipulation ops, loads, stores and atomics around x8, forward branches and
+// jumps (some to misaligned targets), CSR accesses, ecall/ebreak, fences,
+// coprocessor instructions and known illegal encodings. Exceptions go to a
+// handler that skips the faulting instruction, and interrupts, raised at
+// random cycles through set_irq_*, to vectors that just mret. The state is
+// compared every time the core gets back to fetch: on each retired
+// instruction, exception and interrupt. RAM is compared at the end.
+
+// Memory layout. Boot runs the prologue, which sets mtvec to VECTORS in
+// vectored mode and jumps to the body.
+#define PROLOGUE 0x000
+#define VECTORS 0x040
+#define HANDLER 0x080
+#define BODY 0x100
+// jalr targets are absolute, off x0, so the body has to end below 2048
+#define MAX_LENGTH 440
+
+// Loads, stores and atomics address RAM through x8, and misaligned atomics
+// through x9. Neither is ever written, and nor is x31, which the handler
+// uses.
+#define BASE_REG 8
+#define BASE (ROM_SIZE + 0x800)
+#define MISALIGNED_REG 9
+#define HANDLER_REG 31
+
+#define MAX_IRQS 8
+#define CYCLES_PER_INSTR 32
+
+#define SOFTWARE_IRQ 3
+#define TIMER_IRQ 7
+#define EXTERNAL_IRQ 11
+
+#define CSR_MEPC 0x341
+#define CSR_MCAUSE 0x342
+#define CSR_MTVAL 0x343
+#define CSR_MINSTRET 0xB02
+#define CSR_MINSTRETH 0xB82
+
+// Raises irq line (an interrupt number) from cycle for duration cycles, or
+// until the core takes it
+struct IrqEvent {
+  int cycle;
+  int line;
+  int duration;
+};
+
+struct Program {
+  uint32_t seed;
+  uint32_t regs[32];
+  uint32_t mie;
+  bool enable_irqs;
+  std::vector<uint32_t> body;
+  std::vector<uint32_t> ram;
+  std::vector<IrqEvent> irqs;
+  int cop_latency;
+};
+
+enum Verdict {
+  PASS = 0,
+  MISMATCH = 1,
+  // The harness hit an assertion, say on a fetch from outside ROM
+  CRASH = 2,
+};
+
+static const uint32_t NOP = 0x00000013; // addi x0, x0, 0
+
+/*
+ * Program generation
+ */
+
+typedef std::mt19937 Rng;
+
+static uint32_t pick(Rng& rng, uint32_t n) {
+  return rng() % n;
+}
+
+static uint8_t src_reg(Rng& rng) {
+  return pick(rng, 32);
+}
+
+static uint8_t dst_reg(Rng& rng) {
+  uint8_t reg;
+  do {
+    reg = pick(rng, 31);
+  } while (reg == BASE_REG || reg == MISALIGNED_REG);
+  return reg;
+}
+
+static uint32_t random_value(Rng& rng) {
+  static const uint32_t edges[] = {0, 1, 0xFFFFFFFF, 0x80000000, 0x7FFFFFFF, 0xFFFF, 0x8000};
+  switch (pick(rng, 4)) {
+  case 0: return edges[pick(rng, sizeof(edges) / sizeof(edges[0]))];
+  case 1: return pick(rng, 64) - 32;
+  default: return rng();
+  }
+}
+
+// Coprocessor model shared by both sides. funct7 0x7F is an error.
+static bool cop_model(uint8_t custom, uint8_t funct3, uint8_t funct7,
+                      uint32_t rs1, uint32_t rs2, uint32_t* rd) {
+  *rd = (rs1 * 0x9E3779B1u) ^ (rs2 >> 3) ^ (custom << 31 | funct7 << 8 | funct3);
+  return funct7 != 0x7F;
+}
+
+static uint32_t gen_alu(Rng& rng) {
+  static uint32_t (*const ops[])(uint8_t, uint8_t, uint8_t) = {
+    rv_add, rv_sub, rv_sll, rv_slt, rv_sltu, rv_xor, rv_srl, rv_sra, rv_or, rv_and,
+    rv_sh1add, rv_sh2add, rv_sh3add, rv_andn, rv_orn, rv_xnor, rv_min, rv_minu,
+    rv_max, rv_maxu, rv_rol, rv_ror,
+  };
+  return ops[pick(rng, sizeof(ops) / sizeof(ops[0]))](dst_reg(rng), src_reg(rng), src_reg(rng));
+}
+
+static uint32_t gen_alu_imm(Rng& rng) {
+  static uint32_t (*const ops[])(uint8_t, uint8_t, int32_t) = {
+    rv_addi, rv_slti, rv_sltiu, rv_xori, rv_ori, rv_andi,
+  };
+  static uint32_t (*const shifts[])(uint8_t, uint8_t, int32_t) = {
+    rv_slli, rv_srli, rv_srai, rv_rori,
+  };
+  static uint32_t (*const unary[])(uint8_t, uint8_t) = {
+    rv_clz, rv_ctz, rv_cpop, rv_sext_b, rv_sext_h, rv_zext_h, rv_rev8, rv_orc_b,
+  };
+  switch (pick(rng, 3)) {
+  case 0:
+    return ops[pick(rng, sizeof(ops) / sizeof(ops[0]))](dst_reg(rng), src_reg(rng),
+                                                        (int32_t) pick(rng, 4096) - 2048);
+  case 1:
+    return shifts[pick(rng, sizeof(shifts) / sizeof(shifts[0]))](dst_reg(rng), src_reg(rng),
+                                                                 pick(rng, 32));
+  default:
+    return unary[pick(rng, sizeof(unary) / sizeof(unary[0]))](dst_reg(rng), src_reg(rng));
+  }
+}
+
+static uint32_t gen_load_store(Rng& rng) {
+  static uint32_t (*const loads[])(uint8_t, uint8_t, int32_t) = {
+    rv_lb, rv_lh, rv_lw, rv_lbu, rv_lhu,
+  };
+  static uint32_t (*const stores[])(uint8_t, uint8_t, int32_t) = {
+    rv_sb, rv_sh, rv_sw,
+  };
+  // Mostly aligned, the rest may fault
+  int32_t offset = (int32_t) pick(rng, 4095) - 2047;
+  if (pick(rng, 4) != 0)
+    offset &= ~3;
+  if (pick(rng, 2))
+    return loads[pick(rng, 5)](dst_reg(rng), BASE_REG, offset);
+  return stores[pick(rng, 3)](src_reg(rng), BASE_REG, offset);
+}
+
+static uint32_t gen_atomic(Rng& rng) {
+  static uint32_t (*const amos[])(uint8_t, uint8_t, uint8_t) = {
+    rv_amoswap_w, rv_amoadd_w, rv_amoxor_w, rv_amoand_w, rv_amoor_w,
+    rv_amomin_w, rv_amomax_w, rv_amominu_w, rv_amomaxu_w,
+  };
+  uint8_t base = pick(rng, 8) == 0 ? MISALIGNED_REG : BASE_REG;
+  switch (pick(rng, 3)) {
+  case 0: return rv_lr_w(dst_reg(rng), base);
+  case 1: return rv_sc_w(dst_reg(rng), base, src_reg(rng));
+  default: return amos[pick(rng, 9)](dst_reg(rng), base, src_reg(rng));
+  }
+}
+
+// A forward offset to somewhere up to end, occasionally misaligned
+static int32_t gen_offset(Rng& rng, uint32_t pc, uint32_t end) {
+  uint32_t max = (end - pc) / 4;
+  if (max > 16)
+    max = 16;
+  int32_t offset = 4 * (1 + pick(rng, max));
+  if (pick(rng, 16) == 0)
+    offset -= 2;
+  return offset;
+}
+
+static uint32_t gen_control(Rng& rng, uint32_t pc, uint32_t end) {
+  static uint32_t (*const branches[])(uint8_t, uint8_t, int32_t) = {
+    rv_beq, rv_bne, rv_blt, rv_bge, rv_bltu, rv_bgeu,
+  };
+  int32_t offset = gen_offset(rng, pc, end);
+  switch (pick(rng, 4)) {
+  case 0:
+    return rv_jal(dst_reg(rng), offset);
+  case 1:
+    // Bit 0 of the target is dropped, bit 1 faults
+    return rv_jalr(dst_reg(rng), 0, (pc + offset) | (pick(rng, 8) == 0));
+  default:
+    return branches[pick(rng, 6)](src_reg(rng), src_reg(rng), offset);
+  }
+}
+
+static uint32_t gen_csr(Rng& rng) {
+  // No mtvec writes, which would lose the handler, or mip reads, which
+  // depend on the cycle. The counters, mhpmevent and 0x7B0 (which doesn't
+  // exist) test access rules.
+  static const uint32_t csrs[] = {
+    RV_CSR_MSCRATCH, CSR_MEPC, CSR_MCAUSE, CSR_MTVAL, RV_CSR_MSTATUS, RV_CSR_MIE,
+    RV_CSR_MISA, RV_CSR_MHARTID, RV_CSR_INSTRET, RV_CSR_INSTRETH, CSR_MINSTRET,
+    CSR_MINSTRETH, 0xB03, 0xC03, 0x323, 0x33F, 0x7B0, RV_CSR_MTVEC,
+  };
+  static uint32_t (*const ops[])(uint8_t, uint8_t, uint32_t) = {
+    rv_csrrw, rv_csrrs, rv_csrrc, rv_csrrwi, rv_csrrsi, rv_csrrci,
+  };
+  uint32_t csr = csrs[pick(rng, sizeof(csrs) / sizeof(csrs[0]))];
+  // The register and immediate forms share the rs1 field
+  uint8_t rs1 = pick(rng, 4) == 0 ? 0 : src_reg(rng);
+  uint32_t op = pick(rng, 6);
+  if (csr == RV_CSR_MTVEC) {
+    // Only reads: set or clear from x0, as csrrw writes even then
+    rs1 = 0;
+    if (op % 3 == 0)
+      op++;
+  }
+  return ops[op](dst_reg(rng), rs1, csr);
+}
+
+static uint32_t gen_cop(Rng& rng) {
+  uint8_t funct7 = pick(rng, 8) == 0 ? 0x7F : pick(rng, 0x7F);
+  if (pick(rng, 2))
+    return rv_custom0(dst_reg(rng), src_reg(rng), src_reg(rng), pick(rng, 8), funct7);
+  return rv_custom1(dst_reg(rng), src_reg(rng), src_reg(rng), pick(rng, 8), funct7);
+}
+
+// Encodings the core must raise illegal instruction exceptions for
+static uint32_t gen_illegal(Rng& rng) {
+  static const uint32_t opcodes[] = {
+    0b0000111, 0b0100111, 0b1000011, 0b1010011, 0b1010111, 0b1011011, 0b1111011,
+  };
+  uint8_t rd = dst_reg(rng);
+  uint8_t rs1 = src_reg(rng);
+  uint8_t rs2 = src_reg(rng);
+  switch (pick(rng, 9)) {
+  case 0: return 0;
+  case 1: return 0xFFFFFFFF;
+  case 2: return (rng() & ~0x7Fu) | opcodes[pick(rng, 7)];
+  case 3: return (rv_lw(rd, BASE_REG, 0) & ~0x7000u) | (0b011 + pick(rng, 2) * 3) << 12;
+  case 4: return (rv_sw(rs2, BASE_REG, 0) & ~0x7000u) | (0b011 + pick(rng, 5)) << 12;
+  case 5: return (rv_beq(rs1, rs2, 8) & ~0x7000u) | (0b010 + pick(rng, 2)) << 12;
+  case 6: return rv_jalr(rd, 0, BODY) | (1 + pick(rng, 7)) << 12;
+  // M extension, which the core doesn't have
+  case 7: return rv_add(rd, rs1, rs2) | 1 << 25 | pick(rng, 8) << 12;
+  default: return rv_amoadd_w(rd, BASE_REG, rs2) ^ (1 + pick(rng, 7)) << 12;
+  }
+}
+
+static uint32_t gen_instr(Rng& rng, uint32_t pc, uint32_t end) {
+  uint32_t r = pick(rng, 100);
+  if (r < 20) return gen_alu(rng);
+  if (r < 38) return gen_alu_imm(rng);
+  if (r < 42) return pick(rng, 2) ? rv_lui(dst_reg(rng), rng()) : rv_auipc(dst_reg(rng), rng());
+  if (r < 60) return gen_load_store(rng);
+  if (r < 70) return gen_control(rng, pc, end);
+  if (r < 80) return gen_csr(rng);
+  if (r < 86) return gen_atomic(rng);
+  if (r < 90) return gen_cop(rng);
+  if (r < 92) return pick(rng, 2) ? rv_ecall() : rv_ebreak();
+  if (r < 94) return pick(rng, 2) ? rv_fence() : rv_fence_i();
+  return gen_illegal(rng);
+}
+
+static Program generate(uint32_t seed, int length) {
+  Rng rng(seed);
+  Program p;
+  p.seed = seed;
+  p.regs[0] = 0;
+  for (int i = 1; i < 32; i++)
+    p.regs[i] = random_value(rng);
+  p.regs[BASE_REG] = BASE;
+  p.regs[MISALIGNED_REG] = BASE + 2;
+  p.mie = (pick(rng, 2) << SOFTWARE_IRQ) | (pick(rng, 2) << TIMER_IRQ) |
+          (pick(rng, 2) << EXTERNAL_IRQ);
+  p.enable_irqs = pick(rng, 2);
+
+  uint32_t end = BODY + 4 * length;
+  for (int i = 0; i < length; i++)
+    p.body.push_back(gen_instr(rng, BODY + 4 * i, end));
+
+  for (int i = 0; i < RAM_SIZE / 4; i++)
+    p.ram.push_back(rng());
+
+  static const int lines[] = {SOFTWARE_IRQ, TIMER_IRQ, EXTERNAL_IRQ};
+  int irqs = pick(rng, MAX_IRQS + 1);
+  for (int i = 0; i < irqs; i++) {
+    IrqEvent e;
+    e.cycle = pick(rng, 6 * length);
+    e.line = lines[pick(rng, 3)];
+    e.duration = 1 + pick(rng, 64);
+    p.irqs.push_back(e);
+  }
+  p.cop_latency = pick(rng, 4);
+  return p;
+}
+
+/*
+ * Running
+ */
+
+static std::vector<uint32_t> rom_image(const Program& p) {
+  std::vector<uint32_t> rom(ROM_SIZE / 4, 0);
+  auto at = [&rom](uint32_t addr) -> uint32_t& { return rom[addr / 4]; };
+
+  // x31 is free until the handler needs it
+  int i = 0;
+  at(PROLOGUE + 4 * i++) = rv_addi(HANDLER_REG, 0, VECTORS | 1);
+  at(PROLOGUE + 4 * i++) = rv_csrrw(0, HANDLER_REG, RV_CSR_MTVEC);
+  at(PROLOGUE + 4 * i++) = rv_addi(HANDLER_REG, 0, p.mie >> 3);
+  at(PROLOGUE + 4 * i++) = rv_slli(HANDLER_REG, HANDLER_REG, 3);
+  at(PROLOGUE + 4 * i++) = rv_csrrw(0, HANDLER_REG, RV_CSR_MIE);
+  at(PROLOGUE + 4 * i++) = rv_csrrsi(0, p.enable_irqs << 3, RV_CSR_MSTATUS);
+  at(PROLOGUE + 4 * i) = rv_jal(0, BODY - (PROLOGUE + 4 * i));
+
+  at(VECTORS) = rv_jal(0, HANDLER - VECTORS);
+  at(VECTORS + 4 * SOFTWARE_IRQ) = rv_mret();
+  at(VECTORS + 4 * TIMER_IRQ) = rv_mret();
+  at(VECTORS + 4 * EXTERNAL_IRQ) = rv_mret();
+
+  // Resume after the faulting instruction
+  at(HANDLER + 0) = rv_csrrs(HANDLER_REG, 0, CSR_MEPC);
+  at(HANDLER + 4) = rv_addi(HANDLER_REG, HANDLER_REG, 4);
+  at(HANDLER + 8) = rv_csrrw(0, HANDLER_REG, CSR_MEPC);
+  at(HANDLER + 12) = rv_mret();
+
+  uint32_t end = BODY + 4 * p.body.size();
+  for (size_t j = 0; j < p.body.size(); j++)
+    at(BODY + 4 * j) = p.body[j];
+  at(end) = rv_fence();
+  at(end + 4) = rv_jal(0, 0);
+  return rom;
+}
+
+static bool is_vector(uint32_t pc) {
+  return pc == VECTORS + 4 * SOFTWARE_IRQ || pc == VECTORS + 4 * TIMER_IRQ ||
+         pc == VECTORS + 4 * EXTERNAL_IRQ;
+}
+
+struct Retired {
+  uint32_t pc;
+  uint32_t instr;
+  const char* what;
+};
+
+static void print_history(const std::vector<Retired>& history) {
+  size_t start = history.size() > 8 ? history.size() - 8 : 0;
+  for (size_t i = start; i < history.size(); i++) {
+    printf("  %-9s 0x%03x: ", history[i].what, history[i].pc);
+    print_instruction(history[i].instr, history[i].pc);
+  }
+}
+
+// Prints the fields that differ, returning whether any did
+static bool compare(Lemoncore& cpu, Iss& iss, bool report) {
+  bool differ = false;
+  auto check = [&](const char* name, uint32_t core, uint32_t model) {
+    if (core == model)
+      return;
+    differ = true;
+    if (report)
+      printf("  %-8s core 0x%08x, model 0x%08x\n", name, core, model);
+  };
+  check("pc", cpu.get_pc(), iss.get_pc());
+  for (int i = 1; i < 32; i++) {
+    char name[8];
+    snprintf(name, sizeof(name), "x%d", i);
+    check(name, cpu.get_reg(i), iss.get_reg(i));
+  }
+  check("mstatus", cpu.get_mstatus(), iss.get_mstatus());
+  check("mie", cpu.get_mie(), iss.get_mie());
+  check("mscratch", cpu.get_mscratch(), iss.get_mscratch());
+  check("mepc", cpu.get_mepc(), iss.get_mepc());
+  check("mcause", cpu.get_mcause(), iss.get_mcause());
+  check("mtval", cpu.get_mtval(), iss.get_mtval());
+  return differ;
+}
+
+// Runs p on both sides. With report set, says where they diverged.
+static Verdict run(const Program& p, bool report, const char* vcd_path) {
+  Lemoncore* cpu = vcd_path ? new Lemoncore(false, std::string(vcd_path))
+                            : new Lemoncore(false, false);
+  Iss iss(ROM_SIZE + RAM_SIZE);
+
+  std::vector<uint32_t> rom = rom_image(p);
+  for (uint32_t addr = 0; addr < ROM_SIZE; addr += 4) {
+    cpu->write_imem(addr, rom[addr / 4]);
+    iss.write_mem(addr, rom[addr / 4]);
+  }
+  for (uint32_t addr = 0; addr < RAM_SIZE; addr += 4) {
+    cpu->write_ram(addr, p.ram[addr / 4]);
+    iss.write_mem(ROM_SIZE + addr, p.ram[addr / 4]);
+  }
+  for (int i = 1; i < 32; i++) {
+    cpu->set_reg(i, p.regs[i]);
+    iss.set_reg(i, p.regs[i]);
+  }
+  iss.set_reset_state(cpu->get_mstatus(), cpu->get_mscratch(), cpu->get_mepc(),
+                      cpu->get_mcause(), cpu->get_mtval());
+  cpu->set_coprocessor(cop_model, p.cop_latency);
+  iss.set_coprocessor(cop_model);
+
+  uint32_t end = BODY + 4 * p.body.size() + 4;
+  int max_cycles = CYCLES_PER_INSTR * (p.body.size() + 16);
+  std::vector<bool> taken(p.irqs.size(), false);
+  std::vector<Retired> history;
+  bool was_fetching = true;
+  uint32_t last_pc = cpu->get_pc();
+  Verdict verdict = MISMATCH;
+
+  int cycle;
+  for (cycle = 0; cycle < max_cycles; cycle++) {
+    int lines = 0;
+    for (size_t i = 0; i < p.irqs.size(); i++) {
+      const IrqEvent& e = p.irqs[i];
+      if (!taken[i] && cycle >= e.cycle && cycle < e.cycle + e.duration)
+        lines |= 1 << e.line;
+    }
+    cpu->set_irq_software(lines >> SOFTWARE_IRQ & 1);
+    cpu->set_irq_timer(lines >> TIMER_IRQ & 1);
+    cpu->set_irq_external(lines >> EXTERNAL_IRQ & 1);
+    iss.set_irq_software(lines >> SOFTWARE_IRQ & 1);
+    iss.set_irq_timer(lines >> TIMER_IRQ & 1);
+    iss.set_irq_external(lines >> EXTERNAL_IRQ & 1);
+
+    // Between instructions, the core has to take a pending interrupt now
+    int pending = was_fetching ? iss.pending_interrupt() : -1;
+
+    cpu->step();
+    bool fetching = cpu->is_fetching();
+    uint32_t pc = cpu->get_pc();
+    bool event = fetching && (!was_fetching || pc != last_pc);
+    was_fetching = fetching;
+    last_pc = pc;
+
+    if (!event) {
+      if (pending >= 0) {
+        if (report)
+          printf("cycle %d: core didn't take interrupt %d\n", cycle, pending);
+        break;
+      }
+      continue;
+    }
+
+    uint32_t mcause = cpu->get_mcause();
+    if (is_vector(pc) && mcause == (1u << 31 | (pc - VECTORS) / 4)) {
+      int cause = mcause & 0x7FFFFFFF;
+      history.push_back({iss.get_pc(), iss.read_mem(iss.get_pc()), "interrupt"});
+      if (!iss.interrupt(cause)) {
+        if (report)
+          printf("cycle %d: core took interrupt %d, model expected %d\n", cycle, cause,
+                 iss.pending_interrupt());
+        break;
+      }
+      for (size_t i = 0; i < p.irqs.size(); i++) {
+        if (p.irqs[i].line == cause)
+          taken[i] = true;
+      }
+    } else {
+      uint32_t model_pc = iss.get_pc();
+      uint32_t instr = iss.read_mem(model_pc);
+      Iss::Result result = iss.step();
+      history.push_back({model_pc, instr, result == Iss::TRAPPED ? "trap" : "retire"});
+      if (result == Iss::UNMODELED) {
+        if (report) {
+          printf("cycle %d: the model doesn't cover 0x%08x at 0x%03x\n", cycle, instr,
+                 model_pc);
+        }
+        break;
+      }
+    }
+
+    if (compare(*cpu, iss, false)) {
+      if (report) {
+        printf("cycle %d: state differs after\n", cycle);
+        print_history(history);
+        compare(*cpu, iss, true);
+      }
+      break;
+    }
+
+    if (pc == end) {
+      verdict = PASS;
+      for (uint32_t addr = 0; addr < RAM_SIZE; addr += 4) {
+        uint32_t core = cpu->read_ram(addr);
+        uint32_t model = iss.read_mem(ROM_SIZE + addr);
+        if (core != model) {
+          verdict = MISMATCH;
+          if (report)
+            printf("RAM at 0x%04x: core 0x%08x, model 0x%08x\n", ROM_SIZE + addr, core,
+                   model);
+        }
+      }
+      break;
+    }
+  }
+  if (cycle == max_cycles && report)
+    printf("didn't reach the end in %d cycles\n", max_cycles);
+
+  delete cpu;
+  return verdict;
+}
+
+// In a child process, so harness assertions don't take the fuzzer down
+static Verdict run_isolated(const Program& p, bool report, const char* vcd_path) {
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    exit(EXIT_FAILURE);
+  }
+  if (pid == 0) {
+    Verdict verdict = run(p, report, vcd_path);
+    fflush(stdout);
+    _exit(verdict);
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  if (WIFEXITED(status))
+    return (Verdict) WEXITSTATUS(status);
+  return CRASH;
+}
+
+/*
+ * Minimizing
+ */
+
+static Program minimize(Program p, Verdict failure) {
+  for (int i = p.irqs.size() - 1; i >= 0; i--) {
+    Program q = p;
+    q.irqs.erase(q.irqs.begin() + i);
+    if (run_isolated(q, false, nullptr) == failure)
+      p = q;
+  }
+
+  // Nops keep every branch target where it was
+  for (size_t chunk = p.body.size() / 2; chunk >= 1; chunk /= 2) {
+    for (size_t start = 0; start < p.body.size(); start += chunk) {
+      Program q = p;
+      bool changed = false;
+      for (size_t i = start; i < start + chunk && i < q.body.size(); i++) {
+        changed |= q.body[i] != NOP;
+        q.body[i] = NOP;
+      }
+      if (changed && run_isolated(q, false, nullptr) == failure)
+        p = q;
+    }
+  }
+  return p;
+}
+
+static void print_program(const Program& p) {
+  printf("seed %u, mie 0x%03x, interrupts %s, coprocessor latency %d\n", p.seed, p.mie,
+         p.enable_irqs ? "on" : "off", p.cop_latency);
+  for (const IrqEvent& e : p.irqs)
+    printf("  irq %d at cycle %d for %d cycles\n", e.line, e.cycle, e.duration);
+  for (int i = 1; i < 32; i++)
+    printf("  x%-2d 0x%08x%s", i, p.regs[i], i % 4 == 3 ? "\n" : "");
+  printf("\n");
+  for (size_t i = 0; i < p.body.size(); i++) {
+    if (p.body[i] == NOP)
+      continue;
+    printf("  0x%03zx: ", BODY + 4 * i);
+    print_instruction(p.body[i], BODY + 4 * i);
+  }
+}
+
+static void report_failure(uint32_t seed, int length, bool trace) {
+  Program p = generate(seed, length);
+  Verdict failure = run_isolated(p, false, nullptr);
+  if (failure == PASS) {
+    printf("seed %u passed on its own\n", seed);
+    return;
+  }
+  Program small = minimize(p, failure);
+  printf("\n=== seed %u: %s, minimized to %zu instructions ===\n", seed,
+         failure == CRASH ? "harness assertion" : "mismatch",
+         small.body.size() - (size_t) std::count(small.body.begin(), small.body.end(), NOP));
+  print_program(small);
+  std::string vcd = "sim/fuzz-" + std::to_string(seed) + ".vcd";
+  run_isolated(small, true, trace ? vcd.c_str() : nullptr);
+  if (trace)
+    printf("waveform in %s\n", vcd.c_str());
+}
+
+static void usage(const char* name) {
+  fprintf(stderr, "Usage: %s [--seed N | --seeds A:B] [--jobs N] [--length N] [--trace]\n",
+          name);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char** argv) {
+  Verilated::commandArgs(argc, argv);
+
+  uint32_t first = 0, last = 1000;
+  int jobs = sysconf(_SC_NPROCESSORS_ONLN);
+  int length = 200;
+  bool trace = false;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--trace") {
+      trace = true;
+    } else if (i + 1 >= argc) {
+      usage(argv[0]);
+    } else if (arg == "--seed") {
+      first = strtoul(argv[++i], nullptr, 0);
+      last = first + 1;
+    } else if (arg == "--seeds") {
+      char* colon;
+      first = strtoul(argv[++i], &colon, 0);
+      if (*colon != ':')
+        usage(argv[0]);
+      last = strtoul(colon + 1, nullptr, 0);
+    } else if (arg == "--jobs") {
+      jobs = atoi(argv[++i]);
+    } else if (arg == "--length") {
+      length = atoi(argv[++i]);
+    } else {
+      usage(argv[0]);
+    }
+  }
+  if (length < 1 || length > MAX_LENGTH || jobs < 1 || last <= first)
+    usage(argv[0]);
+
+  // Workers take every jobs-th seed and send back the ones that fail
+  int fds[2];
+  if (pipe(fds) != 0) {
+    perror("pipe");
+    exit(EXIT_FAILURE);
+  }
+  fflush(stdout);
+  for (int w = 0; w < jobs; w++) {
+    pid_t pid = fork();
+    if (pid < 0) {
+      perror("fork");
+      exit(EXIT_FAILURE);
+    }
+    if (pid == 0) {
+      close(fds[0]);
+      for (uint32_t seed = first + w; seed < last; seed += jobs) {
+        if (run_isolated(generate(seed, length), false, nullptr) != PASS) {
+          if (write(fds[1], &seed, sizeof(seed)) != sizeof(seed))
+            _exit(EXIT_FAILURE);
+        }
+      }
+      _exit(EXIT_SUCCESS);
+    }
+  }
+  close(fds[1]);
+
+  std::vector<uint32_t> failures;
+  uint32_t seed;
+  while (read(fds[0], &seed, sizeof(seed)) == sizeof(seed))
+    failures.push_back(seed);
+  close(fds[0]);
+  while (wait(nullptr) > 0)
+    ;
+
+  std::sort(failures.begin(), failures.end());
+  printf("%u seeds, %zu failed\n", last - first, failures.size());
+  for (uint32_t seed : failures)
+    report_failure(seed, length, trace);
+
+  exit(failures.empty() ? EXIT_SUCCESS : EXIT_FAILURE);
+}
@@ -0,0 +1,753 @@
+#include "iss.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "riscv.h"
+
+#define CSR_MVENDORID 0xF11
+#define CSR_MARCHID 0xF12
+#define CSR_MIMPID 0xF13
+#define CSR_MEPC 0x341
+#define CSR_MCAUSE 0x342
+#define CSR_MTVAL 0x343
+#define CSR_MIP 0x344
+#define CSR_MCYCLE 0xB00
+#define CSR_MINSTRET 0xB02
+#define CSR_MCYCLEH 0xB80
+#define CSR_MINSTRETH 0xB82
+
+// RV32I plus A and X, as the fuzzing configuration builds the core
+#define MISA 0x40800101
+
+#define SOFTWARE_IRQ 3
+#define TIMER_IRQ 7
+#define EXTERNAL_IRQ 11
+
+static uint32_t bits(uint32_t val, int hi, int lo) {
+  return (val >> lo) & ((hi - lo == 31) ? 0xFFFFFFFF : ((1u << (hi - lo + 1)) - 1));
+}
+
+static int32_t sext(uint32_t val, int width) {
+  return (int32_t) (val << (32 - width)) >> (32 - width);
+}
+
+static uint32_t rotr(uint32_t val, uint32_t shamt) {
+  shamt &= 31;
+  return shamt ? (val >> shamt) | (val << (32 - shamt)) : val;
+}
+
+Iss::Iss(uint32_t mem_size) : mem(mem_size / 4, 0) {
+  for (int i = 0; i < 32; i++)
+    regs[i] = 0;
+  pc = 0;
+  mstatus_mie = false;
+  mstatus_mpie = false;
+  mie = 0;
+  mtvec = 0;
+  mscratch = 0;
+  mepc = 0;
+  mcause = 0;
+  mtval = 0;
+  instret = 0;
+  instret_written = false;
+  hart_id = 0;
+  irq_timer = false;
+  irq_software = false;
+  irq_external = false;
+  reservation_valid = false;
+  reservation_addr = 0;
+  cop_handler = nullptr;
+  bus = nullptr;
+  full_system = false;
+  asleep = false;
+  cycles = 0;
+  shadow_en = false;
+  bank = false;
+  prev_bank = false;
+  for (int i = 0; i < 32; i++)
+    other_regs[i] = 0;
+}
+
+void Iss::write_mem(uint32_t addr, uint32_t data) {
+  assert(addr % 4 == 0);
+  assert(addr / 4 < mem.size());
+  mem[addr / 4] = data;
+}
+
+uint32_t Iss::read_mem(uint32_t addr) {
+  assert(addr % 4 == 0);
+  assert(addr / 4 < mem.size());
+  return mem[addr / 4];
+}
+
+void Iss::set_reg(uint8_t reg, uint32_t data) {
+  assert(reg < 32);
+  if (reg != 0)
+    regs[reg] = data;
+}
+
+uint32_t Iss::get_reg(uint8_t reg) {
+  assert(reg < 32);
+  return regs[reg];
+}
+
+uint32_t Iss::get_pc() {
+  return pc;
+}
+
+uint32_t Iss::get_mstatus() {
+  return mstatus_mie << 3 | mstatus_mpie << 7;
+}
+
+uint32_t Iss::get_mie() {
+  return mie;
+}
+
+uint32_t Iss::get_mtvec() {
+  return mtvec;
+}
+
+uint32_t Iss::get_mscratch() {
+  return mscratch;
+}
+
+uint32_t Iss::get_mepc() {
+  return mepc;
+}
+
+uint32_t Iss::get_mcause() {
+  return mcause;
+}
+
+uint32_t Iss::get_mtval() {
+  return mtval;
+}
+
+void Iss::set_reset_state(uint32_t mstatus, uint32_t mscratch, uint32_t mepc,
+                          uint32_t mcause, uint32_t mtval) {
+  mstatus_mie = (mstatus >> 3) & 1;
+  mstatus_mpie = (mstatus >> 7) & 1;
+  this->mscratch = mscratch;
+  this->mepc = mepc;
+  this->mcause = mcause;
+  this->mtval = mtval;
+}
+
+void Iss::set_irq_timer(int val) {
+  irq_timer = val;
+}
+
+void Iss::set_irq_software(int val) {
+  irq_software = val;
+}
+
+void Iss::set_irq_external(int val) {
+  irq_external = val;
+}
+
+void Iss::set_coprocessor(CopHandler handler) {
+  cop_handler = handler;
+}
+
+void Iss::set_hart_id(uint32_t hart_id) {
+  this->hart_id = hart_id;
+}
+
+void Iss::set_bus(Bus* bus) {
+  this->bus = bus;
+}
+
+void Iss::set_full_system(bool enable) {
+  full_system = enable;
+}
+
+void Iss::add_cycles(uint64_t cycles) {
+  this->cycles += cycles;
+}
+
+bool Iss::is_sleeping() {
+  return asleep;
+}
+
+// Whether a WFI would wake up, which only needs the interrupt enabled in mie
+bool Iss::wake() {
+  return (irq_external && (mie & (1 << EXTERNAL_IRQ))) ||
+         (irq_software && (mie & (1 << SOFTWARE_IRQ))) ||
+         (irq_timer && (mie & (1 << TIMER_IRQ)));
+}
+
+void Iss::retire_wfi() {
+  asleep = false;
+  pc += 4;
+  instret++;
+}
+
+// Registers swap between regs and other_regs, so regs is always the bank in
+// use
+void Iss::set_bank(bool bank) {
+  if (bank == this->bank)
+    return;
+  for (int i = 0; i < 32; i++) {
+    uint32_t tmp = regs[i];
+    regs[i] = other_regs[i];
+    other_regs[i] = tmp;
+  }
+  this->bank = bank;
+}
+
+int Iss::pending_interrupt() {
+  if (!mstatus_mie)
+    return -1;
+  // Same priority as the core: external, software, timer
+  if (irq_external && (mie & (1 << EXTERNAL_IRQ)))
+    return EXTERNAL_IRQ;
+  if (irq_software && (mie & (1 << SOFTWARE_IRQ)))
+    return SOFTWARE_IRQ;
+  if (irq_timer && (mie & (1 << TIMER_IRQ)))
+    return TIMER_IRQ;
+  return -1;
+}
+
+bool Iss::interrupt(uint32_t cause) {
+  if (pending_interrupt() != (int) cause)
+    return false;
+  // A WFI that wakes up retires first, so mepc points past it
+  if (asleep)
+    retire_wfi();
+  trap(1u << 31 | cause, 0);
+  return true;
+}
+
+void Iss::trap(uint32_t cause, uint32_t tval) {
+  mepc = pc;
+  mcause = cause;
+  mtval = tval;
+  mstatus_mpie = mstatus_mie;
+  mstatus_mie = false;
+  if (full_system) {
+    prev_bank = bank;
+    if (shadow_en)
+      set_bank(true);
+  }
+  // Vectored mode only applies to interrupts
+  if ((mtvec & 1) && (cause >> 31))
+    pc = (mtvec & ~3u) + 4 * (cause & 0x7FFFFFFF);
+  else
+    pc = mtvec & ~3u;
+}
+
+bool Iss::in_range(uint32_t addr, int size) {
+  return addr / 4 < mem.size() && (addr + size - 1) / 4 < mem.size();
+}
+
+uint32_t Iss::load(uint32_t addr, int size) {
+  uint32_t word = mem[addr / 4] >> (8 * (addr % 4));
+  return size == 4 ? word : word & ((1u << (8 * size)) - 1);
+}
+
+void Iss::store(uint32_t addr, int size, uint32_t data) {
+  uint32_t mask = size == 4 ? 0xFFFFFFFF : (1u << (8 * size)) - 1;
+  int shift = 8 * (addr % 4);
+  mem[addr / 4] = (mem[addr / 4] & ~(mask << shift)) | ((data & mask) << shift);
+  if (reservation_addr / 4 == addr / 4)
+    reservation_valid = false;
+}
+
+bool Iss::read(uint32_t addr, int size, uint32_t* data) {
+  if (bus)
+    return bus->load(addr, size, data);
+  if (!in_range(addr, size))
+    return false;
+  *data = load(addr, size);
+  return true;
+}
+
+bool Iss::write(uint32_t addr, int size, uint32_t data) {
+  if (bus)
+    return bus->store(addr, size, data);
+  if (!in_range(addr, size))
+    return false;
+  store(addr, size, data);
+  return true;
+}
+
+Iss::Result Iss::step() {
+  if (asleep) {
+    if (!wake())
+      return SLEEPING;
+    retire_wfi();
+    return RETIRED;
+  }
+  uint32_t instr;
+  if (bus ? !bus->fetch(pc, &instr) : !in_range(pc, 4)) {
+    trap(1, pc);
+    return TRAPPED;
+  }
+  if (!bus)
+    instr = mem[pc / 4];
+  instret_written = false;
+  Result result = exec(instr);
+  if (result == RETIRED && !instret_written)
+    instret++;
+  return result;
+}
+
+bool Iss::csr_readable(uint32_t num) {
+  if ((num >= 0xB03 && num <= 0xB1F) || (num >= 0xB83 && num <= 0xB9F) ||
+      (num >= 0xC03 && num <= 0xC1F) || (num >= 0xC83 && num <= 0xC9F) ||
+      (num >= 0x323 && num <= 0x33F))
+    return true;
+  switch (num) {
+  case CSR_MVENDORID:
+  case CSR_MARCHID:
+  case CSR_MIMPID:
+  case RV_CSR_MHARTID:
+  case RV_CSR_MSTATUS:
+  case RV_CSR_MISA:
+  case RV_CSR_MIE:
+  case RV_CSR_MTVEC:
+  case RV_CSR_MSCRATCH:
+  case CSR_MEPC:
+  case CSR_MCAUSE:
+  case CSR_MTVAL:
+  case CSR_MIP:
+  case RV_CSR_MSHADOW:
+  case RV_CSR_CYCLE:
+  case CSR_MCYCLE:
+  case RV_CSR_CYCLEH:
+  case CSR_MCYCLEH:
+  case RV_CSR_INSTRET:
+  case CSR_MINSTRET:
+  case RV_CSR_INSTRETH:
+  case CSR_MINSTRETH:
+    return true;
+  default:
+    return false;
+  }
+}
+
+bool Iss::csr_writable(uint32_t num) {
+  if ((num >= 0xB03 && num <= 0xB1F) || (num >= 0xB83 && num <= 0xB9F) ||
+      (num >= 0x323 && num <= 0x33F))
+    return true;
+  switch (num) {
+  case RV_CSR_MSTATUS:
+  case RV_CSR_MISA:
+  case RV_CSR_MIE:
+  case RV_CSR_MTVEC:
+  case RV_CSR_MSCRATCH:
+  case CSR_MEPC:
+  case CSR_MCAUSE:
+  case CSR_MTVAL:
+  case CSR_MIP:
+  case CSR_MCYCLE:
+  case CSR_MINSTRET:
+  case CSR_MCYCLEH:
+  case CSR_MINSTRETH:
+  case RV_CSR_MSHADOW:
+    return true;
+  default:
+    return false;
+  }
+}
+
+uint32_t Iss::csr_read(uint32_t num) {
+  switch (num) {
+  case RV_CSR_MHARTID: return hart_id;
+  case RV_CSR_MSTATUS: return get_mstatus();
+  case RV_CSR_MISA: return MISA;
+  case RV_CSR_MIE: return mie;
+  case RV_CSR_MTVEC: return mtvec;
+  case RV_CSR_MSCRATCH: return mscratch;
+  case CSR_MEPC: return mepc;
+  case CSR_MCAUSE: return mcause;
+  case CSR_MTVAL: return mtval;
+  case CSR_MIP:
+    return irq_external << EXTERNAL_IRQ | irq_timer << TIMER_IRQ |
+           irq_software << SOFTWARE_IRQ;
+  case RV_CSR_MSHADOW: return prev_bank << 2 | bank << 1 | shadow_en;
+  case RV_CSR_CYCLE:
+  case CSR_MCYCLE: return (uint32_t) cycles;
+  case RV_CSR_CYCLEH:
+  case CSR_MCYCLEH: return (uint32_t) (cycles >> 32);
+  case RV_CSR_INSTRET:
+  case CSR_MINSTRET: return (uint32_t) instret;
+  case RV_CSR_INSTRETH:
+  case CSR_MINSTRETH: return (uint32_t) (instret >> 32);
+  default: return 0;
+  }
+}
+
+void Iss::csr_write(uint32_t num, uint32_t data) {
+  switch (num) {
+  case RV_CSR_MSTATUS:
+    mstatus_mie = (data >> 3) & 1;
+    mstatus_mpie = (data >> 7) & 1;
+    break;
+  case RV_CSR_MIE:
+    mie = data & (1 << EXTERNAL_IRQ | 1 << TIMER_IRQ | 1 << SOFTWARE_IRQ);
+    break;
+  case RV_CSR_MTVEC: mtvec = data; break;
+  case RV_CSR_MSCRATCH: mscratch = data; break;
+  case CSR_MEPC: mepc = data & ~3u; break;
+  case CSR_MCAUSE: mcause = data; break;
+  case CSR_MTVAL: mtval = data; break;
+  case CSR_MINSTRET:
+    instret = (instret & 0xFFFFFFFF00000000ull) | data;
+    instret_written = true;
+    break;
+  case CSR_MINSTRETH:
+    instret = (instret & 0xFFFFFFFFull) | (uint64_t) data << 32;
+    instret_written = true;
+    break;
+  case CSR_MCYCLE:
+    cycles = (cycles & 0xFFFFFFFF00000000ull) | data;
+    break;
+  case CSR_MCYCLEH:
+    cycles = (cycles & 0xFFFFFFFFull) | (uint64_t) data << 32;
+    break;
+  case RV_CSR_MSHADOW:
+    // rd is written after this, so it goes to the new bank
+    shadow_en = data & 1;
+    prev_bank = (data >> 2) & 1;
+    set_bank((data >> 1) & 1);
+    break;
+  default:
+    // misa, mip and the extra counters ignore writes
+    break;
+  }
+}
+
+Iss::Result Iss::exec(uint32_t instr) {
+  uint32_t opcode = bits(instr, 6, 0);
+  uint32_t rd = bits(instr, 11, 7);
+  uint32_t funct3 = bits(instr, 14, 12);
+  uint32_t rs1 = bits(instr, 19, 15);
+  uint32_t rs2 = bits(instr, 24, 20);
+  uint32_t funct7 = bits(instr, 31, 25);
+  uint32_t a = regs[rs1];
+  uint32_t b = regs[rs2];
+  int32_t imm_i = sext(bits(instr, 31, 20), 12);
+  int32_t imm_s = sext(bits(instr, 31, 25) << 5 | bits(instr, 11, 7), 12);
+  int32_t imm_b = sext(bits(instr, 31, 31) << 12 | bits(instr, 7, 7) << 11 |
+                       bits(instr, 30, 25) << 5 | bits(instr, 11, 8) << 1, 13);
+  int32_t imm_j = sext(bits(instr, 31, 31) << 20 | bits(instr, 19, 12) << 12 |
+                       bits(instr, 20, 20) << 11 | bits(instr, 30, 21) << 1, 21);
+
+  uint32_t next_pc = pc + 4;
+  bool write_rd = true;
+  uint32_t result = 0;
+
+  switch (opcode) {
+  case 0b0110111: // lui
+    result = instr & 0xFFFFF000;
+    break;
+  case 0b0010111: // auipc
+    result = pc + (instr & 0xFFFFF000);
+    break;
+  case 0b1101111: // jal
+    result = pc + 4;
+    next_pc = pc + imm_j;
+    break;
+  case 0b1100111: // jalr
+    if (funct3 != 0) {
+      trap(2, instr);
+      return TRAPPED;
+    }
+    result = pc + 4;
+    next_pc = (a + imm_i) & ~1u;
+    break;
+  case 0b1100011: { // branches
+    bool taken;
+    switch (funct3) {
+    case 0b000: taken = a == b; break;
+    case 0b001: taken = a != b; break;
+    case 0b100: taken = (int32_t) a < (int32_t) b; break;
+    case 0b101: taken = (int32_t) a >= (int32_t) b; break;
+    case 0b110: taken = a < b; break;
+    case 0b111: taken = a >= b; break;
+    default:
+      trap(2, instr);
+      return TRAPPED;
+    }
+    if (taken)
+      next_pc = pc + imm_b;
+    write_rd = false;
+    break;
+  }
+  case 0b0000011: { // loads
+    if (funct3 == 0b011 || funct3 == 0b110 || funct3 == 0b111) {
+      trap(2, instr);
+      return TRAPPED;
+    }
+    uint32_t addr = a + imm_i;
+    int size = 1 << (funct3 & 3);
+    if (addr % size != 0) {
+      trap(4, addr);
+      return TRAPPED;
+    }
+    if (!read(addr, size, &result)) {
+      trap(5, addr);
+      return TRAPPED;
+    }
+    if (funct3 == 0b000)
+      result = sext(result, 8);
+    else if (funct3 == 0b001)
+      result = sext(result, 16);
+    break;
+  }
+  case 0b0100011: { // stores
+    if (funct3 > 0b010) {
+      trap(2, instr);
+      return TRAPPED;
+    }
+    uint32_t addr = a + imm_s;
+    int size = 1 << funct3;
+    if (addr % size != 0) {
+      trap(6, addr);
+      return TRAPPED;
+    }
+    if (!write(addr, size, b)) {
+      trap(7, addr);
+      return TRAPPED;
+    }
+    write_rd = false;
+    break;
+  }
+  case 0b0010011: { // OP-IMM
+    uint32_t shamt = rs2;
+    switch (funct3) {
+    case 0b000: result = a + imm_i; break;
+    case 0b010: result = (int32_t) a < imm_i; break;
+    case 0b011: result = a < (uint32_t) imm_i; break;
+    case 0b100: result = a ^ imm_i; break;
+    case 0b110: result = a | imm_i; break;
+    case 0b111: result = a & imm_i; break;
+    case 0b001:
+      if (funct7 == 0) {
+        result = a << shamt;
+      } else if (funct7 == 0b0110000 && rs2 == 0) { // clz
+        result = a ? __builtin_clz(a) : 32;
+      } else if (funct7 == 0b0110000 && rs2 == 1) { // ctz
+        result = a ? __builtin_ctz(a) : 32;
+      } else if (funct7 == 0b0110000 && rs2 == 2) { // cpop
+        result = __builtin_popcount(a);
+      } else if (funct7 == 0b0110000 && rs2 == 4) { // sext.b
+        result = sext(a, 8);
+      } else if (funct7 == 0b0110000 && rs2 == 5) { // sext.h
+        result = sext(a, 16);
+      } else {
+        trap(2, instr);
+        return TRAPPED;
+      }
+      break;
+    case 0b101:
+      if (funct7 == 0) {
+        result = a >> shamt;
+      } else if (funct7 == 0b0100000) {
+        result = (int32_t) a >> shamt;
+      } else if (funct7 == 0b0110000) { // rori
+        result = rotr(a, shamt);
+      } else if (bits(instr, 31, 20) == 0x698) { // rev8
+        result = __builtin_bswap32(a);
+      } else if (bits(instr, 31, 20) == 0x287) { // orc.b
+        result = 0;
+        for (int i = 0; i < 32; i += 8) {
+          if ((a >> i) & 0xFF)
+            result |= 0xFFu << i;
+        }
+      } else {
+        trap(2, instr);
+        return TRAPPED;
+      }
+      break;
+    }
+    break;
+  }
+  case 0b0110011: { // OP
+    uint32_t shamt = b & 31;
+    bool legal = true;
+    switch (funct7 << 3 | funct3) {
+    case 0b0000000000: result = a + b; break;
+    case 0b0100000000: result = a - b; break;
+    case 0b0000000001: result = a << shamt; break;
+    case 0b0000000010: result = (int32_t) a < (int32_t) b; break;
+    case 0b0000000011: result = a < b; break;
+    case 0b0000000100: result = a ^ b; break;
+    case 0b0000000101: result = a >> shamt; break;
+    case 0b0100000101: result = (int32_t) a >> shamt; break;
+    case 0b0000000110: result = a | b; break;
+    case 0b0000000111: result = a & b; break;
+    case 0b0010000010: result = (a << 1) + b; break;   // sh1add
+    case 0b0010000100: result = (a << 2) + b; break;   // sh2add
+    case 0b0010000110: result = (a << 3) + b; break;   // sh3add
+    case 0b0100000111: result = a & ~b; break;         // andn
+    case 0b0100000110: result = a | ~b; break;         // orn
+    case 0b0100000100: result = ~(a ^ b); break;       // xnor
+    case 0b0000101100: result = (int32_t) a < (int32_t) b ? a : b; break; // min
+    case 0b0000101101: result = a < b ? a : b; break;  // minu
+    case 0b0000101110: result = (int32_t) a < (int32_t) b ? b : a; break; // max
+    case 0b0000101111: result = a < b ? b : a; break;  // maxu
+    case 0b0110000001: result = rotr(a, 32 - shamt); break; // rol
+    case 0b0110000101: result = rotr(a, shamt); break; // ror
+    case 0b0000100100: // zext.h
+      legal = rs2 == 0;
+      result = a & 0xFFFF;
+      break;
+    default:
+      legal = false;
+    }
+    if (!legal) {
+      trap(2, instr);
+      return TRAPPED;
+    }
+    break;
+  }
+  case 0b0001111: // fence, fence.i
+    write_rd = false;
+    break;
+  case 0b1110011: { // SYSTEM
+    if (funct3 == 0 || funct3 == 0b100) {
+      if (instr == rv_ecall()) {
+        trap(11, 0);
+        return TRAPPED;
+      } else if (instr == rv_ebreak()) {
+        trap(3, 0);
+        return TRAPPED;
+      } else if (instr == rv_mret()) {
+        mstatus_mie = mstatus_mpie;
+        mstatus_mpie = true;
+        if (full_system)
+          set_bank(prev_bank);
+        next_pc = mepc;
+        write_rd = false;
+        break;
+      } else if (!full_system) {
+        return UNMODELED;
+      } else if (instr == rv_wfi()) {
+        asleep = true;
+        return SLEEPING;
+      }
+      trap(2, instr);
+      return TRAPPED;
+    }
+    uint32_t csr_num = bits(instr, 31, 20);
+    uint32_t op = funct3 & 3;
+    bool use_imm = funct3 & 4;
+    uint32_t operand = use_imm ? rs1 : a;
+    // csrrs/csrrc from x0 (or with a zero zimm) don't write, and csrrw with
+    // rd = x0 doesn't read. csrrw always writes.
+    bool no_write = op != 1 && rs1 == 0;
+    bool reads = !(op == 1 && rd == 0);
+    if ((!csr_readable(csr_num) && reads) || (!csr_writable(csr_num) && !no_write)) {
+      trap(2, instr);
+      return TRAPPED;
+    }
+    if (!full_system && (csr_num == CSR_MCYCLE || csr_num == CSR_MCYCLEH ||
+                         csr_num == RV_CSR_CYCLE || csr_num == RV_CSR_CYCLEH ||
+                         csr_num == RV_CSR_MSHADOW))
+      return UNMODELED;
+    uint32_t old = csr_read(csr_num);
+    if (!no_write) {
+      uint32_t update = op == 1 ? operand : op == 2 ? old | operand : old & ~operand;
+      csr_write(csr_num, update);
+    }
+    result = old;
+    break;
+  }
+  case 0b0101111: { // AMO
+    uint32_t funct5 = bits(instr, 31, 27);
+    bool lr = funct5 == 0b00010;
+    bool sc = funct5 == 0b00011;
+    bool amo = funct5 == 0b00000 || funct5 == 0b00001 || funct5 == 0b00100 ||
+               funct5 == 0b01000 || funct5 == 0b01100 || funct5 == 0b10000 ||
+               funct5 == 0b10100 || funct5 == 0b11000 || funct5 == 0b11100;
+    if (!(lr || sc || amo) || funct3 != 0b010 || (lr && rs2 != 0)) {
+      trap(2, instr);
+      return TRAPPED;
+    }
+    uint32_t addr = a;
+    if (addr % 4 != 0) {
+      trap(lr ? 4 : 6, addr);
+      return TRAPPED;
+    }
+    if (!bus && !in_range(addr, 4)) {
+      trap(lr ? 5 : 7, addr);
+      return TRAPPED;
+    }
+    if (lr) {
+      if (bus) {
+        if (!bus->load_reserved(addr, &result)) {
+          trap(5, addr);
+          return TRAPPED;
+        }
+      } else {
+        result = load(addr, 4);
+        reservation_valid = true;
+        reservation_addr = addr;
+      }
+    } else if (sc) {
+      bool ok;
+      if (bus) {
+        if (!bus->store_conditional(addr, b, &ok)) {
+          trap(7, addr);
+          return TRAPPED;
+        }
+      } else {
+        ok = reservation_valid && reservation_addr / 4 == addr / 4;
+        reservation_valid = false;
+        if (ok)
+          store(addr, 4, b);
+      }
+      result = !ok;
+    } else {
+      uint32_t old;
+      if (!read(addr, 4, &old)) {
+        trap(7, addr);
+        return TRAPPED;
+      }
+      uint32_t val;
+      switch (funct5) {
+      case 0b00000: val = old + b; break;
+      case 0b00100: val = old ^ b; break;
+      case 0b01000: val = old | b; break;
+      case 0b01100: val = old & b; break;
+      case 0b10000: val = (int32_t) old < (int32_t) b ? old : b; break;
+      case 0b10100: val = (int32_t) old < (int32_t) b ? b : old; break;
+      case 0b11000: val = old < b ? old : b; break;
+      case 0b11100: val = old < b ? b : old; break;
+      default: val = b; break; // amoswap
+      }
+      if (!write(addr, 4, val)) {
+        trap(7, addr);
+        return TRAPPED;
+      }
+      reservation_valid = false;
+      result = old;
+    }
+    break;
+  }
+  case 0b0001011: // custom-0
+  case 0b0101011: { // custom-1
+    if (!cop_handler || !cop_handler(bits(instr, 5, 5), funct3, funct7, a, b, &result)) {
+      trap(2, instr);
+      return TRAPPED;
+    }
+    break;
+  }
+  default:
+    trap(2, instr);
+    return TRAPPED;
+  }
+
+  if (next_pc % 4 != 0) {
+    trap(0, next_pc);
+    return TRAPPED;
+  }
+  if (write_rd && rd != 0)
+    regs[rd] = result;
+  pc = next_pc;
+  return RETIRED;
+}
@@ -0,0 +1,135 @@
+#ifndef ISS_H
+#define ISS_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <functional>
+#include <vector>
+
+// Instruction set simulator used as a reference model for the core. It runs
+// one instruction at a time with no notion of cycles: RV32I, Zicsr, Zba/Zbb,
+// the A extension and the coprocessor opcodes, with machine-mode traps and
+// interrupts. CSR access rules (what's readable, what's writable, and that
+// csrrs/csrrc with an x0 source or zero zimm don't write) follow the core
+// rather than leaving them open. Memory is a flat array from address 0, and reservations
+// behave like the core harness's: any write to the reserved word ends one.
+// A Bus can stand in for the array, and full-system mode covers what the
+// model otherwise leaves to its caller, for running whole programs on it
+// (see lemonsoc_tlm.h).
+class Iss {
+ public:
+  // Memory and devices in place of the flat array. Accesses are naturally
+  // aligned with data in the low bits, and returning false makes one an
+  // access fault.
+  class Bus {
+   public:
+    virtual ~Bus() {}
+    virtual bool fetch(uint32_t addr, uint32_t* instr) = 0;
+    virtual bool load(uint32_t addr, int size, uint32_t* data) = 0;
+    virtual bool store(uint32_t addr, int size, uint32_t data) = 0;
+    // lr.w, which places this hart's reservation on the word
+    virtual bool load_reserved(uint32_t addr, uint32_t* data) = 0;
+    // sc.w. *stored is false, and memory is left alone, if the reservation
+    // has gone.
+    virtual bool store_conditional(uint32_t addr, uint32_t data, bool* stored) = 0;
+  };
+
+  // Same contract as Lemoncore::CopHandler
+  typedef std::function<bool(uint8_t custom, uint8_t funct3, uint8_t funct7,
+                             uint32_t rs1, uint32_t rs2, uint32_t* rd)> CopHandler;
+
+  // What step() did with an instruction
+  enum Result {
+    RETIRED,
+    TRAPPED,
+    // Something the model has no single answer for: WFI, the cycle counter,
+    // mshadow, and system encodings the core doesn't decode. Nothing changes.
+    UNMODELED,
+    // Full-system mode only: the hart is in a WFI, waiting for an interrupt
+    // that's enabled in mie. The WFI retires once one is pending.
+    SLEEPING,
+  };
+
+  // mem_size bytes of memory from address 0
+  explicit Iss(uint32_t mem_size);
+  void write_mem(uint32_t addr, uint32_t data);
+  uint32_t read_mem(uint32_t addr);
+  void set_reg(uint8_t reg, uint32_t data);
+  uint32_t get_reg(uint8_t reg);
+  uint32_t get_pc();
+  uint32_t get_mstatus();
+  uint32_t get_mie();
+  uint32_t get_mtvec();
+  uint32_t get_mscratch();
+  uint32_t get_mepc();
+  uint32_t get_mcause();
+  uint32_t get_mtval();
+  // The core leaves some of these unset at reset, so they're copied from it
+  void set_reset_state(uint32_t mstatus, uint32_t mscratch, uint32_t mepc,
+                       uint32_t mcause, uint32_t mtval);
+  void set_irq_timer(int val);
+  void set_irq_software(int val);
+  void set_irq_external(int val);
+  void set_coprocessor(CopHandler handler);
+  void set_hart_id(uint32_t hart_id);
+  // Nullptr goes back to the flat array
+  void set_bus(Bus* bus);
+  // Models what UNMODELED leaves out, the way the SoC's harts do: WFI sleeps
+  // until an interrupt that's enabled in mie is pending and then retires,
+  // mcycle counts what add_cycles() is given, mshadow switches to a second
+  // register bank as with SHADOW_REGS, and other system encodings are
+  // illegal.
+  void set_full_system(bool enable);
+  void add_cycles(uint64_t cycles);
+  bool is_sleeping();
+
+  Result step();
+  // The interrupt the core would take before the next instruction, or -1
+  int pending_interrupt();
+  // Takes interrupt cause. Returns false, changing nothing, unless it's the
+  // one pending_interrupt() picks.
+  bool interrupt(uint32_t cause);
+
+ private:
+  Result exec(uint32_t instr);
+  void trap(uint32_t cause, uint32_t tval);
+  bool in_range(uint32_t addr, int size);
+  uint32_t load(uint32_t addr, int size);
+  void store(uint32_t addr, int size, uint32_t data);
+  bool read(uint32_t addr, int size, uint32_t* data);
+  bool write(uint32_t addr, int size, uint32_t data);
+  bool wake();
+  void retire_wfi();
+  void set_bank(bool bank);
+  bool csr_readable(uint32_t num);
+  bool csr_writable(uint32_t num);
+  uint32_t csr_read(uint32_t num);
+  void csr_write(uint32_t num, uint32_t data);
+
+  std::vector<uint32_t> mem;
+  uint32_t regs[32];
+  uint32_t pc;
+  bool mstatus_mie, mstatus_mpie;
+  uint32_t mie;
+  uint32_t mtvec;
+  uint32_t mscratch;
+  uint32_t mepc;
+  uint32_t mcause;
+  uint32_t mtval;
+  uint64_t instret;
+  bool instret_written;
+  uint32_t hart_id;
+  bool irq_timer, irq_software, irq_external;
+  bool reservation_valid;
+  uint32_t reservation_addr;
+  CopHandler cop_handler;
+  Bus* bus;
+  bool full_system;
+  bool asleep;
+  uint64_t cycles;
+  // mshadow, and the registers of the bank not in use
+  bool shadow_en, bank, prev_bank;
+  uint32_t other_regs[32];
+};
+
+#endif
@@ -3,6 +3,9 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+#include <string.h>
+
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 
@@ -15,35 +18,84 @@
 
 #define DEFAULT_VCD_PATH "lemoncore.vcd"
 
+#define NUM_PAGES ((ROM_SIZE + RAM_SIZE + CHECKPOINT_PAGE_SIZE - 1) / CHECKPOINT_PAGE_SIZE)
+static_assert(NUM_PAGES <= 64, "dirty_pages holds a bit per page");
+
+// Partial stores come low-aligned
+static void write_masked(uint32_t* mem, uint32_t addr, uint32_t data, uint8_t mask) {
+  uint32_t bits = 0;
+  for (int i = 0; i < 4; i++) {
+    if (mask & (1 << i))
+      bits |= 0xFFu << (8 * i);
+  }
+  int shift = 8 * (addr % 4);
+  mem[addr / 4] = (mem[addr / 4] & ~(bits << shift)) | ((data & bits) << shift);
+}
+
 Lemoncore::Lemoncore(bool verbose) {
-  init(verbose, DEFAULT_VCD_PATH);
+  init(verbose, true, DEFAULT_VCD_PATH);
+}
+
+Lemoncore::Lemoncore(bool verbose, bool trace) {
+  init(verbose, trace, DEFAULT_VCD_PATH);
 }
 
 Lemoncore::Lemoncore(bool verbose, std::string vcd_path) {
-  init(verbose, vcd_path);
+  init(verbose, true, vcd_path);
 }
 
-void Lemoncore::init(bool verbose, std::string vcd_path) {
+Lemoncore::Lemoncore(bool verbose, bool trace, std::string vcd_path) {
+  init(verbose, trace, vcd_path);
+}
+
+void Lemoncore::init(bool verbose, bool trace, std::string vcd_path) {
   this->verbose = verbose;
+  this->trace = trace;
   tb = new Vlemoncore;
   cycle = 0;
-
-  // Start tracing
-  tfp = new VerilatedVcdC;
-  Verilated::traceEverOn(true);
-  tb->trace(tfp, 99);
-  tfp->open(vcd_path.c_str());
+  cop_handler = nullptr;
+  cop_latency = 0;
+  cop_ready_latency = 0;
+  cop_ready_countdown = -1;
+  cop_req_waiting = false;
+  cop_pending = false;
+  write_latency = 0;
+  write_countdown = -1;
+  write_error = false;
+  reservation_valid = false;
+  reservation_addr = 0;
+  retire_trace = nullptr;
+  retiring = RetireRecord();
+  retired = 0;
+  vcd_dumping = true;
+  checkpoints = nullptr;
+  checkpoint_due = false;
+  checkpoint_hash = 0;
+  dirty_pages = 0;
+  arch_store = ArchStore();
+  // Runs that checkpoint the same firmware have to start from the same memory
+  memset(mem, 0, sizeof(mem));
+
+  if (trace) {
+    // Start tracing
+    tfp = new VerilatedVcdC;
+    Verilated::traceEverOn(true);
+    tb->trace(tfp, 99);
+    tfp->open(vcd_path.c_str());
+  }
 
   // Reset core
   reset();
 }
 
 Lemoncore::~Lemoncore() {
-  // Stop tracing
-  tfp->close();
+  if (trace) {
+    // Stop tracing
+    tfp->close();
+    delete tfp;
+  }
 
   delete tb;
-  delete tfp;
 }
 
 bool Lemoncore::load_firmware(std::string path) {
@@ -61,14 +113,15 @@ bool Lemoncore::load_firmware(std::string path) {
 
 void Lemoncore::reset() {
   // Reset the core
+  tb->clk_en_i = 1;
   tb->rst_i = 1;
   tb->clk_i = 0;
   tb->eval();
-  tfp->dump(cycle);
+  if (trace && vcd_dumping) tfp->dump(cycle);
   tb->clk_i = 1;
   tb->eval();
   tb->rst_i = 0;
-  tfp->dump(cycle + 1);
+  if (trace && vcd_dumping) tfp->dump(cycle + 1);
 
   cycle++;
 }
@@ -86,16 +139,24 @@ void Lemoncore::dump_regs() {
 bool Lemoncore::step() {
   tb->clk_i = 0;
   tb->eval();
-  tfp->dump(2 * cycle);
+  if (trace && vcd_dumping) tfp->dump(2 * cycle);
+#ifdef LEMONCORE_PROBES
+  if (retire_trace) trace_retirement();
+  if (checkpoints) checkpoint_retirement();
+#endif
+  if (tb->lemoncore->instret) retired++;
   tb->clk_i = 1;
   tb->eval();
-  tfp->dump(2 * cycle + 1);
+  if (trace && vcd_dumping) tfp->dump(2 * cycle + 1);
+  if (checkpoint_due) take_checkpoint();
 
   cycle++;
 
   tb->instr_res_valid_i = 0;
   tb->mem_read_res_valid_i = 0;
   tb->mem_write_res_valid_i = 0;
+  tb->mem_write_res_error_i = 0;
+  tb->mem_write_res_excl_fail_i = 0;
 
   // Requesting instruction memory
   if (tb->instr_req_valid_o) {
@@ -107,7 +168,7 @@ bool Lemoncore::step() {
 
     uint32_t data = mem[addr / 4];
     log("Instruction: ");
-    if (verbose) print_instruction(data);
+    if (verbose) print_instruction(data, addr);
 
     tb->instr_res_valid_i = 1;
     tb->instr_res_data_i = data;
@@ -118,37 +179,110 @@ bool Lemoncore::step() {
     uint32_t addr = tb->mem_read_req_addr_o;
     log("Reading memory @ 0x%08x\n", addr);
 
-    // TODO: should support partial loads
-    assert(addr % 4 == 0);
     if (addr < ROM_SIZE || addr >= ROM_SIZE + RAM_SIZE) {
       std::cout << "Address out of bounds: " << addr << std::endl;
       dump_regs();
       assert(false);
     }
 
-    uint32_t data = mem[addr / 4];
+    // The core takes partial loads low-aligned
+    uint32_t data = mem[addr / 4] >> (8 * (addr % 4));
     log("Response: 0x%08x\n", data);
 
+    if (tb->mem_read_req_excl_o) {
+      reservation_valid = true;
+      reservation_addr = addr;
+    }
+
     tb->mem_read_res_valid_i = 1;
     tb->mem_read_res_data_i = data;
   }
 
-  // Data memory write
-  if (tb->mem_write_req_valid_o) {
+  // Data memory write, responding after write_latency cycles
+  if (!tb->mem_write_req_valid_o) {
+    write_countdown = -1;
+  } else if (write_countdown < 0) {
+    write_countdown = write_latency;
+  } else {
+    write_countdown--;
+  }
+
+  if (tb->mem_write_req_valid_o && write_countdown == 0 && write_error) {
+    log("Write error @ 0x%08x\n", tb->mem_write_req_addr_o);
+    tb->mem_write_res_error_i = 1;
+    write_countdown = -1;
+  } else if (tb->mem_write_req_valid_o && write_countdown == 0) {
     uint32_t addr = tb->mem_write_req_addr_o;
     uint32_t data = tb->mem_write_req_data_o;
     log("Writing value 0x%08x to location 0x%08x\n", data, addr);
 
-    // TODO: should support partial stores
-    assert(addr % 4 == 0);
     if (addr < ROM_SIZE || addr >= ROM_SIZE + RAM_SIZE) {
       std::cout << "Address out of bounds: " << addr << std::endl;
       dump_regs();
       assert(false);
     }
 
+    // Any write ends a reservation on its word, and an exclusive write only
+    // goes ahead if it had one
+    bool same_word = reservation_addr / 4 == addr / 4;
+    bool excl_fail = tb->mem_write_req_excl_o && !(reservation_valid && same_word);
+    if (tb->mem_write_req_excl_o || same_word)
+      reservation_valid = false;
+    if (excl_fail)
+      log("Exclusive write failed\n");
+
     tb->mem_write_res_valid_i = 1;
-    mem[addr / 4] = data;
+    tb->mem_write_res_excl_fail_i = excl_fail;
+    if (!excl_fail) {
+      write_masked(mem, addr, data, tb->mem_write_req_mask_o);
+      // Exclusive writes are never buffered, so they take effect now
+      if (checkpoints && tb->mem_write_req_excl_o)
+        write_arch_mem(addr, data, tb->mem_write_req_mask_o);
+    }
+    write_countdown = -1;
+  }
+
+  // Coprocessor. A request has to stay up until it's accepted.
+  tb->cop_req_ready_i = 0;
+  tb->cop_res_valid_i = 0;
+  if (cop_req_waiting && !tb->cop_req_valid_o) {
+    std::cout << "Coprocessor request withdrawn before it was accepted" << std::endl;
+    return false;
+  }
+  cop_req_waiting = false;
+  if (!cop_pending && tb->cop_req_valid_o && cop_handler) {
+    if (cop_ready_countdown < 0)
+      cop_ready_countdown = cop_ready_latency;
+  } else {
+    cop_ready_countdown = -1;
+  }
+
+  if (cop_ready_countdown > 0) {
+    cop_ready_countdown--;
+    cop_req_waiting = true;
+  } else if (cop_ready_countdown == 0) {
+    log("Coprocessor request: custom-%d funct3 %d funct7 %d rs1 0x%08x rs2 0x%08x\n",
+        tb->cop_req_custom_o, tb->cop_req_funct3_o, tb->cop_req_funct7_o,
+        tb->cop_req_rs1_o, tb->cop_req_rs2_o);
+
+    tb->cop_req_ready_i = 1;
+    cop_ready_countdown = -1;
+    cop_result = 0;
+    cop_error = !cop_handler(tb->cop_req_custom_o, tb->cop_req_funct3_o,
+                             tb->cop_req_funct7_o, tb->cop_req_rs1_o,
+                             tb->cop_req_rs2_o, &cop_result);
+    cop_pending = true;
+    cop_countdown = cop_latency;
+  } else if (cop_pending) {
+    cop_countdown--;
+  }
+
+  if (cop_pending && cop_countdown == 0) {
+    log("Coprocessor response: 0x%08x%s\n", cop_result, cop_error ? " (error)" : "");
+    tb->cop_res_valid_i = 1;
+    tb->cop_res_data_i = cop_result;
+    tb->cop_res_error_i = cop_error;
+    cop_pending = false;
   }
 
   return true;
@@ -176,6 +310,111 @@ bool Lemoncore::run_till_pc(uint32_t pc) {
   return true;
 }
 
+#ifdef LEMONCORE_PROBES
+// Called between the edges, where the core's signals are those of the cycle
+// about to end. The signals are only public in builds with
+// sim/lemoncore_probes.vlt.
+void Lemoncore::trace_retirement() {
+  auto core = tb->lemoncore;
+
+  if (tb->mem_read_req_valid_o && tb->mem_read_res_valid_i) {
+    retiring.flags |= RETIRE_LOAD;
+    retiring.mem_addr = tb->mem_read_req_addr_o;
+    retiring.load_data = tb->mem_read_res_data_i;
+  }
+  if (core->store_issue) {
+    retiring.flags |= RETIRE_STORE;
+    retiring.mem_addr = core->alu_result_q;
+    retiring.store_data = core->store_wdata;
+    retiring.store_mask = core->store_mask;
+  }
+
+  if (core->exception) {
+    retiring.flags = (retiring.flags & ~(RETIRE_LOAD | RETIRE_STORE)) | RETIRE_TRAP;
+    retiring.cause = core->mcause_d;
+  } else if (core->instret) {
+    if (core->we && core->rd != 0) {
+      retiring.flags |= RETIRE_RD;
+      retiring.rd = core->rd;
+      retiring.rd_value = core->wdata;
+    }
+  } else {
+    return;
+  }
+
+  // A trap in fetch comes before the instruction is in
+  if (core->ctrl_state == 0)
+    retiring.flags |= RETIRE_NO_INSTR;
+  retiring.pc = core->pc_q;
+  retiring.instr = core->instr_q;
+  retire_trace->record(retiring);
+  retiring = RetireRecord();
+}
+
+// Called between the edges like trace_retirement(). A store counts once its
+// instruction retires, whether or not it has left the store buffer, so the
+// hashed memory doesn't depend on when the buffer drains.
+void Lemoncore::checkpoint_retirement() {
+  auto core = tb->lemoncore;
+
+  if (core->store_issue && !tb->mem_write_req_excl_o) {
+    arch_store.valid = true;
+    arch_store.addr = core->alu_result_q;
+    arch_store.data = core->store_wdata;
+    arch_store.mask = core->store_mask;
+  }
+
+  if (core->exception) {
+    arch_store.valid = false;
+  } else if (core->instret) {
+    if (arch_store.valid)
+      write_arch_mem(arch_store.addr, arch_store.data, arch_store.mask);
+    arch_store.valid = false;
+    if ((retired + 1) % checkpoints->get_interval() == 0)
+      checkpoint_due = true;
+  }
+}
+#endif
+
+void Lemoncore::write_arch_mem(uint32_t addr, uint32_t data, uint8_t mask) {
+  // Out of bounds stores stop the run once they reach the bus
+  if (addr >= ROM_SIZE + RAM_SIZE)
+    return;
+  write_masked(arch_mem, addr, data, mask);
+  dirty_pages |= 1ull << (addr / CHECKPOINT_PAGE_SIZE);
+}
+
+// Called after the edge the checkpointed instruction retires on, so its
+// results are in
+void Lemoncore::take_checkpoint() {
+  StateHash hash(checkpoint_hash);
+  for (int i = 0; i < 32; i++)
+    hash.add(get_reg(i));
+  hash.add(get_pc());
+  hash.add(get_mstatus());
+  hash.add(get_mie());
+  hash.add(tb->lemoncore->mtvec_q);
+  hash.add(get_mscratch());
+  hash.add(get_mepc());
+  hash.add(get_mcause());
+  hash.add(get_mtval());
+
+  for (int page = 0; page < NUM_PAGES; page++) {
+    if (!(dirty_pages & (1ull << page)))
+      continue;
+    hash.add(page);
+    int first = page * CHECKPOINT_PAGE_SIZE / 4;
+    int end = std::min(first + CHECKPOINT_PAGE_SIZE / 4, (ROM_SIZE + RAM_SIZE) / 4);
+    for (int i = first; i < end; i++)
+      hash.add(arch_mem[i]);
+  }
+  dirty_pages = 0;
+
+  checkpoint_hash = hash.value();
+  checkpoints->record({retired, (uint64_t)cycle, get_pc(), checkpoint_hash});
+  checkpoint_due = false;
+}
+
 void Lemoncore::log(const char* fmt...) {
   // https://stackoverflow.com/q/41400
   if (verbose) {
@@ -190,12 +429,14 @@ void Lemoncore::write_imem(uint32_t addr, uint32_t data) {
   assert(addr % 4 == 0);
   assert(addr < ROM_SIZE);
   mem[addr / 4] = data;
+  if (checkpoints) write_arch_mem(addr, data, 0xF);
 }
 
 void Lemoncore::write_ram(uint32_t addr, uint32_t data) {
   assert(addr % 4 == 0);
   assert(addr < RAM_SIZE + ROM_SIZE);
   mem[(addr + ROM_SIZE) / 4] = data;
+  if (checkpoints) write_arch_mem(addr + ROM_SIZE, data, 0xF);
 }
 
 uint32_t Lemoncore::read_ram(uint32_t addr) {
@@ -204,6 +445,10 @@ uint32_t Lemoncore::read_ram(uint32_t addr) {
   return mem[(addr + ROM_SIZE) / 4];
 }
 
+uint32_t* Lemoncore::get_mem() {
+  return mem;
+}
+
 void Lemoncore::set_reg(uint8_t reg, uint32_t data) {
   tb->lemoncore->regfile->regs[reg] = data;
 }
@@ -214,6 +459,12 @@ uint32_t Lemoncore::get_reg(uint8_t reg) {
   return regs[reg];
 }
 
+uint32_t Lemoncore::get_shadow_reg(uint8_t reg) {
+  assert(reg < 32);
+  auto regs = tb->lemoncore->regfile->regs;
+  return regs[32 + reg];
+}
+
 uint32_t Lemoncore::get_pc() {
   return tb->lemoncore->pc_q;
 }
@@ -236,6 +487,18 @@ uint32_t Lemoncore::get_mtval() {
   return tb->lemoncore->mtval_q;
 }
 
+uint32_t Lemoncore::get_mepc() {
+  return tb->lemoncore->mepc_q;
+}
+
+bool Lemoncore::is_sleeping() {
+  return tb->sleep_o;
+}
+
+bool Lemoncore::is_fetching() {
+  return tb->lemoncore->ctrl_state == 0;
+}
+
 uint32_t Lemoncore::get_mscratch() {
   return tb->lemoncore->mscratch_q;
 }
@@ -261,3 +524,59 @@ void Lemoncore::set_irq_software(int val) {
 void Lemoncore::set_irq_external(int val) {
   tb->irq_external_i = val;
 }
+
+void Lemoncore::set_coprocessor(CopHandler handler, int latency) {
+  cop_handler = handler;
+  cop_latency = latency;
+}
+
+void Lemoncore::set_coprocessor_ready_latency(int latency) {
+  cop_ready_latency = latency;
+}
+
+void Lemoncore::set_write_latency(int latency) {
+  write_latency = latency;
+}
+
+void Lemoncore::set_write_error(bool error) {
+  write_error = error;
+}
+
+void Lemoncore::set_retire_trace(RetireTraceWriter* writer) {
+#ifndef LEMONCORE_PROBES
+  if (writer) {
+    std::cout << "Retirement traces need a build with LEMONCORE_PROBES" << std::endl;
+    assert(false);
+  }
+#endif
+  retire_trace = writer;
+  retiring = RetireRecord();
+}
+
+void Lemoncore::set_vcd_dumping(bool dumping) {
+  vcd_dumping = dumping;
+}
+
+uint64_t Lemoncore::get_retired() {
+  return retired;
+}
+
+void Lemoncore::set_checkpoints(CheckpointLog* log) {
+#ifndef LEMONCORE_PROBES
+  if (log) {
+    std::cout << "Checkpoints need a build with LEMONCORE_PROBES" << std::endl;
+    assert(false);
+  }
+#endif
+  checkpoints = log;
+  checkpoint_due = false;
+  checkpoint_hash = 0;
+  dirty_pages = 0;
+  arch_store = ArchStore();
+  memcpy(arch_mem, mem, sizeof(arch_mem));
+}
+
+// As if another hart had written the reserved word
+void Lemoncore::clear_reservation() {
+  reservation_valid = false;
+}
@@ -3,16 +3,27 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <functional>
 #include <iostream>
 #include "Vlemoncore.h"
+#include "checkpoint.h"
+#include "retire_trace.h"
 
 #define ROM_SIZE 4096  // bytes
 #define RAM_SIZE 8208  // bytes, includes RAM and peripherals
+#define CHECKPOINT_PAGE_SIZE 256  // bytes, granularity of dirty RAM tracking
 
 class Lemoncore {
  public:
+  // Coprocessor model: fills in rd and returns true, or returns false to send
+  // an error response
+  typedef std::function<bool(uint8_t custom, uint8_t funct3, uint8_t funct7,
+                             uint32_t rs1, uint32_t rs2, uint32_t* rd)> CopHandler;
+
   explicit Lemoncore(bool verbose);
+  Lemoncore(bool verbose, bool trace);
   Lemoncore(bool verbose, std::string vcd_path);
+  Lemoncore(bool verbose, bool trace, std::string vcd_path);
   ~Lemoncore();
   bool load_firmware(std::string path);
   void reset();
@@ -21,6 +32,8 @@ class Lemoncore {
   bool run_till_pc(uint32_t pc);
   void set_reg(uint8_t reg, uint32_t data);
   uint32_t get_reg(uint8_t reg);
+  // A register in the shadow bank (needs SHADOW_REGS)
+  uint32_t get_shadow_reg(uint8_t reg);
   uint32_t get_pc();
   uint32_t get_mcause();
   uint32_t get_mstatus();
@@ -29,21 +42,83 @@ class Lemoncore {
   void set_mie(uint32_t mie);
   uint32_t get_mip();
   uint32_t get_mtval();
+  uint32_t get_mepc();
   uint32_t get_mscratch();
+  bool is_sleeping();
+  // In the fetch state, between one instruction and the next
+  bool is_fetching();
   void write_imem(uint32_t addr, uint32_t data);
   void write_ram(uint32_t addr, uint32_t data);
   uint32_t read_ram(uint32_t addr);
+  // The memory the harness serves, ROM then RAM, in place. Writes to it
+  // reach the core like write_imem and write_ram, but aren't seen by
+  // checkpoints, which only follow stores and those two.
+  uint32_t* get_mem();
   void set_irq_timer(int val);
   void set_irq_software(int val);
   void set_irq_external(int val);
+  void set_coprocessor(CopHandler handler, int latency);
+  // Cycles the coprocessor keeps a request waiting before accepting it
+  void set_coprocessor_ready_latency(int latency);
+  void set_write_latency(int latency);
+  void set_write_error(bool error);
+  void clear_reservation();
+  // Records every retired instruction and trap to writer, or stops if null
+  void set_retire_trace(RetireTraceWriter* writer);
+  // Pauses and resumes the waveform, if there is one
+  void set_vcd_dumping(bool dumping);
+  // Instructions retired since construction
+  uint64_t get_retired();
+  // Logs a checkpoint every log->get_interval() retired instructions, or stops
+  // if null. Memory is tracked from here on, so load firmware first.
+  void set_checkpoints(CheckpointLog* log);
  private:
-  void init(bool verbose, std::string vcd_path);
+  struct ArchStore {
+    bool valid;
+    uint32_t addr;
+    uint32_t data;
+    uint8_t mask;
+  };
+
+  void init(bool verbose, bool trace, std::string vcd_path);
   void dump_regs();
   void log(const char* fmt...);
+  void trace_retirement();
+  void checkpoint_retirement();
+  void take_checkpoint();
+  void write_arch_mem(uint32_t addr, uint32_t data, uint8_t mask);
 
   uint32_t mem[(ROM_SIZE + RAM_SIZE) / 4];
   bool verbose;
+  bool trace;
   int cycle;
+  CopHandler cop_handler;
+  int cop_latency;
+  int cop_ready_latency;
+  int cop_ready_countdown;
+  bool cop_req_waiting;
+  bool cop_pending;
+  int cop_countdown;
+  uint32_t cop_result;
+  bool cop_error;
+  int write_latency;
+  int write_countdown;
+  bool write_error;
+  bool reservation_valid;
+  uint32_t reservation_addr;
+  RetireTraceWriter* retire_trace;
+  // The instruction in flight, filled in as it goes
+  RetireRecord retiring;
+  uint64_t retired;
+  bool vcd_dumping;
+  CheckpointLog* checkpoints;
+  bool checkpoint_due;
+  uint64_t checkpoint_hash;
+  // Memory as retired instructions see it, which is ahead of mem while stores
+  // sit in the store buffer
+  uint32_t arch_mem[(ROM_SIZE + RAM_SIZE) / 4];
+  uint64_t dirty_pages;
+  ArchStore arch_store;
   Vlemoncore *tb;
   VerilatedVcdC* tfp;
 };
@@ -1,15 +1,34 @@
+#include <inttypes.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <chrono>
 #include <iostream>
 
+#include "checkpoint.h"
 #include "lemoncore.h"
+#include "retire_trace.h"
 #include "verilated.h"
 
-// Simulation settings and parameters
-// TODO: set from command line
+// Simulation settings and parameters. +cycles=N runs for N cycles instead.
 #define NUM_CYCLES 100
 
+// Log every fetch and memory access, unless writing a retirement trace with
+// +trace=<path> (read it back with trace_decode) or checkpoints with
+// +checkpoints=<path>
 #define VERBOSE true
 
+// +quiet drops the log and the waveform as well, and prints how long the run
+// took in wall-clock time, for timing a run with and without the trace
+
+// Instructions between checkpoints, unless given with +checkpoint_interval=N
+#define CHECKPOINT_INTERVAL 100000
+
+// +window=FROM:TO limits the retirement trace and the waveform (written to
+// +vcd=<path>) to the instructions numbered FROM up to TO, counting from 0,
+// and stops the run after them. checkpoint_bisect uses it to trace just the
+// interval where two runs part.
+
 int main(int argc, char **argv) {
   // Initialize Verilators variables
   Verilated::commandArgs(argc, argv);
@@ -24,16 +43,101 @@ int main(int argc, char **argv) {
     exit(EXIT_FAILURE);
   }
 
-  Lemoncore cpu(VERBOSE);
+  int num_cycles = NUM_CYCLES;
+  const char* flag_cycles = Verilated::commandArgsPlusMatch("cycles");
+  if (flag_cycles[0]) {
+    num_cycles = atoi(flag_cycles + strlen("+cycles="));
+  }
+
+  const char* flag_trace = Verilated::commandArgsPlusMatch("trace");
+  bool tracing = flag_trace[0] != 0;
+  RetireTraceWriter retire_trace;
+  if (tracing) {
+    std::string trace_path(flag_trace + strlen("+trace="));
+    if (!retire_trace.open(trace_path)) {
+      std::cerr << "Error opening " << trace_path << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  const char* flag_checkpoints = Verilated::commandArgsPlusMatch("checkpoints");
+  bool checkpointing = flag_checkpoints[0] != 0;
+  uint64_t checkpoint_interval = CHECKPOINT_INTERVAL;
+  const char* flag_interval = Verilated::commandArgsPlusMatch("checkpoint_interval");
+  if (flag_interval[0]) {
+    checkpoint_interval = strtoull(flag_interval + strlen("+checkpoint_interval="), nullptr, 0);
+  }
+  CheckpointLog checkpoints;
+  if (checkpointing) {
+    std::string checkpoint_path(flag_checkpoints + strlen("+checkpoints="));
+    if (!checkpoints.open(checkpoint_path, checkpoint_interval)) {
+      std::cerr << "Error opening " << checkpoint_path << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  const char* flag_window = Verilated::commandArgsPlusMatch("window");
+  bool windowed = flag_window[0] != 0;
+  uint64_t window_from = 0;
+  uint64_t window_to = 0;
+  if (windowed && sscanf(flag_window + strlen("+window="), "%" SCNu64 ":%" SCNu64, &window_from,
+                         &window_to) != 2) {
+    std::cerr << "+window takes FROM:TO" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  std::string vcd_path = "lemoncore.vcd";
+  const char* flag_vcd = Verilated::commandArgsPlusMatch("vcd");
+  if (flag_vcd[0]) {
+    vcd_path = std::string(flag_vcd + strlen("+vcd="));
+  }
+
+  bool timed = Verilated::commandArgsPlusMatch("quiet")[0] != 0;
+
+  // The retirement trace and checkpoints stand in for the log and the
+  // waveform, except that a window keeps the waveform for itself
+  bool quiet = tracing || checkpointing || windowed || timed;
+  Lemoncore cpu(VERBOSE && !quiet, !quiet || windowed, vcd_path);
 
   // Load test code
   if (!cpu.load_firmware(firmware_path)) {
     std::cerr << "Error reading file " << firmware_path << std::endl;
     exit(EXIT_FAILURE);
   }
+  if (checkpointing) {
+    cpu.set_checkpoints(&checkpoints);
+  }
 
   // Run CPU
-  if (cpu.run(NUM_CYCLES)) {
+  auto start = std::chrono::steady_clock::now();
+  bool ok = true;
+  if (windowed) {
+    bool inside = false;
+    cpu.set_vcd_dumping(false);
+    for (int c = 0; ok && c < num_cycles && !Verilated::gotFinish(); c++) {
+      uint64_t retired = cpu.get_retired();
+      if (retired >= window_to)
+        break;
+      if (!inside && retired >= window_from) {
+        inside = true;
+        cpu.set_vcd_dumping(true);
+        if (tracing)
+          cpu.set_retire_trace(&retire_trace);
+      }
+      ok = cpu.step();
+    }
+  } else {
+    if (tracing)
+      cpu.set_retire_trace(&retire_trace);
+    ok = cpu.run(num_cycles);
+  }
+  retire_trace.close();
+  checkpoints.close();
+  if (timed) {
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    printf("%" PRIu64 " instructions in %.3f s\n", cpu.get_retired(), elapsed.count());
+  }
+  if (ok) {
     exit(EXIT_SUCCESS);
   }
   else {
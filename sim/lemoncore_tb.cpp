@@ -1,5 +1,6 @@
 #include <stdint.h>
 #include <stdlib.h>
+#include <vector>
 #include <gtest/gtest.h>
 #include "verilated.h"
 #include "riscv.h"
@@ -49,6 +50,25 @@ TEST_F(LemoncoreTest, MisalignedAddr) {
   EXPECT_EQ(cpu->get_mtval(), 2);
 }
 
+TEST_F(LemoncoreTest, MisalignedJumpLink) {
+  // A jump that traps on its target doesn't write rd
+  cpu->set_reg(1, 0x1234);
+  cpu->write_imem(0, rv_jal(1, 6));
+  ASSERT_TRUE(cpu->run(7));
+  EXPECT_EQ(cpu->get_mcause(), 0);
+  EXPECT_EQ(cpu->get_reg(1), 0x1234);
+}
+
+TEST_F(LemoncoreTest, FenceAfterBranch) {
+  // Fences go to the next instruction, not where the branch before went
+  cpu->write_imem(0, rv_beq(0, 0, 8));
+  cpu->write_imem(8, rv_fence());
+  cpu->write_imem(12, rv_addi(1, 0, 5));
+  cpu->write_imem(16, rv_jal(0, 0));
+  ASSERT_TRUE(cpu->run_till_pc(16));
+  EXPECT_EQ(cpu->get_reg(1), 5);
+}
+
 TEST_F(LemoncoreTest, MisalignedLoad) {
   cpu->write_imem(0, rv_lw(0, 0, 1)); // lw x0, 1(x0)
   ASSERT_TRUE(cpu->run(6));
@@ -73,6 +93,66 @@ TEST_F(LemoncoreTest, CSR) {
   EXPECT_EQ(cpu->get_mscratch(), 5);
 }
 
+TEST_F(LemoncoreTest, CSRWriteZero) {
+  // CSRRW/CSRRWI write even when the source is x0 or zero
+  cpu->write_imem(0, rv_csrrwi(0, 5, RV_CSR_MSCRATCH));
+  cpu->write_imem(4, rv_csrrw(1, 0, RV_CSR_MSCRATCH));
+  cpu->write_imem(8, rv_csrrwi(0, 7, RV_CSR_MSCRATCH));
+  cpu->write_imem(12, rv_csrrwi(2, 0, RV_CSR_MSCRATCH));
+  ASSERT_TRUE(cpu->run_till_pc(8));
+  EXPECT_EQ(cpu->get_reg(1), 5);
+  EXPECT_EQ(cpu->get_mscratch(), 0);
+  ASSERT_TRUE(cpu->run_till_pc(16));
+  EXPECT_EQ(cpu->get_reg(2), 7);
+  EXPECT_EQ(cpu->get_mscratch(), 0);
+}
+
+TEST_F(LemoncoreTest, CSRClear) {
+  cpu->set_reg(2, 0x5);
+  cpu->write_imem(0, rv_csrrwi(0, 0xF, RV_CSR_MSCRATCH));
+  cpu->write_imem(4, rv_csrrc(1, 2, RV_CSR_MSCRATCH));
+  cpu->write_imem(8, rv_csrrci(3, 0x5, RV_CSR_MSCRATCH));
+  ASSERT_TRUE(cpu->run_till_pc(12));
+  EXPECT_EQ(cpu->get_reg(1), 0xF);
+  EXPECT_EQ(cpu->get_reg(3), 0xA); // bits already clear stay clear
+  EXPECT_EQ(cpu->get_mscratch(), 0xA);
+}
+
+TEST_F(LemoncoreTest, CSRReadOnly) {
+  // csrr reads a read-only CSR, but setting bits in one is illegal
+  cpu->set_reg(1, 0x7);
+  cpu->set_reg(3, 0x1);
+  cpu->write_imem(0, rv_csrrs(1, 0, RV_CSR_MHARTID));
+  cpu->write_imem(4, rv_csrrs(2, 3, RV_CSR_MHARTID));
+  ASSERT_TRUE(cpu->run_till_pc(4));
+  EXPECT_EQ(cpu->get_reg(1), 0);
+  ASSERT_TRUE(cpu->run(4));
+  EXPECT_EQ(cpu->get_pc(), 0);
+  EXPECT_EQ(cpu->get_mcause(), 2);
+}
+
+TEST_F(LemoncoreTest, HpmCounterReadOnly) {
+  // The machine hpmcounters take writes, their user shadows don't
+  cpu->set_reg(1, 0x7);
+  cpu->write_imem(0, rv_csrrw(0, 1, RV_CSR_MHPMCOUNTER3));
+  cpu->write_imem(4, rv_csrrs(2, 0, RV_CSR_HPMCOUNTER3));
+  cpu->write_imem(8, rv_csrrw(0, 1, RV_CSR_HPMCOUNTER3));
+  ASSERT_TRUE(cpu->run_till_pc(8));
+  EXPECT_EQ(cpu->get_reg(2), 0);
+  ASSERT_TRUE(cpu->run(4));
+  EXPECT_EQ(cpu->get_pc(), 0);
+  EXPECT_EQ(cpu->get_mcause(), 2);
+}
+
+TEST_F(LemoncoreTest, HpmEvents) {
+  // All of mhpmevent3-31 are there, hardwired to zero
+  cpu->set_reg(1, 0x7);
+  cpu->write_imem(0, rv_csrrw(0, 1, RV_CSR_MHPMEVENT31));
+  cpu->write_imem(4, rv_csrrs(2, 0, RV_CSR_MHPMEVENT31));
+  ASSERT_TRUE(cpu->run_till_pc(8));
+  EXPECT_EQ(cpu->get_reg(2), 0);
+}
+
 TEST_F(LemoncoreTest, TimerIRQ) {
   cpu->set_mstatus(1 << 3);
   cpu->set_mie(1 << 7);
@@ -103,6 +183,63 @@ TEST_F(LemoncoreTest, SoftwareIRQ) {
   EXPECT_EQ(cpu->get_pc(), 0);
 }
 
+TEST_F(LemoncoreTest, VectoredIRQ) {
+  // Interrupts jump to mtvec base + 4 * cause, exceptions to the base
+  cpu->set_mstatus(1 << 3);
+  cpu->set_mie(1 << 7 | 1 << 11);
+  cpu->write_imem(0, rv_addi(1, 0, 0x101));
+  cpu->write_imem(4, rv_csrrw(0, 1, RV_CSR_MTVEC));
+  cpu->write_imem(8, rv_jal(0, 0));
+  cpu->write_imem(0x100 + 4 * 7, rv_jal(0, 0));
+  ASSERT_TRUE(cpu->run_till_pc(8));
+
+  cpu->set_irq_timer(1);
+  ASSERT_TRUE(cpu->run_till_pc(0x100 + 4 * 7));
+  EXPECT_EQ(cpu->get_mcause(), 1 << 31 | 7);
+
+  cpu->set_irq_timer(0);
+  cpu->set_mstatus(1 << 3);
+  cpu->set_irq_external(1);
+  ASSERT_TRUE(cpu->run_till_pc(0x100 + 4 * 11));
+  EXPECT_EQ(cpu->get_mcause(), 1 << 31 | 11);
+}
+
+TEST_F(LemoncoreTest, WFI) {
+  // Interrupt enabled in mie but not globally: wakes up and carries on
+  cpu->set_mie(1 << 7);
+  cpu->write_imem(0, rv_wfi());
+  cpu->write_imem(4, rv_addi(1, 0, 5));
+  ASSERT_TRUE(cpu->run(20));
+  EXPECT_TRUE(cpu->is_sleeping());
+  EXPECT_EQ(cpu->get_pc(), 0);
+
+  cpu->set_irq_timer(1);
+  ASSERT_TRUE(cpu->run_till_pc(8));
+  EXPECT_FALSE(cpu->is_sleeping());
+  EXPECT_EQ(cpu->get_reg(1), 5);
+}
+
+TEST_F(LemoncoreTest, WFITrap) {
+  // With interrupts on, the trap is taken after the WFI retires
+  cpu->set_mstatus(1 << 3);
+  cpu->set_mie(1 << 11);
+  cpu->write_imem(0, rv_jal(0, 8));
+  cpu->write_imem(8, rv_wfi());
+  ASSERT_TRUE(cpu->run(20));
+  EXPECT_TRUE(cpu->is_sleeping());
+
+  // Only enabled interrupts wake it up
+  cpu->set_irq_timer(1);
+  ASSERT_TRUE(cpu->run(10));
+  EXPECT_TRUE(cpu->is_sleeping());
+
+  cpu->set_irq_external(1);
+  ASSERT_TRUE(cpu->run(4));
+  EXPECT_EQ(cpu->get_mcause(), 1 << 31 | 11);
+  EXPECT_EQ(cpu->get_mepc(), 12);
+  EXPECT_EQ(cpu->get_pc(), 0);
+}
+
 TEST_F(LemoncoreTest, ExternalIRQ) {
   cpu->set_mstatus(1 << 3);
   cpu->set_mie(1 << 11);
@@ -118,11 +255,72 @@ TEST_F(LemoncoreTest, ExternalIRQ) {
   EXPECT_EQ(cpu->get_pc(), 0);
 }
 
+TEST_F(LemoncoreTest, MaskedIRQCause) {
+  // A pending interrupt that isn't enabled leaves other traps' causes alone
+  cpu->set_irq_timer(1);
+  cpu->write_imem(0, rv_ecall());
+  ASSERT_TRUE(cpu->run(4));
+  EXPECT_EQ(cpu->get_mcause(), 11);
+  EXPECT_EQ(cpu->get_mtval(), 0);
+}
+
+TEST_F(LemoncoreTest, Mret) {
+  // mret restores MIE from MPIE and sets MPIE
+  cpu->write_imem(0, rv_addi(1, 0, 12));
+  cpu->write_imem(4, rv_csrrw(0, 1, RV_CSR_MEPC));
+  cpu->write_imem(8, rv_mret());
+  cpu->write_imem(12, rv_jal(0, 0));
+  ASSERT_TRUE(cpu->run_till_pc(8));
+  cpu->set_mstatus(0);
+  ASSERT_TRUE(cpu->run_till_pc(12));
+  EXPECT_EQ(cpu->get_mstatus(), 1 << 7);
+}
+
+TEST_F(LemoncoreTest, MepcAlign) {
+  // Without compressed instructions, mepc's low two bits are always zero
+  cpu->write_imem(0, rv_addi(1, 0, 0x13));
+  cpu->write_imem(4, rv_csrrw(0, 1, RV_CSR_MEPC));
+  cpu->write_imem(8, rv_csrrs(2, 0, RV_CSR_MEPC));
+  ASSERT_TRUE(cpu->run_till_pc(12));
+  EXPECT_EQ(cpu->get_mepc(), 0x10);
+  EXPECT_EQ(cpu->get_reg(2), 0x10);
+}
+
+TEST_F(LemoncoreTest, CSRWriteIRQ) {
+  // Whichever cycle an interrupt comes in, a CSR instruction either retires
+  // or is replayed from scratch, never half done
+  for (int delay = 0; delay < 12; delay++) {
+    Lemoncore core(false);
+    core.set_mstatus(1 << 3);
+    core.set_mie(1 << 7);
+    core.set_reg(2, 9);
+    core.set_reg(3, 0x100);
+    core.write_imem(0, rv_csrrw(0, 3, RV_CSR_MTVEC));
+    core.write_imem(4, rv_csrrwi(0, 5, RV_CSR_MSCRATCH));
+    core.write_imem(8, rv_csrrw(1, 2, RV_CSR_MSCRATCH));
+    core.write_imem(12, rv_jal(0, 0));
+    core.write_imem(0x100, rv_jal(0, 0));
+    ASSERT_TRUE(core.run_till_pc(8));
+    ASSERT_TRUE(core.run(delay));
+    core.set_irq_timer(1);
+    ASSERT_TRUE(core.run_till_pc(0x100));
+
+    if (core.get_mepc() == 8) {
+      EXPECT_EQ(core.get_mscratch(), 5) << "delay " << delay;
+      EXPECT_EQ(core.get_reg(1), 0) << "delay " << delay;
+    } else {
+      EXPECT_EQ(core.get_mepc(), 12) << "delay " << delay;
+      EXPECT_EQ(core.get_mscratch(), 9) << "delay " << delay;
+      EXPECT_EQ(core.get_reg(1), 5) << "delay " << delay;
+    }
+  }
+}
+
 TEST_F(LemoncoreTest, InstructionCounter) {
   cpu->write_imem(0, rv_addi(1, 1, 1));
   cpu->write_imem(4, rv_blt(1, 2, -4));
-  cpu->write_imem(8, rv_csrrw(3, 0, RV_CSR_INSTRET));
-  cpu->write_imem(12, rv_csrrw(4, 0, RV_CSR_INSTRETH));
+  cpu->write_imem(8, rv_csrrs(3, 0, RV_CSR_INSTRET));
+  cpu->write_imem(12, rv_csrrs(4, 0, RV_CSR_INSTRETH));
   cpu->set_reg(2, 10);
   const int bound = 300;
   int cycle = 0;
@@ -142,7 +340,7 @@ TEST_F(LemoncoreTest, CycleCounter) {
   cpu->set_mstatus(1 << 3);
   cpu->set_mie(1 << 11);
 
-  cpu->write_imem(0, rv_csrrw(1, 0, RV_CSR_CYCLE));
+  cpu->write_imem(0, rv_csrrs(1, 0, RV_CSR_CYCLE));
   cpu->write_imem(4, rv_jal(0, 0));
 
   ASSERT_TRUE(cpu->run(24));
@@ -152,6 +350,47 @@ TEST_F(LemoncoreTest, CycleCounter) {
   ASSERT_EQ(cpu->get_reg(1), 24 + 3);
 }
 
+TEST_F(LemoncoreTest, CycleCounterSleep) {
+  // mcycle stands still while the core sleeps
+  cpu->set_mie(1 << 7);
+  cpu->write_imem(0, rv_wfi());
+  cpu->write_imem(4, rv_csrrs(1, 0, RV_CSR_CYCLE));
+  ASSERT_TRUE(cpu->run(100));
+  EXPECT_TRUE(cpu->is_sleeping());
+
+  cpu->set_irq_timer(1);
+  ASSERT_TRUE(cpu->run_till_pc(8));
+  EXPECT_LT(cpu->get_reg(1), 20);
+}
+
+TEST_F(LemoncoreTest, CounterWriteIRQ) {
+  // An interrupted write to minstret is replayed, so it mustn't land before
+  // the trap either
+  for (int delay = 0; delay < 12; delay++) {
+    Lemoncore core(false);
+    core.set_mstatus(1 << 3);
+    core.set_mie(1 << 7);
+    core.set_reg(2, 1000);
+    core.set_reg(3, 0x100);
+    core.write_imem(0, rv_csrrw(0, 3, RV_CSR_MTVEC));
+    core.write_imem(4, rv_csrrw(0, 2, RV_CSR_MINSTRET));
+    core.write_imem(8, rv_jal(0, 0));
+    core.write_imem(0x100, rv_csrrs(5, 0, RV_CSR_MINSTRET));
+    core.write_imem(0x104, rv_jal(0, 0));
+    ASSERT_TRUE(core.run_till_pc(4));
+    ASSERT_TRUE(core.run(delay));
+    core.set_irq_timer(1);
+    ASSERT_TRUE(core.run_till_pc(0x104));
+
+    if (core.get_mepc() == 4) {
+      EXPECT_LT(core.get_reg(5), 1000) << "delay " << delay;
+    } else {
+      EXPECT_EQ(core.get_mepc(), 8) << "delay " << delay;
+      EXPECT_GE(core.get_reg(5), 1000) << "delay " << delay;
+    }
+  }
+}
+
 TEST_F(LemoncoreTest, ExceptionHandler) {
   ASSERT_TRUE(cpu->load_firmware("sw/tests/test-exception-handler.bin"));
 
@@ -201,3 +440,441 @@ TEST_F(LemoncoreTest, InsertionSort) {
     EXPECT_EQ(num, sorted_numbers[i]);
   }
 }
+
+TEST_F(LemoncoreTest, BitmanipPopcount) {
+  // Population count as a plain RV32I shift/mask loop vs. a single Zbb cpop
+  const uint32_t value = 0xF0F0F0F0;
+  cpu->set_reg(1, value);
+  cpu->set_reg(2, value);
+
+  cpu->write_imem(0, rv_beq(1, 0, 20));
+  cpu->write_imem(4, rv_andi(4, 1, 1));
+  cpu->write_imem(8, rv_add(3, 3, 4));
+  cpu->write_imem(12, rv_srli(1, 1, 1));
+  cpu->write_imem(16, rv_jal(0, -16));
+  cpu->write_imem(20, rv_addi(31, 0, 1));
+  cpu->write_imem(24, rv_cpop(5, 2));
+  cpu->write_imem(28, rv_addi(31, 0, 2));
+
+  const int bound = 2000;
+  int loop_cycles = 0;
+  while (loop_cycles < bound && cpu->get_reg(31) != 1) {
+    ASSERT_TRUE(cpu->step());
+    loop_cycles++;
+  }
+  ASSERT_LT(loop_cycles, bound);
+
+  int cpop_cycles = 0;
+  while (cpop_cycles < bound && cpu->get_reg(31) != 2) {
+    ASSERT_TRUE(cpu->step());
+    cpop_cycles++;
+  }
+  ASSERT_LT(cpop_cycles, bound);
+
+  EXPECT_EQ(cpu->get_reg(3), 16);
+  EXPECT_EQ(cpu->get_reg(5), 16);
+  // 32 iterations of a 5 instruction loop vs. one instruction (both followed
+  // by the addi that flags completion)
+  EXPECT_LT(cpop_cycles * 20, loop_cycles);
+}
+
+TEST_F(LemoncoreTest, Coprocessor) {
+  cpu->set_coprocessor([](uint8_t custom, uint8_t funct3, uint8_t funct7,
+                          uint32_t rs1, uint32_t rs2, uint32_t* rd) {
+    *rd = rs1 * funct7 + rs2 + funct3 + (custom << 8);
+    return true;
+  }, 3);
+
+  cpu->set_reg(1, 10);
+  cpu->set_reg(2, 5);
+  cpu->write_imem(0, rv_custom0(3, 1, 2, 1, 2));
+  cpu->write_imem(4, rv_custom1(4, 1, 2, 0, 0));
+  ASSERT_TRUE(cpu->run_till_pc(8));
+
+  EXPECT_EQ(cpu->get_reg(3), 10 * 2 + 5 + 1);
+  EXPECT_EQ(cpu->get_reg(4), 5 + (1 << 8));
+}
+
+TEST_F(LemoncoreTest, CoprocessorError) {
+  cpu->set_coprocessor([](uint8_t custom, uint8_t funct3, uint8_t funct7,
+                          uint32_t rs1, uint32_t rs2, uint32_t* rd) {
+    return false;
+  }, 1);
+
+  uint32_t instr = rv_custom0(3, 1, 2, 7, 0);
+  cpu->write_imem(0, instr);
+
+  const int bound = 20;
+  int cycle = 0;
+  while (cycle < bound && cpu->get_mcause() != 2) {
+    ASSERT_TRUE(cpu->step());
+    cycle++;
+  }
+
+  ASSERT_LT(cycle, bound);
+  EXPECT_EQ(cpu->get_mtval(), instr);
+  EXPECT_EQ(cpu->get_pc(), 0);
+  EXPECT_EQ(cpu->get_reg(3), 0);
+}
+
+TEST_F(LemoncoreTest, CoprocessorIRQ) {
+  // An interrupt while the coprocessor keeps a request waiting doesn't pull
+  // the request; it's taken after the instruction retires
+  int requests = 0;
+  cpu->set_coprocessor([&](uint8_t custom, uint8_t funct3, uint8_t funct7,
+                           uint32_t rs1, uint32_t rs2, uint32_t* rd) {
+    requests++;
+    *rd = rs1 + rs2;
+    return true;
+  }, 3);
+  cpu->set_coprocessor_ready_latency(8);
+
+  cpu->set_mstatus(1 << 3);
+  cpu->set_mie(1 << 7);
+  cpu->set_reg(1, 10);
+  cpu->set_reg(2, 5);
+  cpu->write_imem(0, rv_custom0(3, 1, 2, 0, 0));
+  cpu->write_imem(4, rv_jal(0, 0));
+  ASSERT_TRUE(cpu->run(4));
+  cpu->set_irq_timer(1);
+
+  const int bound = 100;
+  int cycle = 0;
+  while (cycle < bound && cpu->get_mcause() != (1u << 31 | 7)) {
+    ASSERT_TRUE(cpu->step());
+    cycle++;
+  }
+  ASSERT_LT(cycle, bound);
+  EXPECT_EQ(requests, 1);
+  EXPECT_EQ(cpu->get_reg(3), 15);
+}
+
+TEST_F(LemoncoreTest, StoreBuffer) {
+  const uint32_t value = 0xdeadbeef;
+  cpu->set_write_latency(10);
+  cpu->set_reg(1, value);
+  for (int i = 0; i < 3; i++)
+    cpu->write_ram(4 * i, 0);
+
+  cpu->write_imem(0, rv_lui(2, ROM_SIZE));
+  cpu->write_imem(4, rv_sw(1, 2, 0));
+  cpu->write_imem(8, rv_sw(1, 2, 4));
+  cpu->write_imem(12, rv_addi(4, 0, 1));
+  cpu->write_imem(16, rv_lw(3, 2, 0));
+  cpu->write_imem(20, rv_addi(5, 0, 1));
+  cpu->write_imem(24, rv_sw(1, 2, 8));
+  cpu->write_imem(28, rv_fence());
+  cpu->write_imem(32, rv_addi(6, 0, 1));
+
+  const int bound = 200;
+  int cycle = 0;
+  while (cycle < bound && cpu->get_reg(4) != 1) {
+    ASSERT_TRUE(cpu->step());
+    cycle++;
+  }
+  ASSERT_LT(cycle, bound);
+  // Both stores have retired, but the second is still waiting to drain
+  EXPECT_EQ(cpu->read_ram(4), 0);
+
+  // Load waits for the buffered store to the same word
+  while (cycle < bound && cpu->get_reg(5) != 1) {
+    ASSERT_TRUE(cpu->step());
+    cycle++;
+  }
+  ASSERT_LT(cycle, bound);
+  EXPECT_EQ(cpu->get_reg(3), value);
+
+  // Fence waits for the buffer to drain
+  while (cycle < bound && cpu->get_reg(6) != 1) {
+    ASSERT_TRUE(cpu->step());
+    cycle++;
+  }
+  ASSERT_LT(cycle, bound);
+  EXPECT_EQ(cpu->read_ram(4), value);
+  EXPECT_EQ(cpu->read_ram(8), value);
+}
+
+TEST_F(LemoncoreTest, StoreBufferIoLoad) {
+  // A load from one device register waits for a buffered store to another,
+  // as when polling a status register after writing a control register
+  const uint32_t value = 0xdeadbeef;
+  const uint32_t io_base = ROM_SIZE + 8192;
+  cpu->set_write_latency(10);
+  cpu->set_reg(1, value);
+  cpu->write_ram(io_base + 4 - ROM_SIZE, 0);
+
+  cpu->write_imem(0, rv_lui(2, io_base));
+  cpu->write_imem(4, rv_sw(1, 2, 4));
+  cpu->write_imem(8, rv_lw(3, 2, 8));
+  cpu->write_imem(12, rv_addi(5, 0, 1));
+
+  const int bound = 100;
+  int cycle = 0;
+  while (cycle < bound && cpu->get_reg(5) != 1) {
+    ASSERT_TRUE(cpu->step());
+    cycle++;
+  }
+  ASSERT_LT(cycle, bound);
+  EXPECT_EQ(cpu->read_ram(io_base + 4 - ROM_SIZE), value);
+}
+
+TEST_F(LemoncoreTest, StoreBufferFault) {
+  cpu->set_write_latency(3);
+  cpu->set_write_error(true);
+
+  cpu->write_imem(0, rv_lui(2, ROM_SIZE));
+  cpu->write_imem(4, rv_sw(0, 2, 8));
+  for (int i = 8; i < 40; i += 4)
+    cpu->write_imem(i, rv_addi(3, 3, 1));
+
+  const int bound = 50;
+  int cycle = 0;
+  while (cycle < bound && cpu->get_mcause() != 7) {
+    ASSERT_TRUE(cpu->step());
+    cycle++;
+  }
+
+  // The store has retired by the time the fault comes back, so it's reported
+  // imprecisely against a later instruction
+  ASSERT_LT(cycle, bound);
+  EXPECT_EQ(cpu->get_mtval(), ROM_SIZE + 8);
+  EXPECT_EQ(cpu->get_pc(), 0);
+  EXPECT_GT(cpu->get_reg(3), 0);
+}
+
+TEST_F(LemoncoreTest, Checkpoints) {
+  auto checkpoints = [](uint32_t store, int write_latency, bool poke) {
+    Lemoncore cpu(false, false);
+    cpu.set_write_latency(write_latency);
+    cpu.set_reg(1, 0x12345678);
+    cpu.write_imem(0, rv_lui(2, ROM_SIZE));
+    cpu.write_imem(4, store);
+    cpu.write_imem(8, rv_addi(1, 1, 1));
+    cpu.write_imem(12, rv_jal(0, -8));
+
+    const char* path = WAVE_OUT_DIR "LemoncoreTest-Checkpoints.ckpt";
+    CheckpointLog log;
+    EXPECT_TRUE(log.open(path, 3));
+    cpu.set_checkpoints(&log);
+    if (poke)
+      cpu.write_ram(0x100, 1);
+    EXPECT_TRUE(cpu.run(300));
+    log.close();
+
+    uint64_t interval;
+    std::vector<Checkpoint> result;
+    EXPECT_TRUE(read_checkpoints(path, &interval, &result));
+    EXPECT_EQ(interval, 3);
+    return result;
+  };
+
+  // A store counts when it retires, not when it drains
+  auto fast = checkpoints(rv_sw(1, 2, 0), 0, false);
+  auto slow = checkpoints(rv_sw(1, 2, 0), 8, false);
+  ASSERT_GE(fast.size(), 10);
+  ASSERT_GE(slow.size(), 10);
+  for (int i = 0; i < 10; i++) {
+    EXPECT_EQ(fast[i].instret, 3 * (i + 1));
+    EXPECT_EQ(slow[i].instret, fast[i].instret);
+    EXPECT_EQ(slow[i].hash, fast[i].hash);
+  }
+  EXPECT_LT(fast[9].cycle, slow[9].cycle);
+
+  // Same registers, different memory
+  auto halfword = checkpoints(rv_sh(1, 2, 0), 0, false);
+  ASSERT_GE(halfword.size(), 1);
+  EXPECT_NE(halfword[0].hash, fast[0].hash);
+
+  // Memory the harness writes counts too
+  auto poked = checkpoints(rv_sw(1, 2, 0), 0, true);
+  ASSERT_GE(poked.size(), 1);
+  EXPECT_NE(poked[0].hash, fast[0].hash);
+}
+
+TEST_F(LemoncoreTest, Atomics) {
+  cpu->write_ram(0, 5);
+  cpu->set_reg(1, 3);
+  cpu->set_reg(5, 100);
+  cpu->set_reg(7, -1);
+  cpu->write_imem(0, rv_lui(2, ROM_SIZE));
+  // Each returns the old value, and writes the result back
+  cpu->write_imem(4, rv_amoadd_w(3, 2, 1));
+  cpu->write_imem(8, rv_amoswap_w(4, 2, 5));
+  cpu->write_imem(12, rv_amomin_w(6, 2, 7));
+  cpu->write_imem(16, rv_amomaxu_w(8, 2, 1));
+  ASSERT_TRUE(cpu->run_till_pc(20));
+
+  EXPECT_EQ(cpu->get_reg(3), 5);
+  EXPECT_EQ(cpu->get_reg(4), 8);
+  EXPECT_EQ(cpu->get_reg(6), 100);
+  // -1 is the larger unsigned value, so it stays
+  EXPECT_EQ(cpu->get_reg(8), 0xffffffff);
+  EXPECT_EQ(cpu->read_ram(0), 0xffffffff);
+}
+
+TEST_F(LemoncoreTest, LoadReservedStoreConditional) {
+  cpu->write_ram(0, 7);
+  cpu->set_reg(1, 42);
+  cpu->write_imem(0, rv_lui(2, ROM_SIZE));
+  cpu->write_imem(4, rv_lr_w(3, 2));
+  cpu->write_imem(8, rv_sc_w(4, 2, 1));
+  // The reservation is gone after the first sc
+  cpu->write_imem(12, rv_sc_w(5, 2, 0));
+  cpu->write_imem(16, rv_lr_w(6, 2));
+  cpu->write_imem(20, rv_sc_w(7, 2, 0));
+  ASSERT_TRUE(cpu->run_till_pc(20));
+
+  EXPECT_EQ(cpu->get_reg(3), 7);
+  EXPECT_EQ(cpu->get_reg(4), 0);
+  EXPECT_EQ(cpu->get_reg(5), 1);
+  EXPECT_EQ(cpu->get_reg(6), 42);
+
+  // Someone else writes the word between the lr and the sc
+  cpu->clear_reservation();
+  ASSERT_TRUE(cpu->run_till_pc(24));
+  EXPECT_EQ(cpu->get_reg(7), 1);
+  EXPECT_EQ(cpu->read_ram(0), 42);
+}
+
+TEST_F(LemoncoreTest, ReservationSameWord) {
+  // A write to any byte of the reserved word ends the reservation
+  cpu->write_ram(0, 7);
+  cpu->set_reg(1, 42);
+  cpu->write_imem(0, rv_lui(2, ROM_SIZE));
+  cpu->write_imem(4, rv_lr_w(3, 2));
+  cpu->write_imem(8, rv_sb(1, 2, 1));
+  cpu->write_imem(12, rv_sc_w(4, 2, 1));
+  ASSERT_TRUE(cpu->run_till_pc(16));
+  EXPECT_EQ(cpu->get_reg(4), 1);
+  EXPECT_EQ(cpu->read_ram(0), 42 << 8 | 7);
+}
+
+TEST_F(LemoncoreTest, AtomicRetry) {
+  cpu->write_ram(0, 1);
+  cpu->set_reg(1, 1);
+  cpu->write_imem(0, rv_lui(2, ROM_SIZE));
+  cpu->write_imem(4, rv_amoadd_w(3, 2, 1));
+
+  // Keep losing the reservation between the AMO's read and write for a while.
+  // It goes back for another read each time, and adds just once in the end.
+  ASSERT_TRUE(cpu->run_till_pc(4));
+  const int contended = 20;
+  const int bound = 50;
+  int cycle = 0;
+  while (cycle < bound && cpu->get_pc() == 4) {
+    if (cycle < contended)
+      cpu->clear_reservation();
+    ASSERT_TRUE(cpu->step());
+    cycle++;
+  }
+  ASSERT_LT(cycle, bound);
+  EXPECT_GT(cycle, contended);
+  EXPECT_EQ(cpu->get_reg(3), 1);
+  EXPECT_EQ(cpu->read_ram(0), 2);
+}
+
+TEST_F(LemoncoreTest, ShadowRegs) {
+  // The timer handler adds 1000 to x5 and clears mie in the shadow bank, while
+  // the main loop counts in its own x5
+  cpu->set_mstatus(1 << 3);
+  cpu->set_mie(1 << 7);
+  cpu->set_reg(1, 0x101);
+  cpu->write_imem(0, rv_csrrw(0, 1, RV_CSR_MTVEC));
+  cpu->write_imem(4, rv_csrrwi(0, 1, RV_CSR_MSHADOW));
+  cpu->write_imem(8, rv_addi(5, 5, 1));
+  cpu->write_imem(12, rv_jal(0, -4));
+  cpu->write_imem(0x100 + 4 * 7, rv_jal(0, 0x200 - (0x100 + 4 * 7)));
+  cpu->write_imem(0x200, rv_addi(5, 5, 1000));
+  cpu->write_imem(0x204, rv_addi(6, 0, 1 << 7));
+  cpu->write_imem(0x208, rv_csrrc(0, 6, RV_CSR_MIE));
+  cpu->write_imem(0x20C, rv_mret());
+  ASSERT_TRUE(cpu->run_till_pc(12));
+  ASSERT_TRUE(cpu->run(20));
+  uint32_t count = cpu->get_reg(5);
+  EXPECT_GT(count, 0);
+
+  cpu->set_irq_timer(1);
+  ASSERT_TRUE(cpu->run_till_pc(0x20C));
+  cpu->set_irq_timer(0);
+  ASSERT_TRUE(cpu->run_till_pc(12));
+  EXPECT_EQ(cpu->get_shadow_reg(5), 1000);
+  EXPECT_EQ(cpu->get_shadow_reg(6), 1 << 7);
+  EXPECT_EQ(cpu->get_reg(6), 0);
+  EXPECT_GE(cpu->get_reg(5), count);
+  EXPECT_LT(cpu->get_reg(5), 1000);
+
+  // Again, picking up where the bank was left
+  cpu->set_mie(1 << 7);
+  cpu->set_irq_timer(1);
+  ASSERT_TRUE(cpu->run_till_pc(0x20C));
+  cpu->set_irq_timer(0);
+  ASSERT_TRUE(cpu->run_till_pc(12));
+  EXPECT_EQ(cpu->get_shadow_reg(5), 2000);
+  EXPECT_LT(cpu->get_reg(5), 1000);
+}
+
+TEST_F(LemoncoreTest, ShadowRegsLatency) {
+  // Time a timer interrupt that turns itself off, from the interrupt to being
+  // back in the main loop: once with a handler that saves the two registers
+  // it needs, like entry.S without the shadow bank, and once with the bank
+  auto run = [](Lemoncore* cpu, bool shadow) {
+    cpu->set_mstatus(1 << 3);
+    cpu->set_mie(1 << 7);
+    cpu->set_reg(1, 0x101);
+    cpu->set_reg(2, ROM_SIZE);
+    cpu->set_reg(3, shadow);
+    cpu->write_imem(0, rv_csrrw(0, 1, RV_CSR_MTVEC));
+    cpu->write_imem(4, rv_csrrw(0, 2, RV_CSR_MSCRATCH));
+    cpu->write_imem(8, rv_csrrw(0, 3, RV_CSR_MSHADOW));
+    cpu->write_imem(12, rv_jal(0, 0));
+    cpu->write_imem(0x100 + 4 * 7, rv_jal(0, 0x200 - (0x100 + 4 * 7)));
+    std::vector<uint32_t> handler;
+    if (!shadow) {
+      handler.push_back(rv_csrrw(10, 10, RV_CSR_MSCRATCH));
+      handler.push_back(rv_sw(11, 10, 0));
+    }
+    handler.push_back(rv_addi(11, 0, 1 << 7));
+    handler.push_back(rv_csrrc(0, 11, RV_CSR_MIE));
+    if (!shadow) {
+      handler.push_back(rv_lw(11, 10, 0));
+      handler.push_back(rv_csrrw(10, 10, RV_CSR_MSCRATCH));
+    }
+    handler.push_back(rv_mret());
+    for (size_t i = 0; i < handler.size(); i++)
+      cpu->write_imem(0x200 + 4 * i, handler[i]);
+    EXPECT_TRUE(cpu->run_till_pc(12));
+
+    const int bound = 1000;
+    int cycles = 0;
+    cpu->set_irq_timer(1);
+    while (cycles < bound && cpu->get_pc() != 0x200) {
+      EXPECT_TRUE(cpu->step());
+      cycles++;
+    }
+    cpu->set_irq_timer(0);
+    while (cycles < bound && cpu->get_pc() != 12) {
+      EXPECT_TRUE(cpu->step());
+      cycles++;
+    }
+    EXPECT_LT(cycles, bound);
+    return cycles;
+  };
+
+  cpu->set_reg(10, 0xA0);
+  cpu->set_reg(11, 0xA1);
+  int saving_cycles = run(cpu, false);
+  EXPECT_EQ(cpu->get_reg(10), 0xA0);
+  EXPECT_EQ(cpu->get_reg(11), 0xA1);
+
+  delete cpu;
+  cpu = new Lemoncore(false);
+  cpu->set_reg(10, 0xA0);
+  cpu->set_reg(11, 0xA1);
+  int shadow_cycles = run(cpu, true);
+  EXPECT_EQ(cpu->get_reg(10), 0xA0);
+  EXPECT_EQ(cpu->get_reg(11), 0xA1);
+
+  std::cout << "timer interrupt, saving registers: " << saving_cycles
+            << " cycles, shadow bank: " << shadow_cycles << " cycles" << std::endl;
+  EXPECT_LT(shadow_cycles, saving_cycles);
+}
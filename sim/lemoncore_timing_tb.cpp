@@ -0,0 +1,189 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <gtest/gtest.h>
+#include "verilated.h"
+#include "riscv.h"
+
+#include "Vlemoncore_lemoncore.h"
+#include "lemoncore.h"
+
+// Exact cycle counts for each class of instruction, on the core harness with
+// every memory answering in the cycle it's asked and writes taking no extra
+// latency. An instruction's count runs from the cycle its fetch starts to the
+// cycle the next one's does, so it covers the whole FETCH, DECODE, EX, MEM,
+// WB sequence. The counts come from rtl/core/timing.vh, which the formal
+// latency bounds build on too; a change to the pipeline that moves them
+// fails the tests below until it's updated there.
+
+#define WAVE_OUT_DIR "sim/"
+
+// Where the instruction under test goes, after one warm-up instruction so
+// the fetch that follows reset isn't counted
+#define BODY_START 4
+#define BODY_LEN 8
+#define HANDLER 0x100
+#define BOUND 1000
+
+static const struct {
+  const char* name;
+  int cycles;
+} budgets[] = {
+  {"alu", Vlemoncore_lemoncore::TIMING_ALU},               // add
+  {"alu_imm", Vlemoncore_lemoncore::TIMING_ALU},           // addi
+  {"lui", Vlemoncore_lemoncore::TIMING_ALU},
+  {"auipc", Vlemoncore_lemoncore::TIMING_ALU},
+  {"load", Vlemoncore_lemoncore::TIMING_LOAD},             // lw
+  {"load_byte", Vlemoncore_lemoncore::TIMING_LOAD},        // lbu
+  {"store", Vlemoncore_lemoncore::TIMING_STORE},           // sw, posted to the store buffer
+  {"store_byte", Vlemoncore_lemoncore::TIMING_STORE},      // sb
+  {"branch_taken", Vlemoncore_lemoncore::TIMING_ALU},      // beq
+  {"branch_not_taken", Vlemoncore_lemoncore::TIMING_ALU},  // bne
+  {"jal", Vlemoncore_lemoncore::TIMING_ALU},
+  {"jalr", Vlemoncore_lemoncore::TIMING_ALU},
+  {"csr_read", Vlemoncore_lemoncore::TIMING_ALU},          // csrrs rd, mscratch, x0
+  {"csr_write", Vlemoncore_lemoncore::TIMING_ALU},         // csrrw x0, mscratch, rs1
+  {"fence", Vlemoncore_lemoncore::TIMING_FENCE},           // with the store buffer empty
+  {"ecall", Vlemoncore_lemoncore::TIMING_TRAP},
+  {"illegal", Vlemoncore_lemoncore::TIMING_TRAP},
+  {"irq", Vlemoncore_lemoncore::TIMING_IRQ},
+  {"mret", Vlemoncore_lemoncore::TIMING_MRET},
+};
+
+static int budget(const std::string& name) {
+  for (const auto& b : budgets) {
+    if (name == b.name)
+      return b.cycles;
+  }
+  ADD_FAILURE() << "no budget for " << name;
+  return -1;
+}
+
+// A run of BODY_LEN copies of one instruction. instr gets the address of
+// each copy, for the ones that depend on where they are.
+struct TimingCase {
+  const char* name;
+  std::function<uint32_t(uint32_t addr)> instr;
+  std::function<void(Lemoncore* cpu)> setup;
+};
+
+static void no_setup(Lemoncore* cpu) {
+  (void) cpu;
+}
+
+static void point_at_ram(Lemoncore* cpu) {
+  cpu->set_reg(8, ROM_SIZE);
+  cpu->set_reg(6, 0x12345678);
+}
+
+static const TimingCase cases[] = {
+  {"alu", [](uint32_t) { return rv_add(5, 6, 7); }, no_setup},
+  {"alu_imm", [](uint32_t) { return rv_addi(5, 6, 1); }, no_setup},
+  {"lui", [](uint32_t) { return rv_lui(5, 0x12345); }, no_setup},
+  {"auipc", [](uint32_t) { return rv_auipc(5, 0x12345); }, no_setup},
+  {"load", [](uint32_t) { return rv_lw(5, 8, 0); }, point_at_ram},
+  {"load_byte", [](uint32_t) { return rv_lbu(5, 8, 1); }, point_at_ram},
+  {"store", [](uint32_t) { return rv_sw(6, 8, 0); }, point_at_ram},
+  {"store_byte", [](uint32_t) { return rv_sb(6, 8, 1); }, point_at_ram},
+  // Both kinds of branch go on to the next instruction
+  {"branch_taken", [](uint32_t) { return rv_beq(0, 0, 4); }, no_setup},
+  {"branch_not_taken", [](uint32_t) { return rv_bne(0, 0, 4); }, no_setup},
+  {"jal", [](uint32_t) { return rv_jal(1, 4); }, no_setup},
+  // x9 holds each jalr's own address, and the jalr leaves the next one's
+  {"jalr", [](uint32_t) { return rv_jalr(9, 9, 4); },
+   [](Lemoncore* cpu) { cpu->set_reg(9, BODY_START); }},
+  {"csr_read", [](uint32_t) { return rv_csrrs(5, 0, RV_CSR_MSCRATCH); }, no_setup},
+  {"csr_write", [](uint32_t) { return rv_csrrw(0, 6, RV_CSR_MSCRATCH); }, no_setup},
+  {"fence", [](uint32_t) { return rv_fence(); }, no_setup},
+};
+
+class LemoncoreTimingTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    auto test_name = ::testing::UnitTest::GetInstance()->current_test_info()->name();
+
+    std::ostringstream stream;
+    stream << WAVE_OUT_DIR << "LemoncoreTimingTest-" << test_name << ".vcd";
+    std::string vcd_path = stream.str();
+
+    cpu = new Lemoncore(false, vcd_path);
+  }
+  void TearDown() override {
+    delete cpu;
+  }
+
+  // Cycles from the PC reaching from to it reaching to
+  int cycles_between(uint32_t from, uint32_t to) {
+    EXPECT_TRUE(cpu->run_till_pc(from));
+    int cycles = 0;
+    while (cycles < BOUND && cpu->get_pc() != to) {
+      EXPECT_TRUE(cpu->step());
+      cycles++;
+    }
+    EXPECT_LT(cycles, BOUND);
+    return cycles;
+  }
+
+  // The warm-up instruction points mtvec at HANDLER
+  void set_up_traps() {
+    cpu->set_reg(1, HANDLER);
+    cpu->write_imem(0, rv_csrrw(0, 1, RV_CSR_MTVEC));
+  }
+
+  Lemoncore* cpu;
+};
+
+TEST_F(LemoncoreTimingTest, Instructions) {
+  for (const auto& c : cases) {
+    SCOPED_TRACE(c.name);
+    delete cpu;
+    cpu = new Lemoncore(false, false);
+
+    c.setup(cpu);
+    cpu->write_imem(0, rv_addi(0, 0, 0));
+    uint32_t end = BODY_START + 4 * BODY_LEN;
+    for (uint32_t addr = BODY_START; addr < end; addr += 4)
+      cpu->write_imem(addr, c.instr(addr));
+    cpu->write_imem(end, rv_jal(0, 0));
+
+    int cycles = cycles_between(BODY_START, end);
+    std::cout << c.name << ": " << cycles << " cycles for " << BODY_LEN
+              << std::endl;
+    EXPECT_EQ(cycles, budget(c.name) * BODY_LEN);
+  }
+}
+
+TEST_F(LemoncoreTimingTest, TrapEntryAndReturn) {
+  set_up_traps();
+  cpu->write_imem(BODY_START, rv_ecall());
+  cpu->write_imem(HANDLER, rv_mret());
+
+  // mret goes back to the ecall, since nothing moves mepc on
+  EXPECT_EQ(cycles_between(BODY_START, HANDLER), budget("ecall"));
+  EXPECT_EQ(cpu->get_mcause(), 11);
+  EXPECT_EQ(cycles_between(HANDLER, BODY_START), budget("mret"));
+}
+
+TEST_F(LemoncoreTimingTest, IllegalInstruction) {
+  set_up_traps();
+  cpu->write_imem(BODY_START, 0);
+
+  EXPECT_EQ(cycles_between(BODY_START, HANDLER), budget("illegal"));
+  EXPECT_EQ(cpu->get_mcause(), 2);
+}
+
+TEST_F(LemoncoreTimingTest, InterruptEntry) {
+  set_up_traps();
+  cpu->write_imem(BODY_START, rv_jal(0, 0));
+  cpu->set_mstatus(1 << 3);
+  cpu->set_mie(1 << 3);
+
+  EXPECT_TRUE(cpu->run_till_pc(BODY_START));
+  cpu->set_irq_software(1);
+  EXPECT_EQ(cycles_between(BODY_START, HANDLER), budget("irq"));
+  EXPECT_EQ(cpu->get_mcause(), 0x80000003);
+  EXPECT_EQ(cpu->get_mepc(), BODY_START);
+}
@@ -1,12 +1,18 @@
+#include <algorithm>
 #include <array>
 #include <stdlib.h>
+#include <unistd.h>
 #include <fstream>
 #include <iostream>
+#include <iterator>
 #include "Vlemonsoc.h"
 #include "Vlemonsoc_lemonsoc.h"
+#include "Vlemonsoc_icache.h"
 #include "Vlemonsoc_lemoncore.h"
 #include "Vlemonsoc_regfile.h"
+#include "Vlemonsoc_timer.h"
 #include "verilated.h"
+#include "verilated_syms.h"
 #include "verilated_vcd_c.h"
 
 #include <svdpi.h>
@@ -16,6 +22,15 @@
 
 #define DEFAULT_VCD_PATH "lemonsoc.vcd"
 
+// How long the SoC must have been idle before skip_idle() will fast-forward,
+// long enough for a flash line fill or bus response already in flight when the
+// harts went to sleep, or an interrupt from the DMA engine or the UART once
+// they went idle, to get through
+#define SKIP_SETTLE_CYCLES 256
+
+// Models created so far, to give each its own name
+static int num_models = 0;
+
 Lemonsoc::Lemonsoc(bool verbose, bool trace) {
   init(verbose, trace, DEFAULT_VCD_PATH);
 }
@@ -27,11 +42,18 @@ Lemonsoc::Lemonsoc(bool verbose, bool trace, std::string vcd_path) {
 void Lemonsoc::init(bool verbose, bool trace, std::string vcd_path) {
   this->verbose = verbose;
   this->trace = trace;
-  tb = new Vlemonsoc;
+  // Verilator registers a model's scopes under its name, and the first model
+  // to claim a name keeps it, so each needs a unique one for the DPI calls and
+  // public_mem() to find its own memories
+  name = "lemonsoc" + std::to_string(num_models++);
+  tb = new Vlemonsoc(name.c_str());
   cycle = 0;
+  fast_skip = false;
+  asleep_cycles = 0;
+  uart_fd = -1;
+  tb->UART_RX_VALID = 0;
 
   //Verilated::scopesDump();
-  svSetScope(svGetScopeFromName("TOP.lemonsoc.ram"));
 
   if (trace) {
     // Start tracing
@@ -56,6 +78,10 @@ Lemonsoc::~Lemonsoc() {
 }
 
 bool Lemonsoc::load_firmware(std::string path) {
+  // ROM and RAM each pick their own slice out of the image
+  svSetScope(mem_scope("rom"));
+  verilator_load_mem(path.c_str());
+  svSetScope(mem_scope("ram"));
   verilator_load_mem(path.c_str());
   return true;
 }
@@ -69,6 +95,7 @@ void Lemonsoc::reset() {
   tb->CLK = 1;
   tb->eval();
   tb->BTN_N = 1;
+  step_flash();
   if (trace) tfp->dump(cycle + 1);
 
   cycle++;
@@ -78,11 +105,18 @@ bool Lemonsoc::step() {
   tb->CLK = 0;
   tb->eval();
   if (trace) tfp->dump(2 * cycle);
+  // UART bytes change hands on the rising edge
+  bool uart_tx_valid = tb->UART_TX_VALID;
+  uint8_t uart_tx_data = tb->UART_TX_DATA;
+  bool uart_rx_taken = tb->UART_RX_VALID && tb->UART_RX_READY;
   tb->CLK = 1;
   tb->eval();
+  step_flash();
+  step_uart(uart_tx_valid, uart_tx_data, uart_rx_taken);
   if (trace) tfp->dump(2 * cycle + 1);
 
   cycle++;
+  asleep_cycles = tb->lemonsoc->soc_idle ? asleep_cycles + 1 : 0;
 
   if (tb->LEDR_N == 0) {
     return false;
@@ -93,6 +127,11 @@ bool Lemonsoc::step() {
 
 bool Lemonsoc::run(int cycles) {
   for (int c = 0; c < cycles && !Verilated::gotFinish() && !is_done(); c++) {
+    if (fast_skip) {
+      c += skip_idle(cycles - c);
+      if (c == cycles)
+        break;
+    }
     if (!step())
       return false;
   }
@@ -100,6 +139,51 @@ bool Lemonsoc::run(int cycles) {
   return true;
 }
 
+// With fast skip on, run() jumps over time the core spends asleep in WFI
+// rather than simulating every idle cycle. The end state is the same, but
+// the skipped cycles are missing from the trace.
+void Lemonsoc::set_fast_skip(bool enable) {
+  fast_skip = enable;
+}
+
+// Fast-forwards up to max_cycles while every hart sleeps, stopping just short
+// of the next timer interrupt. Returns the number of cycles skipped.
+//
+// Once the harts are asleep and the DMA engine and the UART's transmitter are
+// idle, the timer is the only thing with state that changes by itself. A DMA
+// transfer or a byte still being sent could raise an interrupt, so the SoC
+// only counts as idle without them. Buttons only change between calls, and
+// set_btns() makes us wait to let them through the synchronizers. Nothing is
+// skipped while there's UART input waiting to be received.
+int Lemonsoc::skip_idle(int max_cycles) {
+  if (asleep_cycles < SKIP_SETTLE_CYCLES || !uart_input.empty())
+    return 0;
+
+  auto timer = tb->lemonsoc->timer;
+  uint64_t skip = max_cycles;
+  if (tb->lemonsoc->lemon->mie_timer) {
+    if (timer->mtime >= timer->mtimecmp)
+      return 0;
+    // Cycles until mtime reaches mtimecmp. Leave the last one to simulate
+    uint64_t until = (timer->mtimecmp - timer->mtime - 1) * TIMER_TICKS_PER_MS +
+                     (TIMER_TICKS_PER_MS - timer->prescaler);
+    skip = std::min(skip, until - 1);
+  }
+
+  uint64_t ticks = timer->prescaler + skip;
+  timer->mtime += ticks / TIMER_TICKS_PER_MS;
+  timer->prescaler = ticks % TIMER_TICKS_PER_MS;
+  tb->eval();
+
+  cycle += skip;
+  asleep_cycles += skip;
+  return skip;
+}
+
+bool Lemonsoc::is_sleeping() {
+  return tb->lemonsoc->core_sleep;
+}
+
 void Lemonsoc::log(const char* fmt...) {
   // https://stackoverflow.com/q/41400
   if (verbose) {
@@ -111,6 +195,8 @@ void Lemonsoc::log(const char* fmt...) {
 }
 
 void Lemonsoc::set_btns(bool btn1, bool btn2, bool btn3) {
+  if (btn1 != tb->BTN1 || btn2 != tb->BTN2 || btn3 != tb->BTN3)
+    asleep_cycles = 0;
   tb->BTN1 = btn1;
   tb->BTN2 = btn2;
   tb->BTN3 = btn3;
@@ -149,9 +235,141 @@ void Lemonsoc::set_reg(uint8_t reg, uint32_t data) {
 void Lemonsoc::write_imem(uint32_t addr, uint32_t data) {
   assert(addr % 4 == 0);
   //assert(addr < ROM_SIZE);
+  svSetScope(mem_scope("rom"));
   verilator_set_mem_entry(addr, data);
 }
 
+// SPRAM helpers take bus addresses, i.e. starting at SPRAM_BASE
+bool Lemonsoc::load_spram(std::string path) {
+  svSetScope(mem_scope("spram"));
+  verilator_load_spram(path.c_str());
+  return true;
+}
+
+void Lemonsoc::write_spram(uint32_t addr, uint32_t data) {
+  assert(addr % 4 == 0);
+  assert(addr >= SPRAM_BASE && addr < SPRAM_BASE + SPRAM_SIZE);
+  svSetScope(mem_scope("spram"));
+  verilator_set_spram_entry(addr - SPRAM_BASE, data);
+}
+
+uint32_t Lemonsoc::read_spram(uint32_t addr) {
+  assert(addr % 4 == 0);
+  assert(addr >= SPRAM_BASE && addr < SPRAM_BASE + SPRAM_SIZE);
+  svSetScope(mem_scope("spram"));
+  return verilator_get_spram_entry(addr - SPRAM_BASE);
+}
+
+// The scope of one of the SoC's memories, for the DPI calls into it
+svScope Lemonsoc::mem_scope(const char* mem) {
+  std::string scope = name + ".lemonsoc." + mem;
+  svScope vscope = svGetScopeFromName(scope.c_str());
+  assert(vscope);
+  return vscope;
+}
+
+// The memories mark their arrays public, which lists them in their scopes
+uint32_t* Lemonsoc::public_mem(const char* mem) {
+  auto vscope = static_cast<const VerilatedScope*>(mem_scope(mem));
+  VerilatedVar* var = vscope->varFind("mem");
+  assert(var);
+  return static_cast<uint32_t*>(var->datap());
+}
+
+uint32_t* Lemonsoc::get_rom() {
+  return public_mem("rom");
+}
+
+uint32_t* Lemonsoc::get_ram() {
+  return public_mem("ram");
+}
+
+uint32_t* Lemonsoc::get_spram() {
+  return public_mem("spram");
+}
+
+// The flash model sees the pins as they are after each rising edge, and what
+// it drives back is sampled on the next one
+void Lemonsoc::step_flash() {
+  tb->FLASH_IO_I = flash.step(tb->FLASH_SCK, tb->FLASH_SSB, tb->FLASH_IO_O,
+                              tb->FLASH_IO_OE);
+}
+
+// Offset is from the start of flash, as for iceprog -o
+bool Lemonsoc::load_flash(std::string path, uint32_t offset) {
+  return flash.load(path, offset);
+}
+
+// Takes a bus address, i.e. starting at FLASH_BASE. Changes to flash aren't
+// seen by the core if the line is already cached
+void Lemonsoc::write_flash(uint32_t addr, uint32_t data) {
+  assert(addr >= FLASH_BASE && addr < FLASH_BASE + FLASH_SIZE);
+  flash.write_word(addr - FLASH_BASE, data);
+}
+
+// The UART's serial side is replaced by a byte a cycle in each direction.
+// Transmitted bytes are collected, and also written to uart_fd if it's set.
+void Lemonsoc::step_uart(bool tx_valid, uint8_t tx_data, bool rx_taken) {
+  if (tx_valid) {
+    uart_output.push_back(tx_data);
+    if (uart_fd >= 0 && write(uart_fd, &tx_data, 1) != 1)
+      log("Failed to write UART output\n");
+  }
+  if (rx_taken)
+    uart_input.pop_front();
+
+  tb->UART_RX_VALID = !uart_input.empty();
+  tb->UART_RX_DATA = uart_input.empty() ? 0 : uart_input.front();
+}
+
+// Pass -1 to stop forwarding
+void Lemonsoc::set_uart_output(int fd) {
+  uart_fd = fd;
+}
+
+// Everything transmitted since reset
+std::string Lemonsoc::get_uart_output() {
+  return uart_output;
+}
+
+// Queues bytes for the UART to receive
+void Lemonsoc::uart_send(std::string data) {
+  uart_input.insert(uart_input.end(), data.begin(), data.end());
+  tb->UART_RX_VALID = !uart_input.empty();
+  tb->UART_RX_DATA = uart_input.empty() ? 0 : uart_input.front();
+}
+
+// Queues a file's contents for the UART to receive, or stdin's with "-"
+bool Lemonsoc::load_uart_input(std::string path) {
+  if (path == "-") {
+    uart_send(std::string(std::istreambuf_iterator<char>(std::cin), {}));
+    return true;
+  }
+
+  std::ifstream file(path, std::ios::in | std::ios::binary);
+  if (!file)
+    return false;
+  uart_send(std::string(std::istreambuf_iterator<char>(file), {}));
+  return true;
+}
+
+uint32_t Lemonsoc::get_icache_hits() {
+  return tb->lemonsoc->icache->hits_q;
+}
+
+uint32_t Lemonsoc::get_icache_misses() {
+  return tb->lemonsoc->icache->misses_q;
+}
+
+uint64_t Lemonsoc::get_mtime() {
+  return tb->lemonsoc->timer->mtime;
+}
+
+uint32_t Lemonsoc::get_mip() {
+  auto lemon = tb->lemonsoc->lemon;
+  return lemon->mip_external << 11 | lemon->mip_timer << 7 | lemon->mip_software << 3;
+}
+
 bool Lemonsoc::run_till_pc(uint32_t pc) {
   int bound = 10000;
   int c = 0;
@@ -2,9 +2,15 @@
 #define LEMONSOC_H
 
 #include <stdlib.h>
+#include <deque>
 #include <iostream>
+#include <string>
+#include <svdpi.h>
 #include "Vlemonsoc.h"
 
+#include "memmap.h"
+#include "spiflash.h"
+
 class Lemonsoc {
  public:
   Lemonsoc(bool verbose, bool trace);
@@ -14,23 +20,54 @@ class Lemonsoc {
   void reset();
   bool step();
   bool run(int cycles);
+  void set_fast_skip(bool enable);
+  int skip_idle(int max_cycles);
+  bool is_sleeping();
   void set_btns(bool btn1, bool btn2, bool btn3);
   int get_led(int led);
   bool is_done();
   std::array<int, 5> get_leds();
   void set_reg(uint8_t reg, uint32_t data);
   void write_imem(uint32_t addr, uint32_t data);
+  bool load_spram(std::string path);
+  void write_spram(uint32_t addr, uint32_t data);
+  uint32_t read_spram(uint32_t addr);
+  // ROM, RAM and SPRAM, in place, each from the start of its region
+  uint32_t* get_rom();
+  uint32_t* get_ram();
+  uint32_t* get_spram();
+  bool load_flash(std::string path, uint32_t offset);
+  void write_flash(uint32_t addr, uint32_t data);
+  uint32_t get_icache_hits();
+  uint32_t get_icache_misses();
+  void set_uart_output(int fd);
+  std::string get_uart_output();
+  void uart_send(std::string data);
+  bool load_uart_input(std::string path);
+  uint64_t get_mtime();
+  uint32_t get_mip();
   bool run_till_pc(uint32_t pc);
   uint32_t get_pc();
   uint32_t get_reg(uint8_t reg);
  private:
   void init(bool verbose, bool trace, std::string vcd_path);
   void log(const char* fmt...);
+  svScope mem_scope(const char* mem);
+  uint32_t* public_mem(const char* mem);
+  void step_flash();
+  void step_uart(bool tx_valid, uint8_t tx_data, bool rx_taken);
 
   bool verbose;
   bool trace;
   int cycle;
+  bool fast_skip;
+  int asleep_cycles;
+  std::string name;  // the model's, which its scopes start with
   Vlemonsoc *tb;
+  SpiFlash flash;
+  int uart_fd;
+  std::string uart_output;
+  std::deque<uint8_t> uart_input;
   VerilatedVcdC* tfp;
 };
 
@@ -1,4 +1,6 @@
+#include <fcntl.h>
 #include <stdlib.h>
+#include <unistd.h>
 #include <fstream>
 #include <iostream>
 
@@ -8,6 +10,7 @@
 #include "verilated.h"
 
 #include "lemonsoc.h"
+#include "lemonsoc_tlm.h"
 
 #define DEFAULT_FW_PATH "sw/hello.sim.mem"
 #define NUM_CYCLES -1
@@ -17,7 +20,8 @@ enum ReturnStatus {
   FirmwareError,
   ProcessorException,
   ProcessorDone,
-  SimulationDone
+  SimulationDone,
+  UartInputError
 };
 
 bool btn1 = false;
@@ -28,6 +32,13 @@ char led2c(bool led) {
   return led ? '*' : ' ';
 }
 
+// Show the end of the UART output below the LEDs
+void output_uart(const std::string& output) {
+  const size_t max_chars = 1024;
+  printw("\nUART output:\n%s", output.size() > max_chars ?
+         output.substr(output.size() - max_chars).c_str() : output.c_str());
+}
+
 void output_leds(bool leds[5]) {
   move(0, 0);
   printw("    [%c]     \n", led2c(leds[3]));
@@ -39,11 +50,16 @@ void output_leds(bool leds[5]) {
   printw("Button 3: %s\n", btn3 ? "pressed" : "released");
   printw("\n");
   printw("Press keyboard keys 1 - 3 to toggle buttons. Press q to exit.\n");
-  refresh();
+  printw("Other keys are sent to the UART.\n");
 }
 
-ReturnStatus run (std::string firmware_path) {
-  Lemonsoc soc(false, false);
+// Soc is Lemonsoc or LemonsocTlm
+template <class Soc>
+ReturnStatus run (Soc& soc, std::string firmware_path, std::string uart_in_path, int uart_out_fd) {
+  soc.set_uart_output(uart_out_fd);
+  if (!uart_in_path.empty() && !soc.load_uart_input(uart_in_path)) {
+    return UartInputError;
+  }
 
   int cycle = 0;
 
@@ -62,6 +78,8 @@ ReturnStatus run (std::string firmware_path) {
       btn3 = !btn3;
     else if (input == 'q')
       return SimulationDone;
+    else if (input != ERR)
+      soc.uart_send(std::string(1, input));
     soc.set_btns(btn1, btn2, btn3);
 
     if (!soc.step()) {
@@ -76,7 +94,10 @@ ReturnStatus run (std::string firmware_path) {
       bool leds[5];
       for (int i = 0; i < 5; i++)
         leds[i] = (bool) soc.get_led(i+1);
+      erase();
       output_leds(leds);
+      output_uart(soc.get_uart_output());
+      refresh();
     }
 
     cycle++;
@@ -92,10 +113,18 @@ int main(int argc, char **argv) {
   cxxopts::Options options("socsim", "Interactive simulation of Lemoncore SoC");
   options.add_options()
     ("f,firmware", "Path to firmware file", cxxopts::value<std::string>()->default_value(DEFAULT_FW_PATH))
+    ("uart-in", "File to send to the UART, - for stdin", cxxopts::value<std::string>()->default_value(""))
+    ("uart-out", "File to also write UART output to", cxxopts::value<std::string>()->default_value(""))
+    ("tlm", "Run the transaction-level model rather than the RTL")
+    ("timing", "With --tlm, give instructions approximately their RTL cycle counts")
     ("h,help", "Print usage")
     ;
 
   std::string firmware_path;
+  std::string uart_in_path;
+  std::string uart_out_path;
+  bool tlm;
+  bool timing;
   try {
     auto result = options.parse(argc, argv);
     if (result.count("help")) {
@@ -103,19 +132,39 @@ int main(int argc, char **argv) {
       return 0;
     }
     firmware_path = result["firmware"].as<std::string>();
+    uart_in_path = result["uart-in"].as<std::string>();
+    uart_out_path = result["uart-out"].as<std::string>();
+    tlm = result.count("tlm") > 0;
+    timing = result.count("timing") > 0;
   } catch (cxxopts::OptionException e) {
     std::cerr << "Error parsing command line arguments: " << e.what() << std::endl;
     return 1;
   }
 
 
+  int uart_out_fd = -1;
+  if (!uart_out_path.empty()) {
+    uart_out_fd = open(uart_out_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (uart_out_fd < 0) {
+      std::cerr << "Error opening file " << uart_out_path << std::endl;
+      return 1;
+    }
+  }
+
   // Init ncurses
   initscr();
   nodelay(stdscr, TRUE); // don't block on getch()
   noecho(); // don't echo input
 
   // Run simulation
-  ReturnStatus result = run(firmware_path);
+  ReturnStatus result;
+  if (tlm) {
+    LemonsocTlm soc(timing);
+    result = run(soc, firmware_path, uart_in_path, uart_out_fd);
+  } else {
+    Lemonsoc soc(false, false);
+    result = run(soc, firmware_path, uart_in_path, uart_out_fd);
+  }
 
   // De-init ncurses
   endwin();
@@ -124,6 +173,9 @@ int main(int argc, char **argv) {
   case FirmwareError:
     std::cerr << "Error reading file " << firmware_path << std::endl;
     return 1;
+  case UartInputError:
+    std::cerr << "Error reading file " << uart_in_path << std::endl;
+    return 1;
   case ProcessorException:
     std::cerr << "Processor had unhandled exception!" << std::endl;
     return 1;
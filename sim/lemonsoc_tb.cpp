@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <array>
 #include <stdlib.h>
 #include <gtest/gtest.h>
@@ -5,6 +6,7 @@
 #include "verilated.h"
 
 #include "lemonsoc.h"
+#include "lemonsoc_tlm.h"
 
 // where vcd dumps are stored
 #define WAVE_OUT_DIR "sim/"
@@ -29,19 +31,20 @@ protected:
 TEST_F(LemonsocTest, Main) {
   // Smoke test: make sure LED flickers within a roughly correct # of cycles
   // we don't specify an exact timing because it varies with small changes to
-  // the software library.
+  // the software library. mtime ticks every 100 cycles in simulation, with no
+  // interrupt handler in the way.
   EXPECT_TRUE(soc->load_firmware("sw/hello.sim.mem"));
 
   auto leds = soc->get_leds();
   for (int i = 0; i < 5; i++)
     EXPECT_EQ(leds[i], 0);
   int cycles = 0;
-  while (soc->get_led(1) == 0 && cycles < 100000) {
+  while (soc->get_led(1) == 0 && cycles < 53000) {
     soc->step();
     cycles++;
   }
-  EXPECT_LT(cycles, 100000);
-  EXPECT_GT(cycles, 90000);
+  EXPECT_LT(cycles, 53000);
+  EXPECT_GT(cycles, 48000);
 
   cycles = 0;
   soc->set_btns(0, 0, 1);
@@ -53,8 +56,8 @@ TEST_F(LemonsocTest, Main) {
     soc->step();
     cycles++;
   }
-  EXPECT_LT(cycles, 80000);
-  EXPECT_GT(cycles, 70000);
+  EXPECT_LT(cycles, 42000);
+  EXPECT_GT(cycles, 38000);
 }
 
 TEST_F(LemonsocTest, PartialStore) {
@@ -156,3 +159,677 @@ TEST_F(LemonsocTest, PartialLoads) {
   EXPECT_EQ(soc->get_reg(4), -1);
 
 }
+
+TEST_F(LemonsocTest, Crc32Coprocessor) {
+  soc->set_reg(1, 0xFFFFFFFF); // initial CRC
+  soc->set_reg(2, 0x64636261); // "abcd"
+  soc->write_imem(0, rv_custom0(3, 1, 2, 2, 0)); // word update
+  soc->write_imem(4, rv_custom0(4, 1, 2, 0, 0)); // byte update, just 'a'
+  ASSERT_TRUE(soc->run_till_pc(8));
+
+  EXPECT_EQ(~soc->get_reg(3), 0xED82CD11);
+  EXPECT_EQ(~soc->get_reg(4), 0xE8B7BE43);
+}
+
+TEST_F(LemonsocTest, RomLoad) {
+  // Loads from ROM share its port with instruction fetch
+  soc->write_imem(64, 0x12345678);
+  soc->write_imem(0, rv_lw(3, 0, 64));
+  soc->write_imem(4, rv_lhu(4, 0, 66));
+  ASSERT_TRUE(soc->run_till_pc(8));
+
+  EXPECT_EQ(soc->get_reg(3), 0x12345678);
+  EXPECT_EQ(soc->get_reg(4), 0x1234);
+}
+
+TEST_F(LemonsocTest, Spram) {
+  soc->write_spram(SPRAM_BASE + 4, 0xCAFEF00D);
+
+  soc->set_reg(1, 0x12345678);
+  soc->set_reg(2, SPRAM_BASE + 0x10008); // second bank
+  soc->set_reg(5, SPRAM_BASE + 4);
+  soc->write_imem(0, rv_sw(1, 2, 0));
+  soc->write_imem(4, rv_sb(0, 2, 1));
+  soc->write_imem(8, rv_lw(3, 2, 0));
+  soc->write_imem(12, rv_lw(4, 5, 0));
+  soc->write_imem(16, rv_lhu(6, 5, 2));
+  ASSERT_TRUE(soc->run_till_pc(20));
+
+  EXPECT_EQ(soc->get_reg(3), 0x12340078);
+  EXPECT_EQ(soc->read_spram(SPRAM_BASE + 0x10008), 0x12340078);
+  EXPECT_EQ(soc->get_reg(4), 0xCAFEF00D);
+  EXPECT_EQ(soc->get_reg(6), 0xCAFE);
+}
+
+TEST_F(LemonsocTest, FlashXip) {
+  // Count down from 4 in flash, then load a constant from flash
+  soc->write_flash(FLASH_BASE + 0, rv_addi(2, 0, 4));
+  soc->write_flash(FLASH_BASE + 4, rv_addi(3, 3, 3));
+  soc->write_flash(FLASH_BASE + 8, rv_addi(2, 2, -1));
+  soc->write_flash(FLASH_BASE + 12, rv_bne(2, 0, -8));
+  soc->write_flash(FLASH_BASE + 16, rv_lw(4, 1, 32));
+  soc->write_flash(FLASH_BASE + 20, rv_lhu(5, 1, 34));
+  soc->write_flash(FLASH_BASE + 24, rv_jal(0, 0));
+  soc->write_flash(FLASH_BASE + 32, 0xDEADBEEF);
+
+  soc->set_reg(1, FLASH_BASE);
+  soc->write_imem(0, rv_jalr(0, 1, 0));
+  ASSERT_TRUE(soc->run_till_pc(FLASH_BASE + 24));
+
+  EXPECT_EQ(soc->get_reg(3), 12);
+  EXPECT_EQ(soc->get_reg(4), 0xDEADBEEF);
+  EXPECT_EQ(soc->get_reg(5), 0xDEAD);
+
+  // 17 accesses to three lines, the first to each of which misses
+  EXPECT_EQ(soc->get_icache_misses(), 3);
+  EXPECT_EQ(soc->get_icache_hits(), 17 - 3);
+}
+
+TEST_F(LemonsocTest, Clint) {
+  soc->set_reg(1, TIMER_BASE);
+  soc->set_reg(2, 3);
+  soc->set_reg(3, 1);
+  soc->write_imem(0, rv_sw(2, 1, 8));  // mtimecmp = 3
+  soc->write_imem(4, rv_sw(0, 1, 12));
+  soc->write_imem(8, rv_sw(3, 1, 16)); // msip = 1
+  soc->write_imem(12, rv_lw(4, 1, 16));
+  soc->write_imem(16, rv_jal(0, 0));
+  ASSERT_TRUE(soc->run_till_pc(16));
+
+  // Interrupts aren't enabled, so they only show up as pending
+  EXPECT_EQ(soc->get_reg(4), 1);
+  EXPECT_EQ(soc->get_mip(), 1 << 3);
+
+  // mtime counts a millisecond every 100 cycles
+  soc->run(300);
+  EXPECT_EQ(soc->get_mip(), 1 << 7 | 1 << 3);
+  EXPECT_GE(soc->get_mtime(), 3);
+}
+
+TEST_F(LemonsocTest, DelayLowerBound) {
+  // delay(1) must last a whole millisecond (100 cycles) wherever in the
+  // current one it's called. sw/delay.c lights LED1 for each call.
+  EXPECT_TRUE(soc->load_firmware("sw/delay.sim.mem"));
+
+  const int bound = 200000;
+  int cycles = 0;
+  int calls = 0;
+  int shortest = bound;
+  int lit_at = -1;
+  while (soc->get_led(2) == 0 && cycles < bound) {
+    ASSERT_TRUE(soc->step());
+    cycles++;
+    if (soc->get_led(1) && lit_at < 0) {
+      lit_at = cycles;
+    } else if (!soc->get_led(1) && lit_at >= 0) {
+      shortest = std::min(shortest, cycles - lit_at);
+      calls++;
+      lit_at = -1;
+    }
+  }
+  ASSERT_LT(cycles, bound);
+  EXPECT_EQ(calls, 40);
+  EXPECT_GE(shortest, 100);
+}
+
+TEST_F(LemonsocTest, DualHartAtomics) {
+  // Both harts run this: hart 0 starts hart 1 through its msip, then each adds
+  // 1 to the same SPRAM word 50 times with amoadd.w. No update may be lost.
+  const int adds = 50;
+  soc->write_spram(SPRAM_BASE, 0);
+  soc->write_imem(0, rv_lui(1, SPRAM_BASE));
+  soc->write_imem(4, rv_addi(2, 0, adds));
+  soc->write_imem(8, rv_addi(3, 0, 1));
+  soc->write_imem(12, rv_csrrs(5, 0, RV_CSR_MHARTID));
+  soc->write_imem(16, rv_bne(5, 0, 12));
+  soc->write_imem(20, rv_lui(4, TIMER_BASE & ~0xFFF));
+  soc->write_imem(24, rv_sw(3, 4, (TIMER_BASE & 0xFFF) + 0x14)); // msip[1] = 1
+  soc->write_imem(28, rv_amoadd_w(0, 1, 3));
+  soc->write_imem(32, rv_addi(2, 2, -1));
+  soc->write_imem(36, rv_bne(2, 0, -8));
+  soc->write_imem(40, rv_jal(0, 0));
+  ASSERT_TRUE(soc->run_till_pc(40));
+  EXPECT_EQ(soc->get_reg(5), 0);
+
+  // Give hart 1, which started later, time to finish
+  ASSERT_TRUE(soc->run(2000));
+  EXPECT_EQ(soc->read_spram(SPRAM_BASE), 2 * adds);
+}
+
+TEST_F(LemonsocTest, WfiFastSkip) {
+  // Sleep until mtime reaches 50, then count in x5. Run it cycle by cycle and
+  // then with fast skip, and check both end up in the same place.
+  auto program = [](Lemonsoc* soc) {
+    soc->set_reg(1, TIMER_BASE);
+    soc->set_reg(2, 50);
+    soc->set_reg(3, 1 << 7);
+    soc->write_imem(0, rv_sw(2, 1, 8)); // mtimecmp = 50
+    soc->write_imem(4, rv_sw(0, 1, 12));
+    soc->write_imem(8, rv_csrrs(0, 3, RV_CSR_MIE));
+    soc->write_imem(12, rv_wfi());
+    soc->write_imem(16, rv_addi(5, 5, 1));
+    soc->write_imem(20, rv_jal(0, -4));
+  };
+
+  program(soc);
+  ASSERT_TRUE(soc->run(4000));
+  EXPECT_TRUE(soc->is_sleeping());
+  EXPECT_EQ(soc->get_pc(), 12);
+  uint64_t mtime_asleep = soc->get_mtime();
+  ASSERT_TRUE(soc->run(2000));
+  EXPECT_FALSE(soc->is_sleeping());
+  uint64_t mtime_awake = soc->get_mtime();
+  uint32_t count = soc->get_reg(5);
+  EXPECT_GT(count, 0);
+
+  delete soc;
+  soc = new Lemonsoc(false, false);
+  program(soc);
+  soc->set_fast_skip(true);
+  ASSERT_TRUE(soc->run(4000));
+  EXPECT_TRUE(soc->is_sleeping());
+  EXPECT_EQ(soc->get_mtime(), mtime_asleep);
+  ASSERT_TRUE(soc->run(2000));
+  EXPECT_EQ(soc->get_mtime(), mtime_awake);
+  EXPECT_EQ(soc->get_reg(5), count);
+}
+
+TEST_F(LemonsocTest, ButtonIrq) {
+  // Sleep with a rising-edge interrupt on button 3, vectored to 0x100
+  soc->set_reg(1, IRQ_BASE);
+  soc->set_reg(2, 1 << 2);
+  soc->set_reg(3, 1 << 11);
+  soc->set_reg(4, 0x101);
+  soc->write_imem(0, rv_sw(2, 1, 4)); // rising edge
+  soc->write_imem(4, rv_sw(2, 1, 0)); // enable
+  soc->write_imem(8, rv_csrrs(0, 3, RV_CSR_MIE));
+  soc->write_imem(12, rv_csrrw(0, 4, RV_CSR_MTVEC));
+  soc->write_imem(16, rv_csrrsi(0, 8, RV_CSR_MSTATUS));
+  soc->write_imem(20, rv_wfi());
+  soc->write_imem(24, rv_jal(0, -4));
+  soc->write_imem(0x100 + 4 * 11, rv_lw(5, 1, 16)); // claim
+  soc->write_imem(0x100 + 4 * 12, rv_jal(0, 0));
+  ASSERT_TRUE(soc->run_till_pc(20));
+  ASSERT_TRUE(soc->run(50));
+  EXPECT_TRUE(soc->is_sleeping());
+
+  // Press to handler entry, through the synchronizer and edge detector
+  soc->set_btns(0, 0, 1);
+  int cycles = 0;
+  while (soc->get_pc() != 0x100 + 4 * 11 && cycles < 100) {
+    soc->step();
+    cycles++;
+  }
+  EXPECT_LT(cycles, 16);
+  EXPECT_EQ(soc->get_mip(), 1 << 11);
+
+  ASSERT_TRUE(soc->run_till_pc(0x100 + 4 * 12));
+  EXPECT_EQ(soc->get_reg(5), 3); // button 3 is source 2
+  EXPECT_EQ(soc->get_mip(), 0);
+}
+
+TEST_F(LemonsocTest, UartTx) {
+  soc->set_reg(1, UART_BASE);
+  soc->set_reg(2, 'h');
+  soc->set_reg(3, 'i');
+  soc->write_imem(0, rv_sw(2, 1, 0));
+  soc->write_imem(4, rv_sw(3, 1, 0));
+  soc->write_imem(8, rv_lw(4, 1, 0)); // full flag
+  soc->write_imem(12, rv_lui(6, 1 << 16));
+  soc->write_imem(16, rv_lw(5, 1, 8)); // wait for the transmitter to go idle
+  soc->write_imem(20, rv_and(7, 5, 6));
+  soc->write_imem(24, rv_beq(7, 0, -8));
+  soc->write_imem(28, rv_jal(0, 0));
+  ASSERT_TRUE(soc->run_till_pc(28));
+  EXPECT_EQ(soc->get_uart_output(), "hi");
+  EXPECT_EQ(soc->get_reg(4), 0);
+}
+
+TEST_F(LemonsocTest, UartRx) {
+  soc->uart_send("ok");
+  soc->set_reg(1, UART_BASE);
+  soc->write_imem(0, rv_addi(0, 0, 0));
+  soc->write_imem(4, rv_addi(0, 0, 0));
+  soc->write_imem(8, rv_lw(4, 1, 8));  // status
+  soc->write_imem(12, rv_lw(2, 1, 4));
+  soc->write_imem(16, rv_lw(3, 1, 4));
+  soc->write_imem(20, rv_lw(5, 1, 4)); // now empty
+  soc->write_imem(24, rv_jal(0, 0));
+  ASSERT_TRUE(soc->run_till_pc(24));
+  EXPECT_EQ(soc->get_reg(4), 2 << 8);
+  EXPECT_EQ(soc->get_reg(2), 'o');
+  EXPECT_EQ(soc->get_reg(3), 'k');
+  EXPECT_EQ(soc->get_reg(5), 0x80000000);
+}
+
+TEST_F(LemonsocTest, UartRxLoadNotReplayed) {
+  // Raise the software interrupt just as rxdata is read. The core must finish
+  // the load before taking the interrupt, or the replayed load would pop a
+  // second byte.
+  soc->uart_send("ab");
+  soc->set_reg(1, UART_BASE);
+  soc->set_reg(3, 1 << 3);
+  soc->set_reg(4, 0x100);
+  soc->set_reg(6, TIMER_BASE);
+  soc->set_reg(7, 1);
+  soc->write_imem(0, rv_csrrs(0, 3, RV_CSR_MIE));
+  soc->write_imem(4, rv_csrrw(0, 4, RV_CSR_MTVEC));
+  soc->write_imem(8, rv_csrrsi(0, 8, RV_CSR_MSTATUS));
+  soc->write_imem(12, rv_sw(7, 6, 16)); // msip = 1
+  soc->write_imem(16, rv_lw(2, 1, 4));
+  soc->write_imem(20, rv_lw(5, 1, 4));
+  soc->write_imem(24, rv_jal(0, 0));
+  soc->write_imem(0x100, rv_sw(0, 6, 16)); // msip = 0
+  soc->write_imem(0x104, rv_fence());
+  soc->write_imem(0x108, rv_addi(9, 9, 1));
+  soc->write_imem(0x10C, rv_mret());
+  ASSERT_TRUE(soc->run_till_pc(24));
+  EXPECT_GE(soc->get_reg(9), 1);
+  EXPECT_EQ(soc->get_reg(2), 'a');
+  EXPECT_EQ(soc->get_reg(5), 'b');
+}
+
+TEST_F(LemonsocTest, UartRxIrq) {
+  // Sleep with the RX interrupt on, vectored to 0x100
+  soc->set_reg(1, UART_BASE);
+  soc->set_reg(2, 1 << 1); // rx_ie, threshold 0
+  soc->set_reg(6, IRQ_BASE);
+  soc->set_reg(7, 1 << 3); // UART source
+  soc->set_reg(3, 1 << 11);
+  soc->set_reg(4, 0x101);
+  soc->write_imem(0, rv_sw(2, 1, 12));
+  soc->write_imem(4, rv_sw(7, 6, 0));
+  soc->write_imem(8, rv_csrrs(0, 3, RV_CSR_MIE));
+  soc->write_imem(12, rv_csrrw(0, 4, RV_CSR_MTVEC));
+  soc->write_imem(16, rv_csrrsi(0, 8, RV_CSR_MSTATUS));
+  soc->write_imem(20, rv_wfi());
+  soc->write_imem(24, rv_jal(0, -4));
+  soc->write_imem(0x100 + 4 * 11, rv_lw(5, 6, 16)); // claim
+  soc->write_imem(0x100 + 4 * 12, rv_lw(8, 1, 4));  // rxdata
+  soc->write_imem(0x100 + 4 * 13, rv_lw(9, 6, 12)); // pending
+  soc->write_imem(0x100 + 4 * 14, rv_jal(0, 0));
+  ASSERT_TRUE(soc->run_till_pc(20));
+  ASSERT_TRUE(soc->run(50));
+  EXPECT_TRUE(soc->is_sleeping());
+
+  soc->uart_send("x");
+  ASSERT_TRUE(soc->run_till_pc(0x100 + 4 * 14));
+  EXPECT_EQ(soc->get_reg(5), 4); // UART is source 3
+  EXPECT_EQ(soc->get_reg(8), 'x');
+  // Claiming doesn't clear a level source, draining the FIFO does
+  EXPECT_EQ(soc->get_reg(9), 0);
+}
+
+// Starts the DMA transfer set up in x2 (src), x3 (dst), x4 (len), x5 (ctrl)
+// and x8 (fill), then polls status into x6 until it's no longer busy. Ends at
+// base + 32.
+static void write_dma_program(Lemonsoc* soc, uint32_t base = 0) {
+  soc->set_reg(1, DMA_BASE);
+  soc->write_imem(base, rv_sw(8, 1, 20));
+  soc->write_imem(base + 4, rv_sw(2, 1, 0));
+  soc->write_imem(base + 8, rv_sw(3, 1, 4));
+  soc->write_imem(base + 12, rv_sw(4, 1, 8));
+  soc->write_imem(base + 16, rv_sw(5, 1, 12));
+  soc->write_imem(base + 20, rv_lw(6, 1, 16));
+  soc->write_imem(base + 24, rv_andi(7, 6, 1));
+  soc->write_imem(base + 28, rv_bne(7, 0, -8));
+  soc->write_imem(base + 32, rv_jal(0, 0));
+}
+
+TEST_F(LemonsocTest, DmaCopy) {
+  const int words = 37; // not a whole number of bursts
+  for (int i = 0; i < words + 1; i++)
+    soc->write_spram(SPRAM_BASE + 4 * i, 0x1000 + i);
+  soc->write_spram(SPRAM_BASE + 0x1000 + 4 * words, 0xDEADBEEF);
+
+  soc->set_reg(2, SPRAM_BASE);
+  soc->set_reg(3, SPRAM_BASE + 0x1000);
+  soc->set_reg(4, 4 * words + 3); // the partial word is left alone
+  soc->set_reg(5, 1);
+  write_dma_program(soc);
+  ASSERT_TRUE(soc->run_till_pc(32));
+
+  EXPECT_EQ(soc->get_reg(6), 1 << 1); // done, no error
+  for (int i = 0; i < words; i++)
+    EXPECT_EQ(soc->read_spram(SPRAM_BASE + 0x1000 + 4 * i), 0x1000 + i);
+  EXPECT_EQ(soc->read_spram(SPRAM_BASE + 0x1000 + 4 * words), 0xDEADBEEF);
+}
+
+TEST_F(LemonsocTest, DmaWfiFastSkip) {
+  // Sleep through a transfer far longer than fast skip's settling time, with
+  // only the DMA interrupt enabled to wake up. Fast skip mustn't jump over the
+  // transfer.
+  const int words = 512;
+  for (int i = 0; i < words; i++)
+    soc->write_spram(SPRAM_BASE + 4 * i, 0x1000 + i);
+
+  soc->set_reg(1, DMA_BASE);
+  soc->set_reg(2, SPRAM_BASE);
+  soc->set_reg(3, SPRAM_BASE + 0x1000);
+  soc->set_reg(4, 4 * words);
+  soc->set_reg(5, 1 | 1 << 4); // interrupt when done
+  soc->set_reg(6, IRQ_BASE);
+  soc->set_reg(7, 1 << 4);     // DMA source
+  soc->set_reg(8, 1 << 11);
+  soc->write_imem(0, rv_sw(7, 6, 0));
+  soc->write_imem(4, rv_csrrs(0, 8, RV_CSR_MIE));
+  soc->write_imem(8, rv_sw(2, 1, 0));
+  soc->write_imem(12, rv_sw(3, 1, 4));
+  soc->write_imem(16, rv_sw(4, 1, 8));
+  soc->write_imem(20, rv_sw(5, 1, 12));
+  soc->write_imem(24, rv_wfi());
+  soc->write_imem(28, rv_addi(9, 0, 1));
+  soc->write_imem(32, rv_jal(0, 0));
+  soc->set_fast_skip(true);
+  ASSERT_TRUE(soc->run(100000));
+
+  EXPECT_FALSE(soc->is_sleeping());
+  EXPECT_EQ(soc->get_pc(), 32);
+  EXPECT_EQ(soc->get_reg(9), 1);
+  for (int i = 0; i < words; i++)
+    EXPECT_EQ(soc->read_spram(SPRAM_BASE + 0x1000 + 4 * i), 0x1000 + i);
+}
+
+TEST_F(LemonsocTest, DmaFill) {
+  soc->write_spram(SPRAM_BASE + 4 * 10, 0x12345678);
+
+  soc->set_reg(3, SPRAM_BASE);
+  soc->set_reg(4, 4 * 10);
+  soc->set_reg(5, 1 | 1 << 1); // fill mode
+  soc->set_reg(8, 0xA5A5A5A5);
+  write_dma_program(soc);
+  ASSERT_TRUE(soc->run_till_pc(32));
+
+  EXPECT_EQ(soc->get_reg(6), 1 << 1);
+  for (int i = 0; i < 10; i++)
+    EXPECT_EQ(soc->read_spram(SPRAM_BASE + 4 * i), 0xA5A5A5A5);
+  EXPECT_EQ(soc->read_spram(SPRAM_BASE + 4 * 10), 0x12345678);
+}
+
+TEST_F(LemonsocTest, DmaToPeripheral) {
+  // Words to the UART's txdata register, which sends their low bytes
+  const char* text = "dma!";
+  for (int i = 0; i < 4; i++)
+    soc->write_spram(SPRAM_BASE + 4 * i, text[i]);
+
+  soc->set_reg(2, SPRAM_BASE);
+  soc->set_reg(3, UART_BASE);
+  soc->set_reg(4, 4 * 4);
+  soc->set_reg(5, 1 | 1 << 3); // dst fixed
+  write_dma_program(soc);
+  ASSERT_TRUE(soc->run_till_pc(32));
+  ASSERT_TRUE(soc->run(10));
+
+  EXPECT_EQ(soc->get_uart_output(), "dma!");
+}
+
+TEST_F(LemonsocTest, DmaError) {
+  // The ROM rejects writes, so the first burst fails and the rest is skipped
+  soc->set_reg(2, SPRAM_BASE);
+  soc->set_reg(3, 0x800);
+  soc->set_reg(4, 4 * 16);
+  soc->set_reg(5, 1);
+  write_dma_program(soc);
+  ASSERT_TRUE(soc->run_till_pc(32));
+
+  EXPECT_EQ(soc->get_reg(6), 1 << 2 | 1 << 1);
+  soc->set_reg(6, 0);
+  soc->write_imem(32, rv_lw(6, 1, 4));
+  soc->write_imem(36, rv_jal(0, 0));
+  ASSERT_TRUE(soc->run_till_pc(36));
+  EXPECT_EQ(soc->get_reg(6), 0x800 + 4 * 4); // dst stopped after one burst
+}
+
+TEST_F(LemonsocTest, DmaSpeedup) {
+  // Copy 256 words with an lw/sw loop on the core, then with the DMA engine
+  const int words = 256;
+  for (int i = 0; i < words; i++)
+    soc->write_spram(SPRAM_BASE + 4 * i, i);
+
+  soc->set_reg(9, SPRAM_BASE);
+  soc->set_reg(10, SPRAM_BASE + 0x1000);
+  soc->set_reg(11, words);
+  soc->write_imem(0, rv_lw(6, 9, 0));
+  soc->write_imem(4, rv_sw(6, 10, 0));
+  soc->write_imem(8, rv_addi(9, 9, 4));
+  soc->write_imem(12, rv_addi(10, 10, 4));
+  soc->write_imem(16, rv_addi(11, 11, -1));
+  soc->write_imem(20, rv_bne(11, 0, -20));
+  soc->write_imem(24, rv_fence());
+  soc->write_imem(28, rv_jal(0, 0x100 - 28));
+
+  soc->set_reg(2, SPRAM_BASE);
+  soc->set_reg(3, SPRAM_BASE + 0x2000);
+  soc->set_reg(4, 4 * words);
+  soc->set_reg(5, 1);
+  write_dma_program(soc, 0x100);
+
+  const int bound = 100000;
+  int loop_cycles = 0;
+  while (soc->get_pc() != 0x100 && loop_cycles < bound) {
+    ASSERT_TRUE(soc->step());
+    loop_cycles++;
+  }
+  ASSERT_LT(loop_cycles, bound);
+
+  int dma_cycles = 0;
+  while (soc->get_pc() != 0x100 + 32 && dma_cycles < bound) {
+    ASSERT_TRUE(soc->step());
+    dma_cycles++;
+  }
+  ASSERT_LT(dma_cycles, bound);
+
+  for (int i = 0; i < words; i++) {
+    EXPECT_EQ(soc->read_spram(SPRAM_BASE + 0x1000 + 4 * i), i);
+    EXPECT_EQ(soc->read_spram(SPRAM_BASE + 0x2000 + 4 * i), i);
+  }
+  std::cout << "lw/sw loop: " << loop_cycles << " cycles, DMA: " << dma_cycles
+            << " cycles" << std::endl;
+  EXPECT_LT(dma_cycles * 4, loop_cycles);
+}
+
+// CRC-32 as used by zlib, for bootloader frames
+static uint32_t crc32(const std::string& data) {
+  uint32_t crc = 0xFFFFFFFF;
+  for (unsigned char c : data) {
+    crc ^= c;
+    for (int i = 0; i < 8; i++)
+      crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+  }
+  return ~crc;
+}
+
+static std::string le_bytes(uint32_t value, int bytes) {
+  std::string s;
+  for (int i = 0; i < bytes; i++)
+    s.push_back((char) (value >> (8 * i)));
+  return s;
+}
+
+// A bootloader frame as sent by sw/upload.py
+static std::string boot_frame(char type, uint32_t addr, const std::string& payload) {
+  std::string body = std::string(1, type) + le_bytes(payload.size(), 2) +
+                     le_bytes(addr, 4) + payload;
+  return "LB" + body + le_bytes(crc32(body), 4);
+}
+
+TEST_F(LemonsocTest, Bootloader) {
+  EXPECT_TRUE(soc->load_firmware("sw/boot.sim.mem"));
+
+  // A program that prints "OK" and stops
+  const uint32_t program[] = {
+    rv_lui(1, UART_BASE & ~0xFFF),
+    rv_addi(1, 1, UART_BASE & 0xFFF),
+    rv_addi(2, 0, 'O'),
+    rv_sw(2, 1, 0),
+    rv_addi(2, 0, 'K'),
+    rv_sw(2, 1, 0),
+    rv_jal(0, 0),
+  };
+  std::string image;
+  for (uint32_t word : program)
+    image += le_bytes(word, 4);
+
+  // Two write frames, with a corrupted one in between that should be refused
+  std::string bad = boot_frame('W', SPRAM_BASE, image);
+  bad[10] ^= 1;
+  soc->uart_send(boot_frame('W', SPRAM_BASE, image.substr(0, 12)));
+  soc->uart_send(bad);
+  soc->uart_send(boot_frame('W', SPRAM_BASE + 12, image.substr(12)));
+  soc->uart_send(boot_frame('W', 0x0, image)); // ROM isn't writable
+  soc->uart_send(boot_frame('J', SPRAM_BASE, ""));
+
+  const std::string expected = "lemonboot\r\nKEKEKOK";
+  int cycles = 0;
+  while (soc->get_uart_output().size() < expected.size() && cycles < 100000) {
+    ASSERT_TRUE(soc->step());
+    cycles++;
+  }
+  EXPECT_EQ(soc->get_uart_output(), expected);
+  for (int i = 0; i < 7; i++)
+    EXPECT_EQ(soc->read_spram(SPRAM_BASE + 4 * i), program[i]);
+}
+
+// Runs the same program on the RTL and the transaction-level model, which
+// should agree on the results and, with timing, roughly on how long it takes
+TEST_F(LemonsocTest, SeparateModels) {
+  // Each SoC's memories are its own, through the DPI calls and in place
+  Lemonsoc other(false, false);
+  soc->write_imem(0, rv_addi(1, 0, 1));
+  other.write_imem(0, rv_addi(1, 0, 2));
+  soc->get_ram()[0] = 0x1234;
+  other.get_ram()[0] = 0x5678;
+  other.write_spram(SPRAM_BASE, 0xCAFEF00D);
+  EXPECT_EQ(soc->get_rom()[0], rv_addi(1, 0, 1));
+  EXPECT_EQ(other.get_rom()[0], rv_addi(1, 0, 2));
+  EXPECT_EQ(soc->get_ram()[0], 0x1234);
+  EXPECT_EQ(other.get_spram()[0], 0xCAFEF00D);
+  EXPECT_NE(soc->read_spram(SPRAM_BASE), 0xCAFEF00D);
+}
+
+class LemonsocTlmTest : public LemonsocTest {
+protected:
+  void SetUp() override {
+    LemonsocTest::SetUp();
+    tlm = new LemonsocTlm(true);
+  }
+  void TearDown() override {
+    delete tlm;
+    LemonsocTest::TearDown();
+  }
+  template <class Soc>
+  int cycles_till_pc(Soc* s, uint32_t pc) {
+    int cycles = 0;
+    while (s->get_pc() != pc && cycles < 100000) {
+      EXPECT_TRUE(s->step());
+      cycles++;
+    }
+    return cycles;
+  }
+  LemonsocTlm* tlm;
+};
+
+TEST_F(LemonsocTlmTest, MatchesRtl) {
+  // Sum a table in SPRAM, with a CRC of each entry, from a loop in flash
+  const uint32_t program[] = {
+    rv_addi(2, 0, 16),
+    rv_lw(3, 1, 0),
+    rv_add(4, 4, 3),
+    rv_custom0(5, 5, 3, 2, 0),
+    rv_addi(1, 1, 4),
+    rv_addi(2, 2, -1),
+    rv_bne(2, 0, -20),
+    rv_jal(0, 0),
+  };
+  for (uint32_t i = 0; i < sizeof(program) / sizeof(program[0]); i++) {
+    soc->write_flash(FLASH_BASE + 4 * i, program[i]);
+    tlm->write_flash(FLASH_BASE + 4 * i, program[i]);
+  }
+  for (int i = 0; i < 16; i++) {
+    soc->write_spram(SPRAM_BASE + 4 * i, i * 0x01010101);
+    tlm->write_spram(SPRAM_BASE + 4 * i, i * 0x01010101);
+  }
+  soc->write_imem(0, rv_jalr(0, 6, 0));
+  tlm->write_imem(0, rv_jalr(0, 6, 0));
+  soc->set_reg(1, SPRAM_BASE);
+  tlm->set_reg(1, SPRAM_BASE);
+  soc->set_reg(6, FLASH_BASE);
+  tlm->set_reg(6, FLASH_BASE);
+
+  int rtl_cycles = cycles_till_pc(soc, FLASH_BASE + 28);
+  int tlm_cycles = cycles_till_pc(tlm, FLASH_BASE + 28);
+  for (int reg = 1; reg < 32; reg++)
+    EXPECT_EQ(tlm->get_reg(reg), soc->get_reg(reg)) << "x" << reg;
+  EXPECT_EQ(tlm->get_icache_misses(), soc->get_icache_misses());
+  EXPECT_EQ(tlm->get_icache_hits(), soc->get_icache_hits());
+  EXPECT_NEAR(tlm_cycles, rtl_cycles, rtl_cycles / 4);
+}
+
+TEST_F(LemonsocTlmTest, InstructionCosts) {
+  // One of each class of instruction from ROM, with a trap through a handler
+  // that mrets past the ecall. The stores are placed so nothing after them has
+  // to wait for the store buffer, which the model leaves out.
+  const uint32_t program[] = {
+    rv_addi(8, 0, 5),
+    rv_sw(8, 1, 0),
+    rv_addi(7, 0, 0x100),
+    rv_csrrw(0, 7, RV_CSR_MTVEC),
+    rv_lw(3, 1, 0),
+    rv_fence(),
+    rv_lr_w(4, 1),
+    rv_amoadd_w(5, 1, 3),
+    rv_sw(3, 1, 4),
+    rv_add(6, 3, 4),
+    rv_ecall(),
+    rv_addi(6, 6, 1),
+    rv_jal(0, 0),
+  };
+  const uint32_t handler[] = {
+    rv_csrrs(8, 0, RV_CSR_MEPC),
+    rv_addi(8, 8, 4),
+    rv_csrrw(0, 8, RV_CSR_MEPC),
+    rv_mret(),
+  };
+  const uint32_t end = 4 * (sizeof(program) / sizeof(program[0]) - 1);
+  for (uint32_t i = 0; i < sizeof(program) / sizeof(program[0]); i++) {
+    soc->write_imem(4 * i, program[i]);
+    tlm->write_imem(4 * i, program[i]);
+  }
+  for (uint32_t i = 0; i < sizeof(handler) / sizeof(handler[0]); i++) {
+    soc->write_imem(0x100 + 4 * i, handler[i]);
+    tlm->write_imem(0x100 + 4 * i, handler[i]);
+  }
+  soc->set_reg(1, RAM_BASE);
+  tlm->set_reg(1, RAM_BASE);
+
+  int rtl_cycles = cycles_till_pc(soc, end);
+  int tlm_cycles = cycles_till_pc(tlm, end);
+  for (int reg = 1; reg < 32; reg++)
+    EXPECT_EQ(tlm->get_reg(reg), soc->get_reg(reg)) << "x" << reg;
+  EXPECT_NEAR(tlm_cycles, rtl_cycles, rtl_cycles / 10);
+}
+
+// Words written in place are what loads see, and stores land in place
+template <class Soc>
+static void check_memory_views(Soc* s) {
+  s->get_ram()[4] = 0x12345678;
+  s->get_spram()[2] = 0xCAFEF00D;
+  s->set_reg(1, RAM_BASE);
+  s->set_reg(2, SPRAM_BASE);
+  s->write_imem(0, rv_lw(3, 1, 16));
+  s->write_imem(4, rv_lw(4, 2, 8));
+  s->write_imem(8, rv_sw(3, 2, 12));
+  s->write_imem(12, rv_jal(0, 0));
+  ASSERT_TRUE(s->run_till_pc(12));
+  ASSERT_TRUE(s->run(20));
+
+  EXPECT_EQ(s->get_reg(3), 0x12345678);
+  EXPECT_EQ(s->get_reg(4), 0xCAFEF00D);
+  EXPECT_EQ(s->get_spram()[3], 0x12345678);
+  EXPECT_EQ(s->get_rom()[1], rv_lw(4, 2, 8));
+}
+
+TEST_F(LemonsocTlmTest, MemoryViews) {
+  check_memory_views(soc);
+  check_memory_views(tlm);
+}
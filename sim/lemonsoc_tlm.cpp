@@ -0,0 +1,854 @@
+#include "lemonsoc_tlm.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+#include "lemoncore_timing.h"
+#include "riscv.h"
+
+// Instruction cache shape, see rtl/soc/icache.v
+#define ICACHE_SETS 64
+#define ICACHE_LINE_BYTES 16
+
+#define IRQ_LEVEL_SOURCES 0x18  // DMA and UART, see rtl/soc/lemonsoc.v
+#define UART_FIFO_DEPTH 16
+#define UART_DEFAULT_DIV 103
+#define DMA_BURST 4  // words
+
+// Cycles each instruction takes with timing on. The base costs are the
+// budgets in rtl/core/timing.vh, which count every memory as answering in the
+// cycle it's asked; on the SoC each bus access takes ACCESS_CYCLES instead, so
+// the wait on top of that is added for every access the instruction makes.
+// This is how the latency bounds in formal/latency/latency_checks.vh are built
+// too, with MEM_LATENCY at the SoC's and nothing in the store buffer. The
+// TIMING_ values come from timing.vh itself, through lemoncore_timing.h, which
+// the Makefile generates from it. LemonsocTlmTest compares the totals with
+// the RTL's.
+//
+// A bus access takes three cycles: the crossbar registers the request, the
+// slave answers it the next cycle, and the core takes the answer in the one
+// after that.
+#define ACCESS_CYCLES 3
+#define ACCESS_WAIT (ACCESS_CYCLES - 1)
+#define ICACHE_MISS_CYCLES 40  // a line fill from flash, on top of the access
+
+#define SOFTWARE_IRQ 3
+#define TIMER_IRQ 7
+#define EXTERNAL_IRQ 11
+
+static bool in_region(uint32_t addr, uint32_t base, uint32_t size) {
+  return addr >= base && addr - base < size;
+}
+
+// Bytes of data enabled in mask, over old
+static uint32_t masked(uint32_t old, uint32_t data, uint8_t mask) {
+  uint32_t bits = 0;
+  for (int i = 0; i < 4; i++) {
+    if (mask & (1 << i))
+      bits |= 0xFFu << (8 * i);
+  }
+  return (old & ~bits) | (data & bits);
+}
+
+// The SoC's coprocessor, rtl/soc/crc32.v
+static bool crc32(uint8_t custom, uint8_t funct3, uint8_t funct7, uint32_t rs1, uint32_t rs2,
+                  uint32_t* rd) {
+  if (custom != 0 || funct7 != 0 || funct3 > 2)
+    return false;
+  uint32_t crc = rs1;
+  for (int i = 0; i < (8 << funct3); i++)
+    crc = (crc >> 1) ^ (0xEDB88320 & -((crc ^ (rs2 >> i)) & 1));
+  *rd = crc;
+  return true;
+}
+
+// Reads a $readmemh image into words from the start, leaving any the file
+// doesn't cover alone. Handles @address lines and // comments.
+static bool read_memh(std::string path, std::vector<uint32_t>* words) {
+  std::ifstream file(path);
+  if (!file)
+    return false;
+  std::string token;
+  size_t addr = 0;
+  while (file >> token) {
+    if (token.compare(0, 2, "//") == 0) {
+      std::getline(file, token);
+    } else if (token[0] == '@') {
+      addr = strtoul(token.c_str() + 1, nullptr, 16);
+    } else {
+      token.erase(std::remove(token.begin(), token.end(), '_'), token.end());
+      if (addr < words->size())
+        (*words)[addr] = strtoul(token.c_str(), nullptr, 16);
+      addr++;
+    }
+  }
+  return true;
+}
+
+LemonsocTlm::Hart::Hart(LemonsocTlm* soc, int hart)
+    : iss(0), bus(soc, hart), started(hart == 0), busy_until(0) {
+  iss.set_bus(&bus);
+  iss.set_full_system(true);
+  iss.set_hart_id(hart);
+  // Only hart 0 has the coprocessor
+  if (hart == 0)
+    iss.set_coprocessor(crc32);
+}
+
+bool LemonsocTlm::HartBus::fetch(uint32_t addr, uint32_t* instr) {
+  if (!soc->bus_read(addr, instr))
+    return false;
+  this->instr = *instr;
+  return true;
+}
+
+bool LemonsocTlm::HartBus::load(uint32_t addr, int size, uint32_t* data) {
+  uint32_t word;
+  if (!soc->bus_read(addr & ~3u, &word))
+    return false;
+  word >>= 8 * (addr % 4);
+  *data = size == 4 ? word : word & ((1u << (8 * size)) - 1);
+  return true;
+}
+
+bool LemonsocTlm::HartBus::store(uint32_t addr, int size, uint32_t data) {
+  uint8_t mask = ((1 << size) - 1) << (addr % 4);
+  return soc->bus_write(addr & ~3u, data << (8 * (addr % 4)), mask);
+}
+
+// Reservations are only kept for RAM and SPRAM, as on the SoC
+bool LemonsocTlm::HartBus::load_reserved(uint32_t addr, uint32_t* data) {
+  if (!soc->bus_read(addr, data))
+    return false;
+  if (in_region(addr, RAM_BASE, GPIO_BASE - RAM_BASE) ||
+      in_region(addr, SPRAM_BASE, SPRAM_SIZE)) {
+    soc->resv_valid[hart] = true;
+    soc->resv_addr[hart] = addr;
+  }
+  return true;
+}
+
+bool LemonsocTlm::HartBus::store_conditional(uint32_t addr, uint32_t data, bool* stored) {
+  *stored = soc->resv_valid[hart] && soc->resv_addr[hart] == addr;
+  soc->resv_valid[hart] = false;
+  return !*stored || soc->bus_write(addr, data, 0xF);
+}
+
+LemonsocTlm::LemonsocTlm(bool timing)
+    : mem(GPIO_BASE / 4, 0), spram(SPRAM_SIZE / 4, 0), icache_tags(ICACHE_SETS, 0),
+      icache_valid(ICACHE_SETS, false) {
+  this->timing = timing;
+  fast_skip = false;
+  uart_fd = -1;
+  for (int h = 0; h < TLM_NUM_HARTS; h++)
+    harts[h] = nullptr;
+  reset();
+}
+
+LemonsocTlm::~LemonsocTlm() {
+  for (int h = 0; h < TLM_NUM_HARTS; h++)
+    delete harts[h];
+}
+
+// Memories keep their contents, as on the SoC
+bool LemonsocTlm::load_firmware(std::string path) {
+  return read_memh(path, &mem);
+}
+
+void LemonsocTlm::reset() {
+  for (int h = 0; h < TLM_NUM_HARTS; h++) {
+    delete harts[h];
+    harts[h] = new Hart(this, h);
+    resv_valid[h] = false;
+    resv_addr[h] = 0;
+    msip[h] = false;
+  }
+  cycle = 0;
+  stall = 0;
+
+  std::fill(icache_valid.begin(), icache_valid.end(), false);
+  icache_hits = 0;
+  icache_misses = 0;
+
+  user_leds = 0;
+  done_led = false;
+  exception_led = false;
+  btns = 0;
+
+  mtime = 0;
+  mtimecmp = ~0ull;
+  prescaler = 0;
+
+  irq_enable = 0;
+  irq_rise = 0;
+  irq_fall = 0;
+  irq_pending = 0;
+  irq_sources = 0;
+
+  uart_tx_ie = false;
+  uart_rx_ie = false;
+  uart_tx_thresh = 0;
+  uart_rx_thresh = 0;
+  uart_div = UART_DEFAULT_DIV;
+
+  dma_src = 0;
+  dma_dst = 0;
+  dma_len = 0;
+  dma_fill = 0;
+  dma_fill_mode = false;
+  dma_src_fixed = false;
+  dma_dst_fixed = false;
+  dma_ie = false;
+  dma_busy = false;
+  dma_done = false;
+  dma_error = false;
+}
+
+// Each hart that's free this cycle runs its next instruction, which keeps it
+// busy for as long as that takes
+bool LemonsocTlm::step() {
+  update_irq_sources();
+  for (int h = 0; h < TLM_NUM_HARTS; h++) {
+    Hart* hart = harts[h];
+    // Held in reset until its msip is first set
+    if (!hart->started) {
+      if (!msip[h])
+        continue;
+      hart->started = true;
+      hart->busy_until = cycle + 1;
+    }
+    if (hart->busy_until <= cycle)
+      hart->busy_until = cycle + execute(h);
+  }
+  advance(1);
+
+  return !exception_led;
+}
+
+bool LemonsocTlm::run(int cycles) {
+  for (int c = 0; c < cycles && !is_done(); c++) {
+    if (fast_skip) {
+      c += skip_idle(cycles - c);
+      if (c == cycles)
+        break;
+    }
+    // Until a hart is free again only time passes, as the harts are the only
+    // thing that changes state between calls
+    uint64_t free = next_free();
+    if (free > cycle) {
+      int busy = std::min<uint64_t>(free - cycle, cycles - c);
+      advance(busy);
+      c += busy;
+      if (c == cycles)
+        break;
+    }
+    if (!step())
+      return false;
+  }
+
+  return true;
+}
+
+// As Lemonsoc::set_fast_skip()
+void LemonsocTlm::set_fast_skip(bool enable) {
+  fast_skip = enable;
+}
+
+// Fast-forwards up to max_cycles while every hart sleeps, stopping just short
+// of the next timer interrupt. Returns the number of cycles skipped.
+int LemonsocTlm::skip_idle(int max_cycles) {
+  // Transfers finish within the write that starts them, so the DMA engine is
+  // never busy here, but like the RTL don't skip over one
+  if (dma_busy)
+    return 0;
+  update_irq_sources();
+  for (int h = 0; h < TLM_NUM_HARTS; h++) {
+    Iss& iss = harts[h]->iss;
+    if (harts[h]->started && (!iss.is_sleeping() || (hart_mip(h) & iss.get_mie())))
+      return 0;
+  }
+
+  uint64_t skip = max_cycles;
+  if (harts[0]->iss.get_mie() & (1 << TIMER_IRQ)) {
+    if (mtime >= mtimecmp)
+      return 0;
+    // Cycles until mtime reaches mtimecmp. Leave the last one to simulate
+    uint64_t until = (mtimecmp - mtime - 1) * TIMER_TICKS_PER_MS +
+                     (TIMER_TICKS_PER_MS - prescaler);
+    skip = std::min(skip, until - 1);
+  }
+  advance(skip);
+  return skip;
+}
+
+bool LemonsocTlm::is_sleeping() {
+  return harts[0]->iss.is_sleeping();
+}
+
+// The first cycle a started hart can run its next instruction in
+uint64_t LemonsocTlm::next_free() {
+  uint64_t free = ~0ull;
+  for (int h = 0; h < TLM_NUM_HARTS; h++) {
+    if (harts[h]->started)
+      free = std::min(free, harts[h]->busy_until);
+  }
+  return free;
+}
+
+uint64_t LemonsocTlm::execute(int h) {
+  Iss& iss = harts[h]->iss;
+  uint32_t mip = hart_mip(h);
+  iss.set_irq_external((mip >> EXTERNAL_IRQ) & 1);
+  iss.set_irq_timer((mip >> TIMER_IRQ) & 1);
+  iss.set_irq_software((mip >> SOFTWARE_IRQ) & 1);
+
+  stall = 0;
+  uint64_t cycles;
+  int cause = iss.pending_interrupt();
+  if (cause >= 0) {
+    iss.interrupt(cause);
+    cycles = timing ? TIMING_IRQ : 1;
+  } else {
+    Iss::Result result = iss.step();
+    // mcycle stops while the hart sleeps
+    if (result == Iss::SLEEPING)
+      return 1;
+    cycles = timing ? instr_cycles(harts[h]->bus.last_instr(), result) + stall : 1;
+  }
+  iss.add_cycles(cycles);
+  return cycles;
+}
+
+uint64_t LemonsocTlm::instr_cycles(uint32_t instr, Iss::Result result) {
+  if (result == Iss::TRAPPED)
+    return TIMING_TRAP + ACCESS_WAIT;
+
+  uint32_t funct3 = (instr >> 12) & 7;
+  switch (instr & 0x7F) {
+  case 0b0000011: // loads
+    return TIMING_LOAD + 2 * ACCESS_WAIT;
+  case 0b0100011: // stores, which go into the store buffer
+    return TIMING_STORE + ACCESS_WAIT;
+  case 0b0101111: { // lr.w and sc.w make one access, AMOs a read and a write
+    uint32_t funct5 = instr >> 27;
+    bool lr_sc = funct5 == 0b00010 || funct5 == 0b00011;
+    return TIMING_LOAD + 2 * ACCESS_WAIT + (lr_sc ? 0 : ACCESS_CYCLES);
+  }
+  case 0b0001111: // fence, fence.i
+    return TIMING_FENCE + ACCESS_WAIT;
+  case 0b0001011: // COP, where the CRC unit folds in a byte a cycle
+    return TIMING_ALU + ACCESS_WAIT + 1 + (1 << funct3);
+  case 0b1110011:
+    if (instr == rv_mret())
+      return TIMING_MRET + ACCESS_WAIT;
+    // WFI leaves from DECODE like a fence, and sleeps from there
+    return instr == rv_wfi() ? TIMING_FENCE + ACCESS_WAIT : TIMING_ALU + ACCESS_WAIT;
+  default:
+    return TIMING_ALU + ACCESS_WAIT;
+  }
+}
+
+// The timer and external interrupts only go to hart 0
+uint32_t LemonsocTlm::hart_mip(int hart) {
+  uint32_t mip = msip[hart] << SOFTWARE_IRQ;
+  if (hart == 0) {
+    mip |= (mtime >= mtimecmp) << TIMER_IRQ;
+    mip |= (bool) (irq_pending & irq_enable) << EXTERNAL_IRQ;
+  }
+  return mip;
+}
+
+void LemonsocTlm::advance(uint64_t cycles) {
+  cycle += cycles;
+  uint64_t ticks = prescaler + cycles;
+  mtime += ticks / TIMER_TICKS_PER_MS;
+  prescaler = ticks % TIMER_TICKS_PER_MS;
+}
+
+// Word accesses as the crossbar sees them, with data and mask on their byte
+// lanes. Returns false for an error response.
+bool LemonsocTlm::bus_read(uint32_t addr, uint32_t* data) {
+  if (addr < GPIO_BASE) {
+    *data = mem[addr / 4];
+    return true;
+  }
+  if (in_region(addr, GPIO_BASE, GPIO_SIZE))
+    return gpio_read(addr - GPIO_BASE, data);
+  if (in_region(addr, TIMER_BASE, TIMER_SIZE))
+    return timer_read(addr - TIMER_BASE, data);
+  if (in_region(addr, IRQ_BASE, IRQ_SIZE))
+    return irq_read(addr - IRQ_BASE, data);
+  if (in_region(addr, UART_BASE, UART_SIZE))
+    return uart_read(addr - UART_BASE, data);
+  if (in_region(addr, DMA_BASE, DMA_SIZE))
+    return dma_read(addr - DMA_BASE, data);
+  if (in_region(addr, SPRAM_BASE, SPRAM_SIZE)) {
+    *data = spram[(addr - SPRAM_BASE) / 4];
+    return true;
+  }
+  if (in_region(addr, FLASH_BASE, FLASH_SIZE)) {
+    icache_lookup(addr);
+    *data = flash.read_word(addr - FLASH_BASE);
+    return true;
+  }
+  // Unmapped, so the crossbar answers
+  return false;
+}
+
+// ROM and flash are read-only
+bool LemonsocTlm::bus_write(uint32_t addr, uint32_t data, uint8_t mask) {
+  if (in_region(addr, RAM_BASE, GPIO_BASE - RAM_BASE)) {
+    end_reservations(addr);
+    mem[addr / 4] = masked(mem[addr / 4], data, mask);
+    return true;
+  }
+  if (in_region(addr, GPIO_BASE, GPIO_SIZE))
+    return gpio_write(addr - GPIO_BASE, data, mask);
+  if (in_region(addr, TIMER_BASE, TIMER_SIZE))
+    return timer_write(addr - TIMER_BASE, data, mask);
+  if (in_region(addr, IRQ_BASE, IRQ_SIZE))
+    return irq_write(addr - IRQ_BASE, data, mask);
+  if (in_region(addr, UART_BASE, UART_SIZE))
+    return uart_write(addr - UART_BASE, data, mask);
+  if (in_region(addr, DMA_BASE, DMA_SIZE))
+    return dma_write(addr - DMA_BASE, data);
+  if (in_region(addr, SPRAM_BASE, SPRAM_SIZE)) {
+    end_reservations(addr);
+    uint32_t& word = spram[(addr - SPRAM_BASE) / 4];
+    word = masked(word, data, mask);
+    return true;
+  }
+  return false;
+}
+
+// Any write to a reserved word ends every reservation on it
+void LemonsocTlm::end_reservations(uint32_t addr) {
+  for (int h = 0; h < TLM_NUM_HARTS; h++) {
+    if (resv_addr[h] == addr)
+      resv_valid[h] = false;
+  }
+}
+
+// Only the tags are kept, for the counters and miss timing. Data always comes
+// from the flash, so unlike on the SoC, write_flash() shows through lines
+// that are already cached.
+void LemonsocTlm::icache_lookup(uint32_t addr) {
+  uint32_t line = (addr - FLASH_BASE) / ICACHE_LINE_BYTES;
+  uint32_t set = line % ICACHE_SETS;
+  if (icache_valid[set] && icache_tags[set] == line) {
+    icache_hits++;
+    return;
+  }
+  icache_misses++;
+  icache_valid[set] = true;
+  icache_tags[set] = line;
+  stall += ICACHE_MISS_CYCLES;
+}
+
+bool LemonsocTlm::gpio_read(uint32_t offset, uint32_t* data) {
+  switch (offset) {
+  case 0x0: *data = user_leds; return true;
+  case 0x4: *data = exception_led << 1 | done_led; return true;
+  case 0x8: *data = btns; return true;
+  default: return false;
+  }
+}
+
+bool LemonsocTlm::gpio_write(uint32_t offset, uint32_t data, uint8_t mask) {
+  switch (offset) {
+  case 0x0:
+    if (mask & 1)
+      user_leds = data & 0x1F;
+    return true;
+  case 0x4:
+    if (mask & 1) {
+      done_led = data & 1;
+      exception_led = (data >> 1) & 1;
+    }
+    return true;
+  default:
+    // The buttons are read-only
+    return false;
+  }
+}
+
+bool LemonsocTlm::timer_read(uint32_t offset, uint32_t* data) {
+  uint32_t hart = (offset - 0x10) / 4;
+  switch (offset) {
+  case 0x0: *data = (uint32_t) mtime; return true;
+  case 0x4: *data = (uint32_t) (mtime >> 32); return true;
+  case 0x8: *data = (uint32_t) mtimecmp; return true;
+  case 0xC: *data = (uint32_t) (mtimecmp >> 32); return true;
+  default:
+    if (hart >= TLM_NUM_HARTS)
+      return false;
+    *data = msip[hart];
+    return true;
+  }
+}
+
+bool LemonsocTlm::timer_write(uint32_t offset, uint32_t data, uint8_t mask) {
+  uint32_t hart = (offset - 0x10) / 4;
+  uint64_t* reg = offset < 0x8 ? &mtime : &mtimecmp;
+  int shift = offset & 4 ? 32 : 0;
+  switch (offset) {
+  case 0x0:
+  case 0x4:
+  case 0x8:
+  case 0xC:
+    *reg = (*reg & ~(0xFFFFFFFFull << shift)) |
+           (uint64_t) masked(*reg >> shift, data, mask) << shift;
+    return true;
+  default:
+    if (hart >= TLM_NUM_HARTS)
+      return false;
+    if (mask & 1)
+      msip[hart] = data & 1;
+    return true;
+  }
+}
+
+// Latches edges from the sources, and has level-triggered ones' pending bits
+// follow them
+void LemonsocTlm::update_irq_sources() {
+  uint8_t sources = (dma_ie && dma_done) << 4 | uart_irq() << 3 | btns;
+  uint8_t edges = ((irq_rise & sources & ~irq_sources) | (irq_fall & ~sources & irq_sources)) &
+                  ~IRQ_LEVEL_SOURCES;
+  irq_pending = (irq_pending & ~IRQ_LEVEL_SOURCES) | edges | (sources & IRQ_LEVEL_SOURCES);
+  irq_sources = sources;
+}
+
+bool LemonsocTlm::irq_read(uint32_t offset, uint32_t* data) {
+  update_irq_sources();
+  switch (offset) {
+  case 0x0: *data = irq_enable; return true;
+  case 0x4: *data = irq_rise; return true;
+  case 0x8: *data = irq_fall; return true;
+  case 0xC: *data = irq_pending; return true;
+  case 0x10: {
+    // Claims the lowest enabled pending source
+    uint8_t active = irq_pending & irq_enable;
+    *data = active ? __builtin_ctz(active) + 1 : 0;
+    if (active)
+      irq_pending &= ~(active & -active & ~IRQ_LEVEL_SOURCES);
+    return true;
+  }
+  default:
+    return false;
+  }
+}
+
+bool LemonsocTlm::irq_write(uint32_t offset, uint32_t data, uint8_t mask) {
+  if (offset > 0x10)
+    return false;
+  if (!(mask & 1))
+    return true;
+  switch (offset) {
+  case 0x0: irq_enable = data & 0x1F; break;
+  case 0x4: irq_rise = data & 0x1F; break;
+  case 0x8: irq_fall = data & 0x1F; break;
+  case 0xC: irq_pending &= ~(data & ~IRQ_LEVEL_SOURCES); break;
+  default: break;
+  }
+  return true;
+}
+
+// The TX FIFO is always empty, see the header
+bool LemonsocTlm::uart_irq() {
+  uint32_t rx_level = std::min<size_t>(uart_input.size(), UART_FIFO_DEPTH);
+  bool tx_ip = 0 < uart_tx_thresh;
+  bool rx_ip = rx_level > uart_rx_thresh;
+  return (uart_tx_ie && tx_ip) || (uart_rx_ie && rx_ip);
+}
+
+bool LemonsocTlm::uart_read(uint32_t offset, uint32_t* data) {
+  uint32_t rx_level = std::min<size_t>(uart_input.size(), UART_FIFO_DEPTH);
+  switch (offset) {
+  case 0x0:
+    *data = 0;
+    return true;
+  case 0x4:
+    if (uart_input.empty()) {
+      *data = 0x80000000;
+    } else {
+      *data = uart_input.front();
+      uart_input.pop_front();
+    }
+    return true;
+  case 0x8:
+    // Bytes go out as they're written, so the transmitter is always idle
+    *data = 1 << 16 | rx_level << 8;
+    return true;
+  case 0xC:
+    *data = uart_rx_thresh << 16 | uart_tx_thresh << 8 | uart_rx_ie << 1 | uart_tx_ie;
+    return true;
+  case 0x10:
+    *data = (rx_level > uart_rx_thresh) << 1 | (0 < uart_tx_thresh);
+    return true;
+  case 0x14:
+    *data = uart_div;
+    return true;
+  default:
+    return false;
+  }
+}
+
+bool LemonsocTlm::uart_write(uint32_t offset, uint32_t data, uint8_t mask) {
+  switch (offset) {
+  case 0x0:
+    if (mask & 1) {
+      uint8_t c = data;
+      uart_output.push_back(c);
+      // Stop forwarding if the file won't take it
+      if (uart_fd >= 0 && write(uart_fd, &c, 1) != 1)
+        uart_fd = -1;
+    }
+    return true;
+  case 0xC:
+    if (mask & 1) {
+      uart_tx_ie = data & 1;
+      uart_rx_ie = (data >> 1) & 1;
+    }
+    if (mask & 2)
+      uart_tx_thresh = (data >> 8) & 0xF;
+    if (mask & 4)
+      uart_rx_thresh = (data >> 16) & 0xF;
+    return true;
+  case 0x14:
+    uart_div = masked(uart_div, data, mask & 3);
+    return true;
+  default:
+    // The other registers ignore writes
+    return offset < UART_SIZE;
+  }
+}
+
+bool LemonsocTlm::dma_read(uint32_t offset, uint32_t* data) {
+  switch (offset) {
+  case 0x0: *data = dma_src; return true;
+  case 0x4: *data = dma_dst; return true;
+  case 0x8: *data = dma_len << 2; return true;
+  case 0xC:
+    *data = dma_ie << 4 | dma_dst_fixed << 3 | dma_src_fixed << 2 | dma_fill_mode << 1 | dma_busy;
+    return true;
+  case 0x10: *data = dma_error << 2 | dma_done << 1 | dma_busy; return true;
+  case 0x14: *data = dma_fill; return true;
+  default: return false;
+  }
+}
+
+// Like the engine, this ignores the byte mask
+bool LemonsocTlm::dma_write(uint32_t offset, uint32_t data) {
+  switch (offset) {
+  case 0x0:
+    if (!dma_busy)
+      dma_src = data;
+    return true;
+  case 0x4:
+    if (!dma_busy)
+      dma_dst = data;
+    return true;
+  case 0x8:
+    if (!dma_busy)
+      dma_len = data >> 2;
+    return true;
+  case 0xC:
+    dma_ie = (data >> 4) & 1;
+    if (dma_busy)
+      return true;
+    dma_fill_mode = (data >> 1) & 1;
+    dma_src_fixed = (data >> 2) & 1;
+    dma_dst_fixed = (data >> 3) & 1;
+    if (data & 1) {
+      dma_done = false;
+      dma_error = false;
+      dma_transfer();
+    }
+    return true;
+  case 0x10:
+    if (data & 2)
+      dma_done = false;
+    if (data & 4)
+      dma_error = false;
+    return true;
+  case 0x14:
+    dma_fill = data;
+    return true;
+  default:
+    return false;
+  }
+}
+
+// Moves the whole transfer at once, through the same bus as the harts, in the
+// engine's bursts so an error stops it in the same place. It takes no time,
+// so a flash miss doesn't hold up whichever hart started it.
+void LemonsocTlm::dma_transfer() {
+  uint64_t hart_stall = stall;
+  dma_busy = true;
+  while (dma_len > 0 && !dma_error) {
+    uint32_t burst = std::min<uint32_t>(dma_len, DMA_BURST);
+    uint32_t data[DMA_BURST];
+    dma_len -= burst;
+    for (uint32_t i = 0; i < burst; i++) {
+      data[i] = dma_fill;
+      if (dma_fill_mode)
+        continue;
+      if (!bus_read(dma_src & ~3u, &data[i]))
+        dma_error = true;
+      if (!dma_src_fixed)
+        dma_src += 4;
+    }
+    // A burst whose reads failed isn't written, and one whose writes fail
+    // still finishes
+    if (dma_error)
+      break;
+    for (uint32_t i = 0; i < burst; i++) {
+      if (!bus_write(dma_dst & ~3u, data[i], 0xF))
+        dma_error = true;
+      if (!dma_dst_fixed)
+        dma_dst += 4;
+    }
+  }
+  dma_busy = false;
+  dma_done = true;
+  stall = hart_stall;
+}
+
+void LemonsocTlm::set_btns(bool btn1, bool btn2, bool btn3) {
+  btns = btn1 | btn2 << 1 | btn3 << 2;
+}
+
+std::array<int, 5> LemonsocTlm::get_leds() {
+  return {get_led(1), get_led(2), get_led(3), get_led(4), get_led(5)};
+}
+
+int LemonsocTlm::get_led(int led) {
+  assert(led >= 1 && led <= 5);
+  return (user_leds >> (led - 1)) & 1;
+}
+
+bool LemonsocTlm::is_done() {
+  return done_led;
+}
+
+void LemonsocTlm::set_reg(uint8_t reg, uint32_t data) {
+  harts[0]->iss.set_reg(reg, data);
+}
+
+// Any ROM or RAM address, as the firmware image covers both
+void LemonsocTlm::write_imem(uint32_t addr, uint32_t data) {
+  assert(addr % 4 == 0 && addr < GPIO_BASE);
+  mem[addr / 4] = data;
+}
+
+// SPRAM helpers take bus addresses, i.e. starting at SPRAM_BASE
+bool LemonsocTlm::load_spram(std::string path) {
+  return read_memh(path, &spram);
+}
+
+void LemonsocTlm::write_spram(uint32_t addr, uint32_t data) {
+  assert(addr % 4 == 0);
+  assert(addr >= SPRAM_BASE && addr < SPRAM_BASE + SPRAM_SIZE);
+  spram[(addr - SPRAM_BASE) / 4] = data;
+}
+
+uint32_t LemonsocTlm::read_spram(uint32_t addr) {
+  assert(addr % 4 == 0);
+  assert(addr >= SPRAM_BASE && addr < SPRAM_BASE + SPRAM_SIZE);
+  return spram[(addr - SPRAM_BASE) / 4];
+}
+
+uint32_t* LemonsocTlm::get_rom() {
+  return mem.data();
+}
+
+uint32_t* LemonsocTlm::get_ram() {
+  return mem.data() + RAM_BASE / 4;
+}
+
+uint32_t* LemonsocTlm::get_spram() {
+  return spram.data();
+}
+
+// Offset is from the start of flash, as for iceprog -o
+bool LemonsocTlm::load_flash(std::string path, uint32_t offset) {
+  return flash.load(path, offset);
+}
+
+// Takes a bus address, i.e. starting at FLASH_BASE
+void LemonsocTlm::write_flash(uint32_t addr, uint32_t data) {
+  assert(addr >= FLASH_BASE && addr < FLASH_BASE + FLASH_SIZE);
+  flash.write_word(addr - FLASH_BASE, data);
+}
+
+uint32_t LemonsocTlm::get_icache_hits() {
+  return icache_hits;
+}
+
+uint32_t LemonsocTlm::get_icache_misses() {
+  return icache_misses;
+}
+
+// Pass -1 to stop forwarding
+void LemonsocTlm::set_uart_output(int fd) {
+  uart_fd = fd;
+}
+
+// Everything transmitted since reset
+std::string LemonsocTlm::get_uart_output() {
+  return uart_output;
+}
+
+// Queues bytes for the UART to receive
+void LemonsocTlm::uart_send(std::string data) {
+  uart_input.insert(uart_input.end(), data.begin(), data.end());
+}
+
+// Queues a file's contents for the UART to receive, or stdin's with "-"
+bool LemonsocTlm::load_uart_input(std::string path) {
+  if (path == "-") {
+    uart_send(std::string(std::istreambuf_iterator<char>(std::cin), {}));
+    return true;
+  }
+
+  std::ifstream file(path, std::ios::in | std::ios::binary);
+  if (!file)
+    return false;
+  uart_send(std::string(std::istreambuf_iterator<char>(file), {}));
+  return true;
+}
+
+uint64_t LemonsocTlm::get_mtime() {
+  return mtime;
+}
+
+uint32_t LemonsocTlm::get_mip() {
+  update_irq_sources();
+  return hart_mip(0);
+}
+
+bool LemonsocTlm::run_till_pc(uint32_t pc) {
+  int bound = 10000;
+  int c = 0;
+  while (get_pc() != pc) {
+    if (c >= bound)
+      return false;
+    if (!step())
+      return false;
+    c++;
+  }
+  return true;
+}
+
+uint32_t LemonsocTlm::get_pc() {
+  return harts[0]->iss.get_pc();
+}
+
+uint32_t LemonsocTlm::get_reg(uint8_t reg) {
+  return harts[0]->iss.get_reg(reg);
+}
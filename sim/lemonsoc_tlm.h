@@ -0,0 +1,166 @@
+#ifndef LEMONSOC_TLM_H
+#define LEMONSOC_TLM_H
+
+#include <stdint.h>
+#include <array>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "iss.h"
+#include "memmap.h"
+#include "spiflash.h"
+
+#define TLM_NUM_HARTS 2
+
+// Transaction-level model of lemonsoc, with the same interface as Lemonsoc so
+// firmware and tests can run on either. Each hart is an Iss in full-system
+// mode, and the memories and peripherals behind them are modelled a bus
+// access at a time at the level of their registers rather than cycle by
+// cycle.
+//
+// step() is a clock cycle, as on Lemonsoc. Without timing every instruction
+// takes one; with it, each is charged its timing.vh budget plus the bus
+// waits it would see on the RTL (see lemonsoc_tlm.cpp), so that mtime, mcycle
+// and the timer interrupt follow the RTL's pace. Either way, left out are:
+//  - contention between the harts and the DMA engine, and the store buffer.
+//    Bus errors on stores trap straight away rather than imprecisely.
+//  - DMA transfers taking time: they finish the moment they're started
+//  - the button synchronizers and the UART's serial side. Received bytes
+//    are in the RX FIFO as soon as they're sent, and transmitted ones leave
+//    the TX FIFO as soon as they're written.
+//  - SoC parameters: it models the default configuration
+class LemonsocTlm {
+ public:
+  explicit LemonsocTlm(bool timing);
+  ~LemonsocTlm();
+  bool load_firmware(std::string path);
+  void reset();
+  bool step();
+  bool run(int cycles);
+  void set_fast_skip(bool enable);
+  int skip_idle(int max_cycles);
+  bool is_sleeping();
+  void set_btns(bool btn1, bool btn2, bool btn3);
+  int get_led(int led);
+  bool is_done();
+  std::array<int, 5> get_leds();
+  void set_reg(uint8_t reg, uint32_t data);
+  void write_imem(uint32_t addr, uint32_t data);
+  bool load_spram(std::string path);
+  void write_spram(uint32_t addr, uint32_t data);
+  uint32_t read_spram(uint32_t addr);
+  // ROM, RAM and SPRAM, in place, each from the start of its region
+  uint32_t* get_rom();
+  uint32_t* get_ram();
+  uint32_t* get_spram();
+  bool load_flash(std::string path, uint32_t offset);
+  void write_flash(uint32_t addr, uint32_t data);
+  uint32_t get_icache_hits();
+  uint32_t get_icache_misses();
+  void set_uart_output(int fd);
+  std::string get_uart_output();
+  void uart_send(std::string data);
+  bool load_uart_input(std::string path);
+  uint64_t get_mtime();
+  uint32_t get_mip();
+  bool run_till_pc(uint32_t pc);
+  uint32_t get_pc();
+  uint32_t get_reg(uint8_t reg);
+
+ private:
+  // A hart's port onto the bus
+  class HartBus : public Iss::Bus {
+   public:
+    HartBus(LemonsocTlm* soc, int hart) : soc(soc), hart(hart), instr(0) {}
+    bool fetch(uint32_t addr, uint32_t* instr) override;
+    bool load(uint32_t addr, int size, uint32_t* data) override;
+    bool store(uint32_t addr, int size, uint32_t data) override;
+    bool load_reserved(uint32_t addr, uint32_t* data) override;
+    bool store_conditional(uint32_t addr, uint32_t data, bool* stored) override;
+    uint32_t last_instr() const { return instr; }
+
+   private:
+    LemonsocTlm* soc;
+    int hart;
+    uint32_t instr;
+  };
+
+  struct Hart {
+    Hart(LemonsocTlm* soc, int hart);
+    Iss iss;
+    HartBus bus;
+    bool started;
+    uint64_t busy_until;  // cycle the next instruction can start in
+  };
+
+  LemonsocTlm(const LemonsocTlm&) = delete;
+  LemonsocTlm& operator=(const LemonsocTlm&) = delete;
+
+  uint64_t next_free();
+  uint64_t execute(int hart);
+  uint64_t instr_cycles(uint32_t instr, Iss::Result result);
+  uint32_t hart_mip(int hart);
+  void advance(uint64_t cycles);
+  bool bus_read(uint32_t addr, uint32_t* data);
+  bool bus_write(uint32_t addr, uint32_t data, uint8_t mask);
+  void end_reservations(uint32_t addr);
+  void icache_lookup(uint32_t addr);
+  bool gpio_read(uint32_t offset, uint32_t* data);
+  bool gpio_write(uint32_t offset, uint32_t data, uint8_t mask);
+  bool timer_read(uint32_t offset, uint32_t* data);
+  bool timer_write(uint32_t offset, uint32_t data, uint8_t mask);
+  void update_irq_sources();
+  bool irq_read(uint32_t offset, uint32_t* data);
+  bool irq_write(uint32_t offset, uint32_t data, uint8_t mask);
+  bool uart_irq();
+  bool uart_read(uint32_t offset, uint32_t* data);
+  bool uart_write(uint32_t offset, uint32_t data, uint8_t mask);
+  bool dma_read(uint32_t offset, uint32_t* data);
+  bool dma_write(uint32_t offset, uint32_t data);
+  void dma_transfer();
+
+  bool timing;
+  bool fast_skip;
+  uint64_t cycle;
+  uint64_t stall;  // extra cycles the bus has taken for this instruction
+  Hart* harts[TLM_NUM_HARTS];
+
+  std::vector<uint32_t> mem;  // ROM and RAM, from 0
+  std::vector<uint32_t> spram;
+  SpiFlash flash;
+  // Reservations for LR/SC, in RAM and SPRAM
+  bool resv_valid[TLM_NUM_HARTS];
+  uint32_t resv_addr[TLM_NUM_HARTS];
+
+  // Tags of the flash lines the instruction cache holds
+  std::vector<uint32_t> icache_tags;
+  std::vector<bool> icache_valid;
+  uint32_t icache_hits;
+  uint32_t icache_misses;
+
+  uint8_t user_leds;
+  bool done_led;
+  bool exception_led;
+  uint8_t btns;
+
+  uint64_t mtime;
+  uint64_t mtimecmp;
+  uint32_t prescaler;
+  bool msip[TLM_NUM_HARTS];
+
+  uint8_t irq_enable, irq_rise, irq_fall, irq_pending, irq_sources;
+
+  bool uart_tx_ie, uart_rx_ie;
+  uint8_t uart_tx_thresh, uart_rx_thresh;
+  uint16_t uart_div;
+  int uart_fd;
+  std::string uart_output;
+  std::deque<uint8_t> uart_input;  // the RX FIFO is its first bytes
+
+  uint32_t dma_src, dma_dst, dma_len, dma_fill;
+  bool dma_fill_mode, dma_src_fixed, dma_dst_fixed, dma_ie;
+  bool dma_busy, dma_done, dma_error;
+};
+
+#endif
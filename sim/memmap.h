@@ -0,0 +1,22 @@
+#ifndef MEMMAP_H
+#define MEMMAP_H
+
+// Must match rtl/soc/memmap.vh. ROM runs from 0 up to RAM_BASE, and RAM up
+// to GPIO_BASE.
+#define RAM_BASE 0x1000
+#define GPIO_BASE 0x3000
+#define GPIO_SIZE 0xC
+#define TIMER_BASE 0x3010
+#define TIMER_SIZE 0x20
+#define TIMER_TICKS_PER_MS 100  // simulation value, see rtl/soc/timer.v
+#define IRQ_BASE 0x3030
+#define IRQ_SIZE 0x14
+#define UART_BASE 0x3050
+#define UART_SIZE 0x18
+#define DMA_BASE 0x3070
+#define DMA_SIZE 0x18
+#define SPRAM_BASE 0x10000
+#define SPRAM_SIZE 0x20000  // bytes
+#define FLASH_BASE 0x1000000
+
+#endif
@@ -0,0 +1,112 @@
+#include <stdint.h>
+#include <string>
+
+#include <pybind11/numpy.h>
+#include <pybind11/pybind11.h>
+
+#include "lemoncore.h"
+
+// Python bindings for the core harness, so tooling can run many simulations
+// in one process rather than starting lemonsim for each. Build with
+// make pybind and put obj_dir on PYTHONPATH:
+//
+//   import pylemoncore
+//   core = pylemoncore.Lemoncore()
+//   core.write_mem(0, image)          # numpy uint32 words, ROM then RAM
+//   core.run(100000)
+//   print(core.get_reg(10), core.ram[0x100 // 4])
+//
+// The mem, rom and ram properties are numpy views straight onto the memory
+// the harness serves, not copies, so they show what the core has stored as
+// soon as it has. They're read-only: writing in place would go around the
+// copy of memory that checkpoints hash, so writes go through write_mem,
+// write_imem or write_ram instead. The views keep the Lemoncore they came
+// from alive.
+
+namespace py = pybind11;
+
+static py::array_t<uint32_t> words(uint32_t* data, size_t count, py::handle owner) {
+  py::array_t<uint32_t> view(static_cast<py::ssize_t>(count), data, owner);
+  view.attr("setflags")(py::arg("write") = false);
+  return view;
+}
+
+PYBIND11_MODULE(pylemoncore, m) {
+  m.attr("ROM_SIZE") = ROM_SIZE;
+  m.attr("RAM_SIZE") = RAM_SIZE;
+
+  py::class_<Lemoncore>(m, "Lemoncore")
+      .def(py::init<bool, bool, std::string>(), py::arg("verbose") = false,
+           py::arg("trace") = false, py::arg("vcd_path") = "lemoncore.vcd")
+      .def("load_firmware", &Lemoncore::load_firmware)
+      .def("reset", &Lemoncore::reset)
+      .def("step", &Lemoncore::step)
+      .def("run", &Lemoncore::run)
+      .def("run_till_pc", &Lemoncore::run_till_pc)
+      .def("set_reg", &Lemoncore::set_reg)
+      .def("get_reg", &Lemoncore::get_reg)
+      .def("get_regs", [](Lemoncore& core) {
+        py::array_t<uint32_t> regs(32);
+        auto r = regs.mutable_unchecked<1>();
+        for (int i = 0; i < 32; i++)
+          r(i) = core.get_reg(i);
+        return regs;
+      })
+      .def("get_shadow_reg", &Lemoncore::get_shadow_reg)
+      .def("get_pc", &Lemoncore::get_pc)
+      .def("get_mcause", &Lemoncore::get_mcause)
+      .def("get_mstatus", &Lemoncore::get_mstatus)
+      .def("set_mstatus", &Lemoncore::set_mstatus)
+      .def("get_mie", &Lemoncore::get_mie)
+      .def("set_mie", &Lemoncore::set_mie)
+      .def("get_mip", &Lemoncore::get_mip)
+      .def("get_mtval", &Lemoncore::get_mtval)
+      .def("get_mepc", &Lemoncore::get_mepc)
+      .def("get_mscratch", &Lemoncore::get_mscratch)
+      .def("is_sleeping", &Lemoncore::is_sleeping)
+      .def("write_imem", &Lemoncore::write_imem)
+      .def("write_ram", &Lemoncore::write_ram)
+      .def("read_ram", &Lemoncore::read_ram)
+      // Words from addr on, across ROM and RAM as in mem
+      .def("write_mem", [](Lemoncore& core, uint32_t addr,
+                           py::array_t<uint32_t, py::array::c_style | py::array::forcecast> data) {
+        auto d = data.unchecked<1>();
+        if (addr % 4 != 0 || addr + 4 * (uint64_t) d.shape(0) > ROM_SIZE + RAM_SIZE)
+          throw py::index_error("write_mem outside ROM and RAM");
+        for (py::ssize_t i = 0; i < d.shape(0); i++) {
+          uint32_t a = addr + 4 * i;
+          if (a < ROM_SIZE)
+            core.write_imem(a, d(i));
+          else
+            core.write_ram(a - ROM_SIZE, d(i));
+        }
+      })
+      .def("set_irq_timer", &Lemoncore::set_irq_timer)
+      .def("set_irq_software", &Lemoncore::set_irq_software)
+      .def("set_irq_external", &Lemoncore::set_irq_external)
+      // handler(custom, funct3, funct7, rs1, rs2) returns rd, or None for an
+      // error response
+      .def("set_coprocessor", [](Lemoncore& core, py::function handler, int latency) {
+        core.set_coprocessor([handler](uint8_t custom, uint8_t funct3, uint8_t funct7,
+                                       uint32_t rs1, uint32_t rs2, uint32_t* rd) {
+          py::object result = handler(custom, funct3, funct7, rs1, rs2);
+          if (result.is_none())
+            return false;
+          *rd = result.cast<uint32_t>();
+          return true;
+        }, latency);
+      })
+      .def("set_write_latency", &Lemoncore::set_write_latency)
+      .def("set_write_error", &Lemoncore::set_write_error)
+      .def("clear_reservation", &Lemoncore::clear_reservation)
+      .def("get_retired", &Lemoncore::get_retired)
+      .def_property_readonly("mem", [](py::object self) {
+        return words(self.cast<Lemoncore&>().get_mem(), (ROM_SIZE + RAM_SIZE) / 4, self);
+      })
+      .def_property_readonly("rom", [](py::object self) {
+        return words(self.cast<Lemoncore&>().get_mem(), ROM_SIZE / 4, self);
+      })
+      .def_property_readonly("ram", [](py::object self) {
+        return words(self.cast<Lemoncore&>().get_mem() + ROM_SIZE / 4, RAM_SIZE / 4, self);
+      });
+}
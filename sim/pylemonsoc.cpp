@@ -0,0 +1,85 @@
+#include <stdint.h>
+#include <string>
+
+#include <pybind11/numpy.h>
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+
+#include "lemonsoc.h"
+#include "lemonsoc_tlm.h"
+
+// Python bindings for the SoC, the RTL as Lemonsoc and the transaction-level
+// model as LemonsocTlm, with the same methods on each. Build with make pybind
+// and put obj_dir on PYTHONPATH:
+//
+//   import pylemonsoc
+//   soc = pylemonsoc.LemonsocTlm(timing=True)
+//   soc.load_firmware("sw/hello.sim.mem")
+//   soc.spram[:4] = [1, 2, 3, 4]
+//   soc.run(1000000)
+//
+// The rom, ram and spram properties are numpy views onto the memories
+// themselves, for the RTL its Verilated arrays, so writes to them are what the
+// harts read next. They keep the SoC they came from alive.
+
+namespace py = pybind11;
+
+static py::array_t<uint32_t> words(uint32_t* data, size_t count, py::handle owner) {
+  return py::array_t<uint32_t>(static_cast<py::ssize_t>(count), data, owner);
+}
+
+template <class Soc>
+static void bind_soc(py::class_<Soc>& soc) {
+  soc.def("load_firmware", &Soc::load_firmware)
+      .def("reset", &Soc::reset)
+      .def("step", &Soc::step)
+      .def("run", &Soc::run)
+      .def("set_fast_skip", &Soc::set_fast_skip)
+      .def("skip_idle", &Soc::skip_idle)
+      .def("is_sleeping", &Soc::is_sleeping)
+      .def("set_btns", &Soc::set_btns)
+      .def("get_led", &Soc::get_led)
+      .def("is_done", &Soc::is_done)
+      .def("get_leds", &Soc::get_leds)
+      .def("set_reg", &Soc::set_reg)
+      .def("get_reg", &Soc::get_reg)
+      .def("get_pc", &Soc::get_pc)
+      .def("run_till_pc", &Soc::run_till_pc)
+      .def("write_imem", &Soc::write_imem)
+      .def("load_spram", &Soc::load_spram)
+      .def("write_spram", &Soc::write_spram)
+      .def("read_spram", &Soc::read_spram)
+      .def("load_flash", &Soc::load_flash)
+      .def("write_flash", &Soc::write_flash)
+      .def("get_icache_hits", &Soc::get_icache_hits)
+      .def("get_icache_misses", &Soc::get_icache_misses)
+      .def("get_uart_output", [](Soc& s) { return py::bytes(s.get_uart_output()); })
+      .def("uart_send", [](Soc& s, py::bytes data) { s.uart_send(std::string(data)); })
+      .def("load_uart_input", &Soc::load_uart_input)
+      .def("get_mtime", &Soc::get_mtime)
+      .def("get_mip", &Soc::get_mip)
+      .def_property_readonly("rom", [](py::object self) {
+        return words(self.cast<Soc&>().get_rom(), RAM_BASE / 4, self);
+      })
+      .def_property_readonly("ram", [](py::object self) {
+        return words(self.cast<Soc&>().get_ram(), (GPIO_BASE - RAM_BASE) / 4, self);
+      })
+      .def_property_readonly("spram", [](py::object self) {
+        return words(self.cast<Soc&>().get_spram(), SPRAM_SIZE / 4, self);
+      });
+}
+
+PYBIND11_MODULE(pylemonsoc, m) {
+  m.attr("RAM_BASE") = RAM_BASE;
+  m.attr("SPRAM_BASE") = SPRAM_BASE;
+  m.attr("FLASH_BASE") = FLASH_BASE;
+
+  py::class_<Lemonsoc> rtl(m, "Lemonsoc");
+  rtl.def(py::init<bool, bool, std::string>(), py::arg("verbose") = false,
+          py::arg("trace") = false, py::arg("vcd_path") = "lemonsoc.vcd");
+  bind_soc(rtl);
+
+  py::class_<LemonsocTlm> tlm(m, "LemonsocTlm");
+  tlm.def(py::init<bool>(), py::arg("timing") = false);
+  bind_soc(tlm);
+}
@@ -0,0 +1,193 @@
+#include "retire_trace.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+// Encoded bytes are handed to fwrite in chunks of about this size
+#define OUT_CHUNK (64 * 1024)
+
+static uint32_t zigzag(int32_t v) {
+  return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static int32_t unzigzag(uint32_t v) {
+  return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+static void put_varint(std::vector<uint8_t>& out, uint32_t v) {
+  while (v >= 0x80) {
+    out.push_back((v & 0x7F) | 0x80);
+    v >>= 7;
+  }
+  out.push_back(v);
+}
+
+RetireTraceWriter::RetireTraceWriter()
+    : ring(RING_SIZE), ring_head(0), ring_tail(0), stopping(false), file(nullptr),
+      last_pc(0), last_addr(0) {
+}
+
+RetireTraceWriter::~RetireTraceWriter() {
+  close();
+}
+
+bool RetireTraceWriter::open(std::string path) {
+  file = fopen(path.c_str(), "wb");
+  if (!file)
+    return false;
+  fwrite(RETIRE_TRACE_MAGIC, 1, strlen(RETIRE_TRACE_MAGIC), file);
+  out.reserve(2 * OUT_CHUNK);
+  writer = std::thread(&RetireTraceWriter::run, this);
+  return true;
+}
+
+void RetireTraceWriter::close() {
+  if (!file)
+    return;
+  stopping.store(true, std::memory_order_release);
+  writer.join();
+  fclose(file);
+  file = nullptr;
+}
+
+void RetireTraceWriter::run() {
+  while (true) {
+    // Read stopping first, so a record pushed before it was set is seen below
+    bool stop = stopping.load(std::memory_order_acquire);
+    size_t head = ring_head.load(std::memory_order_acquire);
+    size_t tail = ring_tail.load(std::memory_order_relaxed);
+
+    if (tail == head) {
+      if (stop)
+        break;
+      std::this_thread::sleep_for(std::chrono::microseconds(200));
+      continue;
+    }
+
+    for (; tail != head; tail++) {
+      encode(ring[tail % RING_SIZE]);
+      if (out.size() >= OUT_CHUNK) {
+        // Let the producer have the slots back before the write blocks
+        ring_tail.store(tail + 1, std::memory_order_release);
+        fwrite(out.data(), 1, out.size(), file);
+        out.clear();
+      }
+    }
+    ring_tail.store(tail, std::memory_order_release);
+  }
+
+  fwrite(out.data(), 1, out.size(), file);
+  out.clear();
+}
+
+void RetireTraceWriter::encode(const RetireRecord& r) {
+  uint8_t flags = r.flags & ~RETIRE_SEQUENTIAL;
+  if (r.pc == last_pc + 4)
+    flags |= RETIRE_SEQUENTIAL;
+  out.push_back(flags);
+
+  if (!(flags & RETIRE_SEQUENTIAL))
+    put_varint(out, zigzag(r.pc - last_pc));
+  last_pc = r.pc;
+
+  if (!(flags & RETIRE_NO_INSTR)) {
+    for (int i = 0; i < 4; i++)
+      out.push_back(r.instr >> (8 * i));
+  }
+  if (flags & RETIRE_RD) {
+    out.push_back(r.rd);
+    put_varint(out, r.rd_value);
+  }
+  if (flags & (RETIRE_LOAD | RETIRE_STORE)) {
+    put_varint(out, zigzag(r.mem_addr - last_addr));
+    last_addr = r.mem_addr;
+  }
+  if (flags & RETIRE_LOAD)
+    put_varint(out, r.load_data);
+  if (flags & RETIRE_STORE) {
+    out.push_back(r.store_mask);
+    put_varint(out, r.store_data);
+  }
+  if (flags & RETIRE_TRAP)
+    put_varint(out, r.cause);
+}
+
+RetireTraceReader::RetireTraceReader() : file(nullptr), last_pc(0), last_addr(0) {
+}
+
+RetireTraceReader::~RetireTraceReader() {
+  if (file)
+    fclose(file);
+}
+
+bool RetireTraceReader::open(std::string path) {
+  file = fopen(path.c_str(), "rb");
+  if (!file)
+    return false;
+  char magic[8];
+  return fread(magic, 1, sizeof(magic), file) == sizeof(magic) &&
+         memcmp(magic, RETIRE_TRACE_MAGIC, sizeof(magic)) == 0;
+}
+
+bool RetireTraceReader::read_varint(uint32_t* value) {
+  *value = 0;
+  for (int shift = 0; shift < 35; shift += 7) {
+    int c = getc(file);
+    if (c == EOF)
+      return false;
+    *value |= (uint32_t)(c & 0x7F) << shift;
+    if (!(c & 0x80))
+      return true;
+  }
+  return false;
+}
+
+bool RetireTraceReader::next(RetireRecord* r) {
+  memset(r, 0, sizeof(*r));
+  int flags = getc(file);
+  if (flags == EOF)
+    return false;
+  r->flags = flags;
+
+  uint32_t v;
+  if (r->flags & RETIRE_SEQUENTIAL) {
+    r->pc = last_pc + 4;
+  } else {
+    if (!read_varint(&v))
+      return false;
+    r->pc = last_pc + unzigzag(v);
+  }
+  last_pc = r->pc;
+
+  if (!(r->flags & RETIRE_NO_INSTR)) {
+    uint8_t b[4];
+    if (fread(b, 1, 4, file) != 4)
+      return false;
+    r->instr = b[0] | b[1] << 8 | b[2] << 16 | (uint32_t)b[3] << 24;
+  }
+  if (r->flags & RETIRE_RD) {
+    int rd = getc(file);
+    if (rd == EOF || !read_varint(&r->rd_value))
+      return false;
+    r->rd = rd;
+  }
+  if (r->flags & (RETIRE_LOAD | RETIRE_STORE)) {
+    if (!read_varint(&v))
+      return false;
+    r->mem_addr = last_addr + unzigzag(v);
+    last_addr = r->mem_addr;
+  }
+  if ((r->flags & RETIRE_LOAD) && !read_varint(&r->load_data))
+    return false;
+  if (r->flags & RETIRE_STORE) {
+    int mask = getc(file);
+    if (mask == EOF || !read_varint(&r->store_data))
+      return false;
+    r->store_mask = mask;
+  }
+  if ((r->flags & RETIRE_TRAP) && !read_varint(&r->cause))
+    return false;
+  return true;
+}
@@ -0,0 +1,110 @@
+#ifndef RETIRE_TRACE_H
+#define RETIRE_TRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Binary trace of retired instructions and traps. The simulation thread only
+// copies a fixed-size record into a single-producer, single-consumer ring,
+// and a background thread encodes and writes them, so it doesn't wait on the
+// encoding or the file unless the writer falls a whole ring behind.
+//
+// File format: the 8-byte magic "LCTRACE1", then one entry per record:
+//
+//   flags          1 byte, RETIRE_* below
+//   pc             zigzag varint of the difference from the last pc, left
+//                  out with RETIRE_SEQUENTIAL (pc is the last one plus 4)
+//   instr          4 bytes little-endian, left out with RETIRE_NO_INSTR
+//   rd, value      1 byte and a varint, with RETIRE_RD
+//   addr           zigzag varint of the difference from the last memory
+//                  address, with RETIRE_LOAD or RETIRE_STORE
+//   load data      varint, with RETIRE_LOAD
+//   store data     mask byte and a varint, with RETIRE_STORE
+//   cause          varint of mcause, with RETIRE_TRAP
+//
+// The first pc and memory address are relative to 0.
+
+#define RETIRE_TRACE_MAGIC "LCTRACE1"
+
+enum {
+  RETIRE_RD = 1 << 0,
+  RETIRE_LOAD = 1 << 1,
+  RETIRE_STORE = 1 << 2,
+  RETIRE_TRAP = 1 << 3,
+  RETIRE_SEQUENTIAL = 1 << 4,
+  // A trap taken before the instruction at pc was fetched, an interrupt or a
+  // store fault
+  RETIRE_NO_INSTR = 1 << 5,
+};
+
+struct RetireRecord {
+  uint8_t flags;  // RETIRE_SEQUENTIAL is worked out by the writer
+  uint8_t rd;
+  uint8_t store_mask;
+  uint32_t pc;
+  uint32_t instr;
+  uint32_t rd_value;
+  uint32_t mem_addr;
+  uint32_t load_data;
+  uint32_t store_data;
+  uint32_t cause;
+};
+
+class RetireTraceWriter {
+ public:
+  RetireTraceWriter();
+  ~RetireTraceWriter();
+  bool open(std::string path);
+  // Waits for everything recorded to be written, then closes the file
+  void close();
+
+  // Called from the simulation thread. Waits for room if the writer has
+  // fallen a whole ring behind, so nothing is ever dropped.
+  void record(const RetireRecord& r) {
+    size_t head = ring_head.load(std::memory_order_relaxed);
+    while (head - ring_tail.load(std::memory_order_acquire) == RING_SIZE)
+      std::this_thread::yield();
+    ring[head % RING_SIZE] = r;
+    ring_head.store(head + 1, std::memory_order_release);
+  }
+
+ private:
+  static const size_t RING_SIZE = 1 << 16;
+
+  void run();
+  void encode(const RetireRecord& r);
+
+  std::vector<RetireRecord> ring;
+  std::atomic<size_t> ring_head;
+  std::atomic<size_t> ring_tail;
+  std::atomic<bool> stopping;
+  std::thread writer;
+  FILE* file;
+  std::vector<uint8_t> out;
+  uint32_t last_pc;
+  uint32_t last_addr;
+};
+
+class RetireTraceReader {
+ public:
+  RetireTraceReader();
+  ~RetireTraceReader();
+  // Fails if the file can't be read or isn't a trace
+  bool open(std::string path);
+  // Returns false at the end of the trace, or if it's cut short
+  bool next(RetireRecord* r);
+
+ private:
+  bool read_varint(uint32_t* value);
+
+  FILE* file;
+  uint32_t last_pc;
+  uint32_t last_addr;
+};
+
+#endif
@@ -39,6 +39,16 @@ uint32_t type_r(uint8_t rd, uint8_t func, uint8_t rs1, uint8_t rs2, uint8_t op_b
     MASK(func, 3) << 12 | MASK(rd, 5) << 7 | 0b0110011;
 }
 
+uint32_t type_r7(uint8_t rd, uint8_t func, uint8_t rs1, uint8_t rs2, uint8_t funct7) {
+  return MASK(funct7, 7) << 25 | MASK(rs2, 5) << 20 | MASK(rs1, 5) << 15 |
+    MASK(func, 3) << 12 | MASK(rd, 5) << 7 | 0b0110011;
+}
+
+uint32_t type_amo(uint8_t rd, uint8_t rs1, uint8_t rs2, uint8_t funct5) {
+  return MASK(funct5, 5) << 27 | MASK(rs2, 5) << 20 | MASK(rs1, 5) << 15 |
+    0b010 << 12 | MASK(rd, 5) << 7 | 0b0101111;
+}
+
 uint32_t rv_lui(uint8_t rd, int32_t imm) {
   return type_u(0b0110111, rd, imm);
 }
@@ -250,7 +260,7 @@ uint32_t rv_srli() {
 }
 
 uint32_t rv_srai(uint8_t rd, uint8_t rs1, int32_t imm) {
-  return type_i(0b0010011, rd, 0b101, rs1, (1 << 30) | MASK(imm, 5));
+  return type_i(0b0010011, rd, 0b101, rs1, 0x400 | MASK(imm, 5));
 }
 
 uint32_t rv_srai() {
@@ -417,3 +427,277 @@ uint32_t rv_mret() {
 uint32_t rv_wfi() {
   return 0b0001000 << 25 | 0b00101 << 20 | 0b1110011;
 }
+
+uint32_t rv_custom0(uint8_t rd, uint8_t rs1, uint8_t rs2, uint8_t funct3, uint8_t funct7) {
+  return MASK(funct7, 7) << 25 | MASK(rs2, 5) << 20 | MASK(rs1, 5) << 15 |
+    MASK(funct3, 3) << 12 | MASK(rd, 5) << 7 | 0b0001011;
+}
+
+uint32_t rv_custom0() {
+  return rv_custom0(0, 0, 0, 0, 0);
+}
+
+uint32_t rv_custom1(uint8_t rd, uint8_t rs1, uint8_t rs2, uint8_t funct3, uint8_t funct7) {
+  return MASK(funct7, 7) << 25 | MASK(rs2, 5) << 20 | MASK(rs1, 5) << 15 |
+    MASK(funct3, 3) << 12 | MASK(rd, 5) << 7 | 0b0101011;
+}
+
+uint32_t rv_custom1() {
+  return rv_custom1(0, 0, 0, 0, 0);
+}
+
+uint32_t rv_sh1add(uint8_t rd, uint8_t rs1, uint8_t rs2) {
+  return type_r7(rd, 0b010, rs1, rs2, 0b0010000);
+}
+
+uint32_t rv_sh1add() {
+  return rv_sh1add(0, 0, 0);
+}
+
+uint32_t rv_sh2add(uint8_t rd, uint8_t rs1, uint8_t rs2) {
+  return type_r7(rd, 0b100, rs1, rs2, 0b0010000);
+}
+
+uint32_t rv_sh2add() {
+  return rv_sh2add(0, 0, 0);
+}
+
+uint32_t rv_sh3add(uint8_t rd, uint8_t rs1, uint8_t rs2) {
+  return type_r7(rd, 0b110, rs1, rs2, 0b0010000);
+}
+
+uint32_t rv_sh3add() {
+  return rv_sh3add(0, 0, 0);
+}
+
+uint32_t rv_andn(uint8_t rd, uint8_t rs1, uint8_t rs2) {
+  return type_r7(rd, 0b111, rs1, rs2, 0b0100000);
+}
+
+uint32_t rv_andn() {
+  return rv_andn(0, 0, 0);
+}
+
+uint32_t rv_orn(uint8_t rd, uint8_t rs1, uint8_t rs2) {
+  return type_r7(rd, 0b110, rs1, rs2, 0b0100000);
+}
+
+uint32_t rv_orn() {
+  return rv_orn(0, 0, 0);
+}
+
+uint32_t rv_xnor(uint8_t rd, uint8_t rs1, uint8_t rs2) {
+  return type_r7(rd, 0b100, rs1, rs2, 0b0100000);
+}
+
+uint32_t rv_xnor() {
+  return rv_xnor(0, 0, 0);
+}
+
+uint32_t rv_min(uint8_t rd, uint8_t rs1, uint8_t rs2) {
+  return type_r7(rd, 0b100, rs1, rs2, 0b0000101);
+}
+
+uint32_t rv_min() {
+  return rv_min(0, 0, 0);
+}
+
+uint32_t rv_minu(uint8_t rd, uint8_t rs1, uint8_t rs2) {
+  return type_r7(rd, 0b101, rs1, rs2, 0b0000101);
+}
+
+uint32_t rv_minu() {
+  return rv_minu(0, 0, 0);
+}
+
+uint32_t rv_max(uint8_t rd, uint8_t rs1, uint8_t rs2) {
+  return type_r7(rd, 0b110, rs1, rs2, 0b0000101);
+}
+
+uint32_t rv_max() {
+  return rv_max(0, 0, 0);
+}
+
+uint32_t rv_maxu(uint8_t rd, uint8_t rs1, uint8_t rs2) {
+  return type_r7(rd, 0b111, rs1, rs2, 0b0000101);
+}
+
+uint32_t rv_maxu() {
+  return rv_maxu(0, 0, 0);
+}
+
+uint32_t rv_rol(uint8_t rd, uint8_t rs1, uint8_t rs2) {
+  return type_r7(rd, 0b001, rs1, rs2, 0b0110000);
+}
+
+uint32_t rv_rol() {
+  return rv_rol(0, 0, 0);
+}
+
+uint32_t rv_ror(uint8_t rd, uint8_t rs1, uint8_t rs2) {
+  return type_r7(rd, 0b101, rs1, rs2, 0b0110000);
+}
+
+uint32_t rv_ror() {
+  return rv_ror(0, 0, 0);
+}
+
+uint32_t rv_rori(uint8_t rd, uint8_t rs1, int32_t imm) {
+  return type_i(0b0010011, rd, 0b101, rs1, 0x600 | MASK(imm, 5));
+}
+
+uint32_t rv_rori() {
+  return rv_rori(0, 0, 0);
+}
+
+uint32_t rv_clz(uint8_t rd, uint8_t rs1) {
+  return type_i(0b0010011, rd, 0b001, rs1, 0x600);
+}
+
+uint32_t rv_clz() {
+  return rv_clz(0, 0);
+}
+
+uint32_t rv_ctz(uint8_t rd, uint8_t rs1) {
+  return type_i(0b0010011, rd, 0b001, rs1, 0x601);
+}
+
+uint32_t rv_ctz() {
+  return rv_ctz(0, 0);
+}
+
+uint32_t rv_cpop(uint8_t rd, uint8_t rs1) {
+  return type_i(0b0010011, rd, 0b001, rs1, 0x602);
+}
+
+uint32_t rv_cpop() {
+  return rv_cpop(0, 0);
+}
+
+uint32_t rv_sext_b(uint8_t rd, uint8_t rs1) {
+  return type_i(0b0010011, rd, 0b001, rs1, 0x604);
+}
+
+uint32_t rv_sext_b() {
+  return rv_sext_b(0, 0);
+}
+
+uint32_t rv_sext_h(uint8_t rd, uint8_t rs1) {
+  return type_i(0b0010011, rd, 0b001, rs1, 0x605);
+}
+
+uint32_t rv_sext_h() {
+  return rv_sext_h(0, 0);
+}
+
+uint32_t rv_rev8(uint8_t rd, uint8_t rs1) {
+  return type_i(0b0010011, rd, 0b101, rs1, 0x698);
+}
+
+uint32_t rv_rev8() {
+  return rv_rev8(0, 0);
+}
+
+uint32_t rv_orc_b(uint8_t rd, uint8_t rs1) {
+  return type_i(0b0010011, rd, 0b101, rs1, 0x287);
+}
+
+uint32_t rv_orc_b() {
+  return rv_orc_b(0, 0);
+}
+
+uint32_t rv_zext_h(uint8_t rd, uint8_t rs1) {
+  return type_r7(rd, 0b100, rs1, 0, 0b0000100);
+}
+
+uint32_t rv_zext_h() {
+  return rv_zext_h(0, 0);
+}
+
+uint32_t rv_lr_w(uint8_t rd, uint8_t rs1) {
+  return type_amo(rd, rs1, 0, 0b00010);
+}
+
+uint32_t rv_lr_w() {
+  return rv_lr_w(0, 0);
+}
+
+uint32_t rv_sc_w(uint8_t rd, uint8_t rs1, uint8_t rs2) {
+  return type_amo(rd, rs1, rs2, 0b00011);
+}
+
+uint32_t rv_sc_w() {
+  return rv_sc_w(0, 0, 0);
+}
+
+uint32_t rv_amoswap_w(uint8_t rd, uint8_t rs1, uint8_t rs2) {
+  return type_amo(rd, rs1, rs2, 0b00001);
+}
+
+uint32_t rv_amoswap_w() {
+  return rv_amoswap_w(0, 0, 0);
+}
+
+uint32_t rv_amoadd_w(uint8_t rd, uint8_t rs1, uint8_t rs2) {
+  return type_amo(rd, rs1, rs2, 0b00000);
+}
+
+uint32_t rv_amoadd_w() {
+  return rv_amoadd_w(0, 0, 0);
+}
+
+uint32_t rv_amoxor_w(uint8_t rd, uint8_t rs1, uint8_t rs2) {
+  return type_amo(rd, rs1, rs2, 0b00100);
+}
+
+uint32_t rv_amoxor_w() {
+  return rv_amoxor_w(0, 0, 0);
+}
+
+uint32_t rv_amoand_w(uint8_t rd, uint8_t rs1, uint8_t rs2) {
+  return type_amo(rd, rs1, rs2, 0b01100);
+}
+
+uint32_t rv_amoand_w() {
+  return rv_amoand_w(0, 0, 0);
+}
+
+uint32_t rv_amoor_w(uint8_t rd, uint8_t rs1, uint8_t rs2) {
+  return type_amo(rd, rs1, rs2, 0b01000);
+}
+
+uint32_t rv_amoor_w() {
+  return rv_amoor_w(0, 0, 0);
+}
+
+uint32_t rv_amomin_w(uint8_t rd, uint8_t rs1, uint8_t rs2) {
+  return type_amo(rd, rs1, rs2, 0b10000);
+}
+
+uint32_t rv_amomin_w() {
+  return rv_amomin_w(0, 0, 0);
+}
+
+uint32_t rv_amomax_w(uint8_t rd, uint8_t rs1, uint8_t rs2) {
+  return type_amo(rd, rs1, rs2, 0b10100);
+}
+
+uint32_t rv_amomax_w() {
+  return rv_amomax_w(0, 0, 0);
+}
+
+uint32_t rv_amominu_w(uint8_t rd, uint8_t rs1, uint8_t rs2) {
+  return type_amo(rd, rs1, rs2, 0b11000);
+}
+
+uint32_t rv_amominu_w() {
+  return rv_amominu_w(0, 0, 0);
+}
+
+uint32_t rv_amomaxu_w(uint8_t rd, uint8_t rs1, uint8_t rs2) {
+  return type_amo(rd, rs1, rs2, 0b11100);
+}
+
+uint32_t rv_amomaxu_w() {
+  return rv_amomaxu_w(0, 0, 0);
+}
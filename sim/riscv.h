@@ -3,12 +3,22 @@
 
 #include <stdint.h>
 
+#define RV_CSR_MSTATUS		0x300
 #define RV_CSR_MISA		0x301
+#define RV_CSR_MIE		0x304
+#define RV_CSR_MTVEC		0x305
+#define RV_CSR_MHPMEVENT31	0x33F
 #define RV_CSR_MSCRATCH		0x340
+#define RV_CSR_MEPC		0x341
+#define RV_CSR_MHARTID		0xF14
+#define RV_CSR_MSHADOW		0x7C0
+#define RV_CSR_MINSTRET		0xB02
+#define RV_CSR_MHPMCOUNTER3	0xB03
 #define RV_CSR_CYCLE 0xC00
 #define RV_CSR_INSTRET 0xC02
 #define RV_CSR_CYCLEH 0xC80
 #define RV_CSR_INSTRETH 0xC82
+#define RV_CSR_HPMCOUNTER3 0xC03
 
 uint32_t rv_lui(uint8_t rd, int32_t imm);
 uint32_t rv_lui();
@@ -105,4 +115,78 @@ uint32_t rv_csrrci();
 uint32_t rv_mret();
 uint32_t rv_wfi();
 
+// Coprocessor (custom-0/custom-1 R-type)
+uint32_t rv_custom0(uint8_t rd, uint8_t rs1, uint8_t rs2, uint8_t funct3, uint8_t funct7);
+uint32_t rv_custom0();
+uint32_t rv_custom1(uint8_t rd, uint8_t rs1, uint8_t rs2, uint8_t funct3, uint8_t funct7);
+uint32_t rv_custom1();
+
+// Zba/Zbb bit-manipulation
+uint32_t rv_sh1add(uint8_t rd, uint8_t rs1, uint8_t rs2);
+uint32_t rv_sh1add();
+uint32_t rv_sh2add(uint8_t rd, uint8_t rs1, uint8_t rs2);
+uint32_t rv_sh2add();
+uint32_t rv_sh3add(uint8_t rd, uint8_t rs1, uint8_t rs2);
+uint32_t rv_sh3add();
+uint32_t rv_andn(uint8_t rd, uint8_t rs1, uint8_t rs2);
+uint32_t rv_andn();
+uint32_t rv_orn(uint8_t rd, uint8_t rs1, uint8_t rs2);
+uint32_t rv_orn();
+uint32_t rv_xnor(uint8_t rd, uint8_t rs1, uint8_t rs2);
+uint32_t rv_xnor();
+uint32_t rv_min(uint8_t rd, uint8_t rs1, uint8_t rs2);
+uint32_t rv_min();
+uint32_t rv_minu(uint8_t rd, uint8_t rs1, uint8_t rs2);
+uint32_t rv_minu();
+uint32_t rv_max(uint8_t rd, uint8_t rs1, uint8_t rs2);
+uint32_t rv_max();
+uint32_t rv_maxu(uint8_t rd, uint8_t rs1, uint8_t rs2);
+uint32_t rv_maxu();
+uint32_t rv_rol(uint8_t rd, uint8_t rs1, uint8_t rs2);
+uint32_t rv_rol();
+uint32_t rv_ror(uint8_t rd, uint8_t rs1, uint8_t rs2);
+uint32_t rv_ror();
+uint32_t rv_rori(uint8_t rd, uint8_t rs1, int32_t imm);
+uint32_t rv_rori();
+uint32_t rv_clz(uint8_t rd, uint8_t rs1);
+uint32_t rv_clz();
+uint32_t rv_ctz(uint8_t rd, uint8_t rs1);
+uint32_t rv_ctz();
+uint32_t rv_cpop(uint8_t rd, uint8_t rs1);
+uint32_t rv_cpop();
+uint32_t rv_sext_b(uint8_t rd, uint8_t rs1);
+uint32_t rv_sext_b();
+uint32_t rv_sext_h(uint8_t rd, uint8_t rs1);
+uint32_t rv_sext_h();
+uint32_t rv_zext_h(uint8_t rd, uint8_t rs1);
+uint32_t rv_zext_h();
+uint32_t rv_rev8(uint8_t rd, uint8_t rs1);
+uint32_t rv_rev8();
+uint32_t rv_orc_b(uint8_t rd, uint8_t rs1);
+uint32_t rv_orc_b();
+
+// A extension (word-sized, aq and rl clear)
+uint32_t rv_lr_w(uint8_t rd, uint8_t rs1);
+uint32_t rv_lr_w();
+uint32_t rv_sc_w(uint8_t rd, uint8_t rs1, uint8_t rs2);
+uint32_t rv_sc_w();
+uint32_t rv_amoswap_w(uint8_t rd, uint8_t rs1, uint8_t rs2);
+uint32_t rv_amoswap_w();
+uint32_t rv_amoadd_w(uint8_t rd, uint8_t rs1, uint8_t rs2);
+uint32_t rv_amoadd_w();
+uint32_t rv_amoxor_w(uint8_t rd, uint8_t rs1, uint8_t rs2);
+uint32_t rv_amoxor_w();
+uint32_t rv_amoand_w(uint8_t rd, uint8_t rs1, uint8_t rs2);
+uint32_t rv_amoand_w();
+uint32_t rv_amoor_w(uint8_t rd, uint8_t rs1, uint8_t rs2);
+uint32_t rv_amoor_w();
+uint32_t rv_amomin_w(uint8_t rd, uint8_t rs1, uint8_t rs2);
+uint32_t rv_amomin_w();
+uint32_t rv_amomax_w(uint8_t rd, uint8_t rs1, uint8_t rs2);
+uint32_t rv_amomax_w();
+uint32_t rv_amominu_w(uint8_t rd, uint8_t rs1, uint8_t rs2);
+uint32_t rv_amominu_w();
+uint32_t rv_amomaxu_w(uint8_t rd, uint8_t rs1, uint8_t rs2);
+uint32_t rv_amomaxu_w();
+
 #endif
@@ -0,0 +1,104 @@
+#include "spiflash.h"
+
+#include <assert.h>
+#include <fstream>
+
+SpiFlash::SpiFlash() : mem(FLASH_SIZE, 0xFF) {
+  powered_down = true;
+  last_sck = false;
+  clocks = 0;
+  cmd = 0;
+  addr = 0;
+  out = 0;
+  out_oe = 0;
+}
+
+// Loads a raw binary image at the given byte offset, like iceprog -o
+bool SpiFlash::load(std::string path, uint32_t offset) {
+  std::ifstream file(path, std::ios::in | std::ios::binary);
+  if (!file) {
+    return false;
+  }
+  char c;
+  for (uint32_t a = offset; a < FLASH_SIZE && file.get(c); a++) {
+    mem[a] = c;
+  }
+  return true;
+}
+
+void SpiFlash::write_word(uint32_t addr, uint32_t data) {
+  assert(addr % 4 == 0 && addr < FLASH_SIZE);
+  for (int i = 0; i < 4; i++) {
+    mem[addr + i] = data >> (8 * i);
+  }
+}
+
+uint32_t SpiFlash::read_word(uint32_t addr) {
+  assert(addr % 4 == 0 && addr < FLASH_SIZE);
+  return mem[addr] | mem[addr + 1] << 8 | mem[addr + 2] << 16 | (uint32_t) mem[addr + 3] << 24;
+}
+
+uint8_t SpiFlash::step(bool sck, bool ssb, uint8_t io, uint8_t oe) {
+  if (ssb) {
+    // Deselected, release the bus and wait for the next command
+    clocks = 0;
+    out_oe = 0;
+  } else if (sck && !last_sck) {
+    // Commands and addresses are sampled on IO0 on the rising edge
+    bool bit = io & 1;
+    if (clocks < 8) {
+      cmd = (cmd << 1) | bit;
+    } else if (clocks < 32) {
+      addr = ((addr << 1) | bit) & (FLASH_SIZE - 1);
+    }
+    clocks++;
+
+    if (clocks == 8 && cmd == 0xAB) {
+      powered_down = false;
+    }
+  } else if (!sck && last_sck) {
+    // Data goes out on the falling edge
+    update_output();
+  }
+  last_sck = sck;
+
+  // Both sides driving a line is a bug in the controller
+  assert((out_oe & oe) == 0);
+
+  // Undriven lines are pulled up
+  uint8_t pins = (oe & io) | (out_oe & out) | (~(oe | out_oe) & 0xF);
+  return pins & 0xF;
+}
+
+void SpiFlash::update_output() {
+  if (powered_down)
+    return;
+
+  // Clocks of command, address and dummy bits before data starts
+  int data_start;
+  switch (cmd) {
+  case 0x03:
+    data_start = 32;
+    break;
+  case 0x0B:
+  case 0x6B:
+    data_start = 40;
+    break;
+  default:
+    return;
+  }
+  if (clocks < data_start)
+    return;
+
+  // Index of the bit/nibble to drive next, MSB first
+  int unit = clocks - data_start;
+  if (cmd == 0x6B) {
+    uint8_t byte = mem[(addr + unit / 2) & (FLASH_SIZE - 1)];
+    out = unit % 2 == 0 ? byte >> 4 : byte & 0xF;
+    out_oe = 0xF;
+  } else {
+    uint8_t byte = mem[(addr + unit / 8) & (FLASH_SIZE - 1)];
+    out = ((byte >> (7 - unit % 8)) & 1) << 1;
+    out_oe = 0x2;
+  }
+}
@@ -0,0 +1,35 @@
+#ifndef SPIFLASH_H
+#define SPIFLASH_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#define FLASH_SIZE 0x1000000  // bytes
+
+// Cycle-level model of a W25Q-style SPI flash, driven from the SoC's flash
+// pins once per clock. Supports Read (0x03), Fast Read (0x0B), Quad Output
+// Fast Read (0x6B) and Release Power-down (0xAB). Like on the Icebreaker, the
+// flash starts out powered down and ignores everything else until woken.
+class SpiFlash {
+ public:
+  SpiFlash();
+  bool load(std::string path, uint32_t offset);
+  void write_word(uint32_t addr, uint32_t data);
+  uint32_t read_word(uint32_t addr);
+  // Takes the controller's pins, returns what it reads back on IO0-3
+  uint8_t step(bool sck, bool ssb, uint8_t io, uint8_t oe);
+ private:
+  void update_output();
+
+  std::vector<uint8_t> mem;
+  bool powered_down;
+  bool last_sck;
+  int clocks;  // rising edges since SSB went low
+  uint8_t cmd;
+  uint32_t addr;
+  uint8_t out;
+  uint8_t out_oe;
+};
+
+#endif
@@ -0,0 +1,95 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+#include "retire_trace.h"
+#include "util.h"
+
+// Prints a retirement trace written by the core harness (see retire_trace.h)
+// as text, one line per retired instruction or trap. Usage:
+//
+//   trace_decode [--disasm] [--elf FILE] [--from ADDR] [--to ADDR] <trace>
+//
+// --from and --to keep only records whose pc is in [ADDR, ADDR) and
+// --disasm disassembles each instruction, naming branch and jump targets with
+// the symbols from --elf if it's given.
+
+static void usage(const char* name) {
+  fprintf(stderr, "Usage: %s [--disasm] [--elf FILE] [--from ADDR] [--to ADDR] <trace>\n",
+          name);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char** argv) {
+  bool disasm = false;
+  uint32_t from = 0;
+  uint32_t to = 0xFFFFFFFF;
+  const char* path = nullptr;
+  const char* elf = nullptr;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--disasm")) {
+      disasm = true;
+    } else if (!strcmp(argv[i], "--elf") && i + 1 < argc) {
+      elf = argv[++i];
+    } else if (!strcmp(argv[i], "--from") && i + 1 < argc) {
+      from = strtoul(argv[++i], nullptr, 0);
+    } else if (!strcmp(argv[i], "--to") && i + 1 < argc) {
+      to = strtoul(argv[++i], nullptr, 0);
+    } else if (argv[i][0] != '-' && !path) {
+      path = argv[i];
+    } else {
+      usage(argv[0]);
+    }
+  }
+  if (!path)
+    usage(argv[0]);
+
+  SymbolTable symbols;
+  if (elf && !symbols.load_elf(elf)) {
+    fprintf(stderr, "Couldn't read symbols from %s\n", elf);
+    return EXIT_FAILURE;
+  }
+
+  RetireTraceReader reader;
+  if (!reader.open(path)) {
+    fprintf(stderr, "%s is not a retirement trace\n", path);
+    return EXIT_FAILURE;
+  }
+
+  RetireRecord r;
+  uint64_t count = 0;
+  char text[128];
+  while (reader.next(&r)) {
+    count++;
+    if (r.pc < from || r.pc >= to)
+      continue;
+
+    printf("%10lu 0x%08x ", (unsigned long)count, r.pc);
+    if (r.flags & RETIRE_TRAP) {
+      printf("trap mcause=0x%08x ", r.cause);
+    }
+    if (r.flags & RETIRE_RD) {
+      printf("x%d=0x%08x ", r.rd, r.rd_value);
+    }
+    if (r.flags & RETIRE_LOAD) {
+      printf("[0x%08x]->0x%08x ", r.mem_addr, r.load_data);
+    }
+    if (r.flags & RETIRE_STORE) {
+      printf("[0x%08x]<-0x%08x/%x ", r.mem_addr, r.store_data, r.store_mask);
+    }
+
+    if (r.flags & RETIRE_NO_INSTR) {
+      printf("\n");
+    } else if (disasm) {
+      disassemble(text, sizeof(text), r.instr, r.pc, elf ? &symbols : nullptr);
+      printf("0x%08x %s\n", r.instr, text);
+    } else {
+      printf("0x%08x\n", r.instr);
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -1,189 +1,467 @@
 #include "util.h"
 
+#include <elf.h>
+#include <stdarg.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <utility>
 
-void print_instruction(uint32_t instr) {
-  int rd = (instr >> 7) & 0x1F;
-  int rs1 = (instr >> 15) & 0x1F;
-  int rs2 = (instr >> 20) & 0x1F;
-  int funct = (instr >> 12) & 0x7;
-  int imm;
-  printf("0x%08x ", instr);
-
-  switch (instr & 0x7F) {
-  case 0b0110111:
-    printf("lui r%d, %x\n",  rd, instr >> 12);
-    break;
-  case 0b0010111:
-    printf("auipc r%d, %x\n", rd, instr >> 12);
-    break;
-  case 0b1101111:
-    // TODO: reswizzle imm
-    printf("jal r%d, ...\n", rd);
-    break;
-  case 0b1100111:
-    printf("jalr r%d, %x\n", rd, instr >> 12);
-    break;
-  case 0b1100011:
-    switch (funct) {
-    case 0b000:
-      printf("beq r%d, r%d\n", rs1, rs2);
-      break;
-    case 0b001:
-      printf("bne r%d, r%d\n", rs1, rs2);
-      break;
-    case 0b100:
-      printf("blt r%d, r%d\n", rs1, rs2);
-      break;
-    case 0b101:
-      printf("bge r%d, r%d\n", rs1, rs2);
-      break;
-    case 0b110:
-      printf("bltu r%d, r%d\n", rs1, rs2);
-      break;
-    case 0b111:
-      printf("bgeu r%d, r%d\n", rs1, rs2);
-      break;
-    default: printf("Illegal branch instruction - funct: %d!\n", funct);
+/*
+ * Disassembler
+ *
+ * Instructions are matched against a table of (mask, match) pairs. The table
+ * is bucketed by major opcode once, so each lookup only scans the handful of
+ * entries that share one, first match wins.
+ */
+
+enum Operands {
+  OP_NONE,
+  OP_R,       // rd, rs1, rs2
+  OP_R1,      // rd, rs1
+  OP_I,       // rd, rs1, imm
+  OP_SHAMT,   // rd, rs1, shamt
+  OP_LOAD,    // rd, imm(rs1)
+  OP_STORE,   // rs2, imm(rs1)
+  OP_BRANCH,  // rs1, rs2, target
+  OP_U,       // rd, imm[31:12]
+  OP_JAL,     // rd, target
+  OP_JALR,    // rd, imm(rs1)
+  OP_CSR,     // rd, csr, rs1
+  OP_CSRI,    // rd, csr, uimm
+  OP_FENCE,   // pred, succ
+  OP_RS,      // rs1, rs2
+  OP_AMO,     // rd, rs2, (rs1), with .aq/.rl
+  OP_LR,      // rd, (rs1), with .aq/.rl
+  OP_CUSTOM,  // rd, rs1, rs2, funct3, funct7
+};
+
+struct Opcode {
+  uint32_t mask;
+  uint32_t match;
+  const char* name;
+  Operands operands;
+};
+
+// More specific encodings come before the ones they overlap with
+static const Opcode opcodes[] = {
+  {0x0000007F, 0x00000037, "lui", OP_U},
+  {0x0000007F, 0x00000017, "auipc", OP_U},
+  {0x0000007F, 0x0000006F, "jal", OP_JAL},
+  {0x0000707F, 0x00000067, "jalr", OP_JALR},
+
+  {0x0000707F, 0x00000063, "beq", OP_BRANCH},
+  {0x0000707F, 0x00001063, "bne", OP_BRANCH},
+  {0x0000707F, 0x00004063, "blt", OP_BRANCH},
+  {0x0000707F, 0x00005063, "bge", OP_BRANCH},
+  {0x0000707F, 0x00006063, "bltu", OP_BRANCH},
+  {0x0000707F, 0x00007063, "bgeu", OP_BRANCH},
+
+  {0x0000707F, 0x00000003, "lb", OP_LOAD},
+  {0x0000707F, 0x00001003, "lh", OP_LOAD},
+  {0x0000707F, 0x00002003, "lw", OP_LOAD},
+  {0x0000707F, 0x00004003, "lbu", OP_LOAD},
+  {0x0000707F, 0x00005003, "lhu", OP_LOAD},
+
+  {0x0000707F, 0x00000023, "sb", OP_STORE},
+  {0x0000707F, 0x00001023, "sh", OP_STORE},
+  {0x0000707F, 0x00002023, "sw", OP_STORE},
+
+  {0xFFF0707F, 0x60001013, "clz", OP_R1},
+  {0xFFF0707F, 0x60101013, "ctz", OP_R1},
+  {0xFFF0707F, 0x60201013, "cpop", OP_R1},
+  {0xFFF0707F, 0x60401013, "sext.b", OP_R1},
+  {0xFFF0707F, 0x60501013, "sext.h", OP_R1},
+  {0xFFF0707F, 0x28705013, "orc.b", OP_R1},
+  {0xFFF0707F, 0x69805013, "rev8", OP_R1},
+  {0xFE00707F, 0x00001013, "slli", OP_SHAMT},
+  {0xFE00707F, 0x00005013, "srli", OP_SHAMT},
+  {0xFE00707F, 0x40005013, "srai", OP_SHAMT},
+  {0xFE00707F, 0x60005013, "rori", OP_SHAMT},
+  {0x0000707F, 0x00000013, "addi", OP_I},
+  {0x0000707F, 0x00002013, "slti", OP_I},
+  {0x0000707F, 0x00003013, "sltiu", OP_I},
+  {0x0000707F, 0x00004013, "xori", OP_I},
+  {0x0000707F, 0x00006013, "ori", OP_I},
+  {0x0000707F, 0x00007013, "andi", OP_I},
+
+  {0xFE00707F, 0x00000033, "add", OP_R},
+  {0xFE00707F, 0x40000033, "sub", OP_R},
+  {0xFE00707F, 0x00001033, "sll", OP_R},
+  {0xFE00707F, 0x00002033, "slt", OP_R},
+  {0xFE00707F, 0x00003033, "sltu", OP_R},
+  {0xFE00707F, 0x00004033, "xor", OP_R},
+  {0xFE00707F, 0x00005033, "srl", OP_R},
+  {0xFE00707F, 0x40005033, "sra", OP_R},
+  {0xFE00707F, 0x00006033, "or", OP_R},
+  {0xFE00707F, 0x00007033, "and", OP_R},
+  {0xFE00707F, 0x20002033, "sh1add", OP_R},
+  {0xFE00707F, 0x20004033, "sh2add", OP_R},
+  {0xFE00707F, 0x20006033, "sh3add", OP_R},
+  {0xFE00707F, 0x40007033, "andn", OP_R},
+  {0xFE00707F, 0x40006033, "orn", OP_R},
+  {0xFE00707F, 0x40004033, "xnor", OP_R},
+  {0xFE00707F, 0x0A004033, "min", OP_R},
+  {0xFE00707F, 0x0A005033, "minu", OP_R},
+  {0xFE00707F, 0x0A006033, "max", OP_R},
+  {0xFE00707F, 0x0A007033, "maxu", OP_R},
+  {0xFE00707F, 0x60001033, "rol", OP_R},
+  {0xFE00707F, 0x60005033, "ror", OP_R},
+  {0xFFF0707F, 0x08004033, "zext.h", OP_R1},
+
+  {0xFFFFFFFF, 0x8330000F, "fence.tso", OP_NONE},
+  {0x0000707F, 0x0000000F, "fence", OP_FENCE},
+  {0x0000707F, 0x0000100F, "fence.i", OP_NONE},
+
+  {0xFFFFFFFF, 0x00000073, "ecall", OP_NONE},
+  {0xFFFFFFFF, 0x00100073, "ebreak", OP_NONE},
+  {0xFFFFFFFF, 0x10200073, "sret", OP_NONE},
+  {0xFFFFFFFF, 0x30200073, "mret", OP_NONE},
+  {0xFFFFFFFF, 0x10500073, "wfi", OP_NONE},
+  {0xFE007FFF, 0x12000073, "sfence.vma", OP_RS},
+  {0x0000707F, 0x00001073, "csrrw", OP_CSR},
+  {0x0000707F, 0x00002073, "csrrs", OP_CSR},
+  {0x0000707F, 0x00003073, "csrrc", OP_CSR},
+  {0x0000707F, 0x00005073, "csrrwi", OP_CSRI},
+  {0x0000707F, 0x00006073, "csrrsi", OP_CSRI},
+  {0x0000707F, 0x00007073, "csrrci", OP_CSRI},
+
+  {0xF9F0707F, 0x1000202F, "lr.w", OP_LR},
+  {0xF800707F, 0x1800202F, "sc.w", OP_AMO},
+  {0xF800707F, 0x0800202F, "amoswap.w", OP_AMO},
+  {0xF800707F, 0x0000202F, "amoadd.w", OP_AMO},
+  {0xF800707F, 0x2000202F, "amoxor.w", OP_AMO},
+  {0xF800707F, 0x6000202F, "amoand.w", OP_AMO},
+  {0xF800707F, 0x4000202F, "amoor.w", OP_AMO},
+  {0xF800707F, 0x8000202F, "amomin.w", OP_AMO},
+  {0xF800707F, 0xA000202F, "amomax.w", OP_AMO},
+  {0xF800707F, 0xC000202F, "amominu.w", OP_AMO},
+  {0xF800707F, 0xE000202F, "amomaxu.w", OP_AMO},
+
+  {0x0000007F, 0x0000000B, "custom0", OP_CUSTOM},
+  {0x0000007F, 0x0000002B, "custom1", OP_CUSTOM},
+};
+
+#define NUM_OPCODES (sizeof(opcodes) / sizeof(opcodes[0]))
+
+// Indices into opcodes, grouped by major opcode (instr[6:2])
+struct OpcodeIndex {
+  uint8_t order[NUM_OPCODES];
+  uint8_t start[33];
+
+  OpcodeIndex() {
+    memset(start, 0, sizeof(start));
+    for (size_t i = 0; i < NUM_OPCODES; i++)
+      start[((opcodes[i].match >> 2) & 0x1F) + 1]++;
+    for (int m = 0; m < 32; m++)
+      start[m + 1] += start[m];
+    uint8_t next[32];
+    memcpy(next, start, sizeof(next));
+    // Stable, so table order is kept within each group
+    for (size_t i = 0; i < NUM_OPCODES; i++)
+      order[next[(opcodes[i].match >> 2) & 0x1F]++] = i;
+  }
+};
+
+static const Opcode* find_opcode(uint32_t instr) {
+  static const OpcodeIndex index;
+  if ((instr & 0x3) != 0x3)
+    return nullptr;
+  uint32_t major = (instr >> 2) & 0x1F;
+  for (int i = index.start[major]; i < index.start[major + 1]; i++) {
+    const Opcode* op = &opcodes[index.order[i]];
+    if ((instr & op->mask) == op->match)
+      return op;
+  }
+  return nullptr;
+}
+
+static const char* const reg_names[32] = {
+  "zero", "ra", "sp", "gp", "tp", "t0", "t1", "t2",
+  "s0", "s1", "a0", "a1", "a2", "a3", "a4", "a5",
+  "a6", "a7", "s2", "s3", "s4", "s5", "s6", "s7",
+  "s8", "s9", "s10", "s11", "t3", "t4", "t5", "t6",
+};
+
+static const struct {
+  uint16_t num;
+  const char* name;
+} csr_names[] = {
+  {0x100, "sstatus"}, {0x104, "sie"}, {0x105, "stvec"}, {0x106, "scounteren"},
+  {0x140, "sscratch"}, {0x141, "sepc"}, {0x142, "scause"}, {0x143, "stval"},
+  {0x144, "sip"}, {0x180, "satp"},
+  {0x300, "mstatus"}, {0x301, "misa"}, {0x302, "medeleg"}, {0x303, "mideleg"},
+  {0x304, "mie"}, {0x305, "mtvec"}, {0x306, "mcounteren"}, {0x310, "mstatush"},
+  {0x320, "mcountinhibit"},
+  {0x340, "mscratch"}, {0x341, "mepc"}, {0x342, "mcause"}, {0x343, "mtval"},
+  {0x344, "mip"},
+  {0x7A0, "tselect"}, {0x7A1, "tdata1"}, {0x7A2, "tdata2"}, {0x7A3, "tdata3"},
+  {0x7B0, "dcsr"}, {0x7B1, "dpc"}, {0x7B2, "dscratch0"}, {0x7B3, "dscratch1"},
+  {0x7C0, "mshadow"},
+  {0xB00, "mcycle"}, {0xB02, "minstret"}, {0xB80, "mcycleh"}, {0xB82, "minstreth"},
+  {0xC00, "cycle"}, {0xC01, "time"}, {0xC02, "instret"},
+  {0xC80, "cycleh"}, {0xC81, "timeh"}, {0xC82, "instreth"},
+  {0xF11, "mvendorid"}, {0xF12, "marchid"}, {0xF13, "mimpid"}, {0xF14, "mhartid"},
+  {0xF15, "mconfigptr"},
+};
+
+// Numbered CSRs: first..first+count-1 are name<first_index + n><suffix>
+static const struct {
+  uint16_t first;
+  uint8_t count;
+  uint8_t first_index;
+  const char* name;
+  const char* suffix;
+} csr_ranges[] = {
+  {0x3A0, 4, 0, "pmpcfg", ""},
+  {0x3B0, 16, 0, "pmpaddr", ""},
+  {0x323, 29, 3, "mhpmevent", ""},
+  {0xB03, 29, 3, "mhpmcounter", ""},
+  {0xB83, 29, 3, "mhpmcounter", "h"},
+  {0xC03, 29, 3, "hpmcounter", ""},
+  {0xC83, 29, 3, "hpmcounter", "h"},
+};
+
+// Output that keeps counting past the end of the buffer, like snprintf
+struct Output {
+  char* buf;
+  size_t size;
+  size_t len;
+};
+
+static void put(Output* out, const char* fmt, ...) {
+  size_t room = out->len < out->size ? out->size - out->len : 0;
+  va_list args;
+  va_start(args, fmt);
+  int n = vsnprintf(room ? out->buf + out->len : nullptr, room, fmt, args);
+  va_end(args);
+  if (n > 0)
+    out->len += n;
+}
+
+static void put_csr(Output* out, uint32_t num) {
+  for (const auto& c : csr_names) {
+    if (c.num == num) {
+      put(out, "%s", c.name);
+      return;
     }
-    break;
-  case 0b0000011:
-    imm = (instr >> 20);
-    switch (funct) {
-    case 0b000:
-      printf("lb r%d, %d(r%d)\n", rd, imm, rs1);
-      break;
-    case 0b001:
-      printf("lh r%d, %d(r%d)\n", rd, imm, rs1);
-      break;
-    case 0b010:
-      printf("lw r%d, %d(r%d)\n", rd, imm, rs1);
-      break;
-    case 0b100:
-      printf("lbu r%d, %d(r%d)\n", rd, imm, rs1);
-      break;
-    case 0b101:
-      printf("lhu r%d, %d(r%d)\n", rd, imm, rs1);
-      break;
-    default: printf("Illegal instruction: load!\n");
+  }
+  for (const auto& r : csr_ranges) {
+    if (num >= r.first && num < (uint32_t)r.first + r.count) {
+      put(out, "%s%d%s", r.name, r.first_index + (num - r.first), r.suffix);
+      return;
     }
+  }
+  put(out, "0x%03x", num);
+}
+
+static void put_target(Output* out, uint32_t target, const SymbolTable* symbols) {
+  put(out, "0x%x", target);
+  uint32_t offset;
+  const char* name = symbols ? symbols->lookup(target, &offset) : nullptr;
+  if (name && offset)
+    put(out, " <%s+0x%x>", name, offset);
+  else if (name)
+    put(out, " <%s>", name);
+}
+
+static void put_fence_set(Output* out, uint32_t set) {
+  if (!set) {
+    put(out, "0");
+    return;
+  }
+  static const char bits[] = "iorw";
+  for (int i = 0; i < 4; i++) {
+    if (set & (8 >> i))
+      put(out, "%c", bits[i]);
+  }
+}
+
+int disassemble(char* buf, size_t size, uint32_t instr, uint32_t pc,
+                const SymbolTable* symbols) {
+  Output out = {buf, size, 0};
+  if (size)
+    buf[0] = '\0';
+
+  const Opcode* op = find_opcode(instr);
+  if (!op) {
+    put(&out, "illegal");
+    return out.len;
+  }
+
+  const char* rd = reg_names[(instr >> 7) & 0x1F];
+  const char* rs1 = reg_names[(instr >> 15) & 0x1F];
+  const char* rs2 = reg_names[(instr >> 20) & 0x1F];
+  int32_t imm_i = (int32_t)instr >> 20;
+  int32_t imm_s = ((int32_t)(instr & 0xFE000000) >> 20) | ((instr >> 7) & 0x1F);
+  int32_t imm_b = ((int32_t)(instr & 0x80000000) >> 19) | ((instr & 0x80) << 4) |
+                  ((instr >> 20) & 0x7E0) | ((instr >> 7) & 0x1E);
+  int32_t imm_j = ((int32_t)(instr & 0x80000000) >> 11) | (instr & 0xFF000) |
+                  ((instr >> 9) & 0x800) | ((instr >> 20) & 0x7FE);
+
+  put(&out, "%s", op->name);
+  if (op->operands == OP_AMO || op->operands == OP_LR) {
+    static const char* const ordering[] = {"", ".rl", ".aq", ".aqrl"};
+    put(&out, "%s", ordering[(instr >> 25) & 0x3]);
+  }
+
+  switch (op->operands) {
+  case OP_NONE:
     break;
-  case 0b0100011:
-    imm = ((instr >> 25) & 0x7F) | ((instr >> 7) & 0x1F);
-    switch (funct) {
-    case 0b000:
-      printf("sb r%d, %d(r%d)\n", rs2, imm, rs1);
-      break;
-    case 0b001:
-      printf("sh r%d, %d(r%d)\n", rs2, imm, rs1);
-      break;
-    case 0b010:
-      printf("sw r%d, %d(r%d)\n", rs2, imm, rs1);
-      break;
-    default: printf("Illegal instruction: store!\n");
-    }
+  case OP_R:
+    put(&out, " %s, %s, %s", rd, rs1, rs2);
     break;
-  case 0b0010011:
-    imm = (instr >> 20);
-    switch (funct) {
-    case 0b000:
-      printf("addi r%d, r%d, %d\n", rd, rs1, imm);
-      break;
-    case 0b010:
-      printf("slti r%d, r%d, %d\n", rd, rs1, imm);
-      break;
-    case 0b011:
-      printf("sltiu r%d, r%d, %d\n", rd, rs1, imm);
-      break;
-    case 0b100:
-      printf("xori r%d, r%d, %d\n", rd, rs1, imm);
-      break;
-    case 0b110:
-      printf("ori r%d, r%d, %d\n", rd, rs1, imm);
-      break;
-    case 0b111:
-      printf("andi r%d, r%d, %d\n", rd, rs1, imm);
-      break;
-    case 0b001:
-      printf("slli r%d, r%d, %d\n", rd, rs1, imm);
-      break;
-    case 0b101:
-      if (!(instr >> 30)) {
-        printf("srli r%d, r%d, %d\n", rd, rs1, imm);
-      } else {
-        printf("srai r%d, r%d, %d\n", rd, rs1, imm);
-      }
-      break;
-    default: printf("Illegal instruction: alui!\n");
-    }
+  case OP_R1:
+    put(&out, " %s, %s", rd, rs1);
     break;
-  case 0b0110011:
-    switch (funct) {
-    case 0b000:
-      if (!(instr >> 30))
-        printf("add r%d, r%d, r%d\n", rd, rs1, rs2);
-      else
-        printf("sub r%d, r%d, r%d\n", rd, rs1, rs2);
-      break;
-    case 0b001:
-      printf("sll r%d, r%d, r%d\n", rd, rs1, rs2);
-      break;
-    case 0b010:
-      printf("slt r%d, r%d, r%d\n", rd, rs1, rs2);
-      break;
-    case 0b011:
-      printf("sltu r%d, r%d, r%d\n", rd, rs1, rs2);
-      break;
-    case 0b100:
-      printf("xor r%d, r%d, r%d\n", rd, rs1, rs2);
-      break;
-    case 0b101:
-      if (!(instr >> 30))
-        printf("srl r%d, r%d, r%d\n", rd, rs1, rs2);
-      else
-        printf("sra r%d, r%d, r%d\n", rd, rs1, rs2);
-      break;
-    case 0b110:
-      printf("or r%d, r%d, r%d\n", rd, rs1, rs2);
-      break;
-    case 0b111:
-      printf("and r%d, r%d, r%d\n", rd, rs1, rs2);
-      break;
-    default: printf("Illegal instruction: alu!\n");
-    }
+  case OP_I:
+    put(&out, " %s, %s, %d", rd, rs1, imm_i);
     break;
-  case 0b1110011:
-    switch (funct) {
-      case 0b000:
-        if (instr >> 20)
-          printf("ebreak\n");
-        else
-          printf("ecall\n");
-        break;
-      // TODO: output csr instruction operands
-      case 0b001:
-        printf("csrrw\n");
-        break;
-      case 0b010:
-        printf("cssrs\n");
-        break;
-      case 0b011:
-        printf("csrrc\n");
-        break;
-      case 0b101:
-        printf("csrrwi\n");
-        break;
-      case 0b110:
-        printf("csrrsi\n");
-        break;
-      case 0b111:
-        printf("csrrci\n");
-        break;
-      default: printf("Illegal instruction: system!\n");
-    }
+  case OP_SHAMT:
+    put(&out, " %s, %s, %d", rd, rs1, (instr >> 20) & 0x1F);
+    break;
+  case OP_LOAD:
+  case OP_JALR:
+    put(&out, " %s, %d(%s)", rd, imm_i, rs1);
+    break;
+  case OP_STORE:
+    put(&out, " %s, %d(%s)", rs2, imm_s, rs1);
+    break;
+  case OP_BRANCH:
+    put(&out, " %s, %s, ", rs1, rs2);
+    put_target(&out, pc + imm_b, symbols);
+    break;
+  case OP_U:
+    put(&out, " %s, 0x%x", rd, instr >> 12);
+    break;
+  case OP_JAL:
+    put(&out, " %s, ", rd);
+    put_target(&out, pc + imm_j, symbols);
+    break;
+  case OP_CSR:
+    put(&out, " %s, ", rd);
+    put_csr(&out, instr >> 20);
+    put(&out, ", %s", rs1);
+    break;
+  case OP_CSRI:
+    put(&out, " %s, ", rd);
+    put_csr(&out, instr >> 20);
+    put(&out, ", %d", (instr >> 15) & 0x1F);
+    break;
+  case OP_FENCE:
+    put(&out, " ");
+    put_fence_set(&out, (instr >> 24) & 0xF);
+    put(&out, ", ");
+    put_fence_set(&out, (instr >> 20) & 0xF);
+    break;
+  case OP_RS:
+    put(&out, " %s, %s", rs1, rs2);
+    break;
+  case OP_AMO:
+    put(&out, " %s, %s, (%s)", rd, rs2, rs1);
+    break;
+  case OP_LR:
+    put(&out, " %s, (%s)", rd, rs1);
+    break;
+  case OP_CUSTOM:
+    put(&out, " %s, %s, %s, %d, %d", rd, rs1, rs2, (instr >> 12) & 0x7, instr >> 25);
     break;
-  default: printf("Illegal instruction: invalid opcode!\n");
   }
+
+  return out.len;
+}
+
+void print_instruction(uint32_t instr, uint32_t pc) {
+  char text[96];
+  disassemble(text, sizeof(text), instr, pc);
+  printf("0x%08x %s\n", instr, text);
+}
+
+/*
+ * ELF symbols
+ */
+
+bool SymbolTable::load_elf(std::string path) {
+  std::ifstream file(path, std::ios::in | std::ios::binary);
+  if (!file)
+    return false;
+  std::vector<char> elf((std::istreambuf_iterator<char>(file)),
+                        std::istreambuf_iterator<char>());
+
+  Elf32_Ehdr ehdr;
+  if (elf.size() < sizeof(ehdr))
+    return false;
+  memcpy(&ehdr, elf.data(), sizeof(ehdr));
+  if (memcmp(ehdr.e_ident, ELFMAG, SELFMAG) != 0 ||
+      ehdr.e_ident[EI_CLASS] != ELFCLASS32 || ehdr.e_ident[EI_DATA] != ELFDATA2LSB ||
+      ehdr.e_shentsize != sizeof(Elf32_Shdr) ||
+      ehdr.e_shoff + (uint64_t)ehdr.e_shnum * sizeof(Elf32_Shdr) > elf.size())
+    return false;
+
+  std::vector<Elf32_Shdr> sections(ehdr.e_shnum);
+  memcpy(sections.data(), elf.data() + ehdr.e_shoff, ehdr.e_shnum * sizeof(Elf32_Shdr));
+
+  symbols.clear();
+  names.clear();
+  std::vector<std::pair<int, Symbol>> ranked;
+  for (const Elf32_Shdr& sh : sections) {
+    if (sh.sh_type != SHT_SYMTAB || sh.sh_link >= sections.size())
+      continue;
+    const Elf32_Shdr& strtab = sections[sh.sh_link];
+    if (sh.sh_offset + (uint64_t)sh.sh_size > elf.size() ||
+        strtab.sh_offset + (uint64_t)strtab.sh_size > elf.size())
+      return false;
+
+    uint32_t base = names.size();
+    names.insert(names.end(), elf.begin() + strtab.sh_offset,
+                 elf.begin() + strtab.sh_offset + strtab.sh_size);
+    names.push_back('\0');
+
+    for (uint32_t off = 0; off + sizeof(Elf32_Sym) <= sh.sh_size; off += sizeof(Elf32_Sym)) {
+      Elf32_Sym sym;
+      memcpy(&sym, elf.data() + sh.sh_offset + off, sizeof(sym));
+      int type = ELF32_ST_TYPE(sym.st_info);
+      if (sym.st_shndx == SHN_UNDEF || sym.st_shndx >= sections.size() ||
+          !(sections[sym.st_shndx].sh_flags & SHF_ALLOC) || sym.st_name == 0 ||
+          sym.st_name >= strtab.sh_size ||
+          (type != STT_FUNC && type != STT_OBJECT && type != STT_NOTYPE))
+        continue;
+      // Local labels and mapping symbols
+      const char* name = &names[base + sym.st_name];
+      if (name[0] == '$' || !strncmp(name, ".L", 2))
+        continue;
+      // Where several symbols share an address, functions win, then symbols
+      // with a size
+      int rank = (type == STT_FUNC) * 2 + (sym.st_size != 0);
+      ranked.push_back({rank, {sym.st_value, sym.st_size, base + sym.st_name}});
+    }
+  }
+
+  std::stable_sort(ranked.begin(), ranked.end(),
+                   [](const std::pair<int, Symbol>& a, const std::pair<int, Symbol>& b) {
+                     if (a.second.addr != b.second.addr)
+                       return a.second.addr < b.second.addr;
+                     return a.first > b.first;
+                   });
+  for (const auto& r : ranked) {
+    if (symbols.empty() || symbols.back().addr != r.second.addr)
+      symbols.push_back(r.second);
+  }
+  return true;
+}
+
+const char* SymbolTable::lookup(uint32_t addr, uint32_t* offset) const {
+  auto it = std::upper_bound(symbols.begin(), symbols.end(), addr,
+                             [](uint32_t a, const Symbol& s) { return a < s.addr; });
+  if (it == symbols.begin())
+    return nullptr;
+  --it;
+  if (it->size && addr - it->addr >= it->size)
+    return nullptr;
+  *offset = addr - it->addr;
+  return &names[it->name];
 }
@@ -3,7 +3,39 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string>
+#include <vector>
 
-void print_instruction(uint32_t instr);
+// Function and object symbols from an ELF file, for naming branch and jump
+// targets in disassembly
+class SymbolTable {
+ public:
+  // Fails if path isn't a 32-bit little-endian ELF file
+  bool load_elf(std::string path);
+  // The symbol addr falls in, or the closest one below it for symbols with
+  // no size. Returns nullptr if there's none.
+  const char* lookup(uint32_t addr, uint32_t* offset) const;
+
+ private:
+  struct Symbol {
+    uint32_t addr;
+    uint32_t size;
+    uint32_t name;  // offset into names
+  };
+  std::vector<Symbol> symbols;  // sorted by address
+  std::vector<char> names;
+};
+
+// Disassembles instr, found at pc, into buf. Like snprintf, it writes at most
+// size bytes including the terminator and returns the length the whole text
+// needs. Registers get their ABI names, CSRs their own names, and targets are
+// absolute, named from symbols when it's given. Covers RV32I, Zicsr, the
+// privileged instructions, A, the Zba/Zbb subset the core implements and the
+// custom-0/custom-1 coprocessor opcodes.
+int disassemble(char* buf, size_t size, uint32_t instr, uint32_t pc,
+                const SymbolTable* symbols = nullptr);
+
+// Prints the instruction word and its disassembly on one line
+void print_instruction(uint32_t instr, uint32_t pc);
 
 #endif
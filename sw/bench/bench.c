@@ -0,0 +1,73 @@
+#include "bench.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+static uint32_t start_cycles, start_instret;
+
+static inline uint32_t read_mcycle() {
+  uint32_t value;
+  asm volatile("csrr %0, mcycle" : "=r" (value));
+  return value;
+}
+
+static inline uint32_t read_minstret() {
+  uint32_t value;
+  asm volatile("csrr %0, minstret" : "=r" (value));
+  return value;
+}
+
+void bench_start(void) {
+  start_instret = read_minstret();
+  start_cycles = read_mcycle();
+}
+
+void bench_stop(uint32_t iterations) {
+  uint32_t cycles = read_mcycle();
+  uint32_t instret = read_minstret();
+  MAILBOX->cycles = cycles - start_cycles;
+  MAILBOX->instret = instret - start_instret;
+  MAILBOX->iterations = iterations;
+}
+
+__attribute__((weak)) void bench_irq(void) {
+}
+
+uint32_t mul(uint32_t a, uint32_t b) {
+  uint32_t result = 0;
+  while (b) {
+    if (b & 1)
+      result += a;
+    a <<= 1;
+    b >>= 1;
+  }
+  return result;
+}
+
+uint16_t crc16(uint32_t data, uint16_t crc) {
+  for (int i = 0; i < 32; i++) {
+    uint16_t bit = (data ^ crc) & 1;
+    data >>= 1;
+    crc >>= 1;
+    if (bit)
+      crc ^= 0xA001;
+  }
+  return crc;
+}
+
+// GCC may turn copies and clears into calls to these even with
+// -ffreestanding
+void* memcpy(void* dst, const void* src, size_t n) {
+  uint8_t* d = dst;
+  const uint8_t* s = src;
+  while (n--)
+    *d++ = *s++;
+  return dst;
+}
+
+void* memset(void* dst, int c, size_t n) {
+  uint8_t* d = dst;
+  while (n--)
+    *d++ = c;
+  return dst;
+}
@@ -0,0 +1,53 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+// Benchmarks run on the core harness (sim/bench.cpp), which loads them at 0
+// with ROM below 0x1000 and RAM above, and reads their results from a
+// mailbox at the top of RAM once status goes nonzero.
+#define MAILBOX_ADDR 0x2FE0
+// Offset of irq_ack in struct bench_mailbox, for start.S
+#define MAILBOX_IRQ_ACK 24
+
+#define BENCH_RUNNING 0
+#define BENCH_PASS 1
+#define BENCH_FAIL 2   // the workload's self-check failed
+#define BENCH_TRAP 3   // an exception was taken
+
+#ifndef __ASSEMBLER__
+#include <stdint.h>
+
+struct bench_mailbox {
+  uint32_t status;
+  uint32_t iterations;
+  uint32_t cycles;
+  uint32_t instret;
+  // The workload's result, for the harness to show if the self-check fails
+  uint32_t checksum;
+  // Cycles the harness waits, after each acknowledged software interrupt,
+  // before raising the next. 0 leaves the interrupt alone.
+  uint32_t irq_delay;
+  // Set by the software interrupt handler, cleared by the harness when it
+  // lowers the interrupt
+  uint32_t irq_ack;
+};
+
+#define MAILBOX ((volatile struct bench_mailbox*) MAILBOX_ADDR)
+
+// Bracket the timed region. bench_stop() records the iteration count and the
+// mcycle and minstret deltas in the mailbox.
+void bench_start(void);
+void bench_stop(uint32_t iterations);
+
+// Called from the software interrupt handler in start.S, after the
+// interrupt has been acknowledged. Workloads that don't take interrupts can
+// leave this out.
+void bench_irq(void);
+
+// rv32i has no multiply, and the benchmarks don't link libgcc
+uint32_t mul(uint32_t a, uint32_t b);
+
+// Folds a word into a running CRC-16, as CoreMark's checksums do
+uint16_t crc16(uint32_t data, uint16_t crc);
+#endif
+
+#endif
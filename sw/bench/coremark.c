@@ -0,0 +1,250 @@
+#include "bench.h"
+
+#include <stdint.h>
+
+// CoreMark-style workload: each iteration runs the three CoreMark kernels on
+// small inputs, a linked list (find, reverse and merge sort), a matrix
+// multiply with constant scaling, and a state machine scanning a string of
+// numbers, and folds their results into a CRC-16. It follows CoreMark's
+// shape but isn't CoreMark, so scores can't be compared with published
+// ones.
+
+#define ITERATIONS 6
+#define EXPECTED 0x5CBA
+
+#define LIST_LEN 24
+#define MATRIX_N 6
+
+struct node {
+  struct node* next;
+  int16_t data;
+  int16_t idx;
+};
+
+static struct node nodes[LIST_LEN];
+static int16_t matrix_a[MATRIX_N * MATRIX_N];
+static int16_t matrix_b[MATRIX_N * MATRIX_N];
+static int32_t matrix_c[MATRIX_N * MATRIX_N];
+
+static const char numbers[] =
+    "5012,1.23,-874,+122,-1.5e3,.9,3e-2,x12,7,-,0.5e,++4,86,2.75,-0.125e+6,";
+
+static uint32_t seed = 0x1234;
+
+static uint32_t next_random() {
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed;
+}
+
+static struct node* list_init() {
+  for (int i = 0; i < LIST_LEN; i++) {
+    nodes[i].next = i + 1 < LIST_LEN ? &nodes[i + 1] : 0;
+    nodes[i].data = next_random() & 0x7FFF;
+    nodes[i].idx = i;
+  }
+  return &nodes[0];
+}
+
+static struct node* list_reverse(struct node* list) {
+  struct node* prev = 0;
+  while (list) {
+    struct node* next = list->next;
+    list->next = prev;
+    prev = list;
+    list = next;
+  }
+  return prev;
+}
+
+static struct node* list_find(struct node* list, int16_t idx) {
+  while (list && list->idx != idx)
+    list = list->next;
+  return list;
+}
+
+// Merge sort without recursion, as CoreMark does it. by_data picks the key.
+static int list_cmp(struct node* a, struct node* b, int by_data) {
+  return by_data ? a->data - b->data : a->idx - b->idx;
+}
+
+static struct node* list_sort(struct node* list, int by_data) {
+  int insize = 1;
+  for (;;) {
+    struct node* p = list;
+    struct node* tail = 0;
+    int merges = 0;
+    list = 0;
+    while (p) {
+      merges++;
+      struct node* q = p;
+      int psize = 0;
+      for (int i = 0; i < insize && q; i++) {
+        psize++;
+        q = q->next;
+      }
+      int qsize = insize;
+      while (psize > 0 || (qsize > 0 && q)) {
+        struct node* e;
+        if (psize == 0) {
+          e = q;
+          q = q->next;
+          qsize--;
+        } else if (qsize == 0 || !q || list_cmp(p, q, by_data) <= 0) {
+          e = p;
+          p = p->next;
+          psize--;
+        } else {
+          e = q;
+          q = q->next;
+          qsize--;
+        }
+        if (tail)
+          tail->next = e;
+        else
+          list = e;
+        tail = e;
+      }
+      p = q;
+    }
+    tail->next = 0;
+    if (merges <= 1)
+      return list;
+    insize <<= 1;
+  }
+}
+
+static uint16_t bench_list(uint16_t crc) {
+  struct node* list = list_init();
+  list = list_reverse(list);
+  for (int i = 0; i < LIST_LEN; i += 3) {
+    struct node* found = list_find(list, i);
+    crc = crc16(found ? found->data : 0xFFFF, crc);
+  }
+  list = list_sort(list, 1);
+  for (struct node* n = list; n; n = n->next)
+    crc = crc16(n->data, crc);
+  list = list_sort(list, 0);
+  crc = crc16(list->data, crc);
+  return crc;
+}
+
+static uint16_t bench_matrix(uint16_t crc) {
+  for (int i = 0; i < MATRIX_N * MATRIX_N; i++) {
+    matrix_a[i] = (next_random() & 0xFF) - 0x80;
+    matrix_b[i] = next_random() & 0xFF;
+  }
+
+  // C = A * B, then scale C by a constant, then add a constant to A
+  for (int i = 0; i < MATRIX_N; i++) {
+    for (int j = 0; j < MATRIX_N; j++) {
+      int32_t sum = 0;
+      for (int k = 0; k < MATRIX_N; k++)
+        sum += mul(matrix_a[i * MATRIX_N + k], matrix_b[k * MATRIX_N + j]);
+      matrix_c[i * MATRIX_N + j] = sum;
+    }
+  }
+  uint32_t total = 0;
+  for (int i = 0; i < MATRIX_N * MATRIX_N; i++) {
+    matrix_c[i] = mul(matrix_c[i], 7);
+    total += matrix_c[i];
+    matrix_a[i] += 3;
+    total ^= matrix_a[i];
+  }
+  return crc16(total, crc);
+}
+
+enum state { START, INVALID, S1, INT, FLOAT, EXPONENT, S2, SCIENTIFIC, NUM_STATES };
+
+static int is_digit(char c) {
+  return c >= '0' && c <= '9';
+}
+
+// Classifies one comma-separated field
+static enum state next_state(const char** str) {
+  enum state state = START;
+  const char* p = *str;
+  for (; *p && *p != ','; p++) {
+    char c = *p;
+    switch (state) {
+    case START:
+      if (is_digit(c))
+        state = INT;
+      else if (c == '+' || c == '-')
+        state = S1;
+      else if (c == '.')
+        state = FLOAT;
+      else
+        state = INVALID;
+      break;
+    case S1:
+      if (is_digit(c))
+        state = INT;
+      else if (c == '.')
+        state = FLOAT;
+      else
+        state = INVALID;
+      break;
+    case INT:
+      if (c == '.')
+        state = FLOAT;
+      else if (!is_digit(c))
+        state = INVALID;
+      break;
+    case FLOAT:
+      if (c == 'e' || c == 'E')
+        state = S2;
+      else if (!is_digit(c))
+        state = INVALID;
+      break;
+    case S2:
+      if (c == '+' || c == '-')
+        state = EXPONENT;
+      else if (is_digit(c))
+        state = SCIENTIFIC;
+      else
+        state = INVALID;
+      break;
+    case EXPONENT:
+      if (is_digit(c))
+        state = SCIENTIFIC;
+      else
+        state = INVALID;
+      break;
+    case SCIENTIFIC:
+      if (!is_digit(c))
+        state = INVALID;
+      break;
+    default:
+      break;
+    }
+  }
+  *str = *p ? p + 1 : p;
+  return state;
+}
+
+static uint16_t bench_state(uint16_t crc) {
+  uint32_t counts[NUM_STATES] = {0};
+  const char* p = numbers;
+  while (*p)
+    counts[next_state(&p)]++;
+  for (int i = 0; i < NUM_STATES; i++)
+    crc = crc16(counts[i], crc);
+  return crc;
+}
+
+int main() {
+  uint16_t crc = 0;
+
+  bench_start();
+  for (int i = 0; i < ITERATIONS; i++) {
+    crc = bench_list(crc);
+    crc = bench_matrix(crc);
+    crc = bench_state(crc);
+  }
+  bench_stop(ITERATIONS);
+
+  MAILBOX->checksum = crc;
+  return crc != EXPECTED;
+}
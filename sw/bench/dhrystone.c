@@ -0,0 +1,238 @@
+#include "bench.h"
+
+#include <stdint.h>
+
+// Dhrystone-style workload: the procedures of Dhrystone 2.1, shuffling
+// records, enums, small arrays and 30-character strings between globals and
+// locals. Multiplies go through mul() and Dhrystone's one divide is replaced
+// by a subtraction, since rv32i has neither. The harness divides the score by
+// 1757, VAX 11/780 Dhrystones per second, for a DMIPS/MHz estimate, which is
+// only indicative given the changes.
+
+#define ITERATIONS 40
+#define EXPECTED 0xBE23
+
+typedef enum { IDENT_1, IDENT_2, IDENT_3, IDENT_4, IDENT_5 } enumeration;
+
+typedef char str_30[31];
+
+struct record {
+  struct record* ptr_comp;
+  enumeration discr;
+  enumeration enum_comp;
+  int int_comp;
+  str_30 str_comp;
+};
+
+static struct record record_glob, next_record_glob;
+static struct record* ptr_glob;
+static struct record* next_ptr_glob;
+static int int_glob;
+static int bool_glob;
+static char char_1_glob, char_2_glob;
+// Dhrystone's are 50 and 50x50, which wouldn't fit in RAM. These still cover
+// every element proc_8 touches.
+#define ARR_1_LEN 40
+#define ARR_2_ROWS 30
+#define ARR_2_COLS 10
+static int arr_1_glob[ARR_1_LEN];
+static int arr_2_glob[ARR_2_ROWS][ARR_2_COLS];
+
+static void str_copy(char* dst, const char* src) {
+  while ((*dst++ = *src++))
+    ;
+}
+
+static int str_compare(const char* a, const char* b) {
+  while (*a && *a == *b) {
+    a++;
+    b++;
+  }
+  return *(const unsigned char*) a - *(const unsigned char*) b;
+}
+
+static int func_3(enumeration enum_par) {
+  return enum_par == IDENT_3;
+}
+
+static enumeration func_1(char ch_1, char ch_2) {
+  char ch_1_loc = ch_1;
+  char ch_2_loc = ch_1_loc;
+  if (ch_2_loc != ch_2)
+    return IDENT_1;
+  char_1_glob = ch_1_loc;
+  return IDENT_2;
+}
+
+static int func_2(const char* str_1, const char* str_2) {
+  int int_loc = 2;
+  char ch_loc = 'A';
+  while (int_loc <= 2) {
+    if (func_1(str_1[int_loc], str_2[int_loc + 1]) == IDENT_1) {
+      ch_loc = 'A';
+      int_loc += 1;
+    }
+  }
+  if (ch_loc >= 'W' && ch_loc < 'Z')
+    int_loc = 7;
+  if (ch_loc == 'R')
+    return 1;
+  if (str_compare(str_1, str_2) > 0) {
+    int_loc += 7;
+    int_glob = int_loc;
+    return 1;
+  }
+  return 0;
+}
+
+static void proc_7(int int_1, int int_2, int* int_out) {
+  *int_out = int_2 + int_1 + 2;
+}
+
+static void proc_8(int* arr_1, int arr_2[ARR_2_ROWS][ARR_2_COLS], int int_1, int int_2) {
+  int int_loc = int_1 + 5;
+  arr_1[int_loc] = int_2;
+  arr_1[int_loc + 1] = arr_1[int_loc];
+  arr_1[int_loc + 30] = int_loc;
+  for (int index = int_loc; index <= int_loc + 1; index++)
+    arr_2[int_loc][index] = int_loc;
+  arr_2[int_loc][int_loc - 1] += 1;
+  arr_2[int_loc + 20][int_loc] = arr_1[int_loc];
+  int_glob = 5;
+}
+
+static void proc_6(enumeration enum_in, enumeration* enum_out) {
+  *enum_out = enum_in;
+  if (!func_3(enum_in))
+    *enum_out = IDENT_4;
+  switch (enum_in) {
+  case IDENT_1:
+    *enum_out = IDENT_1;
+    break;
+  case IDENT_2:
+    *enum_out = int_glob > 100 ? IDENT_1 : IDENT_4;
+    break;
+  case IDENT_3:
+    *enum_out = IDENT_2;
+    break;
+  case IDENT_4:
+    break;
+  case IDENT_5:
+    *enum_out = IDENT_3;
+    break;
+  }
+}
+
+static void proc_3(struct record** ptr_out) {
+  if (ptr_glob)
+    *ptr_out = ptr_glob->ptr_comp;
+  proc_7(10, int_glob, &ptr_glob->int_comp);
+}
+
+static void proc_1(struct record* ptr_in) {
+  struct record* next = ptr_in->ptr_comp;
+  *ptr_in->ptr_comp = *ptr_glob;
+  ptr_in->int_comp = 5;
+  next->int_comp = ptr_in->int_comp;
+  next->ptr_comp = ptr_in->ptr_comp;
+  proc_3(&next->ptr_comp);
+  if (next->discr == IDENT_1) {
+    next->int_comp = 6;
+    proc_6(ptr_in->enum_comp, &next->enum_comp);
+    next->ptr_comp = ptr_glob->ptr_comp;
+    proc_7(next->int_comp, 10, &next->int_comp);
+  } else {
+    *ptr_in = *ptr_in->ptr_comp;
+  }
+}
+
+static void proc_2(int* int_io) {
+  int int_loc = *int_io + 10;
+  enumeration enum_loc = IDENT_2;
+  for (;;) {
+    if (char_1_glob == 'A') {
+      int_loc -= 1;
+      *int_io = int_loc - int_glob;
+      enum_loc = IDENT_1;
+    }
+    if (enum_loc == IDENT_1)
+      break;
+  }
+}
+
+static void proc_4() {
+  int bool_loc = char_1_glob == 'A';
+  bool_glob = bool_loc | bool_glob;
+  char_2_glob = 'B';
+}
+
+static void proc_5() {
+  char_1_glob = 'A';
+  bool_glob = 0;
+}
+
+int main() {
+  str_30 str_1_loc, str_2_loc;
+  int int_1_loc = 0, int_2_loc = 0, int_3_loc = 0;
+  enumeration enum_loc = IDENT_1;
+  uint16_t crc = 0;
+
+  next_ptr_glob = &next_record_glob;
+  ptr_glob = &record_glob;
+  ptr_glob->ptr_comp = next_ptr_glob;
+  ptr_glob->discr = IDENT_1;
+  ptr_glob->enum_comp = IDENT_3;
+  ptr_glob->int_comp = 40;
+  str_copy(ptr_glob->str_comp, "DHRYSTONE PROGRAM, SOME STRING");
+  str_copy(str_1_loc, "DHRYSTONE PROGRAM, 1'ST STRING");
+  arr_2_glob[8][7] = 10;
+
+  bench_start();
+  for (int run = 1; run <= ITERATIONS; run++) {
+    proc_5();
+    proc_4();
+    int_1_loc = 2;
+    int_2_loc = 3;
+    str_copy(str_2_loc, "DHRYSTONE PROGRAM, 2'ND STRING");
+    enum_loc = IDENT_2;
+    bool_glob = !func_2(str_1_loc, str_2_loc);
+    while (int_1_loc < int_2_loc) {
+      int_3_loc = mul(5, int_1_loc) - int_2_loc;
+      proc_7(int_1_loc, int_2_loc, &int_3_loc);
+      int_1_loc += 1;
+    }
+    proc_8(arr_1_glob, arr_2_glob, int_1_loc, int_3_loc);
+    proc_1(ptr_glob);
+    for (char ch_index = 'A'; ch_index <= char_2_glob; ch_index++) {
+      if (enum_loc == func_1(ch_index, 'C')) {
+        proc_6(IDENT_1, &enum_loc);
+        str_copy(str_2_loc, "DHRYSTONE PROGRAM, 3'RD STRING");
+        int_2_loc = run;
+        int_glob = run;
+      }
+    }
+    int_2_loc = mul(int_2_loc, int_1_loc);
+    // Dhrystone divides int_2_loc by int_3_loc here
+    int_1_loc = int_2_loc - int_3_loc;
+    int_2_loc = mul(7, int_2_loc - int_3_loc) - int_1_loc;
+    proc_2(&int_1_loc);
+  }
+  bench_stop(ITERATIONS);
+
+  crc = crc16(int_glob, crc);
+  crc = crc16(bool_glob, crc);
+  crc = crc16(char_1_glob | char_2_glob << 8, crc);
+  crc = crc16(arr_1_glob[8], crc);
+  crc = crc16(arr_2_glob[8][7], crc);
+  crc = crc16(ptr_glob->int_comp | ptr_glob->enum_comp << 16, crc);
+  crc = crc16(next_ptr_glob->int_comp | next_ptr_glob->enum_comp << 16, crc);
+  crc = crc16(int_1_loc, crc);
+  crc = crc16(int_2_loc, crc);
+  crc = crc16(int_3_loc, crc);
+  crc = crc16(enum_loc, crc);
+  crc = crc16(str_compare(str_1_loc, "DHRYSTONE PROGRAM, 1'ST STRING"), crc);
+  crc = crc16(str_compare(str_2_loc, "DHRYSTONE PROGRAM, 2'ND STRING"), crc);
+
+  MAILBOX->checksum = crc;
+  return crc != EXPECTED;
+}
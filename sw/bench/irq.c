@@ -0,0 +1,40 @@
+#include "bench.h"
+
+#include <stdint.h>
+
+// Interrupt-heavy workload: the harness raises the software interrupt a few
+// cycles after each one is acknowledged, while the main loop does a little
+// work between them. An iteration is one interrupt taken, so cycles per
+// iteration is the cost of a round trip through the handler plus the delay
+// and the work done meanwhile.
+
+#define ITERATIONS 64
+
+#define IRQ_DELAY 16
+
+static volatile uint32_t taken;
+
+void bench_irq(void) {
+  taken++;
+}
+
+int main() {
+  uint32_t x = 1;
+
+  MAILBOX->irq_delay = IRQ_DELAY;
+  bench_start();
+  asm volatile("csrs mie, %0" :: "r" (8)); // 1 << 3
+  while (taken < ITERATIONS) {
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+  }
+  asm volatile("csrc mie, %0" :: "r" (8));
+  bench_stop(ITERATIONS);
+  MAILBOX->irq_delay = 0;
+
+  // How far the work got depends on timing, so it can't be checked. The
+  // number of interrupts taken can.
+  MAILBOX->checksum = taken;
+  return taken != ITERATIONS || x == 0;
+}
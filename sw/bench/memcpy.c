@@ -0,0 +1,68 @@
+#include "bench.h"
+
+#include <stdint.h>
+
+// Copies a 2k buffer three ways each iteration: a byte at a time, a word at
+// a time, and a word at a time unrolled by four, so loads and stores rather
+// than loop overhead dominate. Every copy goes through the same
+// destination, which is checked against the source at the end.
+
+#define ITERATIONS 4
+#define EXPECTED 0x249C
+
+#define WORDS 512
+
+static uint32_t src[WORDS];
+static uint32_t dst[WORDS];
+
+static void copy_bytes(uint8_t* d, const uint8_t* s, uint32_t n) {
+  while (n--)
+    *d++ = *s++;
+}
+
+static void copy_words(uint32_t* d, const uint32_t* s, uint32_t n) {
+  while (n--)
+    *d++ = *s++;
+}
+
+static void copy_words_unrolled(uint32_t* d, const uint32_t* s, uint32_t n) {
+  for (; n >= 4; n -= 4) {
+    uint32_t a = s[0], b = s[1], c = s[2], e = s[3];
+    d[0] = a;
+    d[1] = b;
+    d[2] = c;
+    d[3] = e;
+    d += 4;
+    s += 4;
+  }
+  while (n--)
+    *d++ = *s++;
+}
+
+int main() {
+  uint32_t x = 0xC0FFEE;
+  for (int i = 0; i < WORDS; i++) {
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    src[i] = x;
+  }
+
+  bench_start();
+  for (int i = 0; i < ITERATIONS; i++) {
+    // Offset by a byte so the byte copy can't be turned into word accesses
+    copy_bytes((uint8_t*) dst + 1, (const uint8_t*) src + 1, 4 * WORDS - 1);
+    copy_words(dst, src, WORDS);
+    copy_words_unrolled(dst, src, WORDS);
+  }
+  bench_stop(ITERATIONS);
+
+  uint16_t crc = 0;
+  for (int i = 0; i < WORDS; i++) {
+    if (dst[i] != src[i])
+      return 1;
+    crc = crc16(dst[i], crc);
+  }
+  MAILBOX->checksum = crc;
+  return crc != EXPECTED;
+}
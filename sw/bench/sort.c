@@ -0,0 +1,101 @@
+#include "bench.h"
+
+#include <stdint.h>
+
+// Sorts 256 pseudo-random words each iteration, with insertion sort on
+// 64-word slices and then an iterative quicksort on the whole array, from a
+// fresh shuffle each time. The result is checked for order and for its
+// contents.
+
+#define ITERATIONS 2
+#define EXPECTED 0xE93B
+
+#define WORDS 256
+#define SLICE 64
+
+static uint32_t values[WORDS];
+static uint32_t seed = 0x5EED;
+
+static uint32_t next_random() {
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed;
+}
+
+static void insertion_sort(uint32_t* a, int n) {
+  for (int i = 1; i < n; i++) {
+    uint32_t v = a[i];
+    int j = i - 1;
+    while (j >= 0 && a[j] > v) {
+      a[j + 1] = a[j];
+      j--;
+    }
+    a[j + 1] = v;
+  }
+}
+
+// Lomuto partitioning with an explicit stack, smaller side first so the
+// stack stays shallow
+static void quicksort(uint32_t* a, int n) {
+  int stack[32];
+  int top = 0;
+  stack[top++] = 0;
+  stack[top++] = n - 1;
+  while (top) {
+    int hi = stack[--top];
+    int lo = stack[--top];
+    while (lo < hi) {
+      uint32_t pivot = a[(lo + hi) >> 1];
+      a[(lo + hi) >> 1] = a[hi];
+      a[hi] = pivot;
+      int store = lo;
+      for (int i = lo; i < hi; i++) {
+        if (a[i] < pivot) {
+          uint32_t t = a[i];
+          a[i] = a[store];
+          a[store] = t;
+          store++;
+        }
+      }
+      a[hi] = a[store];
+      a[store] = pivot;
+      if (store - lo < hi - store) {
+        stack[top++] = store + 1;
+        stack[top++] = hi;
+        hi = store - 1;
+      } else {
+        stack[top++] = lo;
+        stack[top++] = store - 1;
+        lo = store + 1;
+      }
+    }
+  }
+}
+
+int main() {
+  bench_start();
+  for (int i = 0; i < ITERATIONS; i++) {
+    for (int j = 0; j < WORDS; j++)
+      values[j] = next_random();
+    for (int j = 0; j < WORDS; j += SLICE)
+      insertion_sort(&values[j], SLICE);
+    // Reverse, so quicksort doesn't start from runs that are already sorted
+    for (int j = 0; j < WORDS / 2; j++) {
+      uint32_t t = values[j];
+      values[j] = values[WORDS - 1 - j];
+      values[WORDS - 1 - j] = t;
+    }
+    quicksort(values, WORDS);
+  }
+  bench_stop(ITERATIONS);
+
+  uint16_t crc = 0;
+  for (int i = 0; i < WORDS; i++) {
+    if (i > 0 && values[i - 1] > values[i])
+      return 1;
+    crc = crc16(values[i], crc);
+  }
+  MAILBOX->checksum = crc;
+  return crc != EXPECTED;
+}
@@ -0,0 +1,106 @@
+#include "lemonlib/lemonlib.h"
+#include "lemonlib/coprocessor.h"
+
+#include <stdint.h>
+
+// UART bootloader. Put it in ROM once with `make prog FW=boot`, and from then
+// on programs linked with sw/spram.ld can be sent to the board with
+// `make upload FW=<firmware>` (see sw/upload.py) instead of rebuilding the
+// bitstream.
+//
+// The host sends frames, and the bootloader answers each with 'K' if it was
+// carried out or 'E' if it was rejected (bad checksum, length or address):
+//   'L' 'B' type len[2] addr[4] payload[len] crc[4]
+// Multi-byte fields are little-endian, and crc is the CRC-32 of everything
+// from type to the end of the payload. Types:
+//   'W' write payload (at most MAX_PAYLOAD bytes) to addr, in SPRAM or in the
+//       RAM this program doesn't use
+//   'B' switch the UART divider to addr, after answering at the old rate
+//   'J' jump to addr
+//
+// Frames are acknowledged one at a time, so the RX FIFO can't overflow as
+// long as a frame is read faster than it arrives. Needs the CRC-32
+// coprocessor.
+
+#define MAX_PAYLOAD 256
+#define HEADER_LEN 7
+
+#define RAM_END     0x3000
+#define SPRAM_START 0x10000
+#define SPRAM_END   0x30000
+
+// End of this program's stack, from rom.ld. RAM above it is free.
+extern char _stack_start[];
+
+// Header at offset 1, so the payload starts word-aligned for the DMA engine
+static uint8_t frame[1 + HEADER_LEN + MAX_PAYLOAD + 4] __attribute__((aligned(4)));
+
+static uint32_t read_le(const uint8_t* p, int bytes) {
+  uint32_t value = 0;
+  for (int i = bytes - 1; i >= 0; i--)
+    value = (value << 8) | p[i];
+  return value;
+}
+
+static int in_range(uint32_t addr, uint32_t len, uint32_t start, uint32_t end) {
+  return addr >= start && addr <= end && len <= end - addr;
+}
+
+// Waits for the start of a frame
+static void wait_for_frame() {
+  uint8_t c = 0;
+  while (1) {
+    if (c != 'L')
+      uart_read(&c, 1);
+    if (c != 'L')
+      continue;
+    uart_read(&c, 1);
+    if (c == 'B')
+      return;
+  }
+}
+
+int main() {
+  write_led(LED1, 1);
+  uart_puts("lemonboot\r\n");
+
+  while (1) {
+    wait_for_frame();
+
+    uint8_t* header = frame + 1;
+    uint8_t* payload = frame + 1 + HEADER_LEN;
+    uart_read(header, HEADER_LEN);
+    uint8_t type = header[0];
+    uint32_t len = read_le(header + 1, 2);
+    uint32_t addr = read_le(header + 3, 4);
+    if (len > MAX_PAYLOAD) {
+      uart_putc('E');
+      continue;
+    }
+
+    uart_read(payload, len + 4);
+    if (crc32_buf(header, HEADER_LEN + len) != read_le(payload + len, 4)) {
+      uart_putc('E');
+      continue;
+    }
+
+    if (type == 'W') {
+      if (!in_range(addr, len, SPRAM_START, SPRAM_END) &&
+          !in_range(addr, len, (uint32_t) _stack_start, RAM_END)) {
+        uart_putc('E');
+        continue;
+      }
+      dma_memcpy((void*) addr, payload, len);
+      uart_putc('K');
+    } else if (type == 'B') {
+      uart_putc('K');
+      uart_set_divider(addr);
+    } else if (type == 'J') {
+      uart_putc('K');
+      write_led(LED1, 0);
+      jump_to_image(addr);
+    } else {
+      uart_putc('E');
+    }
+  }
+}
@@ -0,0 +1,21 @@
+#include "lemonlib/lemonlib.h"
+
+// Times delay(1) for the SoC tests. LED1 is lit for the length of each call,
+// and a busy wait that grows every round starts the calls at different points
+// within a millisecond. LED2 lights once all rounds are done.
+
+#define ROUNDS 40
+
+int main() {
+  for (int i = 0; i < ROUNDS; i++) {
+    for (volatile int j = 0; j < i; j++)
+      ;
+    write_led(LED1, 1);
+    delay(1);
+    write_led(LED1, 0);
+  }
+  write_led(LED2, 1);
+
+  while (1)
+    ;
+}
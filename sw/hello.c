@@ -5,13 +5,30 @@
 // This program implements a binary counter on the 5 user LEDs. The speed of the
 // count can be adjusted by pressing the 3 user buttons. Button 1 slows down the
 // counter, button 3 speeds it up, and button 2 returns it to default speed.
+// Buttons are handled by interrupts, and the core sleeps in between.
+
+volatile int time = 50;
+
+void slow_down() {
+  time += 10;
+  if (time > 300) time = 300;
+}
+
+void reset_speed() {
+  time = 50;
+}
+
+void speed_up() {
+  time -= 10;
+  if (time < 10) time = 10;
+}
 
 int main() {
   int count = 0;
-  int time = 50;
-  int prev_btn1 = 0;
-  int prev_btn2 = 0;
-  int prev_btn3 = 0;
+
+  set_button_handler(BTN1, EDGE_RISING, slow_down);
+  set_button_handler(BTN2, EDGE_RISING, reset_speed);
+  set_button_handler(BTN3, EDGE_RISING, speed_up);
 
   uint32_t start = read_timer();
 
@@ -24,25 +41,6 @@ int main() {
       start = read_timer();
     }
 
-    // Poll inputs
-    int btn1 = read_button(BTN1);
-    if (btn1 == 1 && prev_btn1 == 0) {
-      time += 10;
-      if (time > 300) time = 300;
-    }
-    prev_btn1 = btn1;
-
-    int btn2 = read_button(BTN2);
-    if (btn2 == 1 && prev_btn2 == 0) {
-      time = 50;
-    }
-    prev_btn2 = btn2;
-
-    int btn3 = read_button(BTN3);
-    if (btn3 == 1 && prev_btn3 == 0) {
-      time -= 10;
-      if (time < 10) time = 10;
-    }
-    prev_btn3 = btn3;
+    delay(1);
   }
 }
@@ -0,0 +1,50 @@
+#ifndef COPROCESSOR_H
+#define COPROCESSOR_H
+
+#include <stdint.h>
+
+// Issue an R-type instruction on the custom-0/custom-1 opcode, which Lemoncore
+// hands to the attached coprocessor. funct3 and funct7 must be literals.
+#define COP_CUSTOM0(funct3, funct7, rs1, rs2) \
+  COP_INSN("CUSTOM_0", funct3, funct7, rs1, rs2)
+#define COP_CUSTOM1(funct3, funct7, rs1, rs2) \
+  COP_INSN("CUSTOM_1", funct3, funct7, rs1, rs2)
+
+#define COP_INSN(opcode, funct3, funct7, rs1, rs2) ({                     \
+  uint32_t _rd;                                                            \
+  asm volatile(".insn r " opcode ", " #funct3 ", " #funct7 ", %0, %1, %2" \
+               : "=r" (_rd)                                                \
+               : "r" ((uint32_t) (rs1)), "r" ((uint32_t) (rs2)));         \
+  _rd;                                                                     \
+})
+
+// CRC-32 accelerator (rtl/soc/crc32.v). These update a running CRC without
+// the initial/final inversion, see crc32_buf() for a complete checksum.
+static inline uint32_t crc32_update_byte(uint32_t crc, uint8_t data) {
+  return COP_CUSTOM0(0, 0, crc, data);
+}
+
+static inline uint32_t crc32_update_half(uint32_t crc, uint16_t data) {
+  return COP_CUSTOM0(1, 0, crc, data);
+}
+
+static inline uint32_t crc32_update_word(uint32_t crc, uint32_t data) {
+  return COP_CUSTOM0(2, 0, crc, data);
+}
+
+// Standard CRC-32 of a buffer. Reads whole words when the buffer is aligned.
+static inline uint32_t crc32_buf(const void* buf, int len) {
+  const uint8_t* p = (const uint8_t*) buf;
+  uint32_t crc = 0xFFFFFFFF;
+
+  if (((uint32_t) p & 0x3) == 0) {
+    for (; len >= 4; len -= 4, p += 4)
+      crc = crc32_update_word(crc, *((const uint32_t*) p));
+  }
+  for (; len > 0; len--, p++)
+    crc = crc32_update_byte(crc, *p);
+
+  return ~crc;
+}
+
+#endif
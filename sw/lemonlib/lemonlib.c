@@ -1,25 +1,84 @@
 #include "lemonlib.h"
 
+#include <stdarg.h>
 #include <stdint.h>
 
 #define GPIO_BASE 0x3000
+#define TIMER_BASE 0x3010
 
-#ifdef SIM
-#define ITERS_PER_MS 1
-#else
-#define ITERS_PER_MS 1500 // 1/1000 [sec/ms] * 12M [cycles/sec] * 1/8 [iters/cycle]
-#endif
+#define MTIME_LO    (*((volatile uint32_t*) (TIMER_BASE + 0x0)))
+#define MTIME_HI    (*((volatile uint32_t*) (TIMER_BASE + 0x4)))
+#define MTIMECMP_LO (*((volatile uint32_t*) (TIMER_BASE + 0x8)))
+#define MTIMECMP_HI (*((volatile uint32_t*) (TIMER_BASE + 0xC)))
+#define MSIP(hart)  (*((volatile uint32_t*) (TIMER_BASE + 0x10 + 4 * (hart))))
 
-uint32_t timer = 0;
+#define IRQ_BASE 0x3030
 
-void delay(int time) {
-  int iters = time * ITERS_PER_MS;
-  // Inspired by AVR delay:
-  // https://www.nongnu.org/avr-libc/user-manual/delay__basic_8h_source.html
-  asm volatile("1: addi %0, %0, -1 \n\t"
-               "bne x0, %0, 1b"
-               : "=r" (iters)
-               : "0" (iters));
+#define IRQ_ENABLE  (*((volatile uint32_t*) (IRQ_BASE + 0x0)))
+#define IRQ_RISE    (*((volatile uint32_t*) (IRQ_BASE + 0x4)))
+#define IRQ_FALL    (*((volatile uint32_t*) (IRQ_BASE + 0x8)))
+#define IRQ_PENDING (*((volatile uint32_t*) (IRQ_BASE + 0xC)))
+#define IRQ_CLAIM   (*((volatile uint32_t*) (IRQ_BASE + 0x10)))
+
+#define UART_BASE 0x3050
+
+#define UART_TXDATA (*((volatile uint32_t*) (UART_BASE + 0x0)))
+#define UART_RXDATA (*((volatile uint32_t*) (UART_BASE + 0x4)))
+#define UART_STATUS (*((volatile uint32_t*) (UART_BASE + 0x8)))
+#define UART_CTRL   (*((volatile uint32_t*) (UART_BASE + 0xC)))
+#define UART_DIV    (*((volatile uint32_t*) (UART_BASE + 0x14)))
+
+#define UART_FULL   (1u << 31)
+#define UART_EMPTY  (1u << 31)
+#define UART_TX_IDLE (1 << 16)
+#define UART_TX_IE  (1 << 0)
+// Ask for more once the TX FIFO is down to 4 bytes
+#define UART_TX_THRESH (4 << 8)
+
+#define DMA_BASE 0x3070
+
+#define DMA_SRC    (*((volatile uint32_t*) (DMA_BASE + 0x0)))
+#define DMA_DST    (*((volatile uint32_t*) (DMA_BASE + 0x4)))
+#define DMA_LEN    (*((volatile uint32_t*) (DMA_BASE + 0x8)))
+#define DMA_CTRL   (*((volatile uint32_t*) (DMA_BASE + 0xC)))
+#define DMA_STATUS (*((volatile uint32_t*) (DMA_BASE + 0x10)))
+#define DMA_FILL   (*((volatile uint32_t*) (DMA_BASE + 0x14)))
+
+#define DMA_START (1 << 0)
+#define DMA_FILL_MODE (1 << 1)
+#define DMA_IE    (1 << 4)
+#define DMA_BUSY  (1 << 0)
+#define DMA_DONE  (1 << 1)
+#define DMA_ERROR (1 << 2)
+
+#define NUM_IRQ_SOURCES 5
+
+#define MIE_MTIE    (1 << 7)
+#define MIE_MEIE    (1 << 11)
+#define MSTATUS_MIE (1 << 3)
+
+void delay(int ms) {
+  // mtime may be about to tick, so wait for one more to be sure of ms whole
+  // milliseconds
+  uint64_t deadline = read_mtime() + ms + 1;
+  set_mtimecmp(deadline);
+
+  // Sleep until the timer interrupt is pending. It only needs to be enabled in
+  // mie to wake up wfi, so keep it from being taken, which also means it can't
+  // slip in between the check and the wfi.
+  uint32_t mstatus;
+  asm volatile("csrrc %0, mstatus, %1" : "=r" (mstatus) : "r" (MSTATUS_MIE));
+  asm volatile("csrs mie, %0" : : "r" (MIE_MTIE));
+  while (read_mtime() < deadline) {
+    asm volatile("wfi");
+    // Something else may have woken us up, so give its handler a chance to run
+    if (mstatus & MSTATUS_MIE) {
+      asm volatile("csrs mstatus, %0" : : "r" (MSTATUS_MIE));
+      asm volatile("csrc mstatus, %0" : : "r" (MSTATUS_MIE));
+    }
+  }
+  asm volatile("csrc mie, %0" : : "r" (MIE_MTIE));
+  asm volatile("csrs mstatus, %0" : : "r" (mstatus & MSTATUS_MIE));
 }
 
 // Even though GPIO peripheral uses a one-byte register, use uint32_t's to make
@@ -51,5 +110,390 @@ int read_button(int button) {
 }
 
 uint32_t read_timer() {
-  return timer;
+  return MTIME_LO;
+}
+
+uint64_t read_mtime() {
+  // Re-read if the low word wrapped between reading the two halves
+  uint32_t hi, lo;
+  do {
+    hi = MTIME_HI;
+    lo = MTIME_LO;
+  } while (hi != MTIME_HI);
+  return ((uint64_t) hi << 32) | lo;
+}
+
+void set_mtimecmp(uint64_t time) {
+  // Park the high word at its maximum so there's no spurious interrupt while
+  // the new value is only half written
+  MTIMECMP_HI = 0xFFFFFFFF;
+  MTIMECMP_LO = (uint32_t) time;
+  MTIMECMP_HI = (uint32_t) (time >> 32);
+}
+
+static irq_handler_t irq_handlers[NUM_IRQ_SOURCES];
+
+void set_irq_handler(int source, irq_handler_t handler) {
+  if (source >= NUM_IRQ_SOURCES || source < 0)
+    return;
+
+  uint32_t bit = 1 << source;
+  IRQ_ENABLE &= ~bit;
+  irq_handlers[source] = handler;
+  if (!handler)
+    return;
+
+  // Forget edges from before the handler was set
+  IRQ_PENDING = bit;
+  IRQ_ENABLE |= bit;
+  asm volatile("csrs mie, %0" : : "r" (MIE_MEIE));
+}
+
+void set_button_handler(int button, int edges, irq_handler_t handler) {
+  if (button > BTN3 || button < BTN1)
+    return;
+
+  uint32_t bit = 1 << button;
+  set_irq_handler(button, 0);
+  if (!handler || !edges)
+    return;
+
+  if (edges & EDGE_RISING)
+    IRQ_RISE |= bit;
+  else
+    IRQ_RISE &= ~bit;
+  if (edges & EDGE_FALLING)
+    IRQ_FALL |= bit;
+  else
+    IRQ_FALL &= ~bit;
+
+  set_irq_handler(button, handler);
+}
+
+// Called from the external interrupt vector in entry.S
+void handle_external_irq() {
+  uint32_t source;
+  while ((source = IRQ_CLAIM) != 0) {
+    irq_handler_t handler = irq_handlers[source - 1];
+    if (handler)
+      handler();
+    else
+      // A level-triggered source would keep coming back
+      IRQ_ENABLE &= ~(1 << (source - 1));
+  }
+}
+
+// Software TX queue behind the UART's FIFO. uart_putc() only touches it with
+// interrupts disabled, so the handler never sees it half updated.
+#define TX_QUEUE_SIZE 256
+static char tx_queue[TX_QUEUE_SIZE];
+static uint32_t tx_head; // next slot to fill
+static uint32_t tx_tail; // next character to send
+
+static uint32_t disable_irqs() {
+  uint32_t mstatus;
+  asm volatile("csrrc %0, mstatus, %1" : "=r" (mstatus) : "r" (MSTATUS_MIE));
+  return mstatus & MSTATUS_MIE;
+}
+
+static void restore_irqs(uint32_t mie) {
+  asm volatile("csrs mstatus, %0" : : "r" (mie));
+}
+
+// Move queued characters into the FIFO until one of them runs out
+static void uart_tx_refill() {
+  while (tx_head != tx_tail && !(UART_TXDATA & UART_FULL)) {
+    UART_TXDATA = tx_queue[tx_tail % TX_QUEUE_SIZE];
+    tx_tail++;
+  }
+  // The TX interrupt is level-triggered, so it has to go off once there's
+  // nothing left to send
+  if (tx_head == tx_tail)
+    UART_CTRL &= ~UART_TX_IE;
+}
+
+static void uart_irq() {
+  uart_tx_refill();
+}
+
+void uart_putc(char c) {
+  uint32_t mie = disable_irqs();
+
+  // Skip the queue while it's empty, so characters stay in order
+  if (tx_head == tx_tail && !(UART_TXDATA & UART_FULL)) {
+    UART_TXDATA = c;
+    restore_irqs(mie);
+    return;
+  }
+
+  if (!irq_handlers[IRQ_UART])
+    set_irq_handler(IRQ_UART, uart_irq);
+
+  // Queue full: drain it ourselves, since the handler can't run from here.
+  // The FIFO dropping below its threshold wakes up the wfi.
+  UART_CTRL = UART_TX_IE | UART_TX_THRESH;
+  while (tx_head - tx_tail == TX_QUEUE_SIZE) {
+    uart_tx_refill();
+    if (tx_head - tx_tail == TX_QUEUE_SIZE)
+      asm volatile("wfi");
+  }
+
+  tx_queue[tx_head % TX_QUEUE_SIZE] = c;
+  tx_head++;
+  restore_irqs(mie);
+}
+
+void uart_puts(const char* s) {
+  while (*s)
+    uart_putc(*s++);
+}
+
+// rv32i has no divide instruction, so print decimals by repeated subtraction
+static void uart_put_dec(uint32_t value) {
+  static const uint32_t powers[] = {
+    1000000000, 100000000, 10000000, 1000000, 100000,
+    10000, 1000, 100, 10, 1
+  };
+  int started = 0;
+  for (int i = 0; i < 10; i++) {
+    char digit = '0';
+    while (value >= powers[i]) {
+      value -= powers[i];
+      digit++;
+    }
+    if (digit != '0' || started || i == 9) {
+      uart_putc(digit);
+      started = 1;
+    }
+  }
+}
+
+static void uart_put_hex(uint32_t value) {
+  int started = 0;
+  for (int shift = 28; shift >= 0; shift -= 4) {
+    uint32_t nibble = (value >> shift) & 0xF;
+    if (nibble || started || shift == 0) {
+      uart_putc(nibble < 10 ? '0' + nibble : 'a' + nibble - 10);
+      started = 1;
+    }
+  }
+}
+
+void uart_printf(const char* fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  for (; *fmt; fmt++) {
+    if (*fmt != '%') {
+      uart_putc(*fmt);
+      continue;
+    }
+
+    fmt++;
+    switch (*fmt) {
+      case 'd': {
+        int value = va_arg(args, int);
+        if (value < 0) {
+          uart_putc('-');
+          uart_put_dec(-(uint32_t) value);
+        } else {
+          uart_put_dec(value);
+        }
+        break;
+      }
+      case 'u':
+        uart_put_dec(va_arg(args, uint32_t));
+        break;
+      case 'x':
+        uart_put_hex(va_arg(args, uint32_t));
+        break;
+      case 's':
+        uart_puts(va_arg(args, const char*));
+        break;
+      case 'c':
+        uart_putc((char) va_arg(args, int));
+        break;
+      case '%':
+        uart_putc('%');
+        break;
+      case '\0':
+        fmt--;
+        break;
+      default:
+        uart_putc('%');
+        uart_putc(*fmt);
+        break;
+    }
+  }
+  va_end(args);
+}
+
+void uart_read(void* buf, uint32_t len) {
+  uint8_t* p = buf;
+  while (len) {
+    uint32_t data = UART_RXDATA;
+    if (!(data & UART_EMPTY)) {
+      *p++ = data;
+      len--;
+    }
+  }
+}
+
+void uart_flush() {
+  // Drain the queue here rather than relying on the interrupt, which the
+  // caller may have disabled
+  uint32_t mie = disable_irqs();
+  while (tx_head != tx_tail)
+    uart_tx_refill();
+  while (!(UART_STATUS & UART_TX_IDLE))
+    ;
+  restore_irqs(mie);
+}
+
+void uart_set_divider(uint32_t div) {
+  uart_flush();
+  UART_DIV = div;
+}
+
+int uart_getc() {
+  uint32_t data = UART_RXDATA;
+  return (data & UART_EMPTY) ? -1 : (int) (data & 0xFF);
+}
+
+void dma_start(volatile void* dst, const volatile void* src, uint32_t len, int flags) {
+  // The engine reads memory behind the compiler's back
+  asm volatile("" : : : "memory");
+  DMA_SRC = (uint32_t) src;
+  DMA_DST = (uint32_t) dst;
+  DMA_LEN = len;
+  DMA_CTRL = DMA_START | (flags & (DMA_SRC_FIXED | DMA_DST_FIXED));
+}
+
+int dma_wait() {
+  // Sleep on the completion interrupt without taking it, as in delay()
+  uint32_t mie = disable_irqs();
+  IRQ_ENABLE |= 1 << IRQ_DMA;
+  asm volatile("csrs mie, %0" : : "r" (MIE_MEIE));
+  DMA_CTRL = DMA_IE;
+  while (DMA_STATUS & DMA_BUSY)
+    asm volatile("wfi");
+  asm volatile("" : : : "memory");
+
+  uint32_t status = DMA_STATUS;
+  DMA_CTRL = 0;
+  DMA_STATUS = DMA_DONE | DMA_ERROR;
+  if (!irq_handlers[IRQ_DMA])
+    IRQ_ENABLE &= ~(1 << IRQ_DMA);
+  restore_irqs(mie);
+  return (status & DMA_ERROR) ? -1 : 0;
+}
+
+int dma_memcpy(void* dst, const void* src, uint32_t len) {
+  uint8_t* d = dst;
+  const uint8_t* s = src;
+  uint32_t words = 0;
+  int result = 0;
+
+  if ((((uint32_t) d | (uint32_t) s) & 3) == 0) {
+    words = len & ~3;
+    if (words) {
+      dma_start(d, s, words, 0);
+      result = dma_wait();
+    }
+  }
+  for (uint32_t i = words; i < len; i++)
+    d[i] = s[i];
+  return result;
+}
+
+int dma_memset(void* dst, uint8_t value, uint32_t len) {
+  uint8_t* d = dst;
+  uint32_t words = 0;
+  int result = 0;
+
+  if (((uint32_t) d & 3) == 0) {
+    words = len & ~3;
+    if (words) {
+      uint32_t fill = value;
+      fill |= fill << 8;
+      fill |= fill << 16;
+      asm volatile("" : : : "memory");
+      DMA_FILL = fill;
+      DMA_DST = (uint32_t) d;
+      DMA_LEN = words;
+      DMA_CTRL = DMA_START | DMA_FILL_MODE;
+      result = dma_wait();
+    }
+  }
+  for (uint32_t i = words; i < len; i++)
+    d[i] = value;
+  return result;
+}
+
+// Work handed out by start_hart(). fn goes back to null once the hart is done.
+static volatile struct {
+  hart_fn_t fn;
+  void* arg;
+} hart_work[MAX_HARTS];
+
+int hart_id() {
+  int id;
+  asm volatile("csrr %0, mhartid" : "=r" (id));
+  return id;
+}
+
+void start_hart(int hart, hart_fn_t fn, void* arg) {
+  wait_hart(hart);
+  hart_work[hart].arg = arg;
+  hart_work[hart].fn = fn;
+  // The work has to be in memory before the hart goes looking for it
+  asm volatile("fence" : : : "memory");
+  MSIP(hart) = 1;
+}
+
+void wait_hart(int hart) {
+  while (hart_work[hart].fn)
+    ;
+}
+
+// Where entry.S leaves every hart but 0. The first software interrupt takes a
+// hart out of reset, later ones wake it from WFI. msip is cleared before
+// looking for work, so a start_hart() that comes in meanwhile isn't missed.
+void run_hart(int hart) {
+  while (1) {
+    MSIP(hart) = 0;
+    hart_fn_t fn = hart_work[hart].fn;
+    if (fn) {
+      fn(hart_work[hart].arg);
+      hart_work[hart].fn = 0;
+    } else {
+      asm volatile("wfi");
+    }
+  }
+}
+
+void spin_lock(spinlock_t* lock) {
+  uint32_t taken;
+  do {
+    // Spin on plain loads, which leave the lock's word alone, until it looks free
+    while (*lock)
+      ;
+    asm volatile("amoswap.w %0, %2, (%1)" : "=r" (taken) : "r" (lock), "r" (1) : "memory");
+  } while (taken);
+}
+
+void spin_unlock(spinlock_t* lock) {
+  asm volatile("amoswap.w zero, zero, (%0)" : : "r" (lock) : "memory");
+}
+
+void jump_to_image(uint32_t entry) {
+  uart_flush();
+  disable_irqs();
+  asm volatile("csrw mie, zero");
+  IRQ_ENABLE = 0;
+  UART_CTRL = 0;
+  // Wait for every store of the image to land
+  asm volatile("fence.i" : : : "memory");
+  ((void (*)(void)) entry)();
+  while (1)
+    ;
 }
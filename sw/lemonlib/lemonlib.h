@@ -13,10 +13,96 @@
 #define BTN2 1
 #define BTN3 2
 
+// External interrupt sources. Buttons are sources BTN1 - BTN3.
+#define IRQ_UART 3
+#define IRQ_DMA  4
+
+// Button edges that can trigger an interrupt
+#define EDGE_RISING  1
+#define EDGE_FALLING 2
+
+// Place a large buffer in the 128 KiB SPRAM region instead of the 8 KiB RAM.
+// It isn't initialized, so it must be declared without an initializer.
+#define SPRAM __attribute__((section(".spram")))
+
+// Sleeps for at least ms milliseconds
 void delay(int ms);
 void write_led(int led, int value);
 void write_leds(int mask);
 int read_button(int btn);
+// Milliseconds since reset, wrapping after ~49 days
 uint32_t read_timer();
+// The full 64-bit millisecond count (mtime)
+uint64_t read_mtime();
+// Raise the timer interrupt once mtime reaches time. The interrupt also needs
+// to be enabled in mie; the default handler disables it again when it fires.
+void set_mtimecmp(uint64_t time);
+
+typedef void (*irq_handler_t)(void);
+// Call handler from the external interrupt whenever source is pending. Pass a
+// null handler to stop.
+void set_irq_handler(int source, irq_handler_t handler);
+// Call handler from the external interrupt whenever button sees one of the
+// given edges (EDGE_RISING and/or EDGE_FALLING). Pass a null handler to stop.
+// Handlers run with interrupts disabled, so keep them short.
+void set_button_handler(int button, int edges, irq_handler_t handler);
+
+// Write a character to the UART. Characters that don't fit in its FIFO are
+// queued and sent from the UART interrupt, so this only waits when the queue
+// is full too.
+void uart_putc(char c);
+void uart_puts(const char* s);
+// Minimal printf supporting %d, %u, %x, %s, %c and %%, without widths
+void uart_printf(const char* fmt, ...);
+// The next received character, or -1 if there is none
+int uart_getc();
+// Wait for exactly len bytes. Interrupts are held off meanwhile, to keep up
+// with fast baud rates.
+void uart_read(void* buf, uint32_t len);
+// Wait until everything written so far has been sent, stop bit and all
+void uart_flush();
+// Change the baud rate to the clock frequency / (div + 1), once pending
+// output has gone out at the old one
+void uart_set_divider(uint32_t div);
+
+// Flags for dma_start(): keep an address fixed instead of stepping through
+// memory, for peripheral registers
+#define DMA_SRC_FIXED (1 << 2)
+#define DMA_DST_FIXED (1 << 3)
+
+// Copy or fill len bytes with the DMA engine, sleeping until it's done.
+// Return 0, or -1 if the transfer hit a bus error. Unaligned copies, and any
+// bytes past the last whole word, are done by the core.
+int dma_memcpy(void* dst, const void* src, uint32_t len);
+int dma_memset(void* dst, uint8_t value, uint32_t len);
+// Start a copy of len bytes (whole words, word-aligned) and return straight
+// away. The core can keep working, but shares the bus with the engine.
+void dma_start(volatile void* dst, const volatile void* src, uint32_t len, int flags);
+// Sleep until the transfer started by dma_start() is done. Returns as
+// dma_memcpy().
+int dma_wait();
+
+// Harts other than 0 (lemonsoc's NUM_HARTS) sit idle until they're handed a
+// function with start_hart(). They run with interrupts disabled and have no
+// timer, so leave delay() and the peripherals to hart 0.
+#define MAX_HARTS 4
+typedef void (*hart_fn_t)(void* arg);
+// This hart's number, from mhartid
+int hart_id();
+// Run fn(arg) on hart, once it has finished what it was given last
+void start_hart(int hart, hart_fn_t fn, void* arg);
+// Wait until hart has returned from the function start_hart() gave it
+void wait_hart(int hart);
+
+// Locks shared between harts, built on amoswap.w. Atomics only work in RAM and
+// SPRAM, so that's where a lock must live. Zero means unlocked.
+typedef volatile uint32_t spinlock_t;
+void spin_lock(spinlock_t* lock);
+void spin_unlock(spinlock_t* lock);
+
+// Run a program loaded into memory as if from reset: wait for pending UART
+// output, mask every interrupt and jump to entry. Used by sw/boot.c. Only
+// hart 0 moves on, so the new program can't use the others.
+void jump_to_image(uint32_t entry) __attribute__((noreturn));
 
 #endif
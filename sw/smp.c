@@ -0,0 +1,146 @@
+#include "lemonlib/lemonlib.h"
+
+#include <stdint.h>
+
+// Benchmarks for the second hart, printed over the UART:
+//  - a counter shared under a spinlock, with some work between updates, run
+//    on hart 0 alone and then split across both harts,
+//  - messages passed back and forth through a one-slot mailbox, to show what
+//    a round trip between the harts costs.
+// Cycle counts come from hart 0's mcycle.
+
+#define ITEMS 2048
+#define ITEMS_PER_UPDATE 16
+#define ROUND_TRIPS 256
+
+static spinlock_t lock;
+static volatile uint32_t counter;
+
+// Mailbox between the harts. full is set by the sender and cleared by the
+// receiver once it has taken value.
+static volatile uint32_t request, request_full;
+static volatile uint32_t reply, reply_full;
+
+static uint32_t read_cycles() {
+  uint32_t cycles;
+  asm volatile("csrr %0, mcycle" : "=r" (cycles));
+  return cycles;
+}
+
+// Stand-in for real work: a few rounds of xorshift per item
+static uint32_t work(uint32_t x) {
+  for (int i = 0; i < 8; i++) {
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+  }
+  return x;
+}
+
+struct range {
+  uint32_t start;
+  uint32_t end;
+};
+
+static void count_range(void* arg) {
+  struct range* r = arg;
+  uint32_t local = 0;
+  for (uint32_t i = r->start; i < r->end; i++) {
+    local += work(i + 1) & 1;
+    if ((i + 1) % ITEMS_PER_UPDATE == 0) {
+      spin_lock(&lock);
+      counter += local;
+      spin_unlock(&lock);
+      local = 0;
+    }
+  }
+  spin_lock(&lock);
+  counter += local;
+  spin_unlock(&lock);
+}
+
+static uint32_t run_counter(int harts) {
+  struct range ranges[2] = {
+    {0, harts == 2 ? ITEMS / 2 : ITEMS},
+    {ITEMS / 2, ITEMS},
+  };
+
+  counter = 0;
+  uint32_t start = read_cycles();
+  if (harts == 2)
+    start_hart(1, count_range, &ranges[1]);
+  count_range(&ranges[0]);
+  if (harts == 2)
+    wait_hart(1);
+  uint32_t cycles = read_cycles() - start;
+
+  uart_printf("counter, %d hart(s): %u cycles, count %u\r\n", harts, cycles, counter);
+  return cycles;
+}
+
+// Prints a / b to two decimal places. rv32i has no divide, so this is long
+// division by repeated subtraction.
+static void print_ratio(uint32_t a, uint32_t b) {
+  uint32_t whole = 0;
+  while (a >= b) {
+    a -= b;
+    whole++;
+  }
+  uart_printf("%u.", whole);
+  for (int i = 0; i < 2; i++) {
+    a = (a << 3) + (a << 1);
+    char digit = '0';
+    while (a >= b) {
+      a -= b;
+      digit++;
+    }
+    uart_putc(digit);
+  }
+}
+
+static void echo(void* arg) {
+  (void) arg;
+  for (int i = 0; i < ROUND_TRIPS; i++) {
+    while (!request_full)
+      ;
+    uint32_t value = request;
+    request_full = 0;
+    reply = value + 1;
+    reply_full = 1;
+  }
+}
+
+static void run_messages() {
+  uint32_t value = 0;
+  start_hart(1, echo, 0);
+
+  uint32_t start = read_cycles();
+  for (int i = 0; i < ROUND_TRIPS; i++) {
+    request = value;
+    request_full = 1;
+    while (!reply_full)
+      ;
+    value = reply;
+    reply_full = 0;
+  }
+  uint32_t cycles = read_cycles() - start;
+  wait_hart(1);
+
+  uart_printf("messages: %d round trips in %u cycles, last value %u\r\n",
+              ROUND_TRIPS, cycles, value);
+}
+
+int main() {
+  uart_puts("smp\r\n");
+
+  uint32_t one = run_counter(1);
+  uint32_t two = run_counter(2);
+  uart_puts("speedup: ");
+  print_ratio(one, two);
+  uart_puts("x\r\n");
+
+  run_messages();
+
+  uart_flush();
+  return 0;
+}
@@ -0,0 +1,73 @@
+#!/usr/bin/env python3
+"""Send a firmware image to the UART bootloader (sw/boot.c) and run it.
+
+Reset the board first, so the bootloader is waiting. The image is a raw
+binary linked with sw/spram.ld, as built by `make sw/<firmware>.img`.
+"""
+
+import argparse
+import struct
+import sys
+import time
+import zlib
+
+import serial
+
+BOOT_BAUD = 115200
+CLOCK_HZ = 12000000
+MAX_PAYLOAD = 256
+RETRIES = 3
+
+
+def frame(kind, addr, payload=b''):
+    body = struct.pack('<cHI', kind, len(payload), addr) + payload
+    return b'LB' + body + struct.pack('<I', zlib.crc32(body))
+
+
+def send(port, kind, addr, payload=b''):
+    data = frame(kind, addr, payload)
+    for _ in range(RETRIES):
+        port.write(data)
+        reply = port.read(1)
+        if reply == b'K':
+            return
+        if reply != b'E':
+            break
+    sys.exit(f'Bootloader did not accept {kind.decode()} frame at {addr:#x} '
+             f'(got {reply!r})')
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument('image', help='raw binary to load')
+    parser.add_argument('--port', default='/dev/ttyUSB1',
+                        help='serial port (default: %(default)s)')
+    parser.add_argument('--baud', type=int, default=1000000,
+                        help='rate to switch to for the upload, must divide '
+                        f'{CLOCK_HZ} (default: %(default)s)')
+    parser.add_argument('--addr', type=lambda x: int(x, 0), default=0x10000,
+                        help='load and entry address (default: %(default)#x)')
+    args = parser.parse_args()
+
+    with open(args.image, 'rb') as f:
+        image = f.read()
+
+    with serial.Serial(args.port, BOOT_BAUD, timeout=1) as port:
+        port.reset_input_buffer()
+
+        if args.baud != BOOT_BAUD:
+            send(port, b'B', CLOCK_HZ // args.baud - 1)
+            port.baudrate = args.baud
+            # The bootloader waits a millisecond before switching
+            time.sleep(0.01)
+
+        start = time.time()
+        for offset in range(0, len(image), MAX_PAYLOAD):
+            send(port, b'W', args.addr + offset,
+                 image[offset:offset + MAX_PAYLOAD])
+        send(port, b'J', args.addr)
+        print(f'Loaded {len(image)} bytes in {time.time() - start:.2f} s')
+
+
+if __name__ == '__main__':
+    main()